@@ -171,25 +171,37 @@ struct raft_entry
 };
 
 /**
- * Counter for outstanding references to a log entry.
+ * Range of log entries included in an outstanding I/O request.
  *
- * When an entry is first appended to the log, its refcount is set to one (the
- * log itself is the only one referencing the entry). Whenever an entry is
- * included in an I/O request (to write it to disk or to send it to other
- * servers) its refcount is increased by one. Whenever an entry gets deleted
- * from the log its refcount is decreased by one. Likewise, whenever an I/O
- * request is completed the refcount of the relevant entries is decreased by
- * one. When the refcount drops to zero the memory that its @buf attribute
+ * Whenever a range of entries is included in an I/O request (to write it to
+ * disk or to send it to other servers) the range is registered in the log, and
+ * it's unregistered when the I/O request completes. An entry which gets deleted
+ * from the log while it's part of a registered range is not released until the
+ * range gets unregistered. At that point the memory that its @buf attribute
  * points to gets released, or, if the @batch attribute is non-NULL, a check is
- * made to see if all other entries of the same batch also have a zero refcount,
- * and the memory that @batch points to gets released if that's the case.
+ * made to see if all other entries of the same batch are also unreferenced, and
+ * the memory that @batch points to gets released if that's the case.
  */
 struct raft_entry_ref
 {
-    raft_term term;              /* Term of the entry being ref-counted. */
-    raft_index index;            /* Index of the entry being ref-counted. */
-    unsigned short count;        /* Number of references. */
-    struct raft_entry_ref *next; /* Next item in the bucket (for collisions). */
+    raft_index index;           /* Index of the first entry in the range. */
+    struct raft_entry *entries; /* Entries in the range. */
+    unsigned n;                 /* Number of entries in the range. */
+};
+
+/**
+ * Counter for the log entries referencing a batch.
+ *
+ * Entries belonging to the same batch all point into a single memory
+ * allocation, referenced by their @batch attribute. The log keeps track of how
+ * many of its entries point into each batch, so it can release the batch
+ * memory as soon as the last of them gets deleted, unless the batch is still
+ * referenced by some entry included in an outstanding I/O request.
+ */
+struct raft_batch_ref
+{
+    void *batch;    /* Memory shared by the entries of the batch. */
+    unsigned count; /* Number of entries in the log pointing into it. */
 };
 
 /**
@@ -201,13 +213,18 @@ struct raft_entry_ref
  */
 struct raft_log
 {
-    struct raft_entry *entries;  /* Circular buffer of log entries. */
-    size_t size;                 /* Number of available slots in the buffer. */
-    size_t front, back;          /* Indexes of used slots [front, back). */
-    raft_index offset;           /* Index of first entry is offset+1. */
-    struct raft_entry_ref *refs; /* Log entries reference counts hash table. */
-    size_t refs_size;            /* Size of the reference counts hash table. */
-    struct                       /* Information about last snapshot, or zero. */
+    struct raft_entry *entries;     /* Circular buffer of log entries. */
+    size_t size;                    /* Number of available slots in buffer. */
+    size_t front, back;             /* Indexes of used slots [front, back). */
+    raft_index offset;              /* Index of first entry is offset+1. */
+    struct raft_entry_ref *refs;    /* Ranges of entries in I/O requests. */
+    size_t refs_size;               /* Number of ranges in I/O requests. */
+    struct raft_batch_ref *batches; /* Hash table of batch ref counts. */
+    size_t batches_size;            /* Number of slots in the hash table. */
+    size_t n_batches;               /* Number of batches in the table. */
+    size_t bytes;                   /* Size of in-memory entry payloads. */
+    raft_index evicted;             /* Payloads up to here were evicted. */
+    struct                          /* Last snapshot information, or zero. */
     {
         raft_index last_index; /* Snapshot replaces all entries up to here. */
         raft_term last_term;   /* Term of last index. */
@@ -225,6 +242,7 @@ struct raft_request_vote
     unsigned candidate_id;     /* ID of the server requesting the vote. */
     raft_index last_log_index; /* Index of candidate's last log entry. */
     raft_index last_log_term;  /* Term of log entry at last_log_index. */
+    bool disrupt_leader;       /* True if current leader should be ignored. */
 };
 
 /**
@@ -272,7 +290,22 @@ struct raft_install_snapshot
     raft_term last_term;            /* Term of last_index. */
     struct raft_configuration conf; /* Config as of last_index. */
     raft_index conf_index;          /* Commit index of conf. */
-    struct raft_buffer data;        /* Raw snapshot data. */
+    size_t offset;                  /* Offset of data in the snapshot. */
+    bool done;                      /* Whether data is the last chunk. */
+    struct raft_buffer data;        /* Chunk of raw snapshot data. */
+};
+
+/**
+ * Hold the arguments of a TimeoutNow RPC.
+ *
+ * The TimeoutNow RPC is invoked by a leader transferring its leadership, to
+ * make the target server start an election immediately (Section 3.10).
+ */
+struct raft_timeout_now
+{
+    raft_term term;            /* Leader's term. */
+    raft_index last_log_index; /* Index of leader's last log entry. */
+    raft_index last_log_term;  /* Term of log entry at last_log_index. */
 };
 
 /**
@@ -283,7 +316,8 @@ enum {
     RAFT_IO_APPEND_ENTRIES_RESULT,
     RAFT_IO_REQUEST_VOTE,
     RAFT_IO_REQUEST_VOTE_RESULT,
-    RAFT_IO_INSTALL_SNAPSHOT
+    RAFT_IO_INSTALL_SNAPSHOT,
+    RAFT_IO_TIMEOUT_NOW
 };
 
 /**
@@ -300,6 +334,7 @@ struct raft_message
         struct raft_append_entries append_entries;
         struct raft_append_entries_result append_entries_result;
         struct raft_install_snapshot install_snapshot;
+        struct raft_timeout_now timeout_now;
     };
 };
 
@@ -371,6 +406,33 @@ struct raft_io_snapshot_get
     raft_io_snapshot_get_cb cb; /* Request callback */
 };
 
+/**
+ * Asynchronous request to run a function off the event loop thread.
+ */
+struct raft_io_async_work;
+typedef void (*raft_io_async_work_cb)(struct raft_io_async_work *req,
+                                      int status);
+struct raft_io_async_work
+{
+    void *data;                                  /* User data */
+    int (*work)(struct raft_io_async_work *req); /* Function to run */
+    raft_io_async_work_cb cb;                    /* Request callback */
+};
+
+/**
+ * Asynchronous request to read persisted log entries back from storage.
+ */
+struct raft_io_read_entries;
+typedef void (*raft_io_read_entries_cb)(struct raft_io_read_entries *req,
+                                        struct raft_entry entries[],
+                                        unsigned n,
+                                        int status);
+struct raft_io_read_entries
+{
+    void *data;                 /* User data */
+    raft_io_read_entries_cb cb; /* Request callback */
+};
+
 /**
  * Logger interface.
  */
@@ -456,6 +518,12 @@ typedef void (*raft_io_recv_cb)(struct raft_io *io, struct raft_message *msg);
  */
 typedef void (*raft_io_close_cb)(struct raft_io *io);
 
+/**
+ * Callback invoked by the I/O implementation at the end of the event loop
+ * iteration during which raft_io->flush() was called.
+ */
+typedef void (*raft_io_flush_cb)(struct raft_io *io);
+
 /**
  * I/O backend interface implementing periodic ticks, log store read/writes
  * and send/receive of network RPCs.
@@ -463,7 +531,7 @@ typedef void (*raft_io_close_cb)(struct raft_io *io);
 struct raft_io
 {
     /**
-     * API version implemented by this instance. Currently 1.
+     * API version implemented by this instance. Currently 2.
      */
     int version;
 
@@ -601,6 +669,93 @@ struct raft_io
      * Generate a random integer between min and max.
      */
     int (*random)(struct raft_io *io, int min, int max);
+
+    /**
+     * Request the given callback to be invoked once the I/O implementation has
+     * finished processing all events of the current event loop iteration. If
+     * this method gets called again before the callback fires, the callback
+     * will still fire only once.
+     *
+     * If this method is implemented, the raft library defers the disk writes
+     * and the AppendEntries messages for new entries until the callback fires,
+     * so that all entries appended during the same loop iteration (e.g. by
+     * many raft_apply() calls) are coalesced in a single disk write and in a
+     * single message per follower.
+     *
+     * Available since version 2. It can be #NULL, in which case new entries
+     * are written and sent immediately.
+     */
+    int (*flush)(struct raft_io *io, raft_io_flush_cb cb);
+
+    /**
+     * Invoke the @work function of the given request on a thread other than
+     * the event loop one, and then invoke @cb on the event loop thread passing
+     * it the value returned by @work. Requests are executed one at a time in
+     * submission order, and their callbacks fire in the same order. The
+     * callbacks of requests still outstanding when close() is called must fire
+     * before the close callback, with #RAFT_CANCELED if @work was not run.
+     *
+     * The raft library uses this method to apply committed entries to the FSM
+     * when raft_set_async_apply() is enabled.
+     *
+     * Available since version 2. It can be #NULL, in which case entries are
+     * always applied on the event loop thread.
+     */
+    int (*async_work)(struct raft_io *io,
+                      struct raft_io_async_work *req,
+                      raft_io_async_work_cb cb);
+
+    /**
+     * Release a snapshot previously returned by snapshot_get(), once the raft
+     * library is done reading it. This allows the implementation to hand the
+     * same in-memory snapshot to several concurrent snapshot_get() requests
+     * instead of loading a private copy for each of them.
+     *
+     * Available since version 2. It can be #NULL, in which case the snapshot
+     * returned by snapshot_get() is owned by the raft library, which releases
+     * its configuration and buffers and then the snapshot object itself with
+     * raft_free().
+     */
+    void (*snapshot_release)(struct raft_io *io,
+                             struct raft_snapshot *snapshot);
+
+    /**
+     * Asynchronously read persisted log entries starting at the given index.
+     *
+     * The implementation must return at least the entry at @index, plus as
+     * many of the entries following it as fit in @max_bytes. Their payloads
+     * must all point into a single batch allocated with @raft_malloc, or be
+     * empty. Once the request is completed ownership of both the entries
+     * array and the batch is transfered to the raft instance. The callbacks
+     * of requests still outstanding when close() is called must fire before
+     * the close callback.
+     *
+     * The raft library uses this method to send entries to followers that are
+     * lagging behind, after their payloads were evicted from memory because of
+     * raft_set_max_log_bytes().
+     *
+     * Available since version 2. It can be #NULL, in which case payloads are
+     * never evicted from memory.
+     */
+    int (*read_entries)(struct raft_io *io,
+                        struct raft_io_read_entries *req,
+                        raft_index index,
+                        size_t max_bytes,
+                        raft_io_read_entries_cb cb);
+};
+
+/**
+ * Asynchronous request to take a snapshot of the state machine.
+ */
+struct raft_fsm_snapshot;
+typedef void (*raft_fsm_snapshot_cb)(struct raft_fsm_snapshot *req,
+                                     int status);
+struct raft_fsm_snapshot
+{
+    void *data;               /* User data */
+    struct raft_buffer *bufs; /* Snapshot content, filled by the FSM */
+    unsigned n_bufs;          /* Number of buffers in bufs */
+    raft_fsm_snapshot_cb cb;  /* Request callback */
 };
 
 /**
@@ -610,7 +765,7 @@ struct raft_io
 struct raft_fsm
 {
     /**
-     * API version implemented by this instance. Currently 1.
+     * API version implemented by this instance. Currently 2.
      */
     int version;
 
@@ -637,6 +792,43 @@ struct raft_fsm
      * Restore a snapshot of the state machine.
      */
     int (*restore)(struct raft_fsm *fsm, struct raft_buffer *buf);
+
+    /**
+     * Apply a run of @n consecutive committed RAFT_COMMAND entries to the state
+     * machine, storing the result of the i'th entry in @results[i].
+     *
+     * The run never spans across barriers or configuration changes, so it can
+     * be applied atomically, for example in a single storage transaction. If
+     * an error is returned, none of the entries is considered applied.
+     *
+     * Available since version 2. It can be #NULL, in which case apply() is
+     * invoked once for each entry.
+     */
+    int (*apply_batch)(struct raft_fsm *fsm,
+                       const struct raft_buffer bufs[],
+                       unsigned n,
+                       void *results[]);
+
+    /**
+     * Start taking a snapshot of the state machine, capturing its state as of
+     * the last entry applied so far. Once done, fill @req->bufs and
+     * @req->n_bufs as snapshot() would, and invoke @cb on the event loop
+     * thread. If @cb is invoked with a non-zero status, the buffers are
+     * ignored.
+     *
+     * Entries keep being applied while the snapshot is in progress, so the
+     * state must be captured at the time of the call, for example as a
+     * copy-on-write view serialized by a worker thread. Neither restore() nor
+     * another snapshot is requested until @cb fires. Returning #RAFT_BUSY
+     * means that a snapshot can't be taken right now, and will be retried
+     * later.
+     *
+     * Available since version 2. It can be #NULL, in which case snapshot() is
+     * invoked on the event loop thread.
+     */
+    int (*snapshot_async)(struct raft_fsm *fsm,
+                          struct raft_fsm_snapshot *req,
+                          raft_fsm_snapshot_cb cb);
 };
 
 /**
@@ -644,6 +836,12 @@ struct raft_fsm
  */
 enum { RAFT_UNAVAILABLE, RAFT_FOLLOWER, RAFT_CANDIDATE, RAFT_LEADER };
 
+/**
+ * Maximum number of unacknowledged AppendEntries messages that a leader can
+ * have in flight towards a single follower.
+ */
+#define RAFT__MAX_INFLIGHT 32
+
 /**
  * Used by leaders to keep track of replication progress for each server.
  */
@@ -653,8 +851,37 @@ struct raft_progress
     raft_index next_index;     /* Next entry to send. */
     raft_index match_index;    /* Highest index reported as replicated. */
     raft_index snapshot_index; /* Last index of most recent snapshot sent. */
+    raft_index resume_index;   /* Last index of partially sent snapshot. */
+    size_t resume_offset;      /* Bytes of it sent before failing. */
     raft_time last_send;       /* Timestamp of last AppendEntries RPC. */
     bool recent_recv;          /* A msg was received within election timeout. */
+    unsigned long long n_sent; /* Messages sent in the current term. */
+    unsigned long long n_recv; /* Results received in the current term. */
+    unsigned long long n_mark; /* Value of n_sent when a read round began. */
+    bool fetching;             /* Entries are being read from disk. */
+    struct /* AppendEntries sent in pipeline mode and not yet acknowledged. */
+    {
+        raft_index last_index[RAFT__MAX_INFLIGHT]; /* Last entry of each msg. */
+        size_t size[RAFT__MAX_INFLIGHT];           /* Payload of each msg. */
+        unsigned front;                            /* Oldest message slot. */
+        unsigned n;                                /* Number of messages. */
+        size_t bytes;                              /* Total payload size. */
+    } inflight;
+};
+
+/**
+ * Outstanding client requests on the leader, ordered by log index.
+ *
+ * The registry is implemented as a circular buffer of pointers to requests:
+ * since entries are appended and applied in index order, requests are always
+ * added at the back and removed from the front, which makes it possible to
+ * find the request associated with a newly applied entry in constant time.
+ */
+struct raft_request_registry
+{
+    void **slots;       /* Circular buffer of requests. */
+    size_t size;        /* Number of available slots in the buffer. */
+    size_t front, back; /* Indexes of used slots [front, back). */
 };
 
 /**
@@ -749,6 +976,74 @@ struct raft
      */
     unsigned heartbeat_timeout;
 
+    /*
+     * Maximum number of entries and maximum total size in bytes of the entries
+     * payloads that the leader includes in a single AppendEntries RPC (default
+     * 1024 entries and 1 megabyte). Followers that are lagging behind receive
+     * the missing entries in successive windows obeying these limits, rather
+     * than in a single message. An entry whose payload alone exceeds the bytes
+     * limit is sent on its own.
+     *
+     * See raft_set_max_append_entries() and raft_set_max_append_bytes().
+     */
+    unsigned max_append_entries;
+    size_t max_append_bytes;
+
+    /*
+     * Maximum number of AppendEntries messages and maximum total size in bytes
+     * of their entries payloads that the leader keeps in flight towards a
+     * single follower in pipeline mode (default 32 messages and 16 megabytes).
+     * When either limit is reached no further entries are sent to that
+     * follower until it acknowledges some of the outstanding messages.
+     *
+     * See raft_set_max_inflight() and raft_set_max_inflight_bytes().
+     */
+    unsigned max_inflight;
+    size_t max_inflight_bytes;
+
+    /*
+     * Maximum total size in bytes of the entries payloads kept in memory
+     * (default 0, meaning no limit). Once it's exceeded, the payloads of the
+     * oldest entries that were applied and persisted are released, except for
+     * configuration entries, and they get read back from disk with
+     * raft_io->read_entries() if a follower needs them.
+     *
+     * See raft_set_max_log_bytes().
+     */
+    size_t max_log_bytes;
+
+    /*
+     * Whether committed RAFT_COMMAND entries are applied to the FSM off the
+     * event loop thread using raft_io->async_work() (default false), along
+     * with the request currently being executed, if any. At most one run of
+     * entries is applied at a time, and the FSM snapshot() and restore()
+     * methods are never invoked while a run is being applied.
+     *
+     * See raft_set_async_apply().
+     */
+    struct
+    {
+        bool async;
+        struct raft_io_async_work *work;
+    } apply;
+
+    /*
+     * Whether the leader maintains a lease allowing it to serve linearizable
+     * reads locally (default false), and the maximum clock drift between
+     * servers, expressed as a percentage of the election timeout (default
+     * 10). The lease lasts for the election timeout minus the clock drift
+     * after the start of the last round of heartbeats acknowledged by a
+     * majority of voting servers.
+     *
+     * See raft_set_lease(), raft_set_max_clock_drift(), raft_lease_valid() and
+     * raft_read_local().
+     */
+    struct
+    {
+        bool enabled;
+        unsigned max_clock_drift;
+    } lease;
+
     /*
      * The fields below hold the part of the server's volatile state which is
      * always applicable regardless of the whether the server is follower,
@@ -778,6 +1073,7 @@ struct raft
         {
             unsigned randomized_election_timeout; /* Timer expiration. */
             bool *votes;                          /* Vote results. */
+            bool disrupt_leader;                  /* For leadership transfer */
         } candidate_state;
         struct
         {
@@ -787,7 +1083,15 @@ struct raft
             unsigned short round_number;    /* Current sync round. */
             raft_index round_index;         /* Target of the current round. */
             raft_time round_start;          /* Start of current round. */
-            void *requests[2];              /* Outstanding client requests. */
+            struct raft_request_registry requests; /* Client requests. */
+            raft_index flush_index;         /* First entry not yet written. */
+            void *reads[2];                 /* Pending read index requests. */
+            unsigned long long read_round;  /* Last read round started. */
+            unsigned long long read_acked;  /* Last read round confirmed. */
+            raft_time read_start;           /* Start of last read round. */
+            raft_time lease_start;          /* Start of last acked round. */
+            bool lease_revoked;             /* No lease until next term. */
+            struct raft_transfer *transfer; /* Leadership transfer request. */
         } leader_state;
     };
 
@@ -810,6 +1114,15 @@ struct raft
         unsigned trailing;               /* N. of trailing entries to retain */
         struct raft_snapshot pending;    /* In progress snapshot */
         struct raft_io_snapshot_put put; /* Store snapshot request */
+        struct raft_fsm_snapshot *take;  /* Async FSM snapshot request */
+        size_t chunk_size;               /* Max size of sent chunks */
+        struct                           /* Snapshot being received */
+        {
+            raft_index index;        /* Last index of the snapshot */
+            raft_term term;          /* Term of the last index */
+            struct raft_buffer data; /* Chunks received so far */
+            size_t cap;              /* Allocated size of data */
+        } incoming;
     } snapshot;
 
     /*
@@ -877,6 +1190,67 @@ RAFT_API void raft_set_election_timeout(struct raft *r, unsigned msecs);
  */
 RAFT_API void raft_set_heartbeat_timeout(struct raft *r, unsigned msecs);
 
+/**
+ * Maximum number of entries to include in a single AppendEntries RPC. Must be
+ * greater than zero. The default is 1024.
+ */
+RAFT_API void raft_set_max_append_entries(struct raft *r, unsigned n);
+
+/**
+ * Maximum total size in bytes of the entries payloads to include in a single
+ * AppendEntries RPC. The default is 1 megabyte.
+ */
+RAFT_API void raft_set_max_append_bytes(struct raft *r, size_t n);
+
+/**
+ * Maximum number of unacknowledged AppendEntries messages in flight towards a
+ * single follower. Must be greater than zero and not greater than 32, which is
+ * also the default.
+ */
+RAFT_API void raft_set_max_inflight(struct raft *r, unsigned n);
+
+/**
+ * Maximum total size in bytes of the entries payloads in flight towards a
+ * single follower. The default is 16 megabytes.
+ */
+RAFT_API void raft_set_max_inflight_bytes(struct raft *r, size_t n);
+
+/**
+ * Maximum total size in bytes of the entries payloads kept in memory. Beyond
+ * it, the payloads of entries that were applied and persisted are released and
+ * read back from disk when needed. It has no effect if the I/O implementation
+ * doesn't support raft_io->read_entries(). The default is 0, meaning no limit.
+ */
+RAFT_API void raft_set_max_log_bytes(struct raft *r, size_t n);
+
+/**
+ * Enable or disable applying committed entries to the FSM off the event loop
+ * thread, so that slow FSM implementations don't delay heartbeats and the
+ * processing of RPCs. It has no effect if the I/O implementation doesn't
+ * support raft_io->async_work(). It's disabled by default.
+ */
+RAFT_API void raft_set_async_apply(struct raft *r, bool enabled);
+
+/**
+ * Enable or disable leader leases. When enabled, the leader keeps confirming
+ * its leadership with heartbeats, and can serve linearizable reads without any
+ * network round trip while its lease is valid (see raft_read_local()). It's
+ * disabled by default.
+ *
+ * Leases rely on bounded clock drift between servers, and on followers not
+ * granting votes for an election timeout after hearing from the leader. A
+ * follower that restarts forgets the leader it was following, so leases should
+ * not be used if followers can restart faster than an election timeout.
+ */
+RAFT_API void raft_set_lease(struct raft *r, bool enabled);
+
+/**
+ * Maximum drift between the clocks of any two servers over an election timeout,
+ * expressed as a percentage of it. The lease of the leader is shortened by this
+ * amount. The default is 10, and the value must be lower than 100.
+ */
+RAFT_API void raft_set_max_clock_drift(struct raft *r, unsigned percent);
+
 /**
  * Number of outstanding log entries before starting a new snapshot. The default
  * is 1024.
@@ -890,6 +1264,14 @@ RAFT_API void raft_set_snapshot_threshold(struct raft *r, unsigned n);
  */
 RAFT_API void raft_set_snapshot_trailing(struct raft *r, unsigned n);
 
+/**
+ * Maximum size in bytes of the chunks of snapshot data that the leader sends
+ * in a single InstallSnapshot RPC. Followers accumulate the chunks until the
+ * last one is received, and an interrupted transfer resumes from the last chunk
+ * sent. The default is 1 megabyte.
+ */
+RAFT_API void raft_set_snapshot_chunk_size(struct raft *r, size_t n);
+
 /**
  * Set the logging level. Only messages with at this level or above will be
  * emitted.
@@ -981,6 +1363,94 @@ RAFT_API int raft_barrier(struct raft *r,
                           struct raft_barrier *req,
                           raft_barrier_cb cb);
 
+/**
+ * Asynchronous request to perform a linearizable read.
+ */
+struct raft_read_index;
+typedef void (*raft_read_index_cb)(struct raft_read_index *req, int status);
+struct raft_read_index
+{
+    RAFT__REQUEST;
+    raft_read_index_cb cb;
+    unsigned long long round; /* Leadership confirmation round to wait for. */
+};
+
+/**
+ * Wait until the local FSM can be read linearizably, without appending any
+ * entry to the log (ReadIndex, from Section 6.4).
+ *
+ * The current commit index is recorded as read index, then leadership is
+ * confirmed by a round of heartbeats acknowledged by a majority of voting
+ * servers, and finally @cb is invoked once the read index has been applied to
+ * the local FSM. At that point the FSM reflects all entries committed before
+ * this function was called.
+ *
+ * If the leader has not yet appended any entry in its current term, a barrier
+ * entry is appended first, since its commit index might be stale until an
+ * entry from its term gets committed.
+ */
+RAFT_API int raft_read_index(struct raft *r,
+                             struct raft_read_index *req,
+                             raft_read_index_cb cb);
+
+/**
+ * Return true if this server is the leader and holds a valid lease, i.e. no
+ * other server can have been elected leader since the start of the last round
+ * of heartbeats acknowledged by a majority of voting servers.
+ */
+RAFT_API bool raft_lease_valid(struct raft *r);
+
+/**
+ * Check whether the local FSM can be read linearizably right now, without any
+ * network round trip.
+ *
+ * Return 0 if this server holds a valid lease, an entry of its current term
+ * has been committed and all committed entries have been applied to the FSM.
+ * Return #RAFT_NOTLEADER if this server is not the leader, and #RAFT_BUSY if it
+ * is the leader but one of the other conditions does not hold, in which case
+ * raft_read_index() should be used instead.
+ */
+RAFT_API int raft_read_local(struct raft *r);
+
+/**
+ * Asynchronous request to transfer leadership to another server.
+ */
+struct raft_transfer;
+typedef void (*raft_transfer_cb)(struct raft_transfer *req, int status);
+struct raft_transfer
+{
+    RAFT__REQUEST;
+    raft_transfer_cb cb;
+    unsigned id;     /* ID of the server leadership is transferred to. */
+    raft_time start; /* Time the transfer was started at. */
+    bool sent;       /* Whether the TimeoutNow message was sent. */
+};
+
+/**
+ * Transfer leadership to the voting server with the given ID, or to the most
+ * up-to-date voting server if @id is 0 (Section 3.10).
+ *
+ * New entries are not accepted while the transfer is in progress: raft_apply()
+ * and raft_barrier() fail with #RAFT_NOTLEADER and configuration changes can't
+ * be started. Once the log of the target server is up-to-date, a TimeoutNow
+ * message is sent to it, which makes it start an election right away, without
+ * waiting for its election timeout to expire.
+ *
+ * The @cb callback is invoked with status 0 when this server steps down after
+ * having sent the TimeoutNow message, with #RAFT_LEADERSHIPLOST if it steps
+ * down before that, and with #RAFT_CANCELED if the transfer doesn't complete
+ * within an election timeout, in which case this server keeps being the leader
+ * and accepts new entries again.
+ *
+ * Since the target server ignores the current leader when asking for votes, a
+ * leader that sent a TimeoutNow message doesn't hold a lease anymore for the
+ * rest of its term.
+ */
+RAFT_API int raft_transfer(struct raft *r,
+                           struct raft_transfer *req,
+                           unsigned id,
+                           raft_transfer_cb cb);
+
 /**
  * Asynchronous request to change the raft configuration.
  */
@@ -16,7 +16,8 @@
 enum {
     RAFT_FIXTURE_TICK = 1, /* The tick callback has been invoked */
     RAFT_FIXTURE_NETWORK,  /* A network request has been sent or received */
-    RAFT_FIXTURE_DISK      /* An I/O request has been submitted */
+    RAFT_FIXTURE_DISK,     /* An I/O request has been submitted */
+    RAFT_FIXTURE_WORK      /* An async work request has been executed */
 };
 
 /**
@@ -385,6 +386,24 @@ RAFT_API void raft_fixture_set_disk_latency(struct raft_fixture *f,
                                             unsigned i,
                                             unsigned msecs);
 
+/**
+ * Enable or disable support for raft_io->flush() in the @i'th server. When
+ * enabled, flush callbacks get fired at the end of each raft_fixture_step()
+ * call. It's disabled by default.
+ */
+RAFT_API void raft_fixture_set_flush(struct raft_fixture *f,
+                                     unsigned i,
+                                     bool enabled);
+
+/**
+ * Enable or disable support for raft_io->async_work() in the @i'th server. When
+ * enabled, the function of each async work request gets run when the request
+ * is completed, at the next raft_fixture_step() call. It's disabled by default.
+ */
+RAFT_API void raft_fixture_set_async_work(struct raft_fixture *f,
+                                          unsigned i,
+                                          bool enabled);
+
 /**
  * Set the persisted term of the @i'th server.
  */
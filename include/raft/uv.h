@@ -79,6 +79,93 @@ RAFT_API int raft_uv_init(struct raft_io *io,
 
 RAFT_API void raft_uv_close(struct raft_io *io);
 
+/**
+ * Enable or disable chunk-level deduplication of snapshot data. Default is
+ * disabled.
+ *
+ * When enabled, each snapshot buffer is split into chunks of at most 256
+ * kilobytes, and each chunk is stored in its own "chunk-<crc>-<len>-<n>" file.
+ * A chunk with the same content as one already stored by a previous snapshot
+ * is not written again. The snapshot data file then contains just the list of
+ * its chunks:
+ *
+ * [8 bytes] Number of chunks.
+ * [8 bytes] CRC32 checksum of the chunk list.
+ * [8 bytes] CRC32 checksum of the first chunk.
+ * [8 bytes] Length of the first chunk.
+ * [8 bytes] Counter of the first chunk.
+ * ...       Checksum, length and counter of the following chunks.
+ *
+ * State machines whose snapshots change only partially between two snapshots
+ * can take advantage of this by returning the parts of their state in
+ * separate buffers. Chunk files not used by any snapshot that is kept are
+ * removed after each new snapshot is stored.
+ *
+ * Snapshots written with deduplication enabled can't be read by versions of
+ * this library that don't support it.
+ */
+RAFT_API void raft_uv_set_snapshot_dedup(struct raft_io *io, bool enabled);
+
+/**
+ * Enable or disable compression of snapshot data. Default is disabled.
+ *
+ * When enabled, snapshot data is compressed in blocks of 64 kilobytes with a
+ * fast LZ77 codec, both when it's stored on disk and when it's sent to other
+ * servers with InstallSnapshot messages. Blocks that don't shrink are kept as
+ * they are, so data that is already compressed costs little more than a copy.
+ *
+ * Compression always runs in the thread pool: when a snapshot is stored, and
+ * when it's loaded to be sent to other servers. In the latter case the
+ * compressed data is kept in memory along with the snapshot, and the
+ * InstallSnapshot messages sent to any server reuse the blocks covering their
+ * chunk. For this to happen the snapshot chunk size must be a multiple of 64
+ * kilobytes, as it is by default, otherwise chunks are sent uncompressed.
+ *
+ * Compressed snapshots and messages can't be read by versions of this library
+ * that don't support compression, so it should be enabled only once all
+ * servers of the cluster have been upgraded. Snapshots written with
+ * compression disabled remain readable either way.
+ */
+RAFT_API void raft_uv_set_snapshot_compression(struct raft_io *io,
+                                               bool enabled);
+
+/**
+ * Enable or disable encoding of log entries in the thread pool. Default is
+ * disabled.
+ *
+ * When disabled, entries passed to raft_io->append() are copied into the open
+ * segment's write buffer and checksummed in the loop thread, before the write
+ * is submitted. When enabled, this work is done by the thread pool thread that
+ * also submits the write and waits for it to complete, so the loop thread only
+ * queues requests and fires their callbacks. This frees the loop thread from
+ * work proportional to the size of the entries, at the cost of always going
+ * through the thread pool, even when the file system supports fully
+ * asynchronous writes, and of submitting writes against an open segment one
+ * at a time instead of pipelining them.
+ *
+ * The on-disk format is the same in both cases.
+ */
+RAFT_API void raft_uv_set_append_offload(struct raft_io *io, bool enabled);
+
+/**
+ * Set for how many microseconds the loop keeps busy-polling for completed
+ * segment writes. Default is 0 (disabled).
+ *
+ * Completed writes are normally noticed through an event file descriptor that
+ * wakes up the loop. When busy-polling is enabled, after submitting a write
+ * the loop is kept spinning and checks for completions at every iteration,
+ * without blocking, so append callbacks fire without waiting for the
+ * wakeup. Polling stops when no write is in flight, or when no write has
+ * completed for the given number of microseconds, at the cost of keeping a
+ * CPU core busy in the meantime.
+ *
+ * This has effect only when writes are fully asynchronous, i.e. when they are
+ * submitted with io_uring or with Linux AIO without going through the thread
+ * pool, and it's mostly useful with low latency devices such as local NVMe
+ * drives.
+ */
+RAFT_API void raft_uv_set_busy_poll(struct raft_io *io, unsigned usecs);
+
 /**
  * Callback invoked by the transport implementation when a new incoming
  * connection has been established.
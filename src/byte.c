@@ -46,15 +46,189 @@ static const unsigned table[] = {
     0x933eb0bb, 0x97ffad0c, 0xafb010b1, 0xab710d06, 0xa6322bdf, 0xa2f33668,
     0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4};
 
+/* CRC32C (Castagnoli) polynomial, in reversed bit order. */
+#define CRC32C_POLY 0x82f63b78
+
+/* Tables for processing 8 bytes at a time ("slicing-by-8"), built at startup
+ * by initTables(). The first table of the CRC32 ones is the same as the static
+ * table above. */
+static uint32_t crc32Tables[8][256];
+static uint32_t crc32cTables[8][256];
+
+/* Implementations of byteCrc32c() and byteCrc32cCopy() picked at startup
+ * depending on the capabilities of the CPU. */
+static unsigned crc32cSliced(const void *buf, size_t size, unsigned init);
+static unsigned crc32cCopySliced(void *dst,
+                                 const void *src,
+                                 size_t size,
+                                 unsigned init);
+static unsigned (*crc32c)(const void *, size_t, unsigned) = crc32cSliced;
+static unsigned (*crc32cCopy)(void *, const void *, size_t, unsigned) =
+    crc32cCopySliced;
+
+static void initTables(void)
+{
+    unsigned i;
+    unsigned k;
+
+    for (i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (k = 0; k < 8; k++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32Tables[0][i] = table[i];
+        crc32cTables[0][i] = crc;
+    }
+
+    for (k = 1; k < 8; k++) {
+        for (i = 0; i < 256; i++) {
+            uint32_t crc;
+            crc = crc32Tables[k - 1][i];
+            crc32Tables[k][i] = (crc << 8) ^ crc32Tables[0][crc >> 24];
+            crc = crc32cTables[k - 1][i];
+            crc32cTables[k][i] = (crc >> 8) ^ crc32cTables[0][crc & 255];
+        }
+    }
+}
+
 unsigned byteCrc32(const void *buf, const size_t size, const unsigned init)
 {
-    unsigned crc = init;
-    uint8_t *cursor = (uint8_t *)buf;
+    uint32_t crc = init;
+    const uint8_t *cursor = buf;
     size_t count = size;
 
+    while (count >= 8) {
+        crc ^= (uint32_t)cursor[0] << 24 | (uint32_t)cursor[1] << 16 |
+               (uint32_t)cursor[2] << 8 | (uint32_t)cursor[3];
+        crc = crc32Tables[7][crc >> 24] ^ crc32Tables[6][(crc >> 16) & 255] ^
+              crc32Tables[5][(crc >> 8) & 255] ^ crc32Tables[4][crc & 255] ^
+              crc32Tables[3][cursor[4]] ^ crc32Tables[2][cursor[5]] ^
+              crc32Tables[1][cursor[6]] ^ crc32Tables[0][cursor[7]];
+        cursor += 8;
+        count -= 8;
+    }
+
     while (count--) {
         crc = (crc << 8) ^ table[((crc >> 24) ^ *cursor) & 255];
         cursor++;
     }
+
+    return crc;
+}
+
+/* Update the given CRC32C with @size bytes, 8 at a time. The @crc is not
+ * inverted. */
+static uint32_t crc32cUpdateSliced(uint32_t crc,
+                                   const uint8_t *cursor,
+                                   size_t size)
+{
+    while (size >= 8) {
+        crc ^= (uint32_t)cursor[0] | (uint32_t)cursor[1] << 8 |
+               (uint32_t)cursor[2] << 16 | (uint32_t)cursor[3] << 24;
+        crc = crc32cTables[7][crc & 255] ^ crc32cTables[6][(crc >> 8) & 255] ^
+              crc32cTables[5][(crc >> 16) & 255] ^ crc32cTables[4][crc >> 24] ^
+              crc32cTables[3][cursor[4]] ^ crc32cTables[2][cursor[5]] ^
+              crc32cTables[1][cursor[6]] ^ crc32cTables[0][cursor[7]];
+        cursor += 8;
+        size -= 8;
+    }
+
+    while (size--) {
+        crc = (crc >> 8) ^ crc32cTables[0][(crc ^ *cursor) & 255];
+        cursor++;
+    }
+
     return crc;
 }
+
+static unsigned crc32cSliced(const void *buf, size_t size, unsigned init)
+{
+    return ~crc32cUpdateSliced(~(uint32_t)init, buf, size);
+}
+
+static unsigned crc32cCopySliced(void *dst,
+                                 const void *src,
+                                 size_t size,
+                                 unsigned init)
+{
+    memcpy(dst, src, size);
+    return crc32cSliced(dst, size, init);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+/* Update the given CRC32C with @size bytes using the SSE 4.2 crc32
+ * instruction. The @crc is not inverted. */
+__attribute__((target("sse4.2"))) static uint32_t
+crc32cUpdateHw(uint32_t crc, const uint8_t *cursor, size_t size)
+{
+    uint64_t crc64 = crc;
+
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, cursor, sizeof word);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        cursor += 8;
+        size -= 8;
+    }
+    crc = (uint32_t)crc64;
+
+    while (size--) {
+        crc = __builtin_ia32_crc32qi(crc, *cursor);
+        cursor++;
+    }
+
+    return crc;
+}
+
+static unsigned crc32cHw(const void *buf, size_t size, unsigned init)
+{
+    return ~crc32cUpdateHw(~(uint32_t)init, buf, size);
+}
+
+/* Copy and checksum 8 bytes at a time, so the data is read only once. */
+__attribute__((target("sse4.2"))) static unsigned
+crc32cCopyHw(void *dst, const void *src, size_t size, unsigned init)
+{
+    uint64_t crc64 = ~(uint32_t)init;
+    uint8_t *out = dst;
+    const uint8_t *in = src;
+
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, in, sizeof word);
+        memcpy(out, &word, sizeof word);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        in += 8;
+        out += 8;
+        size -= 8;
+    }
+
+    memcpy(out, in, size);
+    return ~crc32cUpdateHw((uint32_t)crc64, out, size);
+}
+
+#endif
+
+__attribute__((constructor)) static void byteInit(void)
+{
+    initTables();
+#if defined(__x86_64__) && defined(__GNUC__)
+    /* Needed when checking CPU features in a constructor. */
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c = crc32cHw;
+        crc32cCopy = crc32cCopyHw;
+    }
+#endif
+}
+
+unsigned byteCrc32c(const void *buf, size_t size, unsigned init)
+{
+    return crc32c(buf, size, init);
+}
+
+unsigned byteCrc32cCopy(void *dst, const void *src, size_t size, unsigned init)
+{
+    return crc32cCopy(dst, src, size, init);
+}
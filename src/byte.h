@@ -170,6 +170,15 @@ RAFT__INLINE__ size_t bytePad64(size_t size)
 /* Calculate the CRC32 checksum of the given data buffer. */
 unsigned byteCrc32(const void *buf, size_t size, unsigned init);
 
+/* Calculate the CRC32C (Castagnoli) checksum of the given data buffer, using
+ * the crc32 instruction if the CPU supports it. To checksum several buffers,
+ * pass the result for the previous ones as @init, otherwise pass 0. */
+unsigned byteCrc32c(const void *buf, size_t size, unsigned init);
+
+/* Copy @size bytes from @src to @dst and return their CRC32C checksum, like
+ * byteCrc32c(). */
+unsigned byteCrc32cCopy(void *dst, const void *src, size_t size, unsigned init);
+
 #undef RAFT__INLINE__
 
 #endif /* BYTE_H_ */
@@ -6,9 +6,10 @@
 #include "logging.h"
 #include "membership.h"
 #include "progress.h"
-#include "queue.h"
+#include "read.h"
 #include "replication.h"
 #include "request.h"
+#include "transfer.h"
 
 /* Set to 1 to enable tracing. */
 #if 0
@@ -30,7 +31,8 @@ int raft_apply(struct raft *r,
     assert(bufs != NULL);
     assert(n > 0);
 
-    if (r->state != RAFT_LEADER) {
+    /* No new entries are accepted while transferring leadership. */
+    if (r->state != RAFT_LEADER || r->leader_state.transfer != NULL) {
         rv = RAFT_NOTLEADER;
         goto err;
     }
@@ -48,18 +50,22 @@ int raft_apply(struct raft *r,
         goto err;
     }
 
-    QUEUE_PUSH(&r->leader_state.requests, &req->queue);
+    rv = requestRegEnqueue(&r->leader_state.requests, (struct request *)req);
+    if (rv != 0) {
+        goto err_after_log_append;
+    }
 
     rv = replicationTrigger(r, index);
     if (rv != 0) {
-        goto err_after_log_append;
+        goto err_after_request_enqueue;
     }
 
     return 0;
 
+err_after_request_enqueue:
+    requestRegPopBack(&r->leader_state.requests, (struct request *)req);
 err_after_log_append:
     logDiscard(&r->log, index);
-    QUEUE_REMOVE(&req->queue);
 err:
     assert(rv != 0);
     return rv;
@@ -71,7 +77,7 @@ int raft_barrier(struct raft *r, struct raft_barrier *req, raft_barrier_cb cb)
     struct raft_buffer buf;
     int rv;
 
-    if (r->state != RAFT_LEADER) {
+    if (r->state != RAFT_LEADER || r->leader_state.transfer != NULL) {
         rv = RAFT_NOTLEADER;
         goto err;
     }
@@ -97,7 +103,50 @@ int raft_barrier(struct raft *r, struct raft_barrier *req, raft_barrier_cb cb)
         goto err_after_buf_alloc;
     }
 
-    QUEUE_PUSH(&r->leader_state.requests, &req->queue);
+    rv = requestRegEnqueue(&r->leader_state.requests, (struct request *)req);
+    if (rv != 0) {
+        goto err_after_log_append;
+    }
+
+    rv = replicationTrigger(r, index);
+    if (rv != 0) {
+        goto err_after_request_enqueue;
+    }
+
+    return 0;
+
+err_after_request_enqueue:
+    requestRegPopBack(&r->leader_state.requests, (struct request *)req);
+err_after_log_append:
+    logDiscard(&r->log, index);
+err_after_buf_alloc:
+    raft_free(buf.base);
+err:
+    return rv;
+}
+
+/* Append a barrier entry with no associated request, to get an entry of the
+ * current term committed. */
+static int appendTermBarrier(struct raft *r)
+{
+    raft_index index;
+    struct raft_buffer buf;
+    int rv;
+
+    buf.len = 8;
+    buf.base = raft_malloc(buf.len);
+    if (buf.base == NULL) {
+        rv = RAFT_NOMEM;
+        goto err;
+    }
+
+    index = logLastIndex(&r->log) + 1;
+    tracef("term barrier at %lld", index);
+
+    rv = logAppend(&r->log, r->current_term, RAFT_BARRIER, &buf, NULL);
+    if (rv != 0) {
+        goto err_after_buf_alloc;
+    }
 
     rv = replicationTrigger(r, index);
     if (rv != 0) {
@@ -108,10 +157,114 @@ int raft_barrier(struct raft *r, struct raft_barrier *req, raft_barrier_cb cb)
 
 err_after_log_append:
     logDiscard(&r->log, index);
-    QUEUE_REMOVE(&req->queue);
 err_after_buf_alloc:
     raft_free(buf.base);
 err:
+    assert(rv != 0);
+    return rv;
+}
+
+int raft_read_index(struct raft *r,
+                    struct raft_read_index *req,
+                    raft_read_index_cb cb)
+{
+    raft_index index;
+    int rv;
+
+    if (r->state != RAFT_LEADER) {
+        rv = RAFT_NOTLEADER;
+        goto err;
+    }
+
+    /* From Section 6.4:
+     *
+     *   If the leader has not yet marked an entry from its current term
+     *   committed, it waits until it has done so. The Leader Completeness
+     *   Property guarantees that a leader has all committed entries, but at
+     *   the start of its term, it may not know which those are.
+     *
+     * In that case use our last index as read index: it's not lower than the
+     * actual commit index, and it gets committed along with the first entry
+     * of our term, which we append if there isn't any yet. */
+    if (logTermOf(&r->log, r->commit_index) == r->current_term) {
+        index = r->commit_index;
+    } else {
+        if (logLastTerm(&r->log) != r->current_term) {
+            rv = appendTermBarrier(r);
+            if (rv != 0) {
+                goto err;
+            }
+        }
+        index = logLastIndex(&r->log);
+    }
+
+    tracef("read index %lld", index);
+    req->index = index;
+    req->cb = cb;
+    readEnqueue(r, req);
+
+    return 0;
+
+err:
+    assert(rv != 0);
+    return rv;
+}
+
+bool raft_lease_valid(struct raft *r)
+{
+    return readLeaseValid(r);
+}
+
+int raft_read_local(struct raft *r)
+{
+    if (r->state != RAFT_LEADER) {
+        return RAFT_NOTLEADER;
+    }
+
+    if (!readLeaseValid(r)) {
+        return RAFT_BUSY;
+    }
+
+    /* Our commit index might be stale until an entry of our term gets
+     * committed, see raft_read_index(). */
+    if (logTermOf(&r->log, r->commit_index) != r->current_term) {
+        return RAFT_BUSY;
+    }
+
+    if (r->last_applied < r->commit_index) {
+        return RAFT_BUSY;
+    }
+
+    return 0;
+}
+
+int raft_transfer(struct raft *r,
+                  struct raft_transfer *req,
+                  unsigned id,
+                  raft_transfer_cb cb)
+{
+    int rv;
+
+    if (r->state != RAFT_LEADER) {
+        rv = RAFT_NOTLEADER;
+        goto err;
+    }
+
+    if (r->leader_state.transfer != NULL) {
+        rv = RAFT_BUSY;
+        goto err;
+    }
+
+    req->cb = cb;
+    rv = transferStart(r, req, id);
+    if (rv != 0) {
+        goto err;
+    }
+
+    return 0;
+
+err:
+    assert(rv != 0);
     return rv;
 }
 
@@ -147,19 +300,24 @@ static int changeConfiguration(struct raft *r,
 
     req->type = RAFT_CHANGE;
     req->index = index;
-    QUEUE_PUSH(&r->leader_state.requests, &req->queue);
+    rv = requestRegEnqueue(&r->leader_state.requests, (struct request *)req);
+    if (rv != 0) {
+        goto err_after_log_append;
+    }
 
     /* Start writing the new log entry to disk and send it to the followers. */
     rv = replicationTrigger(r, index);
     if (rv != 0) {
         /* TODO: restore the old next/match indexes and configuration. */
-        goto err_after_log_append;
+        goto err_after_request_enqueue;
     }
 
     r->configuration_uncommitted_index = index;
 
     return 0;
 
+err_after_request_enqueue:
+    requestRegPopBack(&r->leader_state.requests, (struct request *)req);
 err_after_log_append:
     logTruncate(&r->log, index);
 
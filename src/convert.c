@@ -3,9 +3,12 @@
 #include "configuration.h"
 #include "election.h"
 #include "log.h"
+#include "logging.h"
 #include "progress.h"
-#include "queue.h"
+#include "read.h"
+#include "replication.h"
 #include "request.h"
+#include "transfer.h"
 
 /* Convenience for setting a new state value and asserting that the transition
  * is valid. */
@@ -70,18 +73,24 @@ static void failChange(struct raft_change *req)
 /* Clear leader state. */
 static void clearLeader(struct raft *r)
 {
+    int rv;
+
+    /* Persist entries whose disk write was deferred to the end of the current
+     * loop iteration, since they're already part of our in-memory log. */
+    rv = replicationFlush(r, false);
+    if (rv != 0) {
+        warnf(r, "flush new entries: %s", raft_strerror(rv));
+    }
+
     if (r->leader_state.progress != NULL) {
         raft_free(r->leader_state.progress);
         r->leader_state.progress = NULL;
     }
 
     /* Fail all outstanding requests */
-    while (!QUEUE_IS_EMPTY(&r->leader_state.requests)) {
+    while (requestRegNumRequests(&r->leader_state.requests) > 0) {
         struct request *req;
-        queue *head;
-        head = QUEUE_HEAD(&r->leader_state.requests);
-        QUEUE_REMOVE(head);
-        req = QUEUE_DATA(head, struct request, queue);
+        req = requestRegPopFront(&r->leader_state.requests);
         switch (req->type) {
             case RAFT_COMMAND:
                 failApply((struct raft_apply *)req);
@@ -96,6 +105,10 @@ static void clearLeader(struct raft *r)
                 break;
         };
     }
+    requestRegClose(&r->leader_state.requests);
+
+    /* Fail all outstanding read requests. */
+    readFailAll(r, RAFT_LEADERSHIPLOST);
 
     /* Fail any promote request that is still outstanding because the server is
      * still catching up and no entry was submitted. */
@@ -103,6 +116,10 @@ static void clearLeader(struct raft *r)
         failChange(r->leader_state.change);
         r->leader_state.change = NULL;
     }
+
+    /* Complete any leadership transfer, which succeeded if we sent the
+     * TimeoutNow message. */
+    transferClose(r);
 }
 
 /* Clear the current state */
@@ -135,7 +152,7 @@ void convertToFollower(struct raft *r)
     r->follower_state.current_leader.address = NULL;
 }
 
-int convertToCandidate(struct raft *r)
+int convertToCandidate(struct raft *r, bool disrupt_leader)
 {
     size_t n_voting = configurationNumVoting(&r->configuration);
     int rv;
@@ -148,6 +165,7 @@ int convertToCandidate(struct raft *r)
     if (r->candidate_state.votes == NULL) {
         return RAFT_NOMEM;
     }
+    r->candidate_state.disrupt_leader = disrupt_leader;
 
     /* Start a new election round */
     rv = electionStart(r);
@@ -170,8 +188,11 @@ int convertToLeader(struct raft *r)
     /* Reset timers */
     r->election_timer_start = r->io->time(r->io);
 
-    /* Reset apply requests queue */
-    QUEUE_INIT(&r->leader_state.requests);
+    /* Reset apply requests registry */
+    requestRegInit(&r->leader_state.requests);
+    r->leader_state.flush_index = 0;
+    readInit(r);
+    transferInit(r);
 
     /* Allocate and initialize the progress array. */
     rv = progressBuildArray(r);
@@ -20,8 +20,12 @@ void convertToFollower(struct raft *r);
  *
  * From Figure 3.1:
  *
- *   On conversion to candidate, start election */
-int convertToCandidate(struct raft *r);
+ *   On conversion to candidate, start election
+ *
+ * If @disrupt_leader is true, the election was triggered by a TimeoutNow
+ * message and other servers should grant their vote even if they have a
+ * leader. */
+int convertToCandidate(struct raft *r, bool disrupt_leader);
 
 /* Convert from candidate to leader.
  *
@@ -84,6 +84,7 @@ static int sendRequestVote(struct raft *r, const struct raft_server *server)
     message.request_vote.candidate_id = r->id;
     message.request_vote.last_log_index = logLastIndex(&r->log);
     message.request_vote.last_log_term = logLastTerm(&r->log);
+    message.request_vote.disrupt_leader = r->candidate_state.disrupt_leader;
     message.server_id = server->id;
     message.server_address = server->address;
 
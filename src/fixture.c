@@ -20,7 +20,7 @@
 #define DISK_LATENCY 10
 
 /* To keep in sync with raft.h */
-#define N_MESSAGE_TYPES 5
+#define N_MESSAGE_TYPES 6
 
 /* Set to 1 to enable tracing. */
 #if 0
@@ -49,6 +49,9 @@ static char *describeMessage(const struct raft_message *m)
         case RAFT_IO_INSTALL_SNAPSHOT:
             sprintf(d, "install snapshot");
             break;
+        case RAFT_IO_TIMEOUT_NOW:
+            sprintf(d, "timeout now");
+            break;
         default:
             assert(0);
     }
@@ -70,7 +73,15 @@ static char *describeMessage(const struct raft_message *m)
     queue queue                /* Link the I/O pending requests queue. */
 
 /* Request type codes. */
-enum { APPEND = 1, SEND, TRANSMIT, SNAPSHOT_PUT, SNAPSHOT_GET };
+enum {
+    APPEND = 1,
+    SEND,
+    TRANSMIT,
+    SNAPSHOT_PUT,
+    SNAPSHOT_GET,
+    ASYNC_WORK,
+    READ_ENTRIES
+};
 
 /* Abstract base type for an asynchronous request submitted to the stub I/o
  * implementation. */
@@ -112,6 +123,22 @@ struct snapshot_get
     struct raft_io_snapshot_get *req;
 };
 
+/* Pending request to run a function off the event loop thread. */
+struct async_work
+{
+    REQUEST;
+    struct raft_io_async_work *req;
+};
+
+/* Pending request to read persisted entries. */
+struct read_entries
+{
+    REQUEST;
+    struct raft_io_read_entries *req;
+    raft_index index;
+    size_t max_bytes;
+};
+
 /* Message that has been written to the network and is waiting to be delivered
  * (or discarded). */
 struct transmit
@@ -161,6 +188,8 @@ struct io
     struct peer peers[MAX_PEERS];
     unsigned n_peers;
 
+    raft_io_flush_cb flush_cb; /* Pending raft_io->flush() callback, if any. */
+
     unsigned randomized_election_timeout; /* Value returned by io->random() */
     unsigned network_latency;             /* Milliseconds to deliver RPCs */
     unsigned disk_latency;                /* Milliseconds to perform disk I/O */
@@ -307,6 +336,50 @@ static void ioFlushSnapshotGet(struct io *s, struct snapshot_get *r)
     raft_free(r);
 }
 
+/* Flush an async work request, running its function and passing the result to
+ * the callback. */
+static void ioFlushAsyncWork(struct io *s, struct async_work *r)
+{
+    int status;
+    (void)s;
+    status = r->req->work(r->req);
+    r->req->cb(r->req, status);
+    raft_free(r);
+}
+
+/* Flush a read entries request, returning to the client a copy of the
+ * persisted entries starting at the requested index. */
+static void ioFlushReadEntries(struct io *s, struct read_entries *r)
+{
+    struct raft_entry *entries = NULL;
+    size_t bytes;
+    unsigned n = 0;
+    int status = RAFT_IOERR;
+    int rv;
+
+    if (r->index > s->n) {
+        goto out;
+    }
+
+    /* Always include the first entry, then as many others as fit. */
+    bytes = s->entries[r->index - 1].buf.len;
+    for (n = 1; r->index + n <= s->n; n++) {
+        size_t len = s->entries[r->index - 1 + n].buf.len;
+        if (bytes + len > r->max_bytes) {
+            break;
+        }
+        bytes += len;
+    }
+
+    rv = entryBatchCopy(&s->entries[r->index - 1], &entries, n);
+    assert(rv == 0);
+    status = 0;
+
+out:
+    r->req->cb(r->req, entries, status == 0 ? n : 0, status);
+    raft_free(r);
+}
+
 /* Search for the peer with the given ID. */
 static struct peer *ioGetPeer(struct io *io, unsigned id)
 {
@@ -382,7 +455,7 @@ static void ioFlushSend(struct io *io, struct send *send)
     }
 
     /* tracef("io: flush: %s", describeMessage(&send->message)); */
-    io->n_send[send->message.type]++;
+    io->n_send[send->message.type - 1]++;
     status = 0;
 
 out:
@@ -440,6 +513,12 @@ static void ioFlushAll(struct io *io)
             case SNAPSHOT_GET:
                 ioFlushSnapshotGet(io, (struct snapshot_get *)r);
                 break;
+            case ASYNC_WORK:
+                ioFlushAsyncWork(io, (struct async_work *)r);
+                break;
+            case READ_ENTRIES:
+                ioFlushReadEntries(io, (struct read_entries *)r);
+                break;
             default:
                 assert(0);
         }
@@ -451,6 +530,7 @@ static int ioMethodClose(struct raft_io *raft_io,
 {
     struct io *io = raft_io->impl;
     size_t i;
+    io->flush_cb = NULL;
     for (i = 0; i < io->n; i++) {
         struct raft_entry *entry = &io->entries[i];
         raft_free(entry->buf.base);
@@ -711,6 +791,30 @@ static int ioMethodSnapshotGet(struct raft_io *raft_io,
     return 0;
 }
 
+static int ioMethodReadEntries(struct raft_io *raft_io,
+                               struct raft_io_read_entries *req,
+                               raft_index index,
+                               size_t max_bytes,
+                               raft_io_read_entries_cb cb)
+{
+    struct io *io = raft_io->impl;
+    struct read_entries *r;
+
+    r = raft_malloc(sizeof *r);
+    assert(r != NULL);
+
+    r->type = READ_ENTRIES;
+    r->req = req;
+    r->req->cb = cb;
+    r->index = index;
+    r->max_bytes = max_bytes;
+    r->completion_time = *io->time + io->disk_latency;
+
+    QUEUE_PUSH(&io->requests, &r->queue);
+
+    return 0;
+}
+
 static raft_time ioMethodTime(struct raft_io *raft_io)
 {
     struct io *io = raft_io->impl;
@@ -726,6 +830,37 @@ static int ioMethodRandom(struct raft_io *raft_io, int min, int max)
     return io->randomized_election_timeout;
 }
 
+/* Remember the given callback, which will be invoked at the end of the current
+ * fixture step. */
+static int ioMethodFlush(struct raft_io *raft_io, raft_io_flush_cb cb)
+{
+    struct io *io = raft_io->impl;
+    io->flush_cb = cb;
+    return 0;
+}
+
+/* Queue up a request whose function will be run when it's completed, at the
+ * next step. */
+static int ioMethodAsyncWork(struct raft_io *raft_io,
+                             struct raft_io_async_work *req,
+                             raft_io_async_work_cb cb)
+{
+    struct io *io = raft_io->impl;
+    struct async_work *r;
+
+    r = raft_malloc(sizeof *r);
+    assert(r != NULL);
+
+    r->type = ASYNC_WORK;
+    r->req = req;
+    r->req->cb = cb;
+    r->completion_time = *io->time;
+
+    QUEUE_PUSH(&io->requests, &r->queue);
+
+    return 0;
+}
+
 /* Queue up a request which will be processed later, when io_stub_flush()
  * is invoked. */
 static int ioMethodSend(struct raft_io *raft_io,
@@ -765,7 +900,7 @@ static void ioReceive(struct io *io, struct raft_message *message)
     tracef("io: recv: %s from server %d", describeMessage(message),
            message->server_id);
     io->recv_cb(io->io, message);
-    io->n_recv[message->type]++;
+    io->n_recv[message->type - 1]++;
 }
 
 static void ioDeliverTransmit(struct io *io, struct transmit *transmit)
@@ -899,7 +1034,9 @@ static int ioInit(struct raft_io *raft_io, unsigned index, raft_time *time)
     memset(io->n_send, 0, sizeof io->n_send);
     memset(io->n_recv, 0, sizeof io->n_recv);
     io->n_append = 0;
+    io->flush_cb = NULL;
 
+    raft_io->version = 2;
     raft_io->impl = io;
     raft_io->init = ioMethodInit;
     raft_io->start = ioMethodStart;
@@ -915,6 +1052,10 @@ static int ioInit(struct raft_io *raft_io, unsigned index, raft_time *time)
     raft_io->snapshot_get = ioMethodSnapshotGet;
     raft_io->time = ioMethodTime;
     raft_io->random = ioMethodRandom;
+    raft_io->flush = NULL; /* Enabled with raft_fixture_set_flush() */
+    raft_io->async_work = NULL; /* Enabled with raft_fixture_set_async_work() */
+    raft_io->snapshot_release = NULL;
+    raft_io->read_entries = ioMethodReadEntries;
 
     return 0;
 }
@@ -1268,6 +1409,11 @@ static void checkLeaderAppendOnly(struct raft_fixture *f)
         /* Entry was not overwritten. */
         assert(entry1->type == entry2->type);
         assert(entry1->term == entry2->term);
+
+        /* Check if the payload was evicted from memory. */
+        if (entry1->buf.base == NULL || entry2->buf.base == NULL) {
+            continue;
+        }
         for (i = 0; i < entry1->buf.len; i++) {
             assert(((uint8_t *)entry1->buf.base)[i] ==
                    ((uint8_t *)entry2->buf.base)[i]);
@@ -1280,24 +1426,26 @@ static void checkLeaderAppendOnly(struct raft_fixture *f)
 static void copyLeaderLog(struct raft_fixture *f)
 {
     struct raft *raft = raft_fixture_get(f, f->leader_id - 1);
-    struct raft_entry *entries;
-    unsigned n;
-    size_t i;
+    raft_index index;
     int rv;
     logClose(&f->log);
     logInit(&f->log);
-    rv = logAcquire(&raft->log, 1, &entries, &n);
-    assert(rv == 0);
-    for (i = 0; i < n; i++) {
-        struct raft_entry *entry = &entries[i];
+    if (logGet(&raft->log, 1) == NULL) {
+        return;
+    }
+    for (index = 1; index <= logLastIndex(&raft->log); index++) {
+        const struct raft_entry *entry = logGet(&raft->log, index);
         struct raft_buffer buf;
         buf.len = entry->buf.len;
-        buf.base = raft_malloc(buf.len);
-        memcpy(buf.base, entry->buf.base, buf.len);
+        buf.base = NULL;
+        /* The payloads of evicted entries are not in memory anymore. */
+        if (entry->buf.base != NULL) {
+            buf.base = raft_malloc(buf.len);
+            memcpy(buf.base, entry->buf.base, buf.len);
+        }
         rv = logAppend(&f->log, entry->term, entry->type, &buf, NULL);
         assert(rv == 0);
     }
-    logRelease(&raft->log, 1, entries, n);
 }
 
 /* Update the commit index to match the one from the current leader. */
@@ -1397,11 +1545,34 @@ static void completeRequest(struct raft_fixture *f, unsigned i, raft_time t)
             ioFlushSnapshotGet(io, (struct snapshot_get *)r);
             f->event.type = RAFT_FIXTURE_DISK;
             break;
+        case ASYNC_WORK:
+            ioFlushAsyncWork(io, (struct async_work *)r);
+            f->event.type = RAFT_FIXTURE_WORK;
+            break;
+        case READ_ENTRIES:
+            ioFlushReadEntries(io, (struct read_entries *)r);
+            f->event.type = RAFT_FIXTURE_DISK;
+            break;
         default:
             assert(0);
     }
 }
 
+/* Fire the pending raft_io->flush() callbacks of all servers, as a real event
+ * loop would do at the end of an iteration. */
+static void fireFlushes(struct raft_fixture *f)
+{
+    unsigned i;
+    for (i = 0; i < f->n; i++) {
+        struct io *io = f->servers[i].io.impl;
+        raft_io_flush_cb cb = io->flush_cb;
+        if (cb != NULL) {
+            io->flush_cb = NULL;
+            cb(io->io);
+        }
+    }
+}
+
 struct raft_fixture_event *raft_fixture_step(struct raft_fixture *f)
 {
     raft_time tick_time;
@@ -1421,6 +1592,8 @@ struct raft_fixture_event *raft_fixture_step(struct raft_fixture *f)
         completeRequest(f, j, completion_time);
     }
 
+    fireFlushes(f);
+
     /* If the leader has not changed check the Leader Append-Only
      * guarantee. */
     if (!updateLeaderAndCheckElectionSafety(f)) {
@@ -1857,6 +2030,20 @@ void raft_fixture_set_disk_latency(struct raft_fixture *f,
     io->disk_latency = msecs;
 }
 
+void raft_fixture_set_flush(struct raft_fixture *f, unsigned i, bool enabled)
+{
+    struct raft_io *io = &f->servers[i].io;
+    io->flush = enabled ? ioMethodFlush : NULL;
+}
+
+void raft_fixture_set_async_work(struct raft_fixture *f,
+                                 unsigned i,
+                                 bool enabled)
+{
+    struct raft_io *io = &f->servers[i].io;
+    io->async_work = enabled ? ioMethodAsyncWork : NULL;
+}
+
 void raft_fixture_set_term(struct raft_fixture *f, unsigned i, raft_term term)
 {
     struct io *io = f->servers[i].io.impl;
@@ -1897,11 +2084,11 @@ void raft_fixture_io_fault(struct raft_fixture *f,
 unsigned raft_fixture_n_send(struct raft_fixture *f, unsigned i, int type)
 {
     struct io *io = f->servers[i].io.impl;
-    return io->n_send[type];
+    return io->n_send[type - 1];
 }
 
 unsigned raft_fixture_n_recv(struct raft_fixture *f, unsigned i, int type)
 {
     struct io *io = f->servers[i].io.impl;
-    return io->n_recv[type];
+    return io->n_recv[type - 1];
 }
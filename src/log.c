@@ -1,3 +1,5 @@
+#include <limits.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "../include/raft.h"
@@ -6,328 +8,243 @@
 #include "configuration.h"
 #include "log.h"
 
-/* Calculate the reference count hash table key for the given log entry index in
- * an hash table of the given size.
- *
- * The hash is simply the log entry index minus one modulo the size. This
- * minimizes conflicts in the most frequent case, where a new log entry is
- * simply appended to the log and can use the hash table bucket next to the
- * bucket for the entry with the previous index (possibly resizing the table if
- * its cap is reached). */
-static size_t refsKey(const raft_index index, const size_t size)
+/* Return true if the given acquired range contains the entry with the given
+ * index and term. */
+static bool refCovers(const struct raft_entry_ref *ref,
+                      const raft_index index,
+                      const raft_term term)
 {
-    assert(index > 0);
-    assert(size > 0);
-    return (index - 1) % size;
-}
-
-/* Try to insert a new reference count item for the given log entry index into
- * the given reference count hash table.
- *
- * A collision happens when the bucket associated with the hash key of the given
- * log entry index is already used to refcount log entries with a different
- * index. In that case the collision output parameter will be set to true and no
- * new reference count item is inserted into the hash table.
- *
- * If two log entries have the same index but different terms, the associated
- * bucket will be grown accordingly. */
-static int refsTryInsert(struct raft_entry_ref *table,
-                         const size_t size,
-                         const raft_term term,
-                         const raft_index index,
-                         const unsigned short count,
-                         bool *collision)
-{
-    struct raft_entry_ref *bucket;    /* Bucket associated with this index. */
-    struct raft_entry_ref *next_slot; /* For traversing the bucket slots. */
-    struct raft_entry_ref *last_slot; /* To track the last traversed slot. */
-    struct raft_entry_ref *slot;      /* Actual slot to use for this entry. */
-    size_t key;
-
-    assert(table != NULL);
-    assert(size > 0);
-    assert(term > 0);
-    assert(index > 0);
-    assert(count > 0);
-    assert(collision != NULL);
-
-    /* Calculate the hash table key for the given index. */
-    key = refsKey(index, size);
-    bucket = &table[key];
-
-    /* If a bucket is empty, then there's no collision and we can fill its first
-     * slot. */
-    if (bucket->count == 0) {
-        assert(bucket->next == NULL);
-        slot = bucket;
-        goto fill;
+    if (index < ref->index || index >= ref->index + ref->n) {
+        return false;
     }
+    return ref->entries[index - ref->index].term == term;
+}
 
-    /* If the bucket is already used to refcount entries with a different
-     * index, then we have a collision and we must abort here. */
-    if (bucket->index != index) {
-        *collision = true;
-        return 0;
+/* Return true if the entry with the given index and term is contained in any
+ * range of entries acquired with logAcquire() and not yet released. */
+static bool isAcquired(struct raft_log *l,
+                       const raft_index index,
+                       const raft_term term)
+{
+    size_t i;
+    for (i = 0; i < l->refs_size; i++) {
+        if (refCovers(&l->refs[i], index, term)) {
+            return true;
+        }
     }
+    return false;
+}
 
-    /* If we get here it means that the bucket is in use to refcount one or more
-     * entries with the same index as the given one, but different terms.
-     *
-     * We must append a newly allocated slot to refcount the entry with this
-     * term.
-     *
-     * So first let's find the last slot in the bucket. */
-    for (next_slot = bucket; next_slot != NULL; next_slot = next_slot->next) {
-        /* All entries in a bucket must have the same index. */
-        assert(next_slot->index == index);
-
-        /* It should never happen that two entries with the same index and term
-         * get appended. So no existing slot in this bucket must track an entry
-         * with the same term as the given one. */
-        assert(next_slot->term != term);
-
-        last_slot = next_slot;
-    }
+/* Return true if the given number of acquired ranges fills up the refs array,
+ * whose capacity is always the smallest power of two that is not lower than the
+ * number of ranges it holds. */
+static bool refsFull(size_t n)
+{
+    return (n & (n - 1)) == 0;
+}
 
-    /* The last slot must have no next slot. */
-    assert(last_slot->next == NULL);
+/* Register a newly acquired range of entries. */
+static int refsPush(struct raft_log *l,
+                    const raft_index index,
+                    struct raft_entry *entries,
+                    const unsigned n)
+{
+    struct raft_entry_ref *ref;
 
-    slot = raft_malloc(sizeof *slot);
-    if (slot == NULL) {
-        return RAFT_NOMEM;
+    if (refsFull(l->refs_size)) {
+        size_t cap = l->refs_size == 0 ? 1 : l->refs_size * 2;
+        struct raft_entry_ref *refs;
+        refs = raft_realloc(l->refs, cap * sizeof *refs);
+        if (refs == NULL) {
+            return RAFT_NOMEM;
+        }
+        l->refs = refs;
     }
 
-    last_slot->next = slot;
-
-fill:
-    slot->term = term;
-    slot->index = index;
-    slot->count = count;
-    slot->next = NULL;
-
-    *collision = false;
+    ref = &l->refs[l->refs_size];
+    ref->index = index;
+    ref->entries = entries;
+    ref->n = n;
+    l->refs_size++;
 
     return 0;
 }
 
-/* Move the slots of the given bucket into the given reference count hash
- * table. The key of the bucket to use in the given table will be re-calculated
- * according to the given size. */
-static int refsMove(struct raft_entry_ref *bucket,
-                    struct raft_entry_ref *table,
-                    const size_t size)
+/* Unregister the acquired range with the given entries array. */
+static void refsRemove(struct raft_log *l, const struct raft_entry *entries)
 {
-    struct raft_entry_ref *slot;
-    struct raft_entry_ref *next_slot;
-
-    assert(bucket != NULL);
-    assert(table != NULL);
-    assert(size > 0);
-
-    /* Only non-empty buckets should be moved. */
-    assert(bucket->count > 0);
-
-    /* For each slot in the bucket, insert the relevant entry in the given
-     * table, then free it. */
-    next_slot = bucket;
-    while (next_slot != NULL) {
-        bool collision;
-        int rv;
+    size_t i;
 
-        slot = next_slot;
+    for (i = 0; i < l->refs_size; i++) {
+        if (l->refs[i].entries == entries) {
+            break;
+        }
+    }
+    assert(i < l->refs_size);
 
-        /* Insert the reference count for this entry into the new table. */
-        rv = refsTryInsert(table, size, slot->term, slot->index, slot->count,
-                           &collision);
+    /* Order doesn't matter, so just fill the hole with the last range. */
+    l->refs_size--;
+    l->refs[i] = l->refs[l->refs_size];
 
-        next_slot = slot->next;
+    if (l->refs_size == 0) {
+        raft_free(l->refs);
+        l->refs = NULL;
+    }
+}
 
-        /* Unless this is the very first slot in the bucket, we need to free the
-         * slot. */
-        if (slot != bucket) {
-            raft_free(slot);
-        }
+/* Return true if the given batch is pointed to by any entry in any acquired
+ * range. */
+static bool isBatchAcquired(struct raft_log *l, const void *batch)
+{
+    size_t i;
+    unsigned j;
 
-        if (rv != 0) {
-            return rv;
+    for (i = 0; i < l->refs_size; i++) {
+        struct raft_entry_ref *ref = &l->refs[i];
+        for (j = 0; j < ref->n; j++) {
+            if (ref->entries[j].batch == batch) {
+                return true;
+            }
         }
+    }
 
-        /* The given hash table is assumed to be large enough to hold all ref
-         * counts without any conflict. */
-        assert(!collision);
-    };
+    return false;
+}
 
-    return 0;
+/* Calculate the batch hash table key for the given batch.
+ *
+ * Batches are heap allocations, so the lowest bits of their address carry no
+ * information. The other ones are spread by multiplying them by a large odd
+ * number. */
+static size_t batchesKey(struct raft_log *l, const void *batch)
+{
+    uint64_t hash = ((uintptr_t)batch >> 4) * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(hash >> 32) & (l->batches_size - 1);
 }
 
-/* Grow the size of the reference count hash table. */
-static int refsGrow(struct raft_log *l)
+/* Return the slot of the batch hash table where the given batch is stored, or
+ * the empty slot where it should be inserted. */
+static struct raft_batch_ref *batchesLookup(struct raft_log *l,
+                                            const void *batch)
 {
-    struct raft_entry_ref *table; /* New hash table. */
-    size_t size;                  /* Size of the new hash table. */
+    size_t mask = l->batches_size - 1;
     size_t i;
 
-    assert(l != NULL);
-    assert(l->refs_size > 0);
+    i = batchesKey(l, batch);
+    while (l->batches[i].batch != NULL && l->batches[i].batch != batch) {
+        i = (i + 1) & mask;
+    }
+
+    return &l->batches[i];
+}
 
-    size = l->refs_size * 2; /* Double the table size */
+/* Double the size of the batch hash table, or allocate it if needed. */
+static int batchesGrow(struct raft_log *l)
+{
+    struct raft_batch_ref *batches = l->batches;
+    size_t size = l->batches_size;
+    size_t i;
 
-    table = raft_calloc(size, sizeof *table);
-    if (table == NULL) {
+    l->batches_size = size == 0 ? LOG__BATCHES_INITIAL_SIZE : size * 2;
+    l->batches = raft_calloc(l->batches_size, sizeof *l->batches);
+    if (l->batches == NULL) {
+        l->batches = batches;
+        l->batches_size = size;
         return RAFT_NOMEM;
     }
 
-    /* Populate the new hash table, inserting all entries existing in the
-     * current hash table. Each bucket will have a different key in the new hash
-     * table, since the size has changed. */
-    for (i = 0; i < l->refs_size; i++) {
-        struct raft_entry_ref *bucket = &l->refs[i];
-        if (bucket->count > 0) {
-            int rv = refsMove(bucket, table, size);
-            if (rv != 0) {
-                return rv;
-            }
-        } else {
-            /* If the count is zero, we expect that the bucket is unused. */
-            assert(bucket->next == NULL);
+    for (i = 0; i < size; i++) {
+        if (batches[i].batch != NULL) {
+            *batchesLookup(l, batches[i].batch) = batches[i];
         }
     }
 
-    raft_free(l->refs);
-
-    l->refs = table;
-    l->refs_size = size;
+    if (batches != NULL) {
+        raft_free(batches);
+    }
 
     return 0;
 }
 
-/* Initialize the reference count of the entry with the given index, setting it
- * to 1. */
-static int refsInit(struct raft_log *l,
-                    const raft_term term,
-                    const raft_index index)
+/* Increment the number of log entries pointing into the given batch. */
+static int batchesIncr(struct raft_log *l, void *batch)
 {
-    int i;
-
-    assert(l != NULL);
-    assert(term > 0);
-    assert(index > 0);
+    struct raft_batch_ref *slot;
+    int rv;
 
-    /* Initialize the hash map with a reasonable size */
-    if (l->refs == NULL) {
-        l->refs_size = LOG__REFS_INITIAL_SIZE;
-        l->refs = raft_calloc(l->refs_size, sizeof *l->refs);
-        if (l->refs == NULL) {
-            return RAFT_NOMEM;
+    /* Keep the load factor of the table below 1/2. */
+    if (2 * (l->n_batches + 1) > l->batches_size) {
+        rv = batchesGrow(l);
+        if (rv != 0) {
+            return rv;
         }
     }
 
-    /* Check if the bucket associated with the given index is available
-     * (i.e. there are no collisions), or grow the table and re-key it
-     * otherwise.
-     *
-     * We limit the number of times we try to grow the table to 10, to avoid
-     * eating up too much memory. In practice, there should never be a case
-     * where this is not enough. */
-    for (i = 0; i < 10; i++) {
-        bool collision;
-        int rc;
-
-        rc = refsTryInsert(l->refs, l->refs_size, term, index, 1, &collision);
-        if (rc != 0) {
-            return RAFT_NOMEM;
-        }
-
-        if (!collision) {
-            return 0;
-        }
-
-        rc = refsGrow(l);
-        if (rc != 0) {
-            return rc;
-        }
-    };
+    slot = batchesLookup(l, batch);
+    if (slot->batch == NULL) {
+        slot->batch = batch;
+        slot->count = 0;
+        l->n_batches++;
+    }
+    slot->count++;
 
-    return RAFT_NOMEM;
+    return 0;
 }
 
-/* Increment the refcount of the entry with the given term and index. */
-static void refsIncr(struct raft_log *l,
-                     const raft_term term,
-                     const raft_index index)
+/* Remove the given slot from the batch hash table. */
+static void batchesDelete(struct raft_log *l, struct raft_batch_ref *slot)
 {
-    size_t key;                  /* Hash table key for the given index. */
-    struct raft_entry_ref *slot; /* Slot for the given term/index */
-
-    assert(l != NULL);
-    assert(term > 0);
-    assert(index > 0);
+    size_t mask = l->batches_size - 1;
+    size_t hole = (size_t)(slot - l->batches);
+    size_t i = hole;
 
-    key = refsKey(index, l->refs_size);
-
-    /* Lookup the slot associated with the given term/index, which must have
-     * been previously inserted. */
-    for (slot = &l->refs[key]; slot != NULL; slot = slot->next) {
-        assert(slot->index == index);
-        if (slot->term == term) {
+    /* Shift back the following slots of the same cluster which would become
+     * unreachable, so no tombstone is needed. */
+    for (;;) {
+        struct raft_batch_ref *next;
+        size_t home;
+        i = (i + 1) & mask;
+        next = &l->batches[i];
+        if (next->batch == NULL) {
             break;
         }
+        home = batchesKey(l, next->batch);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            l->batches[hole] = *next;
+            hole = i;
+        }
     }
-    assert(slot != NULL);
 
-    slot->count++;
+    l->batches[hole].batch = NULL;
+    l->batches[hole].count = 0;
+    l->n_batches--;
 }
 
-/* Decrement the refcount of the entry with the given index. Return a boolean
- * indicating whether the entry has now zero references. */
-static bool refsDecr(struct raft_log *l,
-                     const raft_term term,
-                     const raft_index index)
+/* Decrement the number of log entries pointing into the given batch. If no
+ * entry in the log nor in any acquired range points into it anymore, the
+ * batch memory is released if @destroy is true. */
+static void batchesDecr(struct raft_log *l, void *batch, bool destroy)
 {
-    size_t key;                       /* Hash table key for the given index. */
-    struct raft_entry_ref *slot;      /* Slot for the given term/index */
-    struct raft_entry_ref *prev_slot; /* Slot preceeding the one to decrement */
+    struct raft_batch_ref *slot = batchesLookup(l, batch);
 
-    assert(l != NULL);
-    assert(term > 0);
-    assert(index > 0);
-
-    key = refsKey(index, l->refs_size);
-    prev_slot = NULL;
-
-    /* Lookup the slot associated with the given term/index, keeping track of
-     * its previous slot in the bucket list. */
-    for (slot = &l->refs[key]; slot != NULL; slot = slot->next) {
-        assert(slot->index == index);
-        if (slot->term == term) {
-            break;
-        }
-        prev_slot = slot;
-    }
-    assert(slot != NULL);
+    assert(slot->batch == batch);
+    assert(slot->count > 0);
 
     slot->count--;
-
     if (slot->count > 0) {
-        /* The entry is still referenced. */
-        return false;
+        return;
     }
 
-    /* If the refcount has dropped to zero, delete the slot. */
-    if (prev_slot != NULL) {
-        /* This isn't the very first slot, simply unlink it from the slot
-         * list. */
-        prev_slot->next = slot->next;
-        raft_free(slot);
-    } else if (slot->next != NULL) {
-        /* This is the very first slot, and slot list is not empty. Copy the
-         * second slot into the first one, then delete it. */
-        struct raft_entry_ref *second_slot = slot->next;
-        *slot = *second_slot;
-        raft_free(second_slot);
+    /* Keep the batch around with a zero count until the last acquired range
+     * pointing into it gets released. */
+    if (destroy && isBatchAcquired(l, batch)) {
+        return;
     }
 
-    return true;
+    batchesDelete(l, slot);
+    if (destroy) {
+        raft_free(batch);
+    }
 }
 
 void logInit(struct raft_log *l)
@@ -339,6 +256,11 @@ void logInit(struct raft_log *l)
     l->offset = 0;
     l->refs = NULL;
     l->refs_size = 0;
+    l->batches = NULL;
+    l->batches_size = 0;
+    l->n_batches = 0;
+    l->bytes = 0;
+    l->evicted = 0;
     l->snapshot.last_index = 0;
     l->snapshot.last_term = 0;
 }
@@ -363,46 +285,40 @@ static struct raft_entry *entryAt(struct raft_log *l, size_t i)
 
 void logClose(struct raft_log *l)
 {
-    void *batch = NULL; /* Last batch that has been freed */
+    size_t i;
 
     assert(l != NULL);
 
+    /* We require that there are no outstanding references to active
+     * entries. */
+    assert(l->refs_size == 0);
+
     if (l->entries != NULL) {
-        size_t i;
         size_t n = logNumEntries(l);
 
+        /* Release the memory used by the entry data, unless it belongs to a
+         * batch. */
         for (i = 0; i < n; i++) {
             struct raft_entry *entry = entryAt(l, i);
-            raft_index index = indexAt(l, i);
-            size_t key = refsKey(index, l->refs_size);
-            struct raft_entry_ref *slot = &l->refs[key];
-
-            /* We require that there are no outstanding references to active
-             * entries. */
-            assert(slot->count == 1);
-
-            /* TODO: we should support the case where the bucket has more than
-             * one slot. */
-            assert(slot->next == NULL);
-
-            /* Release the memory used by the entry data (either directly or via
-             * a batch). */
-            if (entry->batch == NULL) {
-                if (entry->buf.base != NULL) {
-                    raft_free(entry->buf.base);
-                }
-            } else {
-                if (entry->batch != batch) {
-                    /* This batch was not released yet, so let's do it now. */
-                    batch = entry->batch;
-                    raft_free(entry->batch);
-                }
+            if (entry->batch == NULL && entry->buf.base != NULL) {
+                raft_free(entry->buf.base);
             }
         }
 
         raft_free(l->entries);
     }
 
+    /* Release all batches. */
+    for (i = 0; i < l->batches_size; i++) {
+        if (l->batches[i].batch != NULL) {
+            raft_free(l->batches[i].batch);
+        }
+    }
+
+    if (l->batches != NULL) {
+        raft_free(l->batches);
+    }
+
     if (l->refs != NULL) {
         raft_free(l->refs);
     }
@@ -458,7 +374,6 @@ int logAppend(struct raft_log *l,
 {
     int rv;
     struct raft_entry *entry;
-    raft_index index;
 
     assert(l != NULL);
     assert(term > 0);
@@ -470,11 +385,11 @@ int logAppend(struct raft_log *l,
         return rv;
     }
 
-    index = logLastIndex(l) + 1;
-
-    rv = refsInit(l, term, index);
-    if (rv != 0) {
-        return rv;
+    if (batch != NULL) {
+        rv = batchesIncr(l, batch);
+        if (rv != 0) {
+            return rv;
+        }
     }
 
     entry = &l->entries[l->back];
@@ -483,6 +398,10 @@ int logAppend(struct raft_log *l,
     entry->buf = *buf;
     entry->batch = batch;
 
+    if (buf->base != NULL) {
+        l->bytes += buf->len;
+    }
+
     l->back += 1;
     l->back = l->back % l->size;
 
@@ -647,15 +566,32 @@ int logAcquire(struct raft_log *l,
                const raft_index index,
                struct raft_entry *entries[],
                unsigned *n)
+{
+    return logAcquireAtMost(l, index, UINT_MAX, SIZE_MAX, entries, n);
+}
+
+int logAcquireAtMost(struct raft_log *l,
+                     const raft_index index,
+                     const unsigned max_n,
+                     const size_t max_bytes,
+                     struct raft_entry *entries[],
+                     unsigned *n)
 {
     size_t i;
-    size_t j;
+    size_t available;
+    size_t bytes;
+    size_t head;
+    int rv;
 
     assert(l != NULL);
     assert(index > 0);
+    assert(max_n > 0);
     assert(entries != NULL);
     assert(n != NULL);
 
+    /* Evicted payloads must be read from disk instead. */
+    assert(index > l->evicted);
+
     /* Get the array index of the first entry to acquire. */
     i = locateEntry(l, index);
 
@@ -668,48 +604,64 @@ int logAcquire(struct raft_log *l,
     if (i < l->back) {
         /* The last entry does not wrap with respect to i, so the number of
          * entries is simply the length of the range [i...l->back). */
-        *n = l->back - i;
+        available = l->back - i;
     } else {
         /* The last entry wraps with respect to i, so the number of entries is
          * the sum of the lengths of the ranges [i...l->size) and [0...l->back),
          * which is l->size - i + l->back.*/
-        *n = l->size - i + l->back;
+        available = l->size - i + l->back;
     }
 
-    assert(*n > 0);
+    assert(available > 0);
+
+    /* Always include the first entry, even if its payload alone exceeds the
+     * bytes limit, otherwise we'd never make progress. */
+    *n = 1;
+    bytes = l->entries[i].buf.len;
+    while (*n < available && *n < max_n) {
+        size_t len = l->entries[(i + *n) % l->size].buf.len;
+        if (bytes >= max_bytes || len > max_bytes - bytes) {
+            break;
+        }
+        bytes += len;
+        (*n)++;
+    }
 
-    *entries = raft_calloc(*n, sizeof **entries);
+    *entries = raft_malloc(*n * sizeof **entries);
     if (*entries == NULL) {
         return RAFT_NOMEM;
     }
 
-    for (j = 0; j < *n; j++) {
-        size_t k = (i + j) % l->size;
-        struct raft_entry *entry = &(*entries)[j];
-        *entry = l->entries[k];
-        refsIncr(l, entry->term, index + j);
+    /* Copy the entries with at most two bulk copies, one for each side of the
+     * circular buffer's wrap point. Their payloads are not copied: instead the
+     * whole range is registered as acquired, and the payloads of its entries
+     * won't be released until logRelease() is called. */
+    head = *n;
+    if (head > l->size - i) {
+        head = l->size - i;
+    }
+    memcpy(*entries, &l->entries[i], head * sizeof **entries);
+    if (head < *n) {
+        memcpy(*entries + head, l->entries, (*n - head) * sizeof **entries);
+    }
+
+    rv = refsPush(l, index, *entries, *n);
+    if (rv != 0) {
+        raft_free(*entries);
+        return rv;
     }
 
     return 0;
 }
 
-/* Return true if the given batch is referenced by any entry currently in the
- * log. */
-static bool isBatchReferenced(struct raft_log *l, const void *batch)
+/* Return true if the log currently contains the entry with the given index and
+ * term. */
+static bool isInLog(struct raft_log *l,
+                    const raft_index index,
+                    const raft_term term)
 {
-    size_t i;
-
-    /* Iterate through all live entries to see if there's one
-     * belonging to the same batch. This is slightly inefficient but
-     * this code path should be taken very rarely in practice. */
-    for (i = 0; i < logNumEntries(l); i++) {
-        struct raft_entry *entry = entryAt(l, i);
-        if (entry->batch == batch) {
-            return true;
-        }
-    }
-
-    return false;
+    size_t i = locateEntry(l, index);
+    return i != l->size && l->entries[i].term == term;
 }
 
 void logRelease(struct raft_log *l,
@@ -717,40 +669,60 @@ void logRelease(struct raft_log *l,
                 struct raft_entry entries[],
                 const size_t n)
 {
+    struct raft_batch_ref *slot;
     size_t i;
-    void *batch = NULL; /* Last batch whose memory was freed */
 
     assert(l != NULL);
     assert((entries == NULL && n == 0) || (entries != NULL && n > 0));
 
+    if (entries == NULL) {
+        return;
+    }
+
+    refsRemove(l, entries);
+
+    /* In the common case all acquired entries are still in the log, which is
+     * the case if both the first and the last ones are, since entries are
+     * only removed from the front or from the back of the log. */
+    if (isInLog(l, index, entries[0].term) &&
+        isInLog(l, index + n - 1, entries[n - 1].term)) {
+        goto out;
+    }
+
+    /* Some entries were removed from the log while acquired: if there are no
+     * outstanding references left to them, free their payload if they are not
+     * part of a batch, or check if we can free the batch itself. */
     for (i = 0; i < n; i++) {
         struct raft_entry *entry = &entries[i];
-        bool unref;
-
-        unref = refsDecr(l, entry->term, index + i);
-
-        /* If there are no outstanding references to this entry, free its
-         * payload if it's not part of a batch, or check if we can free the
-         * batch itself. */
-        if (unref) {
-            if (entries[i].batch == NULL) {
-                if (entry->buf.base != NULL) {
-                    raft_free(entries[i].buf.base);
-                }
-            } else {
-                if (entry->batch != batch) {
-                    if (!isBatchReferenced(l, entry->batch)) {
-                        batch = entry->batch;
-                        raft_free(batch);
-                    }
-                }
+
+        if (isInLog(l, index + i, entry->term) ||
+            isAcquired(l, index + i, entry->term)) {
+            continue;
+        }
+
+        if (entry->batch == NULL) {
+            if (entry->buf.base != NULL) {
+                raft_free(entry->buf.base);
             }
+            continue;
         }
-    }
 
-    if (entries != NULL) {
-        raft_free(entries);
+        /* If the batch has a zero count, no entry in the log points into it,
+         * and it was kept around only because of acquired ranges. If it's
+         * not in the table at all, it was discarded and we don't own it. */
+        if (l->batches == NULL) {
+            continue;
+        }
+        slot = batchesLookup(l, entry->batch);
+        if (slot->batch == entry->batch && slot->count == 0 &&
+            !isBatchAcquired(l, entry->batch)) {
+            batchesDelete(l, slot);
+            raft_free(entry->batch);
+        }
     }
+
+out:
+    raft_free(entries);
 }
 
 /* Clear the log if it became empty. */
@@ -766,17 +738,28 @@ static void clearIfEmpty(struct raft_log *l)
     l->back = 0;
 }
 
-/* Destroy an entry, possibly releasing the memory of its buffer. */
-static void destroyEntry(struct raft_log *l, struct raft_entry *entry)
+/* Called when an entry with the given index gets deleted from the log. If
+ * @destroy is true, release the memory of its buffer or of its batch, unless
+ * they are still referenced. */
+static void removeEntry(struct raft_log *l,
+                        const raft_index index,
+                        struct raft_entry *entry,
+                        bool destroy)
 {
-    if (entry->batch == NULL) {
-        if (entry->buf.base != NULL) {
-            raft_free(entry->buf.base);
-        }
-    } else {
-        if (!isBatchReferenced(l, entry->batch)) {
-            raft_free(entry->batch);
-        }
+    if (entry->buf.base != NULL) {
+        assert(l->bytes >= entry->buf.len);
+        l->bytes -= entry->buf.len;
+    }
+
+    if (entry->batch != NULL) {
+        batchesDecr(l, entry->batch, destroy);
+        return;
+    }
+
+    /* Acquired entries are destroyed when released. */
+    if (destroy && entry->buf.base != NULL &&
+        !isAcquired(l, index, entry->term)) {
+        raft_free(entry->buf.base);
     }
 }
 
@@ -799,7 +782,6 @@ static void removeSuffix(struct raft_log *l,
 
     for (i = 0; i < n; i++) {
         struct raft_entry *entry;
-        bool unref;
 
         if (l->back == 0) {
             l->back = l->size - 1;
@@ -808,11 +790,7 @@ static void removeSuffix(struct raft_log *l,
         }
 
         entry = &l->entries[l->back];
-        unref = refsDecr(l, entry->term, start + n - i - 1);
-
-        if (unref && destroy) {
-            destroyEntry(l, entry);
-        }
+        removeEntry(l, start + n - i - 1, entry, destroy);
     }
 
     clearIfEmpty(l);
@@ -846,7 +824,6 @@ static void removePrefix(struct raft_log *l, const raft_index index)
 
     for (i = 0; i < n; i++) {
         struct raft_entry *entry;
-        bool unref;
 
         entry = &l->entries[l->front];
 
@@ -857,11 +834,7 @@ static void removePrefix(struct raft_log *l, const raft_index index)
         }
         l->offset++;
 
-        unref = refsDecr(l, entry->term, l->offset);
-
-        if (unref) {
-            destroyEntry(l, entry);
-        }
+        removeEntry(l, l->offset, entry, true);
     }
 
     clearIfEmpty(l);
@@ -887,6 +860,66 @@ void logSnapshot(struct raft_log *l, raft_index last_index, unsigned trailing)
     removePrefix(l, last_index - trailing);
 }
 
+/* Release the payload of the given entry, keeping its metadata. */
+static void evictEntry(struct raft_log *l, struct raft_entry *entry)
+{
+    if (entry->buf.base != NULL) {
+        assert(l->bytes >= entry->buf.len);
+        l->bytes -= entry->buf.len;
+    }
+
+    if (entry->batch != NULL) {
+        batchesDecr(l, entry->batch, true);
+    } else if (entry->buf.base != NULL) {
+        raft_free(entry->buf.base);
+    }
+
+    entry->buf.base = NULL;
+    entry->batch = NULL;
+}
+
+void logEvict(struct raft_log *l,
+              const raft_index index,
+              const size_t max_bytes)
+{
+    raft_index next = l->evicted + 1;
+
+    assert(l != NULL);
+
+    if (next <= l->offset) {
+        next = l->offset + 1;
+    }
+
+    while (l->bytes > max_bytes && next <= index) {
+        size_t i = locateEntry(l, next);
+        struct raft_entry *entry;
+
+        if (i == l->size) {
+            break;
+        }
+        entry = &l->entries[i];
+
+        /* Configuration entries are needed to roll back uncommitted
+         * configurations, and they are rare enough to be always kept. */
+        if (entry->type != RAFT_CHANGE) {
+            /* The payloads of acquired entries are being used by some I/O
+             * request, stop here and resume once it's released. */
+            if (isAcquired(l, next, entry->term)) {
+                break;
+            }
+            evictEntry(l, entry);
+        }
+
+        l->evicted = next;
+        next++;
+    }
+}
+
+raft_index logEvictedIndex(struct raft_log *l)
+{
+    return l->evicted;
+}
+
 void logRestore(struct raft_log *l, raft_index last_index, raft_term last_term)
 {
     size_t n = logNumEntries(l);
@@ -898,6 +931,7 @@ void logRestore(struct raft_log *l, raft_index last_index, raft_term last_term)
     l->snapshot.last_index = last_index;
     l->snapshot.last_term = last_term;
     l->offset = last_index;
+    l->evicted = 0;
 }
 
 void logSeek(struct raft_log *l, raft_index start_index)
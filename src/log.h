@@ -5,8 +5,8 @@
 
 #include "../include/raft.h"
 
-/* Initial size of the entry reference count hash table. */
-#define LOG__REFS_INITIAL_SIZE 256
+/* Initial size of the batch reference count hash table. */
+#define LOG__BATCHES_INITIAL_SIZE 16
 
 /* Initialize an empty in-memory log of raft entries. */
 void logInit(struct raft_log *l);
@@ -58,18 +58,46 @@ int logAppendConfiguration(struct raft_log *l,
 
 /* Acquire an array of entries from the given index onwards. * The payload
  * memory referenced by the @buf attribute of the returned entries is guaranteed
- * to be valid until logRelease() is called. */
+ * to be valid until logRelease() is called.
+ *
+ * The payloads are not copied, and the cost of acquiring and releasing entries
+ * does not depend on their number, except for copying the array of entries
+ * itself and for the rare case of entries deleted from the log in-between. */
 int logAcquire(struct raft_log *l,
                const raft_index index,
                struct raft_entry *entries[],
                unsigned *n);
 
+/* Like logAcquire(), but acquire at most @max_n entries and stop before the
+ * total size of their payloads exceeds @max_bytes. The first entry is always
+ * acquired, regardless of its size. */
+int logAcquireAtMost(struct raft_log *l,
+                     const raft_index index,
+                     const unsigned max_n,
+                     const size_t max_bytes,
+                     struct raft_entry *entries[],
+                     unsigned *n);
+
 /* Release a previously acquired array of entries. */
 void logRelease(struct raft_log *l,
                 const raft_index index,
                 struct raft_entry entries[],
                 const size_t n);
 
+/* Release the payloads of the oldest entries up to the given index (included),
+ * until the total size of the payloads held in memory is at most @max_bytes.
+ * The metadata of the entries is kept, so their terms can still be looked up.
+ * The payloads of configuration entries are never released, and eviction stops
+ * at the first entry which is currently acquired. */
+void logEvict(struct raft_log *l,
+              const raft_index index,
+              const size_t max_bytes);
+
+/* Return the index of the last entry whose payload was released by
+ * logEvict(), or 0 if none was. The payloads of all entries up to this index
+ * are not in memory anymore, except for configuration entries. */
+raft_index logEvictedIndex(struct raft_log *l);
+
 /* Delete all entries from the given index (included) onwards. If the log is *
  * empty this is a no-op. If @index is lower than or equal to the index of the
  * first entry in the log, then the log will become empty. */
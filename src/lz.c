@@ -0,0 +1,227 @@
+#include "lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* Minimum length of a match. */
+#define MIN_MATCH 4
+
+/* Maximum distance between a match and the data it refers to. */
+#define MAX_OFFSET 65535
+
+/* Number of bits of the hash of 4-byte sequences. */
+#define HASH_BITS 12
+
+/* Value of a token nibble meaning that the length continues. */
+#define RUN_MASK 15
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof value);
+    return value;
+}
+
+static unsigned hash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/* Write the continuation bytes of a length that doesn't fit in a token
+ * nibble. Return false if there's no room left. */
+static bool putLength(uint8_t **op, const uint8_t *oend, size_t len)
+{
+    len -= RUN_MASK;
+    while (len >= 255) {
+        if (*op == oend) {
+            return false;
+        }
+        *(*op)++ = 255;
+        len -= 255;
+    }
+    if (*op == oend) {
+        return false;
+    }
+    *(*op)++ = (uint8_t)len;
+    return true;
+}
+
+/* Read the continuation bytes of a length. Return false if the input ends
+ * prematurely. */
+static bool getLength(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+    uint8_t byte;
+    do {
+        if (*ip == iend) {
+            return false;
+        }
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/* Write a sequence with the given literals and match. A match length of zero
+ * means that this is the last sequence, which has no match. */
+static bool putSequence(uint8_t **op,
+                        const uint8_t *oend,
+                        const uint8_t *literals,
+                        size_t n_literals,
+                        size_t offset,
+                        size_t match_len)
+{
+    uint8_t *token;
+    size_t match_code = match_len > 0 ? match_len - MIN_MATCH : 0;
+
+    if (*op == oend) {
+        return false;
+    }
+    token = (*op)++;
+    *token = (uint8_t)((n_literals < RUN_MASK ? n_literals : RUN_MASK) << 4);
+    *token |= (uint8_t)(match_code < RUN_MASK ? match_code : RUN_MASK);
+
+    if (n_literals >= RUN_MASK && !putLength(op, oend, n_literals)) {
+        return false;
+    }
+    if ((size_t)(oend - *op) < n_literals) {
+        return false;
+    }
+    memcpy(*op, literals, n_literals);
+    *op += n_literals;
+
+    if (match_len == 0) {
+        return true;
+    }
+
+    if (oend - *op < 2) {
+        return false;
+    }
+    *(*op)++ = (uint8_t)(offset & 0xff);
+    *(*op)++ = (uint8_t)(offset >> 8);
+
+    if (match_code >= RUN_MASK && !putLength(op, oend, match_code)) {
+        return false;
+    }
+
+    return true;
+}
+
+size_t lzCompressBound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+size_t lzCompress(const void *src, size_t len, void *dst, size_t cap)
+{
+    const uint8_t *in = src;
+    const uint8_t *end = in + len;
+    const uint8_t *ip = in;
+    const uint8_t *anchor = in;
+    uint8_t *op = dst;
+    uint8_t *oend = op + cap;
+    uint32_t table[1 << HASH_BITS];
+
+    memset(table, 0, sizeof table);
+
+    while (len >= MIN_MATCH && ip <= end - MIN_MATCH) {
+        unsigned h = hash(read32(ip));
+        const uint8_t *ref = in + table[h];
+        size_t match_len;
+
+        table[h] = (uint32_t)(ip - in);
+
+        if (ref >= ip || ip - ref > MAX_OFFSET || read32(ref) != read32(ip)) {
+            ip++;
+            continue;
+        }
+
+        match_len = MIN_MATCH;
+        while (ip + match_len < end && ref[match_len] == ip[match_len]) {
+            match_len++;
+        }
+
+        if (!putSequence(&op, oend, anchor, (size_t)(ip - anchor),
+                         (size_t)(ip - ref), match_len)) {
+            return 0;
+        }
+
+        ip += match_len;
+        anchor = ip;
+    }
+
+    if (!putSequence(&op, oend, anchor, (size_t)(end - anchor), 0, 0)) {
+        return 0;
+    }
+
+    return (size_t)(op - (uint8_t *)dst);
+}
+
+int lzDecompress(const void *src, size_t len, void *dst, size_t dst_len)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = ip + len;
+    uint8_t *op = dst;
+    uint8_t *oend = op + dst_len;
+
+    for (;;) {
+        uint8_t token;
+        size_t n_literals;
+        size_t match_len;
+        size_t offset;
+        const uint8_t *ref;
+
+        if (ip == iend) {
+            return RAFT_CORRUPT;
+        }
+        token = *ip++;
+
+        n_literals = token >> 4;
+        if (n_literals == RUN_MASK && !getLength(&ip, iend, &n_literals)) {
+            return RAFT_CORRUPT;
+        }
+        if ((size_t)(iend - ip) < n_literals ||
+            (size_t)(oend - op) < n_literals) {
+            return RAFT_CORRUPT;
+        }
+        memcpy(op, ip, n_literals);
+        ip += n_literals;
+        op += n_literals;
+
+        /* The last sequence has no match. */
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return RAFT_CORRUPT;
+        }
+        offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (uint8_t *)dst)) {
+            return RAFT_CORRUPT;
+        }
+
+        match_len = token & RUN_MASK;
+        if (match_len == RUN_MASK && !getLength(&ip, iend, &match_len)) {
+            return RAFT_CORRUPT;
+        }
+        match_len += MIN_MATCH;
+        if ((size_t)(oend - op) < match_len) {
+            return RAFT_CORRUPT;
+        }
+
+        /* The match might overlap with the output being written, so copy one
+         * byte at a time. */
+        ref = op - offset;
+        while (match_len > 0) {
+            *op++ = *ref++;
+            match_len--;
+        }
+    }
+
+    if (op != oend) {
+        return RAFT_CORRUPT;
+    }
+
+    return 0;
+}
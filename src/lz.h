@@ -0,0 +1,38 @@
+/* Self-contained LZ77 block compression codec.
+ *
+ * A compressed block is a sequence of sequences, each one made of:
+ *
+ * [1 byte ] Token: number of literals in the upper 4 bits, match length minus
+ *           the minimum match length in the lower 4 bits. A value of 15 means
+ *           that the length continues in the following bytes.
+ * [  ...  ] Literal length continuation: bytes added to 15 until one is lower
+ *           than 255.
+ * [  ...  ] Literals, copied as they are.
+ * [2 bytes] Match offset, little endian: distance between the current output
+ *           position and the start of the match.
+ * [  ...  ] Match length continuation, same as for literals.
+ *
+ * The last sequence carries only literals, and ends the block. */
+
+#ifndef LZ_H_
+#define LZ_H_
+
+#include "../include/raft.h"
+
+/* Return the maximum size of the compressed version of @len bytes. */
+size_t lzCompressBound(size_t len);
+
+/* Compress @len bytes from @src into @dst, which has room for @cap bytes.
+ *
+ * Return the size of the compressed data, or 0 if it doesn't fit in @cap
+ * bytes. When @cap is at least lzCompressBound(len) this never fails. */
+size_t lzCompress(const void *src, size_t len, void *dst, size_t cap);
+
+/* Decompress the @len bytes of compressed data at @src into @dst, which must
+ * hold exactly @dst_len bytes of decompressed data.
+ *
+ * Return #RAFT_CORRUPT if the compressed data is malformed or doesn't
+ * decompress to exactly @dst_len bytes. */
+int lzDecompress(const void *src, size_t len, void *dst, size_t dst_len);
+
+#endif /* LZ_H_ */
@@ -10,7 +10,7 @@ int membershipCanChangeConfiguration(struct raft *r)
 {
     int rv;
 
-    if (r->state != RAFT_LEADER) {
+    if (r->state != RAFT_LEADER || r->leader_state.transfer != NULL) {
         rv = RAFT_NOTLEADER;
         return rv;
     }
@@ -6,8 +6,8 @@
 #include "../include/raft.h"
 
 /* Helper returning an error if the configuration can't be changed, either
- * because this node is not the leader or because a configuration change is
- * already in progress. */
+ * because this node is not the leader (or is transferring leadership) or
+ * because a configuration change is already in progress. */
 int membershipCanChangeConfiguration(struct raft *r);
 
 /* Update the information about the progress that the non-voting server
@@ -19,15 +19,49 @@
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #endif
 
+/* Forget about all in-flight AppendEntries messages. */
+static void resetInflight(struct raft_progress *p)
+{
+    p->inflight.front = 0;
+    p->inflight.n = 0;
+    p->inflight.bytes = 0;
+}
+
 /* Initialize a single progress object. */
 static void initProgress(struct raft_progress *p, raft_index last_index)
 {
     p->next_index = last_index + 1;
     p->match_index = 0;
     p->snapshot_index = 0;
+    p->resume_index = 0;
+    p->resume_offset = 0;
     p->last_send = 0;
     p->recent_recv = false;
+    p->n_sent = 0;
+    p->n_recv = 0;
+    p->n_mark = 0;
+    p->fetching = false;
     p->state = PROGRESS__PROBE;
+    resetInflight(p);
+}
+
+/* Release all in-flight messages whose entries have all been acknowledged,
+ * i.e. whose last index is not greater than the given one. */
+static void freeInflight(struct raft_progress *p, raft_index last_index)
+{
+    while (p->inflight.n > 0) {
+        unsigned k = p->inflight.front;
+        if (p->inflight.last_index[k] > last_index) {
+            break;
+        }
+        assert(p->inflight.bytes >= p->inflight.size[k]);
+        p->inflight.bytes -= p->inflight.size[k];
+        p->inflight.front = (k + 1) % RAFT__MAX_INFLIGHT;
+        p->inflight.n--;
+    }
+    if (p->inflight.n == 0) {
+        resetInflight(p);
+    }
 }
 
 int progressBuildArray(struct raft *r)
@@ -114,6 +148,12 @@ bool progressShouldReplicate(struct raft *r, unsigned i)
      * log. */
     assert(p->next_index <= last_index + 1);
 
+    /* If the entries to send are being read from disk, wait for them, see
+     * progressShouldHeartbeat(). */
+    if (p->fetching) {
+        return false;
+    }
+
     switch (p->state) {
         case PROGRESS__SNAPSHOT:
             /* If we have already sent a snapshot, don't send any further entry
@@ -127,6 +167,14 @@ bool progressShouldReplicate(struct raft *r, unsigned i)
             result = needs_heartbeat;
             break;
         case PROGRESS__PIPELINE:
+            /* If the in-flight window is full, we stop sending entries until
+             * some messages get acknowledged, see progressShouldHeartbeat().
+             * Lost messages are detected when the follower rejects the next
+             * heartbeat, which moves it back to probe mode. */
+            if (progressInflightFull(r, i)) {
+                result = false;
+                break;
+            }
             /* In replication mode we send empty append entries messages only if
              * haven't sent anything in the last heartbeat interval. */
             result = !is_up_to_date || needs_heartbeat;
@@ -135,6 +183,22 @@ bool progressShouldReplicate(struct raft *r, unsigned i)
     return result;
 }
 
+bool progressShouldHeartbeat(struct raft *r, unsigned i)
+{
+    struct raft_progress *p = &r->leader_state.progress[i];
+    raft_time now = r->io->time(r->io);
+
+    if (now - p->last_send < r->heartbeat_timeout) {
+        return false;
+    }
+
+    if (p->fetching) {
+        return true;
+    }
+
+    return p->state == PROGRESS__PIPELINE && progressInflightFull(r, i);
+}
+
 raft_index progressNextIndex(struct raft *r, unsigned i)
 {
     return r->leader_state.progress[i].next_index;
@@ -160,6 +224,39 @@ bool progressResetRecentRecv(struct raft *r, const unsigned i)
 void progressMarkRecentRecv(struct raft *r, const unsigned i)
 {
     r->leader_state.progress[i].recent_recv = true;
+    r->leader_state.progress[i].n_recv++;
+}
+
+void progressRecordSend(struct raft *r, const unsigned i)
+{
+    r->leader_state.progress[i].n_sent++;
+}
+
+unsigned long long progressNumSent(struct raft *r, const unsigned i)
+{
+    return r->leader_state.progress[i].n_sent;
+}
+
+void progressReadMark(struct raft *r, const unsigned i)
+{
+    struct raft_progress *p = &r->leader_state.progress[i];
+    p->n_mark = p->n_sent;
+}
+
+bool progressReadAcked(struct raft *r, const unsigned i)
+{
+    struct raft_progress *p = &r->leader_state.progress[i];
+    return p->n_recv > p->n_mark;
+}
+
+void progressSetFetching(struct raft *r, const unsigned i, bool fetching)
+{
+    r->leader_state.progress[i].fetching = fetching;
+}
+
+bool progressIsFetching(struct raft *r, const unsigned i)
+{
+    return r->leader_state.progress[i].fetching;
 }
 
 void progressToSnapshot(struct raft *r, unsigned i)
@@ -167,6 +264,7 @@ void progressToSnapshot(struct raft *r, unsigned i)
     struct raft_progress *p = &r->leader_state.progress[i];
     p->state = PROGRESS__SNAPSHOT;
     p->snapshot_index = logSnapshotIndex(&r->log);
+    resetInflight(p);
 }
 
 void progressAbortSnapshot(struct raft *r, const unsigned i)
@@ -176,6 +274,28 @@ void progressAbortSnapshot(struct raft *r, const unsigned i)
     p->state = PROGRESS__PROBE;
 }
 
+void progressPauseSnapshot(struct raft *r,
+                           const unsigned i,
+                           raft_index index,
+                           size_t offset)
+{
+    struct raft_progress *p = &r->leader_state.progress[i];
+    p->resume_index = index;
+    p->resume_offset = offset;
+    progressAbortSnapshot(r, i);
+}
+
+size_t progressResumeOffset(struct raft *r,
+                            const unsigned i,
+                            raft_index index)
+{
+    struct raft_progress *p = &r->leader_state.progress[i];
+    if (p->resume_index != index) {
+        return 0;
+    }
+    return p->resume_offset;
+}
+
 int progressState(struct raft *r, const unsigned i)
 {
     struct raft_progress *p = &r->leader_state.progress[i];
@@ -198,6 +318,10 @@ bool progressMaybeDecrement(struct raft *r,
         if (rejected != p->snapshot_index) {
             return false;
         }
+        /* The follower might have discarded the chunks it received, start
+         * over next time. */
+        p->resume_index = 0;
+        p->resume_offset = 0;
         progressAbortSnapshot(r, i);
         return true;
     }
@@ -241,6 +365,7 @@ bool progressMaybeUpdate(struct raft *r, unsigned i, raft_index last_index)
 {
     struct raft_progress *p = &r->leader_state.progress[i];
     bool updated = false;
+    freeInflight(p, last_index);
     if (p->match_index < last_index) {
         p->match_index = last_index;
         updated = true;
@@ -270,6 +395,7 @@ void progressToProbe(struct raft *r, const unsigned i)
         p->next_index = p->match_index + 1;
     }
     p->state = PROGRESS__PROBE;
+    resetInflight(p);
 }
 
 void progressToPipeline(struct raft *r, const unsigned i)
@@ -284,3 +410,27 @@ bool progressSnapshotDone(struct raft *r, const unsigned i)
     assert(p->state == PROGRESS__SNAPSHOT);
     return p->match_index >= p->snapshot_index;
 }
+
+void progressInflightAdd(struct raft *r,
+                         unsigned i,
+                         raft_index last_index,
+                         size_t size)
+{
+    struct raft_progress *p = &r->leader_state.progress[i];
+    unsigned k;
+    assert(p->state == PROGRESS__PIPELINE);
+    assert(p->inflight.n < RAFT__MAX_INFLIGHT);
+    k = (p->inflight.front + p->inflight.n) % RAFT__MAX_INFLIGHT;
+    p->inflight.last_index[k] = last_index;
+    p->inflight.size[k] = size;
+    p->inflight.n++;
+    p->inflight.bytes += size;
+}
+
+bool progressInflightFull(struct raft *r, unsigned i)
+{
+    struct raft_progress *p = &r->leader_state.progress[i];
+    return p->inflight.n >= r->max_inflight ||
+           p->inflight.n >= RAFT__MAX_INFLIGHT ||
+           p->inflight.bytes >= r->max_inflight_bytes;
+}
@@ -34,6 +34,12 @@ int progressRebuildArray(struct raft *r,
  * is taken. */
 bool progressShouldReplicate(struct raft *r, unsigned i);
 
+/* Whether an empty AppendEntries message should be sent to the i'th server at
+ * this time, because no entry can be sent to it right now but nothing was sent
+ * to it for a whole heartbeat interval. This is the case when its in-flight
+ * window is full, or when the entries to send are being read from disk. */
+bool progressShouldHeartbeat(struct raft *r, unsigned i);
+
 /* Return the index of the next entry that should be sent to the i'th server. */
 raft_index progressNextIndex(struct raft *r, unsigned i);
 
@@ -51,11 +57,37 @@ void progressUpdateLastSend(struct raft *r, unsigned i);
  * To be called once every election_timeout milliseconds. */
 bool progressResetRecentRecv(struct raft *r, unsigned i);
 
-/* Set to true the recent_recv flag of the server at the given index.
+/* Set to true the recent_recv flag of the server at the given index, and count
+ * the result received.
  *
  * To be called whenever we receive an AppendEntries RPC result */
 void progressMarkRecentRecv(struct raft *r, unsigned i);
 
+/* Count an AppendEntries or InstallSnapshot message sent to the i'th server.
+ * Each such message is answered by at most one result. */
+void progressRecordSend(struct raft *r, unsigned i);
+
+/* Return the number of messages sent to the i'th server so far. */
+unsigned long long progressNumSent(struct raft *r, unsigned i);
+
+/* Remember how many messages were sent to the i'th server so far. To be called
+ * when a new round of leadership confirmation for read requests starts. */
+void progressReadMark(struct raft *r, unsigned i);
+
+/* Return true if the i'th server has answered at least one message sent after
+ * the last call to progressReadMark(). Since every message gets at most one
+ * result, this is the case if more results were received than messages sent
+ * before the mark. */
+bool progressReadAcked(struct raft *r, unsigned i);
+
+/* Set whether the entries to send to the i'th server are being read from disk.
+ * While they are, only heartbeats are sent to it. */
+void progressSetFetching(struct raft *r, unsigned i, bool fetching);
+
+/* Return true if entries to send to the i'th server are being read from
+ * disk. */
+bool progressIsFetching(struct raft *r, unsigned i);
+
 /* Convert to the i'th server to snapshot mode. */
 void progressToSnapshot(struct raft *r, unsigned i);
 
@@ -70,6 +102,18 @@ void progressToPipeline(struct raft *r, unsigned i);
  * Called after sending the snapshot has failed or timed out. */
 void progressAbortSnapshot(struct raft *r, unsigned i);
 
+/* Like progressAbortSnapshot(), but remember that the first @offset bytes of
+ * the snapshot with the given last index were sent successfully, so the next
+ * attempt to send the same snapshot can resume from there. */
+void progressPauseSnapshot(struct raft *r,
+                           unsigned i,
+                           raft_index index,
+                           size_t offset);
+
+/* Return the offset to resume sending the snapshot with the given last index
+ * from, or 0 if it must be sent from the beginning. */
+size_t progressResumeOffset(struct raft *r, unsigned i, raft_index index);
+
 /* Return the progress mode code for the i'th server. */
 int progressState(struct raft *r, unsigned i);
 
@@ -94,6 +138,20 @@ bool progressMaybeDecrement(struct raft *r,
                             raft_index rejected,
                             raft_index last_index);
 
+/* Record an AppendEntries message sent in pipeline mode to the i'th server,
+ * containing entries up to @last_index with a total payload of @size bytes. The
+ * message is considered in flight until the server acknowledges its last
+ * entry. */
+void progressInflightAdd(struct raft *r,
+                         unsigned i,
+                         raft_index last_index,
+                         size_t size);
+
+/* Return true if the number or total size of AppendEntries messages in flight
+ * towards the i'th server has reached the configured limit, in which case no
+ * new entries should be sent until some messages are acknowledged. */
+bool progressInflightFull(struct raft *r, unsigned i);
+
 /* Return true if match_index is equal or higher than the snapshot_index. */
 bool progressSnapshotDone(struct raft *r, unsigned i);
 
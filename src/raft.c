@@ -13,6 +13,12 @@
 #define DEFAULT_HEARTBEAT_TIMEOUT 100 /* One tenth of a second */
 #define DEFAULT_SNAPSHOT_THRESHOLD 1024
 #define DEFAULT_SNAPSHOT_TRAILING 2048
+#define DEFAULT_SNAPSHOT_CHUNK_SIZE (1024 * 1024) /* One megabyte */
+#define DEFAULT_MAX_APPEND_ENTRIES 1024
+#define DEFAULT_MAX_APPEND_BYTES (1024 * 1024) /* One megabyte */
+#define DEFAULT_MAX_INFLIGHT RAFT__MAX_INFLIGHT
+#define DEFAULT_MAX_INFLIGHT_BYTES (16 * 1024 * 1024) /* 16 megabytes */
+#define DEFAULT_MAX_CLOCK_DRIFT 10 /* Percent of the election timeout */
 
 /* Set to 1 to enable tracing. */
 #if 0
@@ -51,6 +57,15 @@ int raft_init(struct raft *r,
     r->configuration_uncommitted_index = 0;
     r->election_timeout = DEFAULT_ELECTION_TIMEOUT;
     r->heartbeat_timeout = DEFAULT_HEARTBEAT_TIMEOUT;
+    r->max_append_entries = DEFAULT_MAX_APPEND_ENTRIES;
+    r->max_append_bytes = DEFAULT_MAX_APPEND_BYTES;
+    r->max_inflight = DEFAULT_MAX_INFLIGHT;
+    r->max_inflight_bytes = DEFAULT_MAX_INFLIGHT_BYTES;
+    r->max_log_bytes = 0;
+    r->apply.async = false;
+    r->apply.work = NULL;
+    r->lease.enabled = false;
+    r->lease.max_clock_drift = DEFAULT_MAX_CLOCK_DRIFT;
     r->commit_index = 0;
     r->last_applied = 0;
     r->last_stored = 0;
@@ -59,6 +74,13 @@ int raft_init(struct raft *r,
     r->snapshot.threshold = DEFAULT_SNAPSHOT_THRESHOLD;
     r->snapshot.trailing = DEFAULT_SNAPSHOT_TRAILING;
     r->snapshot.put.data = NULL;
+    r->snapshot.take = NULL;
+    r->snapshot.chunk_size = DEFAULT_SNAPSHOT_CHUNK_SIZE;
+    r->snapshot.incoming.index = 0;
+    r->snapshot.incoming.term = 0;
+    r->snapshot.incoming.data.base = NULL;
+    r->snapshot.incoming.data.len = 0;
+    r->snapshot.incoming.cap = 0;
     r->close_cb = NULL;
     rv = r->io->init(r->io, r->logger, r->id, r->address);
     if (rv != 0) {
@@ -73,6 +95,7 @@ static void io_close_cb(struct raft_io *io)
     infof(r, "stopped");
 
     raft_free(r->address);
+    raft_free(r->snapshot.incoming.data.base);
     logClose(&r->log);
     raft_configuration_close(&r->configuration);
 
@@ -88,6 +111,14 @@ void raft_close(struct raft *r, void (*cb)(struct raft *r))
     if (r->state != RAFT_UNAVAILABLE) {
         convertToUnavailable(r);
     }
+    /* If the FSM is still taking a snapshot, detach the request, which will be
+     * released by its callback. */
+    if (r->snapshot.take != NULL) {
+        r->snapshot.take->data = NULL;
+        r->snapshot.take = NULL;
+        raft_configuration_close(&r->snapshot.pending.configuration);
+        r->snapshot.pending.term = 0;
+    }
     r->close_cb = cb;
     r->io->close(r->io, io_close_cb);
 }
@@ -102,6 +133,50 @@ void raft_set_heartbeat_timeout(struct raft *r, const unsigned msecs)
     r->heartbeat_timeout = msecs;
 }
 
+void raft_set_max_append_entries(struct raft *r, unsigned n)
+{
+    assert(n > 0);
+    r->max_append_entries = n;
+}
+
+void raft_set_max_append_bytes(struct raft *r, size_t n)
+{
+    r->max_append_bytes = n;
+}
+
+void raft_set_max_inflight(struct raft *r, unsigned n)
+{
+    assert(n > 0);
+    assert(n <= RAFT__MAX_INFLIGHT);
+    r->max_inflight = n;
+}
+
+void raft_set_max_inflight_bytes(struct raft *r, size_t n)
+{
+    r->max_inflight_bytes = n;
+}
+
+void raft_set_max_log_bytes(struct raft *r, size_t n)
+{
+    r->max_log_bytes = n;
+}
+
+void raft_set_async_apply(struct raft *r, bool enabled)
+{
+    r->apply.async = enabled;
+}
+
+void raft_set_lease(struct raft *r, bool enabled)
+{
+    r->lease.enabled = enabled;
+}
+
+void raft_set_max_clock_drift(struct raft *r, unsigned percent)
+{
+    assert(percent < 100);
+    r->lease.max_clock_drift = percent;
+}
+
 void raft_set_snapshot_threshold(struct raft *r, unsigned n)
 {
     r->snapshot.threshold = n;
@@ -112,6 +187,12 @@ void raft_set_snapshot_trailing(struct raft *r, unsigned n)
     r->snapshot.trailing = n;
 }
 
+void raft_set_snapshot_chunk_size(struct raft *r, size_t n)
+{
+    assert(n > 0);
+    r->snapshot.chunk_size = n;
+}
+
 int raft_bootstrap(struct raft *r, const struct raft_configuration *conf)
 {
     int rv;
@@ -0,0 +1,205 @@
+#include "read.h"
+#include "assert.h"
+#include "configuration.h"
+#include "progress.h"
+#include "queue.h"
+#include "replication.h"
+
+/* Set to 1 to enable tracing. */
+#if 0
+#define tracef(MSG, ...) debugf(r, "read: " MSG, ##__VA_ARGS__)
+#else
+#define tracef(MSG, ...)
+#endif
+
+void readInit(struct raft *r)
+{
+    QUEUE_INIT(&r->leader_state.reads);
+    r->leader_state.read_round = 0;
+    r->leader_state.read_acked = 0;
+    r->leader_state.read_start = 0;
+    r->leader_state.lease_start = 0;
+    r->leader_state.lease_revoked = false;
+}
+
+/* Return true if a round of leadership confirmation is in progress. */
+static bool roundInProgress(struct raft *r)
+{
+    return r->leader_state.read_round > r->leader_state.read_acked;
+}
+
+/* Start a new round of leadership confirmation. Any message sent to a
+ * follower from now on can acknowledge it. */
+static void beginRound(struct raft *r)
+{
+    unsigned i;
+
+    assert(!roundInProgress(r));
+
+    r->leader_state.read_round++;
+    r->leader_state.read_start = r->io->time(r->io);
+    tracef("start round %llu", r->leader_state.read_round);
+
+    for (i = 0; i < r->configuration.n; i++) {
+        progressReadMark(r, i);
+    }
+}
+
+/* Start a new round of leadership confirmation, sending a heartbeat to all
+ * followers right away. */
+static void startRound(struct raft *r)
+{
+    beginRound(r);
+    replicationConfirmLeadership(r);
+}
+
+/* Return true if a majority of voting servers acknowledged us as leader since
+ * the current round started. */
+static bool roundAcked(struct raft *r)
+{
+    unsigned i;
+    unsigned acks = 0;
+
+    for (i = 0; i < r->configuration.n; i++) {
+        struct raft_server *server = &r->configuration.servers[i];
+        if (!server->voting) {
+            continue;
+        }
+        if (server->id == r->id || progressReadAcked(r, i)) {
+            acks++;
+        }
+    }
+
+    return acks > configurationNumVoting(&r->configuration) / 2;
+}
+
+void readEnqueue(struct raft *r, struct raft_read_index *req)
+{
+    assert(r->state == RAFT_LEADER);
+
+    if (roundInProgress(r)) {
+        req->round = r->leader_state.read_round + 1;
+    } else {
+        startRound(r);
+        req->round = r->leader_state.read_round;
+    }
+
+    QUEUE_PUSH(&r->leader_state.reads, &req->queue);
+}
+
+void readMaybeComplete(struct raft *r)
+{
+    queue ready;
+    queue *head;
+    bool waiting = false; /* Whether a request waits for a new round. */
+
+    if (r->state != RAFT_LEADER) {
+        return;
+    }
+
+    if (roundInProgress(r) && roundAcked(r)) {
+        r->leader_state.read_acked = r->leader_state.read_round;
+        r->leader_state.lease_start = r->leader_state.read_start;
+        tracef("round %llu confirmed", r->leader_state.read_acked);
+    }
+
+    /* Collect the requests that can be completed. The others stay queued. */
+    QUEUE_INIT(&ready);
+    head = QUEUE_HEAD(&r->leader_state.reads);
+    while (head != &r->leader_state.reads) {
+        struct raft_read_index *req;
+        queue *next = QUEUE_NEXT(head);
+        req = QUEUE_DATA(head, struct raft_read_index, queue);
+        if (req->round > r->leader_state.read_acked) {
+            waiting = true;
+        } else if (req->index <= r->last_applied) {
+            QUEUE_REMOVE(head);
+            QUEUE_PUSH(&ready, head);
+        }
+        head = next;
+    }
+
+    if (waiting && !roundInProgress(r)) {
+        startRound(r);
+    }
+
+    /* Fire the callbacks last, since they might submit new requests or even
+     * make us step down. */
+    while (!QUEUE_IS_EMPTY(&ready)) {
+        struct raft_read_index *req;
+        head = QUEUE_HEAD(&ready);
+        QUEUE_REMOVE(head);
+        req = QUEUE_DATA(head, struct raft_read_index, queue);
+        if (req->cb != NULL) {
+            req->cb(req, 0);
+        }
+    }
+}
+
+void readRenewLease(struct raft *r)
+{
+    assert(r->state == RAFT_LEADER);
+
+    if (!r->lease.enabled || roundInProgress(r)) {
+        return;
+    }
+
+    beginRound(r);
+}
+
+bool readLeaseValid(struct raft *r)
+{
+    raft_time now;
+    raft_time duration;
+
+    if (r->state != RAFT_LEADER || !r->lease.enabled) {
+        return false;
+    }
+
+    /* No round was acknowledged yet in this term, or we started transferring
+     * leadership. */
+    if (r->leader_state.read_acked == 0 || r->leader_state.lease_revoked) {
+        return false;
+    }
+
+    /* Followers don't grant votes for at least an election timeout after
+     * receiving a message from us, and they received the messages of the last
+     * acknowledged round after it started. Account for clocks running at
+     * different rates. */
+    duration = r->election_timeout -
+               r->election_timeout * r->lease.max_clock_drift / 100;
+    now = r->io->time(r->io);
+
+    return now < r->leader_state.lease_start + duration;
+}
+
+void readRevokeLease(struct raft *r)
+{
+    assert(r->state == RAFT_LEADER);
+    r->leader_state.lease_revoked = true;
+}
+
+void readFailAll(struct raft *r, int status)
+{
+    queue reads;
+
+    /* Detach all requests first, so callbacks can't add new ones to the list
+     * being drained. */
+    QUEUE_INIT(&reads);
+    while (!QUEUE_IS_EMPTY(&r->leader_state.reads)) {
+        queue *head = QUEUE_HEAD(&r->leader_state.reads);
+        QUEUE_REMOVE(head);
+        QUEUE_PUSH(&reads, head);
+    }
+
+    while (!QUEUE_IS_EMPTY(&reads)) {
+        struct raft_read_index *req;
+        queue *head;
+        head = QUEUE_HEAD(&reads);
+        QUEUE_REMOVE(head);
+        req = QUEUE_DATA(head, struct raft_read_index, queue);
+        if (req->cb != NULL) {
+            req->cb(req, status);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+/* Linearizable reads using the ReadIndex algorithm and leader leases. */
+
+#ifndef READ_H_
+#define READ_H_
+
+#include "../include/raft.h"
+
+/* Initialize the leader state used to track read requests. */
+void readInit(struct raft *r);
+
+/* Add a new read request whose index has already been set, starting a new
+ * round of leadership confirmation if none is in progress. If a round is in
+ * progress, the request waits for the next one, since the heartbeats of the
+ * current round might have been sent before the request was submitted. */
+void readEnqueue(struct raft *r, struct raft_read_index *req);
+
+/* Check whether a majority of voting servers acknowledged the current round of
+ * leadership confirmation, and fire the callbacks of the read requests whose
+ * round was confirmed and whose index was applied to the FSM. Start a new round
+ * if some request is waiting for it.
+ *
+ * To be called after receiving AppendEntries results, after applying entries
+ * and at every tick. It's a no-op if we are not leader. */
+void readMaybeComplete(struct raft *r);
+
+/* If leases are enabled and no round of leadership confirmation is in
+ * progress, start a new one, which will be acknowledged by the next messages
+ * sent to followers. To be called at every tick, before sending heartbeats. */
+void readRenewLease(struct raft *r);
+
+/* Return true if we are leader and our lease is valid. */
+bool readLeaseValid(struct raft *r);
+
+/* Invalidate our lease for the rest of the current term, since followers might
+ * grant their vote to another server before the lease would expire. */
+void readRevokeLease(struct raft *r);
+
+/* Fail all outstanding read requests with the given status. To be called when
+ * stepping down. */
+void readFailAll(struct raft *r, int status);
+
+#endif /* READ_H_ */
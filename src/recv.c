@@ -9,11 +9,12 @@
 #include "recv_install_snapshot.h"
 #include "recv_request_vote.h"
 #include "recv_request_vote_result.h"
+#include "recv_timeout_now.h"
 #include "string.h"
 
 static const char *message_descs[] = {"append entries", "append entries result",
                                       "request vote", "request vote result",
-                                      "install snapshot"};
+                                      "install snapshot", "timeout now"};
 
 /* Set to 1 to enable tracing. */
 #if 0
@@ -28,7 +29,7 @@ static int recv(struct raft *r, struct raft_message *message)
     int rv = 0;
 
     if (message->type < RAFT_IO_APPEND_ENTRIES ||
-        message->type > RAFT_IO_INSTALL_SNAPSHOT) {
+        message->type > RAFT_IO_TIMEOUT_NOW) {
         warnf(r, "received unknown message type type: %d", message->type);
         return 0;
     }
@@ -65,6 +66,10 @@ static int recv(struct raft *r, struct raft_message *message)
                                         message->server_address,
                                         &message->install_snapshot);
             break;
+        case RAFT_IO_TIMEOUT_NOW:
+            rv = recvTimeoutNow(r, message->server_id, message->server_address,
+                                &message->timeout_now);
+            break;
     };
 
     if (rv != 0 && rv != RAFT_NOCONNECTION) {
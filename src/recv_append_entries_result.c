@@ -2,8 +2,10 @@
 #include "assert.h"
 #include "configuration.h"
 #include "logging.h"
+#include "read.h"
 #include "recv.h"
 #include "replication.h"
+#include "transfer.h"
 
 /* Set to 1 to enable tracing. */
 #if 0
@@ -73,15 +75,23 @@ int recvAppendEntriesResult(struct raft *r,
         return 0;
     }
 
+    /* If we are transferring leadership to this server, check whether its log
+     * caught up with ours. */
+    transferMaybeSend(r, configurationIndexOf(&r->configuration, id));
+
     /* Commit entries if possible.
      *
      * TODO: trigger an heartbeat if the commit index was updated */
-    replicationQuorum(r, result->last_log_index);
+    replicationQuorum(r);
 
     rv = replicationApply(r);
     if (rv != 0) {
         return rv;
     }
 
+    /* Complete the read requests whose round of leadership confirmation got
+     * acknowledged by this result, if any. */
+    readMaybeComplete(r);
+
     return 0;
 }
@@ -36,7 +36,7 @@ int rpcRecvInstallSnapshot(struct raft *r,
 
     if (match < 0) {
         debugf(r, "local term is higher -> reject ");
-        goto reply;
+        goto discard;
     }
 
     /* TODO: this logic duplicates the one in the AppendEntries handler */
@@ -68,13 +68,16 @@ int rpcRecvInstallSnapshot(struct raft *r,
         result->last_log_index = args->last_index;
     }
 
-reply:
-    result->term = r->current_term;
+    goto reply;
 
+discard:
     /* Free the snapshot data. */
     raft_configuration_close(&args->conf);
     raft_free(args->data.base);
 
+reply:
+    result->term = r->current_term;
+
     message.type = RAFT_IO_APPEND_ENTRIES_RESULT;
     message.server_id = id;
     message.server_address = address;
@@ -42,8 +42,13 @@ int recvRequestVote(struct raft *r,
      *   is receiving heartbeats. [...] If a server receives a RequestVote
      *   request within the minimum election timeout of hearing from a current
      *   leader, it does not update its term or grant its vote
+     *
+     * The exception is a candidate that the leader itself asked to take over
+     * by sending it a TimeoutNow message (Section 3.10), which flags its
+     * requests accordingly.
      */
-    if (r->state == RAFT_FOLLOWER && r->follower_state.current_leader.id != 0) {
+    if (r->state == RAFT_FOLLOWER && r->follower_state.current_leader.id != 0 &&
+        !args->disrupt_leader) {
         tracef("local server has a leader -> reject ");
         goto reply;
     }
@@ -0,0 +1,82 @@
+#include "recv_timeout_now.h"
+#include "assert.h"
+#include "configuration.h"
+#include "convert.h"
+#include "log.h"
+#include "logging.h"
+#include "recv.h"
+
+/* Set to 1 to enable tracing. */
+#if 0
+#define tracef(MSG, ...) debugf(r, MSG, ##__VA_ARGS__)
+#else
+#define tracef(MSG, ...)
+#endif
+
+int recvTimeoutNow(struct raft *r,
+                   const unsigned id,
+                   const char *address,
+                   const struct raft_timeout_now *args)
+{
+    const struct raft_server *local_server;
+    raft_index local_last_index;
+    raft_term local_last_term;
+    int match;
+    int rv;
+
+    assert(r != NULL);
+    assert(id > 0);
+    assert(args != NULL);
+
+    (void)address;
+
+    /* Ignore the request if we are not voters. */
+    local_server = configurationGet(&r->configuration, r->id);
+    if (local_server == NULL || !local_server->voting) {
+        tracef("local server is not voting -> ignore");
+        return 0;
+    }
+
+    /* Ignore the request if we are not follower, or we have different
+     * leader. */
+    if (r->state != RAFT_FOLLOWER ||
+        r->follower_state.current_leader.id != id) {
+        tracef("not following the sender -> ignore");
+        return 0;
+    }
+
+    rv = recvEnsureMatchingTerms(r, args->term, &match);
+    if (rv != 0) {
+        return rv;
+    }
+
+    /* Ignore the request if its term is stale. */
+    if (match < 0) {
+        tracef("local term is higher -> ignore");
+        return 0;
+    }
+
+    /* Ignore the request if our log is not up-to-date: the leader should have
+     * waited for it to be, and we would not win the election anyway. */
+    local_last_index = logLastIndex(&r->log);
+    local_last_term = logLastTerm(&r->log);
+    if (local_last_index < args->last_log_index ||
+        local_last_term < args->last_log_term) {
+        tracef("local log is not up-to-date -> ignore");
+        return 0;
+    }
+
+    /* From Section 3.10:
+     *
+     *   This request has the same effect as the target server's election timer
+     *   firing: the target server starts a new election (incrementing its term
+     *   and becoming a candidate). */
+    infof(r, "leadership transferred to us -> start election");
+    rv = convertToCandidate(r, true);
+    if (rv != 0) {
+        errorf(r, "convert to candidate: %s", raft_strerror(rv));
+        return rv;
+    }
+
+    return 0;
+}
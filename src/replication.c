@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <string.h>
 
 #include "assert.h"
@@ -10,7 +11,7 @@
 #include "logging.h"
 #include "membership.h"
 #include "progress.h"
-#include "queue.h"
+#include "read.h"
 #include "replication.h"
 #include "request.h"
 #include "snapshot.h"
@@ -30,6 +31,41 @@
 #    define min(a, b) ((a) < (b) ? (a) : (b))
 #endif
 
+/* Maximum number of RAFT_COMMAND entries passed to a single invocation of
+ * raft_fsm->apply_batch(). */
+#define APPLY_BATCH_MAX 64
+
+/* Context of a request to read entries from disk with raft_io->read_entries(),
+ * in order to send them to a follower. */
+struct fetchEntries
+{
+    struct raft *raft;                /* Instance sending the entries. */
+    struct raft_io_read_entries read; /* Underlying I/O read request. */
+    raft_term term;                   /* Term the request was submitted in. */
+    raft_index index;                 /* Index of the first entry to read. */
+    struct raft_entry *entries;       /* Entries that were read. */
+    unsigned n;                       /* Length of the entries array. */
+    unsigned server_id;               /* Destination server. */
+};
+
+/* Release the entries read by the given request, and the request itself. */
+static void fetchEntriesDestroy(struct fetchEntries *req)
+{
+    unsigned i;
+
+    /* All payloads point into a single batch, or are empty. */
+    for (i = 0; i < req->n; i++) {
+        if (req->entries[i].batch != NULL) {
+            raft_free(req->entries[i].batch);
+            break;
+        }
+    }
+    if (req->entries != NULL) {
+        raft_free(req->entries);
+    }
+    raft_free(req);
+}
+
 /* Context of a RAFT_IO_APPEND_ENTRIES request that was submitted with
  * raft_io_>send(). */
 struct sendAppendEntries
@@ -40,6 +76,7 @@ struct sendAppendEntries
     struct raft_entry *entries; /* Entries referenced in the request. */
     unsigned n;                 /* Length of the entries array. */
     unsigned server_id;         /* Destination server. */
+    struct fetchEntries *fetch; /* Owner of the entries, if read from disk. */
 };
 
 /* Callback invoked after request to send an AppendEntries RPC has completed. */
@@ -70,34 +107,38 @@ static void sendAppendEntriesCb(struct raft_io_send *send, const int status)
         }
     }
 
-    /* Tell the log that we're done referencing these entries. */
-    logRelease(&r->log, req->index, req->entries, req->n);
+    /* Tell the log that we're done referencing these entries, or release them
+     * if they were read from disk. */
+    if (req->fetch != NULL) {
+        fetchEntriesDestroy(req->fetch);
+    } else {
+        logRelease(&r->log, req->index, req->entries, req->n);
+    }
     raft_free(req);
 }
 
-/* Send an AppendEntries message to the i'th server, including all log entries
- * from the given point onwards. */
-static int sendAppendEntries(struct raft *r,
-                             const unsigned i,
-                             const raft_index prev_index,
-                             const raft_term prev_term)
+/* Send an AppendEntries message with the given entries to the i'th server. If
+ * @fetch is not NULL, the entries were read from disk and are owned by it,
+ * otherwise they were acquired from the log. */
+static int sendEntries(struct raft *r,
+                       const unsigned i,
+                       const raft_index prev_index,
+                       const raft_term prev_term,
+                       struct raft_entry *entries,
+                       const unsigned n,
+                       struct fetchEntries *fetch)
 {
     struct raft_server *server = &r->configuration.servers[i];
     struct raft_message message;
     struct raft_append_entries *args = &message.append_entries;
     struct sendAppendEntries *req;
-    raft_index next_index = prev_index + 1;
     int rv;
 
     args->term = r->current_term;
     args->prev_log_index = prev_index;
     args->prev_log_term = prev_term;
-
-    /* TODO: implement a limit to the total size of the entries being sent */
-    rv = logAcquire(&r->log, next_index, &args->entries, &args->n_entries);
-    if (rv != 0) {
-        goto err;
-    }
+    args->entries = entries;
+    args->n_entries = n;
 
     /* From Section §3.5:
      *
@@ -120,38 +161,247 @@ static int sendAppendEntries(struct raft *r,
     req = raft_malloc(sizeof *req);
     if (req == NULL) {
         rv = RAFT_NOMEM;
-        goto err_after_entries_acquired;
+        goto err;
     }
     req->raft = r;
     req->index = args->prev_log_index + 1;
     req->entries = args->entries;
     req->n = args->n_entries;
     req->server_id = server->id;
+    req->fetch = fetch;
 
     req->send.data = req;
     rv = r->io->send(r->io, &req->send, &message, sendAppendEntriesCb);
     if (rv != 0) {
         goto err_after_req_alloc;
     }
+    progressRecordSend(r, i);
 
     if (progressState(r, i) == PROGRESS__PIPELINE) {
         /* Optimitiscally update progress. */
         progressOptimisticNextIndex(r, i, req->index + req->n);
+        /* Track the message until the follower acknowledges it. Heartbeats
+         * don't carry any entry and don't count towards the window. */
+        if (req->n > 0) {
+            size_t size = 0;
+            unsigned j;
+            for (j = 0; j < req->n; j++) {
+                size += req->entries[j].buf.len;
+            }
+            progressInflightAdd(r, i, req->index + req->n - 1, size);
+        }
     }
 
     return 0;
 
 err_after_req_alloc:
     raft_free(req);
-err_after_entries_acquired:
-    logRelease(&r->log, next_index, args->entries, args->n_entries);
 err:
     assert(rv != 0);
     return rv;
 }
 
-/* Context of a RAFT_IO_INSTALL_SNAPSHOT request that was submitted with
- * raft_io_>send(). */
+/* Send an AppendEntries message to the i'th server, including log entries from
+ * the given point onwards, up to the configured per-message limits. */
+static int sendAppendEntries(struct raft *r,
+                             const unsigned i,
+                             const raft_index prev_index,
+                             const raft_term prev_term)
+{
+    struct raft_entry *entries;
+    unsigned n;
+    int rv;
+
+    rv = logAcquireAtMost(&r->log, prev_index + 1, r->max_append_entries,
+                          r->max_append_bytes, &entries, &n);
+    if (rv != 0) {
+        return rv;
+    }
+
+    rv = sendEntries(r, i, prev_index, prev_term, entries, n, NULL);
+    if (rv != 0) {
+        logRelease(&r->log, prev_index + 1, entries, n);
+        return rv;
+    }
+
+    return 0;
+}
+
+/* Send an AppendEntries message with no entries to the i'th server, to prevent
+ * it from timing out while we can't send it any entry. */
+static int sendHeartbeat(struct raft *r, const unsigned i)
+{
+    raft_index prev_index = progressNextIndex(r, i) - 1;
+    raft_term prev_term = 0;
+
+    if (prev_index > 0) {
+        prev_term = logTermOf(&r->log, prev_index);
+        /* The entry was compacted in the meantime, the next message will be a
+         * snapshot. */
+        if (prev_term == 0) {
+            return 0;
+        }
+    }
+
+    return sendEntries(r, i, prev_index, prev_term, NULL, 0, NULL);
+}
+
+/* Return true if the I/O implementation can read entries back from disk, which
+ * is required for evicting their payloads from memory. */
+static bool canFetchEntries(struct raft *r)
+{
+    return r->io->version >= 2 && r->io->read_entries != NULL;
+}
+
+/* Send the entries that were read from disk by the given request to the i'th
+ * server, taking ownership of them. Return false if they are not needed
+ * anymore. */
+static bool sendFetchedEntries(struct fetchEntries *req, const unsigned i)
+{
+    struct raft *r = req->raft;
+    raft_index evicted = logEvictedIndex(&r->log);
+    raft_index prev_index = req->index - 1;
+    raft_term prev_term = 0;
+    unsigned n = req->n;
+    unsigned j;
+    int rv;
+
+    /* Something happened in the meantime, e.g. the follower rejected some
+     * message or we started sending it a snapshot. */
+    if (progressState(r, i) == PROGRESS__SNAPSHOT ||
+        progressNextIndex(r, i) != req->index || req->index > evicted) {
+        return false;
+    }
+
+    if (prev_index > 0) {
+        prev_term = logTermOf(&r->log, prev_index);
+        if (prev_term == 0) {
+            return false;
+        }
+    }
+
+    /* Entries past the evicted ones might have been truncated from the log and
+     * not yet from disk, so only send the evicted ones, which are committed. */
+    if (n > evicted - prev_index) {
+        n = (unsigned)(evicted - prev_index);
+    }
+    if (n > r->max_append_entries) {
+        n = r->max_append_entries;
+    }
+    for (j = 0; j < n; j++) {
+        if (req->entries[j].term != logTermOf(&r->log, req->index + j)) {
+            break;
+        }
+    }
+    if (j == 0) {
+        return false;
+    }
+    n = j;
+
+    rv = sendEntries(r, i, prev_index, prev_term, req->entries, n, req);
+    if (rv != 0) {
+        debugf(r, "failed to send append entries to server %ld: %s",
+               req->server_id, raft_strerror(rv));
+        return false;
+    }
+
+    return true;
+}
+
+static void fetchEntriesCb(struct raft_io_read_entries *read,
+                           struct raft_entry entries[],
+                           unsigned n,
+                           int status)
+{
+    struct fetchEntries *req = read->data;
+    struct raft *r = req->raft;
+    unsigned i;
+    int rv;
+
+    req->entries = entries;
+    req->n = n;
+
+    /* The progress array we were tracking is gone. */
+    if (r->state != RAFT_LEADER || r->current_term != req->term) {
+        goto abort;
+    }
+
+    /* Probably the server was removed in the meantime. */
+    i = configurationIndexOf(&r->configuration, req->server_id);
+    if (i == r->configuration.n) {
+        goto abort;
+    }
+
+    progressSetFetching(r, i, false);
+
+    if (status != 0 || n == 0) {
+        warnf(r, "read entries from index %lld: %s", req->index,
+              raft_strerror(status));
+        /* Retry only after a heartbeat interval. */
+        progressToProbe(r, i);
+        goto abort;
+    }
+
+    if (!sendFetchedEntries(req, i)) {
+        goto abort;
+    }
+
+    /* In pipeline mode, start reading the next window right away. */
+    rv = replicationProgress(r, i);
+    if (rv != 0 && rv != RAFT_NOCONNECTION) {
+        debugf(r, "failed to send append entries to server %ld: %s",
+               req->server_id, raft_strerror(rv));
+    }
+
+    return;
+
+abort:
+    fetchEntriesDestroy(req);
+}
+
+/* Read the entries from the given index onwards from disk, since their
+ * payloads were evicted from memory, and send them to the i'th server once
+ * the read completes. */
+static int fetchEntries(struct raft *r, const unsigned i, raft_index index)
+{
+    struct raft_server *server = &r->configuration.servers[i];
+    struct fetchEntries *req;
+    int rv;
+
+    assert(canFetchEntries(r));
+
+    req = raft_malloc(sizeof *req);
+    if (req == NULL) {
+        return RAFT_NOMEM;
+    }
+    req->raft = r;
+    req->term = r->current_term;
+    req->index = index;
+    req->entries = NULL;
+    req->n = 0;
+    req->server_id = server->id;
+    req->read.data = req;
+
+    tracef("read entries from index %llu for server %lu", index, server->id);
+
+    /* The callback might fire before read_entries() returns. */
+    progressSetFetching(r, i, true);
+
+    rv = r->io->read_entries(r->io, &req->read, index, r->max_append_bytes,
+                             fetchEntriesCb);
+    if (rv != 0) {
+        progressSetFetching(r, i, false);
+        raft_free(req);
+        return rv;
+    }
+
+    return 0;
+}
+
+/* Context of a snapshot being sent to a follower. The snapshot is sent in
+ * chunks of at most chunk_size bytes, each one in its own
+ * RAFT_IO_INSTALL_SNAPSHOT message submitted with raft_io->send() once the
+ * previous one has been sent. */
 struct sendInstallSnapshot
 {
     struct raft *raft;               /* Instance sending the snapshot. */
@@ -159,27 +409,136 @@ struct sendInstallSnapshot
     struct raft_io_send send;        /* Underlying I/O send request. */
     struct raft_snapshot *snapshot;  /* Snapshot to send. */
     unsigned server_id;              /* Destination server. */
+    size_t offset;                   /* Offset of the chunk being sent. */
+    size_t len;                      /* Length of the chunk being sent. */
+    unsigned long long n_sent;       /* Messages sent to the server so far. */
 };
 
+/* Return true if the snapshot of the given request should still be sent,
+ * setting @i to the index of the destination server in the configuration. */
+static bool shouldSendSnapshot(struct sendInstallSnapshot *req, unsigned *i)
+{
+    struct raft *r = req->raft;
+
+    if (r->state != RAFT_LEADER) {
+        return false;
+    }
+
+    /* Probably the server was removed in the meantime. */
+    if (configurationGet(&r->configuration, req->server_id) == NULL) {
+        return false;
+    }
+
+    *i = configurationIndexOf(&r->configuration, req->server_id);
+
+    /* Something happened in the meantime. */
+    if (progressState(r, *i) != PROGRESS__SNAPSHOT) {
+        return false;
+    }
+
+    /* Another message was sent to the server in the meantime, which means
+     * that a new attempt to send a snapshot has superseded this one. */
+    if (req->snapshot != NULL && progressNumSent(r, *i) != req->n_sent) {
+        return false;
+    }
+
+    return true;
+}
+
+/* Release a snapshot returned by raft_io->snapshot_get(). */
+static void releaseSnapshot(struct raft *r, struct raft_snapshot *snapshot)
+{
+    if (r->io->version >= 2 && r->io->snapshot_release != NULL) {
+        r->io->snapshot_release(r->io, snapshot);
+        return;
+    }
+    snapshotDestroy(snapshot);
+}
+
+static void sendInstallSnapshotCb(struct raft_io_send *send, int status);
+
+/* Send the chunk of the snapshot starting at the request's offset to the i'th
+ * server. */
+static int sendSnapshotChunk(struct sendInstallSnapshot *req, unsigned i)
+{
+    struct raft *r = req->raft;
+    struct raft_snapshot *snapshot = req->snapshot;
+    const struct raft_buffer *data = &snapshot->bufs[0];
+    struct raft_server *server = &r->configuration.servers[i];
+    struct raft_message message;
+    struct raft_install_snapshot *args = &message.install_snapshot;
+    int rv;
+
+    assert(req->offset <= data->len);
+
+    req->len = data->len - req->offset;
+    if (req->len > r->snapshot.chunk_size) {
+        req->len = r->snapshot.chunk_size;
+    }
+
+    message.type = RAFT_IO_INSTALL_SNAPSHOT;
+    message.server_id = server->id;
+    message.server_address = server->address;
+
+    args->term = r->current_term;
+    args->last_index = snapshot->index;
+    args->last_term = snapshot->term;
+    args->conf_index = snapshot->configuration_index;
+    args->conf = snapshot->configuration;
+    args->offset = req->offset;
+    args->done = req->offset + req->len == data->len;
+    args->data.base = (uint8_t *)data->base + req->offset;
+    args->data.len = req->len;
+
+    req->send.data = req;
+
+    rv = r->io->send(r->io, &req->send, &message, sendInstallSnapshotCb);
+    if (rv != 0) {
+        return rv;
+    }
+    progressRecordSend(r, i);
+    req->n_sent = progressNumSent(r, i);
+
+    return 0;
+}
+
 static void sendInstallSnapshotCb(struct raft_io_send *send, int status)
 {
     struct sendInstallSnapshot *req = send->data;
     struct raft *r = req->raft;
-    const struct raft_server *server;
+    struct raft_snapshot *snapshot = req->snapshot;
+    unsigned i;
+    int rv;
 
-    server = configurationGet(&r->configuration, req->server_id);
+    if (!shouldSendSnapshot(req, &i)) {
+        goto out;
+    }
 
     if (status != 0) {
         debugf(r, "send install snapshot: %s", raft_strerror(status));
-        if (r->state == RAFT_LEADER && server != NULL) {
-            unsigned i;
-            i = configurationIndexOf(&r->configuration, req->server_id);
-            progressAbortSnapshot(r, i);
-        }
+        goto abort;
+    }
+
+    req->offset += req->len;
+
+    /* If this was the last chunk, wait for the follower to reply. */
+    if (req->offset == snapshot->bufs[0].len) {
+        goto out;
     }
 
-    snapshotClose(req->snapshot);
-    raft_free(req->snapshot);
+    rv = sendSnapshotChunk(req, i);
+    if (rv != 0) {
+        goto abort;
+    }
+
+    return;
+
+abort:
+    /* The chunks sent so far might have been received, try to resume from the
+     * one that failed. */
+    progressPauseSnapshot(r, i, snapshot->index, req->offset);
+out:
+    releaseSnapshot(r, snapshot);
     raft_free(req);
 }
 
@@ -189,70 +548,43 @@ static void sendSnapshotGetCb(struct raft_io_snapshot_get *get,
 {
     struct sendInstallSnapshot *req = get->data;
     struct raft *r = req->raft;
-    struct raft_message message;
-    struct raft_install_snapshot *args = &message.install_snapshot;
-    const struct raft_server *server;
-    bool progress_state_is_snapshot;
     unsigned i;
     int rv;
 
     if (status != 0) {
         errorf(r, "get snapshot %s", raft_strerror(status));
+        if (shouldSendSnapshot(req, &i)) {
+            progressAbortSnapshot(r, i);
+        }
         goto abort;
     }
-    if (r->state != RAFT_LEADER) {
-        goto abort_with_snapshot;
-    }
-
-    server = configurationGet(&r->configuration, req->server_id);
-
-    if (server == NULL) {
-        /* Probably the server was removed in the meantime. */
-        goto abort_with_snapshot;
-    }
-
-    i = configurationIndexOf(&r->configuration, req->server_id);
-    progress_state_is_snapshot = progressState(r, i) == PROGRESS__SNAPSHOT;
 
-    if (!progress_state_is_snapshot) {
-        /* Something happened in the meantime. */
+    if (!shouldSendSnapshot(req, &i)) {
         goto abort_with_snapshot;
     }
 
     assert(snapshot->n_bufs == 1);
 
-    message.type = RAFT_IO_INSTALL_SNAPSHOT;
-    message.server_id = server->id;
-    message.server_address = server->address;
-
-    args->term = r->current_term;
-    args->last_index = snapshot->index;
-    args->last_term = snapshot->term;
-    args->conf_index = snapshot->configuration_index;
-    args->conf = snapshot->configuration;
-    args->data = snapshot->bufs[0];
-
     req->snapshot = snapshot;
-    req->send.data = req;
+    req->offset = progressResumeOffset(r, i, snapshot->index);
+    if (req->offset > snapshot->bufs[0].len) {
+        req->offset = 0;
+    }
 
-    debugf(r, "sending snapshot with last index %ld to %ld", snapshot->index,
-           server->id);
+    debugf(r, "sending snapshot with last index %ld to %ld from offset %zu",
+           snapshot->index, req->server_id, req->offset);
 
-    rv = r->io->send(r->io, &req->send, &message, sendInstallSnapshotCb);
+    rv = sendSnapshotChunk(req, i);
     if (rv != 0) {
+        progressAbortSnapshot(r, i);
         goto abort_with_snapshot;
     }
 
     return;
 
 abort_with_snapshot:
-    snapshotClose(snapshot);
-    raft_free(snapshot);
+    releaseSnapshot(r, snapshot);
 abort:
-    if (r->state == RAFT_LEADER && server != NULL &&
-        progress_state_is_snapshot) {
-        progressAbortSnapshot(r, i);
-    }
     raft_free(req);
     return;
 }
@@ -273,6 +605,7 @@ static int sendSnapshot(struct raft *r, const unsigned i)
     }
     request->raft = r;
     request->server_id = server->id;
+    request->snapshot = NULL;
     request->get.data = request;
 
     /* TODO: make sure that the I/O implementation really returns the latest
@@ -293,7 +626,10 @@ err:
     return rv;
 }
 
-int replicationProgress(struct raft *r, unsigned i)
+/* Send to the i'th server either an AppendEntries RPC with the entries from its
+ * next index onward, or an InstallSnapshot RPC if those entries are not in our
+ * log anymore. */
+static int sendNextMessage(struct raft *r, unsigned i)
 {
     struct raft_server *server = &r->configuration.servers[i];
     raft_index snapshot_index = logSnapshotIndex(&r->log);
@@ -306,10 +642,6 @@ int replicationProgress(struct raft *r, unsigned i)
     assert(server->id != r->id);
     assert(next_index >= 1);
 
-    if (!progressShouldReplicate(r, i)) {
-        return 0;
-    }
-
     /* From Section §3.5:
      *
      *   When sending an AppendEntries RPC, the leader includes the index and
@@ -346,12 +678,49 @@ int replicationProgress(struct raft *r, unsigned i)
         }
     }
 
+    /* If the payloads of the entries to send were evicted from memory, read
+     * them back from disk. */
+    if (next_index <= logEvictedIndex(&r->log)) {
+        return fetchEntries(r, i, next_index);
+    }
+
     return sendAppendEntries(r, i, prev_index, prev_term);
 
 send_snapshot:
     return sendSnapshot(r, i);
 }
 
+int replicationProgress(struct raft *r, unsigned i)
+{
+    int rv;
+
+    if (!progressShouldReplicate(r, i)) {
+        if (progressShouldHeartbeat(r, i)) {
+            return sendHeartbeat(r, i);
+        }
+        return 0;
+    }
+
+    rv = sendNextMessage(r, i);
+    if (rv != 0) {
+        return rv;
+    }
+
+    /* In pipeline mode the next index has been optimistically advanced past
+     * the entries just sent, so keep streaming successive windows until the
+     * follower has been sent our whole log or the in-flight window is full. */
+    while (progressState(r, i) == PROGRESS__PIPELINE &&
+           progressNextIndex(r, i) <= logLastIndex(&r->log) &&
+           !progressInflightFull(r, i) && !progressIsFetching(r, i)) {
+        rv = sendNextMessage(r, i);
+        if (rv != 0) {
+            return rv;
+        }
+    }
+
+    return 0;
+}
+
 /* Possibly trigger I/O requests for newly appended log entries or heartbeats.
  *
  * This function loops through all followers and triggers replication on them.
@@ -387,6 +756,14 @@ static int triggerAll(struct raft *r)
 
 int replicationHeartbeat(struct raft *r)
 {
+    int rv;
+
+    /* Retry a deferred disk write that previously failed, if any. */
+    rv = replicationFlush(r, false);
+    if (rv != 0) {
+        warnf(r, "flush new entries: %s", raft_strerror(rv));
+    }
+
     return triggerAll(r);
 }
 
@@ -479,7 +856,7 @@ static void appendLeaderCb(struct raft_io_append *req, int status)
     }
 
     /* Check if we can commit some new entries. */
-    replicationQuorum(r, r->last_stored);
+    replicationQuorum(r);
 
     rv = replicationApply(r);
     if (rv != 0) {
@@ -543,14 +920,110 @@ err:
     return rv;
 }
 
+/* Return true if the I/O implementation supports deferring disk writes and
+ * AppendEntries messages until the end of the current loop iteration. */
+static bool canDeferFlush(struct raft *r)
+{
+    return r->io->version >= 2 && r->io->flush != NULL;
+}
+
+/* Callback invoked by the I/O implementation at the end of the loop iteration
+ * in which new entries were appended. */
+static void flushCb(struct raft_io *io)
+{
+    struct raft *r = io->data;
+    int rv;
+
+    if (r->state != RAFT_LEADER) {
+        return;
+    }
+
+    rv = replicationFlush(r, true);
+    if (rv != 0) {
+        /* The deferred index is preserved, so the write will be retried at
+         * the next heartbeat. */
+        warnf(r, "flush new entries: %s", raft_strerror(rv));
+    }
+
+    /* Complete read requests confirmed during this loop iteration, if any. */
+    readMaybeComplete(r);
+}
+
+void replicationConfirmLeadership(struct raft *r)
+{
+    unsigned i;
+    int rv;
+
+    assert(r->state == RAFT_LEADER);
+
+    for (i = 0; i < r->configuration.n; i++) {
+        struct raft_server *server = &r->configuration.servers[i];
+        if (server->id == r->id || !server->voting ||
+            progressState(r, i) == PROGRESS__SNAPSHOT) {
+            continue;
+        }
+        rv = sendNextMessage(r, i);
+        if (rv != 0 && rv != RAFT_NOCONNECTION) {
+            debugf(r, "failed to send heartbeat to server %ld: %s (%d)",
+                   server->id, raft_strerror(rv), rv);
+        }
+    }
+
+    /* If we are the only voting server, leadership is confirmed right away, so
+     * have pending reads checked at the end of this loop iteration. */
+    if (canDeferFlush(r)) {
+        r->io->flush(r->io, flushCb);
+    }
+}
+
 int replicationTrigger(struct raft *r, raft_index index)
 {
     int rv;
 
+    /* If the I/O implementation supports it, just remember the first entry
+     * that needs to be written and sent, and let flushCb() handle all
+     * entries appended during this loop iteration in one go. */
+    if (canDeferFlush(r)) {
+        if (r->leader_state.flush_index != 0) {
+            assert(index > r->leader_state.flush_index);
+            return 0;
+        }
+        r->leader_state.flush_index = index;
+        rv = r->io->flush(r->io, flushCb);
+        if (rv == 0) {
+            return 0;
+        }
+        r->leader_state.flush_index = 0;
+    }
+
+    rv = appendLeader(r, index);
+    if (rv != 0) {
+        return rv;
+    }
+
+    return triggerAll(r);
+}
+
+int replicationFlush(struct raft *r, bool send)
+{
+    raft_index index = r->leader_state.flush_index;
+    int rv;
+
+    assert(r->state == RAFT_LEADER);
+
+    if (index == 0) {
+        return 0;
+    }
+
     rv = appendLeader(r, index);
     if (rv != 0) {
         return rv;
     }
+    r->leader_state.flush_index = 0;
+
+    if (!send) {
+        return 0;
+    }
 
     return triggerAll(r);
 }
@@ -598,12 +1071,15 @@ static int triggerActualPromotion(struct raft *r)
 
     req->type = RAFT_CHANGE;
     req->index = index;
-    QUEUE_PUSH(&r->leader_state.requests, &req->queue);
+    rv = requestRegEnqueue(&r->leader_state.requests, (struct request *)req);
+    if (rv != 0) {
+        goto err_after_log_append;
+    }
 
     /* Start writing the new log entry to disk and send it to the followers. */
     rv = replicationTrigger(r, index);
     if (rv != 0) {
-        goto err_after_log_append;
+        goto err_after_request_enqueue;
     }
 
     r->leader_state.promotee_id = 0;
@@ -611,6 +1087,8 @@ static int triggerActualPromotion(struct raft *r)
 
     return 0;
 
+err_after_request_enqueue:
+    requestRegPopBack(&r->leader_state.requests, (struct request *)req);
 err_after_log_append:
     logTruncate(&r->log, index);
 
@@ -706,7 +1184,7 @@ int replicationUpdate(struct raft *r,
     }
 
     /* Check if we can commit some new entries. */
-    replicationQuorum(r, r->last_stored);
+    replicationQuorum(r);
 
     rv = replicationApply(r);
     if (rv != 0) {
@@ -1151,14 +1629,81 @@ respond:
     raft_free(request);
 }
 
+/* Discard the chunks of a snapshot received so far, if any. */
+static void discardIncomingSnapshot(struct raft *r)
+{
+    raft_free(r->snapshot.incoming.data.base);
+    r->snapshot.incoming.index = 0;
+    r->snapshot.incoming.term = 0;
+    r->snapshot.incoming.data.base = NULL;
+    r->snapshot.incoming.data.len = 0;
+    r->snapshot.incoming.cap = 0;
+}
+
+/* Append the chunk carried by the given InstallSnapshot request to the ones
+ * received so far, taking ownership of its data. Set @ok to false and discard
+ * the chunk if it doesn't follow the ones received so far. */
+static int receiveSnapshotChunk(struct raft *r,
+                                struct raft_install_snapshot *args,
+                                bool *ok)
+{
+    struct raft_buffer *data = &r->snapshot.incoming.data;
+    size_t len;
+
+    *ok = true;
+
+    /* The first chunk starts a new transfer, its buffer is used as is. */
+    if (args->offset == 0) {
+        discardIncomingSnapshot(r);
+        r->snapshot.incoming.index = args->last_index;
+        r->snapshot.incoming.term = args->last_term;
+        *data = args->data;
+        r->snapshot.incoming.cap = args->data.len;
+        return 0;
+    }
+
+    if (args->last_index != r->snapshot.incoming.index ||
+        args->last_term != r->snapshot.incoming.term ||
+        args->offset != data->len) {
+        debugf(r, "unexpected chunk at offset %zu of snapshot %llu",
+               args->offset, args->last_index);
+        raft_free(args->data.base);
+        *ok = false;
+        return 0;
+    }
+
+    len = data->len + args->data.len;
+    if (len > r->snapshot.incoming.cap) {
+        size_t cap = r->snapshot.incoming.cap * 2;
+        void *base;
+        if (cap < len) {
+            cap = len;
+        }
+        base = raft_realloc(data->base, cap);
+        if (base == NULL) {
+            raft_free(args->data.base);
+            return RAFT_NOMEM;
+        }
+        data->base = base;
+        r->snapshot.incoming.cap = cap;
+    }
+
+    memcpy((uint8_t *)data->base + data->len, args->data.base, args->data.len);
+    data->len = len;
+    raft_free(args->data.base);
+
+    return 0;
+}
+
 int replicationInstallSnapshot(struct raft *r,
-                               const struct raft_install_snapshot *args,
+                               struct raft_install_snapshot *args,
                                raft_index *rejected,
                                bool *async)
 {
     struct recvInstallSnapshot *request;
     struct raft_snapshot *snapshot;
     raft_term local_term;
+    bool ok;
     int rv;
 
     assert(r->state == RAFT_FOLLOWER);
@@ -1166,25 +1711,40 @@ int replicationInstallSnapshot(struct raft *r,
     *rejected = args->last_index;
     *async = false;
 
-    /* If we are taking a snapshot ourselves or installing a snapshot, ignore
-     * the request, the leader will weventually retry. TODO: we should do
-     * something smarter. */
-    if (r->snapshot.pending.term != 0 || r->snapshot.put.data != NULL) {
+    /* If we are taking a snapshot ourselves, installing a snapshot or applying
+     * entries off the event loop thread, ignore the request, the leader will
+     * weventually retry. TODO: we should do something smarter. */
+    if (r->snapshot.pending.term != 0 || r->snapshot.put.data != NULL ||
+        r->apply.work != NULL) {
         *async = true;
-        return 0;
+        goto discard;
     }
 
     /* If our last snapshot is more up-to-date, this is a no-op */
     if (r->log.snapshot.last_index >= args->last_index) {
         *rejected = 0;
-        return 0;
+        goto discard;
     }
 
     /* If we already have all entries in the snapshot, this is a no-op */
     local_term = logTermOf(&r->log, args->last_index);
     if (local_term != 0 && local_term >= args->last_term) {
         *rejected = 0;
-        return 0;
+        goto discard;
+    }
+
+    rv = receiveSnapshotChunk(r, args, &ok);
+    if (rv != 0) {
+        goto err;
+    }
+    if (!ok) {
+        goto discard_conf;
+    }
+
+    /* Wait for the other chunks. */
+    if (!args->done) {
+        *async = true;
+        goto discard_conf;
     }
 
     *async = true;
@@ -1217,7 +1777,7 @@ int replicationInstallSnapshot(struct raft *r,
         rv = RAFT_NOMEM;
         goto err_after_request_alloc;
     }
-    snapshot->bufs[0] = args->data;
+    snapshot->bufs[0] = r->snapshot.incoming.data;
     snapshot->n_bufs = 1;
 
     assert(r->snapshot.put.data == NULL);
@@ -1228,6 +1788,16 @@ int replicationInstallSnapshot(struct raft *r,
         goto err_after_bufs_alloc;
     }
 
+    /* The snapshot data is now owned by the request. */
+    r->snapshot.incoming.data.base = NULL;
+    discardIncomingSnapshot(r);
+
+    return 0;
+
+discard:
+    raft_free(args->data.base);
+discard_conf:
+    raft_configuration_close(&args->conf);
     return 0;
 
 err_after_bufs_alloc:
@@ -1236,6 +1806,8 @@ err_after_bufs_alloc:
 err_after_request_alloc:
     raft_free(request);
 err:
+    discardIncomingSnapshot(r);
+    raft_configuration_close(&args->conf);
     assert(rv != 0);
     return rv;
 }
@@ -1245,22 +1817,10 @@ static struct request *getRequest(struct raft *r,
                                   const raft_index index,
                                   int type)
 {
-    queue *head;
-    struct request *req;
-
     if (r->state != RAFT_LEADER) {
         return NULL;
     }
-    QUEUE_FOREACH(head, &r->leader_state.requests)
-    {
-        req = QUEUE_DATA(head, struct request, queue);
-        if (req->index == index) {
-            assert(req->type == type);
-            QUEUE_REMOVE(head);
-            return req;
-        }
-    }
-    return NULL;
+    return requestRegDequeue(&r->leader_state.requests, index, type);
 }
 
 /* Apply a RAFT_COMMAND entry that has been committed. */
@@ -1282,6 +1842,211 @@ static int applyCommand(struct raft *r,
     return 0;
 }
 
+/* Return true if the FSM can apply runs of RAFT_COMMAND entries at once. */
+static bool canApplyBatch(struct raft *r)
+{
+    return r->fsm->version >= 2 && r->fsm->apply_batch != NULL;
+}
+
+/* Return the number of consecutive committed RAFT_COMMAND entries starting at
+ * the given index, up to APPLY_BATCH_MAX. */
+static unsigned countCommands(struct raft *r, const raft_index index)
+{
+    unsigned n = 0;
+    while (n < APPLY_BATCH_MAX && index + n <= r->commit_index) {
+        const struct raft_entry *entry = logGet(&r->log, index + n);
+        if (entry->type != RAFT_COMMAND) {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+/* Apply a run of @n consecutive RAFT_COMMAND entries that have been committed,
+ * starting at the given index, using the FSM's batch interface. */
+static int applyCommands(struct raft *r, const raft_index index, unsigned n)
+{
+    struct raft_buffer bufs[APPLY_BATCH_MAX];
+    void *results[APPLY_BATCH_MAX];
+    unsigned i;
+    int rv;
+
+    assert(n > 0 && n <= APPLY_BATCH_MAX);
+
+    for (i = 0; i < n; i++) {
+        const struct raft_entry *entry = logGet(&r->log, index + i);
+        assert(entry->type == RAFT_COMMAND);
+        bufs[i] = entry->buf;
+        results[i] = NULL;
+    }
+
+    rv = r->fsm->apply_batch(r->fsm, bufs, n, results);
+    if (rv != 0) {
+        return rv;
+    }
+
+    for (i = 0; i < n; i++) {
+        struct raft_apply *req;
+        req = (struct raft_apply *)getRequest(r, index + i, RAFT_COMMAND);
+        if (req != NULL && req->cb != NULL) {
+            req->cb(req, 0, results[i]);
+        }
+    }
+
+    return 0;
+}
+
+/* Return true if runs of RAFT_COMMAND entries should be applied off the event
+ * loop thread. */
+static bool canApplyAsync(struct raft *r)
+{
+    return r->apply.async && r->io->version >= 2 && r->io->async_work != NULL;
+}
+
+/* Run of RAFT_COMMAND entries being applied with raft_io->async_work(). */
+struct applyWork
+{
+    struct raft_io_async_work req;
+    struct raft *raft;          /* Instance applying the run */
+    struct raft_fsm *fsm;       /* FSM to apply the entries to */
+    bool batch;                 /* Whether to use raft_fsm->apply_batch() */
+    raft_index index;           /* Index of the first entry */
+    struct raft_entry *entries; /* Acquired entries */
+    unsigned n;                 /* Number of entries */
+    unsigned n_applied;         /* Number of entries successfully applied */
+    struct raft_buffer bufs[APPLY_BATCH_MAX]; /* Payloads of the entries */
+    void *results[APPLY_BATCH_MAX];           /* FSM results */
+};
+
+/* Apply the entries of an applyWork object to the FSM. This is invoked on the
+ * I/O implementation's worker thread, so it must not touch the raft object. */
+static int applyWorkRun(struct raft_io_async_work *req)
+{
+    struct applyWork *w = req->data;
+    unsigned i;
+    int rv;
+
+    if (w->batch) {
+        rv = w->fsm->apply_batch(w->fsm, w->bufs, w->n, w->results);
+        if (rv != 0) {
+            return rv;
+        }
+        w->n_applied = w->n;
+        return 0;
+    }
+
+    for (i = 0; i < w->n; i++) {
+        rv = w->fsm->apply(w->fsm, &w->bufs[i], &w->results[i]);
+        if (rv != 0) {
+            return rv;
+        }
+        w->n_applied++;
+    }
+
+    return 0;
+}
+
+static void applyWorkCb(struct raft_io_async_work *req, int status)
+{
+    struct applyWork *w = req->data;
+    struct raft *r = w->raft;
+    unsigned i;
+
+    assert(r->apply.work == req);
+    r->apply.work = NULL;
+
+    /* Snapshots can't be installed while a run is being applied, so nothing
+     * else could have advanced last_applied in the meantime. */
+    assert(r->last_applied == w->index - 1);
+
+    for (i = 0; i < w->n_applied; i++) {
+        struct raft_apply *apply;
+        apply = (struct raft_apply *)getRequest(r, w->index + i, RAFT_COMMAND);
+        if (apply != NULL && apply->cb != NULL) {
+            apply->cb(apply, 0, w->results[i]);
+        }
+    }
+    r->last_applied += w->n_applied;
+
+    logRelease(&r->log, w->index, w->entries, w->n);
+    raft_free(w);
+
+    readMaybeComplete(r);
+
+    if (status != 0) {
+        if (status != RAFT_CANCELED) {
+            errorf(r, "apply entries: %s", raft_strerror(status));
+        }
+        return;
+    }
+
+    /* Apply any entry that got committed in the meantime. */
+    if (r->state == RAFT_LEADER || r->state == RAFT_FOLLOWER) {
+        replicationApply(r);
+    }
+}
+
+/* Submit a request to apply a run of @n consecutive RAFT_COMMAND entries that
+ * have been committed, starting at the given index, off the event loop
+ * thread. */
+static int applyCommandsAsync(struct raft *r,
+                              const raft_index index,
+                              unsigned n)
+{
+    struct applyWork *w;
+    unsigned i;
+    int rv;
+
+    assert(n > 0 && n <= APPLY_BATCH_MAX);
+    assert(r->apply.work == NULL);
+
+    w = raft_malloc(sizeof *w);
+    if (w == NULL) {
+        rv = RAFT_NOMEM;
+        goto err;
+    }
+    w->raft = r;
+    w->fsm = r->fsm;
+    w->batch = canApplyBatch(r);
+    w->index = index;
+    w->n_applied = 0;
+
+    /* Hold a reference to the entries, since they might be removed from the
+     * log while being applied, e.g. because of a snapshot. */
+    rv = logAcquireAtMost(&r->log, index, n, SIZE_MAX, &w->entries, &w->n);
+    if (rv != 0) {
+        goto err_after_work_alloc;
+    }
+    assert(w->n == n);
+
+    for (i = 0; i < n; i++) {
+        assert(w->entries[i].type == RAFT_COMMAND);
+        w->bufs[i] = w->entries[i].buf;
+        w->results[i] = NULL;
+    }
+
+    w->req.data = w;
+    w->req.work = applyWorkRun;
+    r->apply.work = &w->req;
+
+    rv = r->io->async_work(r->io, &w->req, applyWorkCb);
+    if (rv != 0) {
+        r->apply.work = NULL;
+        goto err_after_acquire_entries;
+    }
+
+    return 0;
+
+err_after_acquire_entries:
+    logRelease(&r->log, index, w->entries, w->n);
+err_after_work_alloc:
+    raft_free(w);
+err:
+    assert(rv != 0);
+    return rv;
+}
+
 /* Fire the callback of a barrier request whose entry has been committed. */
 static void applyBarrier(struct raft *r, const raft_index index)
 {
@@ -1368,12 +2133,114 @@ out:
     r->snapshot.pending.term = 0;
 }
 
-static int takeSnapshot(struct raft *r)
+/* Store the pending snapshot, whose content has been filled by the FSM. On
+ * failure the content is released. */
+static int putSnapshot(struct raft *r)
+{
+    struct raft_snapshot *snapshot = &r->snapshot.pending;
+    unsigned i;
+    int rv;
+
+    assert(r->snapshot.put.data == NULL);
+    r->snapshot.put.data = r;
+    rv = r->io->snapshot_put(r->io, r->snapshot.trailing, &r->snapshot.put,
+                             snapshot, takeSnapshotCb);
+    if (rv != 0) {
+        r->snapshot.put.data = NULL;
+        for (i = 0; i < snapshot->n_bufs; i++) {
+            raft_free(snapshot->bufs[i].base);
+        }
+        raft_free(snapshot->bufs);
+        return rv;
+    }
+
+    return 0;
+}
+
+/* Return true if the FSM can take snapshots asynchronously. */
+static bool canSnapshotAsync(struct raft *r)
+{
+    return r->fsm->version >= 2 && r->fsm->snapshot_async != NULL;
+}
+
+static void takeSnapshotAsyncCb(struct raft_fsm_snapshot *req, int status)
 {
+    struct raft *r = req->data;
     struct raft_snapshot *snapshot;
     unsigned i;
     int rv;
 
+    /* If raft was closed in the meantime, just release the content. */
+    if (r == NULL) {
+        if (status == 0) {
+            for (i = 0; i < req->n_bufs; i++) {
+                raft_free(req->bufs[i].base);
+            }
+            raft_free(req->bufs);
+        }
+        raft_free(req);
+        return;
+    }
+
+    assert(r->snapshot.take == req);
+    r->snapshot.take = NULL;
+    snapshot = &r->snapshot.pending;
+
+    if (status != 0) {
+        rv = status;
+        goto abort;
+    }
+
+    snapshot->bufs = req->bufs;
+    snapshot->n_bufs = req->n_bufs;
+    raft_free(req);
+
+    rv = putSnapshot(r);
+    if (rv != 0) {
+        goto abort_after_fsm_snapshot;
+    }
+
+    return;
+
+abort:
+    raft_free(req);
+abort_after_fsm_snapshot:
+    debugf(r, "snapshot %lld at term %lld: %s", snapshot->index,
+           snapshot->term, raft_strerror(rv));
+    raft_configuration_close(&snapshot->configuration);
+    snapshot->term = 0;
+}
+
+/* Ask the FSM to take a snapshot asynchronously. */
+static int takeSnapshotAsync(struct raft *r)
+{
+    struct raft_fsm_snapshot *req;
+    int rv;
+
+    req = raft_malloc(sizeof *req);
+    if (req == NULL) {
+        return RAFT_NOMEM;
+    }
+    req->data = r;
+    req->bufs = NULL;
+    req->n_bufs = 0;
+
+    r->snapshot.take = req;
+    rv = r->fsm->snapshot_async(r->fsm, req, takeSnapshotAsyncCb);
+    if (rv != 0) {
+        r->snapshot.take = NULL;
+        raft_free(req);
+        return rv;
+    }
+
+    return 0;
+}
+
+static int takeSnapshot(struct raft *r)
+{
+    struct raft_snapshot *snapshot;
+    int rv;
+
     debugf(r, "take snapshot at %lld", r->last_applied);
 
     snapshot = &r->snapshot.pending;
@@ -1387,30 +2254,32 @@ static int takeSnapshot(struct raft *r)
 
     snapshot->configuration_index = r->configuration_index;
 
+    if (canSnapshotAsync(r)) {
+        rv = takeSnapshotAsync(r);
+        if (rv != 0) {
+            goto abort_after_fsm_error;
+        }
+        /* Resumed by takeSnapshotAsyncCb(). */
+        return 0;
+    }
+
     rv = r->fsm->snapshot(r->fsm, &snapshot->bufs, &snapshot->n_bufs);
     if (rv != 0) {
-        /* Ignore transient errors. We'll retry next time. */
-        if (rv == RAFT_BUSY) {
-            rv = 0;
-        }
-        goto abort_after_config_copy;
+        goto abort_after_fsm_error;
     }
 
-    assert(r->snapshot.put.data == NULL);
-    r->snapshot.put.data = r;
-    rv = r->io->snapshot_put(r->io, r->snapshot.trailing, &r->snapshot.put,
-                             snapshot, takeSnapshotCb);
+    rv = putSnapshot(r);
     if (rv != 0) {
-        goto abort_after_fsm_snapshot;
+        goto abort_after_config_copy;
     }
 
     return 0;
 
-abort_after_fsm_snapshot:
-    for (i = 0; i < snapshot->n_bufs; i++) {
-        raft_free(snapshot->bufs[i].base);
+abort_after_fsm_error:
+    /* Ignore transient errors. We'll retry next time. */
+    if (rv == RAFT_BUSY) {
+        rv = 0;
     }
-    raft_free(snapshot->bufs);
 abort_after_config_copy:
     raft_configuration_close(&snapshot->configuration);
 abort:
@@ -1418,6 +2287,21 @@ abort:
     return rv;
 }
 
+/* If the payloads of the entries in memory exceed the configured limit, release
+ * the ones of the oldest entries. Only entries that were both applied and
+ * persisted are eligible, since their payloads are needed only to send them to
+ * followers, and they can be read back from disk for that. */
+static void maybeEvict(struct raft *r)
+{
+    raft_index index = min(r->last_applied, r->last_stored);
+
+    if (r->max_log_bytes == 0 || !canFetchEntries(r)) {
+        return;
+    }
+
+    logEvict(&r->log, index, r->max_log_bytes);
+}
+
 int replicationApply(struct raft *r)
 {
     raft_index index;
@@ -1431,15 +2315,38 @@ int replicationApply(struct raft *r)
         return 0;
     }
 
-    for (index = r->last_applied + 1; index <= r->commit_index; index++) {
+    /* If a run of entries is being applied off the event loop thread, we'll
+     * resume from where it ends once it completes. */
+    if (r->apply.work != NULL) {
+        return 0;
+    }
+
+    index = r->last_applied + 1;
+    while (index <= r->commit_index) {
         const struct raft_entry *entry = logGet(&r->log, index);
+        unsigned n = 1; /* Number of entries applied in this iteration. */
 
         assert(entry->type == RAFT_COMMAND || entry->type == RAFT_BARRIER ||
                entry->type == RAFT_CHANGE);
 
         switch (entry->type) {
             case RAFT_COMMAND:
-                rv = applyCommand(r, index, &entry->buf);
+                if (canApplyAsync(r)) {
+                    n = countCommands(r, index);
+                    rv = applyCommandsAsync(r, index, n);
+                    if (rv == 0) {
+                        /* Resumed by applyWorkCb(). */
+                        return 0;
+                    }
+                    /* Fall back to applying the entries right away. */
+                    n = 1;
+                }
+                if (canApplyBatch(r)) {
+                    n = countCommands(r, index);
+                    rv = applyCommands(r, index, n);
+                } else {
+                    rv = applyCommand(r, index, &entry->buf);
+                }
                 break;
             case RAFT_BARRIER:
                 applyBarrier(r, index);
@@ -1455,23 +2362,63 @@ int replicationApply(struct raft *r)
             break;
         }
 
-        r->last_applied = index;
+        index += n;
+        r->last_applied = index - 1;
     }
 
     if (shouldTakeSnapshot(r)) {
         rv = takeSnapshot(r);
     }
 
+    maybeEvict(r);
+
+    readMaybeComplete(r);
+
     return rv;
 }
 
-void replicationQuorum(struct raft *r, const raft_index index)
+/* Return the highest index that is stored on a majority of voting servers,
+ * according to their match index. That's the match index of the voting server
+ * which is ranked at position n_voting / 2 + 1 when sorting match indexes in
+ * decreasing order, which we find by counting, for each voting server, how many
+ * other voting servers have at least its match index. The number of voting
+ * servers is small, so this is cheaper than allocating an array to sort. */
+static raft_index quorumIndex(struct raft *r)
 {
-    size_t votes = 0;
-    size_t i;
+    unsigned n_voting = configurationNumVoting(&r->configuration);
+    raft_index index = 0;
+    unsigned i;
+    unsigned j;
+
+    for (i = 0; i < r->configuration.n; i++) {
+        raft_index match_index = r->leader_state.progress[i].match_index;
+        unsigned votes = 0;
+        if (!r->configuration.servers[i].voting || match_index <= index) {
+            continue;
+        }
+        for (j = 0; j < r->configuration.n; j++) {
+            if (!r->configuration.servers[j].voting) {
+                continue;
+            }
+            if (r->leader_state.progress[j].match_index >= match_index) {
+                votes++;
+            }
+        }
+        if (votes > n_voting / 2) {
+            index = match_index;
+        }
+    }
+
+    return index;
+}
+
+void replicationQuorum(struct raft *r)
+{
+    raft_index index;
 
     assert(r->state == RAFT_LEADER);
 
+    index = quorumIndex(r);
     if (index <= r->commit_index) {
         return;
     }
@@ -1484,20 +2431,6 @@ void replicationQuorum(struct raft *r, const raft_index index)
     // assert(logTermOf(&r->log, index) > 0);
     assert(logTermOf(&r->log, index) <= r->current_term);
 
-    for (i = 0; i < r->configuration.n; i++) {
-        struct raft_server *server = &r->configuration.servers[i];
-        if (!server->voting) {
-            continue;
-        }
-        if (r->leader_state.progress[i].match_index >= index) {
-            votes++;
-        }
-    }
-
-    if (votes > configurationNumVoting(&r->configuration) / 2) {
-        r->commit_index = index;
-        tracef("new commit index %ld", r->commit_index);
-    }
-
-    return;
+    r->commit_index = index;
+    tracef("new commit index %ld", r->commit_index);
 }
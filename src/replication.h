@@ -9,11 +9,28 @@
  * was sent in the last heartbeat interval. */
 int replicationHeartbeat(struct raft *r);
 
+/* Send an AppendEntries RPC message to all voting followers right away,
+ * regardless of when the last one was sent, so that they acknowledge our
+ * leadership as soon as possible. Followers which are being sent a snapshot are
+ * skipped. */
+void replicationConfirmLeadership(struct raft *r);
+
 /* Start a local disk write for entries from the given index onwards, and
  * trigger replication against all followers, typically sending AppendEntries
- * RPC messages with outstanding log entries. */
+ * RPC messages with outstanding log entries.
+ *
+ * If the I/O implementation supports raft_io->flush(), the disk write and the
+ * messages are deferred until the end of the current loop iteration, and
+ * coalesced with the ones for any other entry appended in the meantime. */
 int replicationTrigger(struct raft *r, raft_index index);
 
+/* Submit the disk write for the entries appended since the last flush, whose
+ * write was deferred until the end of the current loop iteration, and, if @send
+ * is true, trigger replication against all followers.
+ *
+ * This is a no-op if there are no such entries. */
+int replicationFlush(struct raft *r, bool send);
+
 /* Possibly send an AppendEntries or an InstallSnapshot RPC message to the
  * server with the given index.
  *
@@ -27,7 +44,13 @@ int replicationTrigger(struct raft *r, raft_index index);
  *   haven't sent any during the last heartbeat interval.
  *
  * - If we are pipelining entries to the follower, then send any new entries
- *   haven't yet sent.
+ *   haven't yet sent, as long as the follower's in-flight window is not full.
+ *   While the window is full, only send an empty AppendEntries message if we
+ *   haven't sent any during the last heartbeat interval.
+ *
+ * - If the entries to send are being read from disk, only send an empty
+ *   AppendEntries message if we haven't sent any during the last heartbeat
+ *   interval.
  *
  * If a message should be sent, the rules to decide what type of message to send
  * and what it should contain are:
@@ -35,8 +58,11 @@ int replicationTrigger(struct raft *r, raft_index index);
  * - If we don't have anymore the first entry that should be sent to the
  *   follower, then send an InstallSnapshot RPC with the last snapshot.
  *
- * - If we still have the first entry to send, then send all entries from that
-     index onward (possibly zero).
+ * - If we still have the first entry to send, then send the entries from that
+ *   index onward (possibly zero), split in windows that honor the
+ *   max_append_entries and max_append_bytes limits. In probe mode only the
+ *   first window is sent, while in pipeline mode all windows are sent back to
+ *   back.
  *
  * This function must be called only by leaders. */
 int replicationProgress(struct raft *r, unsigned i);
@@ -71,8 +97,18 @@ int replicationAppend(struct raft *r,
                       raft_index *rejected,
                       bool *async);
 
+/* Follower logic for receiving a chunk of a snapshot. Ownership of the
+ * configuration and of the data of @args is always transferred.
+ *
+ * The chunk is appended to the ones received so far. The async output
+ * parameter will be set to true if no reply should be sent right now, either
+ * because more chunks are expected or because the snapshot is being stored and
+ * an AppendEntries result message will be sent once that completes. If the
+ * chunk doesn't follow the ones received so far, it gets rejected.
+ *
+ * It must be called only by followers. */
 int replicationInstallSnapshot(struct raft *r,
-                               const struct raft_install_snapshot *args,
+                               struct raft_install_snapshot *args,
                                raft_index *rejected,
                                bool *async);
 
@@ -81,8 +117,8 @@ int replicationInstallSnapshot(struct raft *r,
  * It must be called by leaders or followers. */
 int replicationApply(struct raft *r);
 
-/* Check if a quorum has been reached for the given log index, and update the
- * commit index accordingly if so.
+/* Update the commit index to the highest index that is stored on a majority of
+ * voting servers, if it's higher than the current one.
  *
  * From Figure 3.1:
  *
@@ -90,6 +126,6 @@ int replicationApply(struct raft *r);
  *
  *   If there exists an N such that N > commitIndex, a majority of
  *   matchIndex[i] >= N, and log[N].term == currentTerm: set commitIndex = N */
-void replicationQuorum(struct raft *r, const raft_index index);
+void replicationQuorum(struct raft *r);
 
 #endif /* REPLICATION_H_ */
@@ -0,0 +1,149 @@
+#include "request.h"
+#include "assert.h"
+
+void requestRegInit(struct raft_request_registry *reg)
+{
+    reg->slots = NULL;
+    reg->size = 0;
+    reg->front = reg->back = 0;
+}
+
+void requestRegClose(struct raft_request_registry *reg)
+{
+    assert(requestRegNumRequests(reg) == 0);
+    if (reg->slots != NULL) {
+        raft_free(reg->slots);
+    }
+    requestRegInit(reg);
+}
+
+size_t requestRegNumRequests(struct raft_request_registry *reg)
+{
+    /* The circular buffer is not wrapped. */
+    if (reg->front <= reg->back) {
+        return reg->back - reg->front;
+    }
+
+    /* The circular buffer is wrapped. */
+    return reg->size - reg->front + reg->back;
+}
+
+/* Return the i'th request in the registry. */
+static struct request *requestAt(struct raft_request_registry *reg, size_t i)
+{
+    return reg->slots[(reg->front + i) % reg->size];
+}
+
+/* Ensure that the slots array has enough room for a new request. */
+static int ensureCapacity(struct raft_request_registry *reg)
+{
+    void **slots; /* New slots array */
+    size_t n;     /* Current number of requests */
+    size_t size;  /* Size of the new array */
+    size_t i;
+
+    n = requestRegNumRequests(reg);
+
+    if (n + 1 < reg->size) {
+        return 0;
+    }
+
+    /* Make the new size twice the current size plus one (for the new
+     * request). */
+    size = (reg->size + 1) * 2;
+
+    slots = raft_malloc(size * sizeof *slots);
+    if (slots == NULL) {
+        return RAFT_NOMEM;
+    }
+
+    /* Copy all active requests to the beginning of the new array. */
+    for (i = 0; i < n; i++) {
+        slots[i] = requestAt(reg, i);
+    }
+
+    if (reg->slots != NULL) {
+        raft_free(reg->slots);
+    }
+
+    reg->slots = slots;
+    reg->size = size;
+    reg->front = 0;
+    reg->back = n;
+
+    return 0;
+}
+
+int requestRegEnqueue(struct raft_request_registry *reg, struct request *req)
+{
+    size_t n = requestRegNumRequests(reg);
+    int rv;
+
+    assert(req->index > 0);
+    assert(n == 0 || requestAt(reg, n - 1)->index < req->index);
+
+    rv = ensureCapacity(reg);
+    if (rv != 0) {
+        return rv;
+    }
+
+    reg->slots[reg->back] = req;
+    reg->back = (reg->back + 1) % reg->size;
+
+    return 0;
+}
+
+struct request *requestRegDequeue(struct raft_request_registry *reg,
+                                  raft_index index,
+                                  int type)
+{
+    struct request *req;
+
+    if (requestRegNumRequests(reg) == 0) {
+        return NULL;
+    }
+
+    req = requestAt(reg, 0);
+
+    /* Entries are applied in order, so there can't be any request with a
+     * lower index still waiting. If the oldest request has a higher index, no
+     * request is associated with this entry (e.g. it was created in a previous
+     * term, or it's not the first entry of a multi-command raft_apply()). */
+    assert(req->index >= index);
+    if (req->index != index) {
+        return NULL;
+    }
+
+    assert(req->type == type);
+    (void)type;
+
+    return requestRegPopFront(reg);
+}
+
+struct request *requestRegPopFront(struct raft_request_registry *reg)
+{
+    struct request *req;
+
+    if (requestRegNumRequests(reg) == 0) {
+        return NULL;
+    }
+
+    req = requestAt(reg, 0);
+    reg->front = (reg->front + 1) % reg->size;
+
+    return req;
+}
+
+void requestRegPopBack(struct raft_request_registry *reg, struct request *req)
+{
+    assert(requestRegNumRequests(reg) > 0);
+
+    if (reg->back == 0) {
+        reg->back = reg->size - 1;
+    } else {
+        reg->back--;
+    }
+
+    assert(reg->slots[reg->back] == req);
+    (void)req;
+}
@@ -13,4 +13,32 @@ struct request
     void *queue[2];
 };
 
+/* Initialize an empty registry of outstanding client requests. */
+void requestRegInit(struct raft_request_registry *reg);
+
+/* Release the memory used by the registry. It must be empty. */
+void requestRegClose(struct raft_request_registry *reg);
+
+/* Return the number of outstanding requests. */
+size_t requestRegNumRequests(struct raft_request_registry *reg);
+
+/* Add a new request to the back of the registry. The index of the request must
+ * be greater than the one of any other request currently in the registry. */
+int requestRegEnqueue(struct raft_request_registry *reg, struct request *req);
+
+/* Remove and return the request associated with the entry at the given index,
+ * if any. The entry must be the lowest one not yet applied, and its type must
+ * match the given one. */
+struct request *requestRegDequeue(struct raft_request_registry *reg,
+                                  raft_index index,
+                                  int type);
+
+/* Remove and return the oldest request, or #NULL if the registry is empty. */
+struct request *requestRegPopFront(struct raft_request_registry *reg);
+
+/* Remove the most recently enqueued request, which must be the given one.
+ *
+ * Used to roll back requests whose entries failed to be appended. */
+void requestRegPopBack(struct raft_request_registry *reg, struct request *req);
+
 #endif /* REQUEST_H_ */
@@ -90,7 +90,7 @@ static int maybeSelfElect(struct raft *r)
         return 0;
     }
     debugf(r, "self elect and convert to leader");
-    rv = convertToCandidate(r);
+    rv = convertToCandidate(r, false);
     if (rv != 0) {
         return rv;
     }
@@ -6,7 +6,9 @@
 #include "election.h"
 #include "logging.h"
 #include "progress.h"
+#include "read.h"
 #include "replication.h"
+#include "transfer.h"
 
 /* Number of milliseconds after which a server promotion will be aborted if the
  * server hasn't caught up with the logs yet. */
@@ -44,7 +46,7 @@ static int tickFollower(struct raft *r)
      */
     if (electionTimerExpired(r) && server->voting) {
         infof(r, "convert to candidate and start new election");
-        rv = convertToCandidate(r);
+        rv = convertToCandidate(r, false);
         if (rv != 0) {
             errorf(r, "convert to candidate: %s", raft_strerror(rv));
             return rv;
@@ -125,6 +127,9 @@ static int tickLeader(struct raft *r)
         r->election_timer_start = r->io->time(r->io);
     }
 
+    /* Keep our lease alive, if leases are enabled. */
+    readRenewLease(r);
+
     /* Possibly send heartbeats.
      *
      * From Figure 3.1:
@@ -134,6 +139,15 @@ static int tickLeader(struct raft *r)
      */
     replicationHeartbeat(r);
 
+    /* Complete any read request that became ready. */
+    readMaybeComplete(r);
+    if (r->state != RAFT_LEADER) {
+        return 0;
+    }
+
+    /* Give up transferring leadership if it's taking too long. */
+    transferMaybeExpire(r);
+
     /* If a server is being promoted, increment the timer of the current
      * round or abort the promotion.
      *
@@ -0,0 +1,208 @@
+#include "transfer.h"
+#include "assert.h"
+#include "configuration.h"
+#include "log.h"
+#include "logging.h"
+#include "progress.h"
+#include "read.h"
+#include "replication.h"
+
+/* Set to 1 to enable tracing. */
+#if 0
+#define tracef(MSG, ...) debugf(r, "transfer: " MSG, ##__VA_ARGS__)
+#else
+#define tracef(MSG, ...)
+#endif
+
+/* TimeoutNow request context */
+struct request
+{
+    struct raft *raft;
+    struct raft_io_send send;
+    unsigned server_id;
+};
+
+void transferInit(struct raft *r)
+{
+    r->leader_state.transfer = NULL;
+}
+
+/* Return the index of the voting server other than us with the highest match
+ * index, or the number of servers if there's none. */
+static unsigned pickTarget(struct raft *r)
+{
+    unsigned target = r->configuration.n;
+    unsigned i;
+
+    for (i = 0; i < r->configuration.n; i++) {
+        const struct raft_server *server = &r->configuration.servers[i];
+        if (server->id == r->id || !server->voting) {
+            continue;
+        }
+        if (target == r->configuration.n ||
+            progressMatchIndex(r, i) > progressMatchIndex(r, target)) {
+            target = i;
+        }
+    }
+
+    return target;
+}
+
+int transferStart(struct raft *r, struct raft_transfer *req, unsigned id)
+{
+    const struct raft_server *server;
+    unsigned i;
+    int rv;
+
+    assert(r->state == RAFT_LEADER);
+    assert(r->leader_state.transfer == NULL);
+
+    if (id == 0) {
+        i = pickTarget(r);
+    } else {
+        i = configurationIndexOf(&r->configuration, id);
+    }
+    if (i == r->configuration.n) {
+        return RAFT_BADID;
+    }
+
+    server = &r->configuration.servers[i];
+    if (server->id == r->id || !server->voting) {
+        return RAFT_BADID;
+    }
+
+    tracef("start transfer to server %u", server->id);
+
+    req->id = server->id;
+    req->start = r->io->time(r->io);
+    req->sent = false;
+    r->leader_state.transfer = req;
+
+    if (progressMatchIndex(r, i) == logLastIndex(&r->log)) {
+        transferMaybeSend(r, i);
+        return 0;
+    }
+
+    /* Immediately send the missing entries to the target server. */
+    rv = replicationProgress(r, i);
+    if (rv != 0 && rv != RAFT_NOCONNECTION) {
+        /* This error is not fatal. */
+        debugf(r, "failed to send append entries to server %ld: %s (%d)",
+               server->id, raft_strerror(rv), rv);
+    }
+
+    return 0;
+}
+
+static void sendTimeoutNowCb(struct raft_io_send *send, int status)
+{
+    struct request *req = send->data;
+    struct raft *r = req->raft;
+    if (status != 0) {
+        warnf(r, "failed to send timeout now to server %ld: %s",
+              req->server_id, raft_strerror(status));
+    }
+    raft_free(req);
+}
+
+/* Send a TimeoutNow RPC to the given server. */
+static int sendTimeoutNow(struct raft *r, const struct raft_server *server)
+{
+    struct raft_message message;
+    struct request *req;
+    int rv;
+
+    message.type = RAFT_IO_TIMEOUT_NOW;
+    message.timeout_now.term = r->current_term;
+    message.timeout_now.last_log_index = logLastIndex(&r->log);
+    message.timeout_now.last_log_term = logLastTerm(&r->log);
+    message.server_id = server->id;
+    message.server_address = server->address;
+
+    req = raft_malloc(sizeof *req);
+    if (req == NULL) {
+        return RAFT_NOMEM;
+    }
+
+    req->raft = r;
+    req->send.data = req;
+    req->server_id = server->id;
+
+    rv = r->io->send(r->io, &req->send, &message, sendTimeoutNowCb);
+    if (rv != 0) {
+        raft_free(req);
+        return rv;
+    }
+
+    return 0;
+}
+
+void transferMaybeSend(struct raft *r, unsigned i)
+{
+    struct raft_transfer *req = r->leader_state.transfer;
+    const struct raft_server *server;
+    int rv;
+
+    assert(r->state == RAFT_LEADER);
+
+    if (req == NULL || req->sent || i >= r->configuration.n) {
+        return;
+    }
+
+    server = &r->configuration.servers[i];
+    if (server->id != req->id) {
+        return;
+    }
+
+    if (progressMatchIndex(r, i) < logLastIndex(&r->log)) {
+        return;
+    }
+
+    tracef("server %u is up-to-date -> send timeout now", server->id);
+
+    /* If sending fails, retry after the next AppendEntries result. */
+    rv = sendTimeoutNow(r, server);
+    if (rv != 0) {
+        warnf(r, "failed to send timeout now to server %ld: %s", server->id,
+              raft_strerror(rv));
+        return;
+    }
+    req->sent = true;
+
+    /* The target server ignores us when asking for votes, so followers might
+     * vote for it right after acknowledging our heartbeats. */
+    readRevokeLease(r);
+}
+
+void transferMaybeExpire(struct raft *r)
+{
+    struct raft_transfer *req = r->leader_state.transfer;
+    raft_time now = r->io->time(r->io);
+
+    assert(r->state == RAFT_LEADER);
+
+    if (req == NULL || now - req->start < r->election_timeout) {
+        return;
+    }
+
+    tracef("transfer to server %u timed out", req->id);
+
+    r->leader_state.transfer = NULL;
+    if (req->cb != NULL) {
+        req->cb(req, RAFT_CANCELED);
+    }
+}
+
+void transferClose(struct raft *r)
+{
+    struct raft_transfer *req = r->leader_state.transfer;
+
+    if (req == NULL) {
+        return;
+    }
+
+    r->leader_state.transfer = NULL;
+    if (req->cb != NULL) {
+        req->cb(req, req->sent ? 0 : RAFT_LEADERSHIPLOST);
+    }
+}
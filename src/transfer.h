@@ -0,0 +1,32 @@
+/* Leadership transfer using the TimeoutNow message (Section 3.10). */
+
+#ifndef TRANSFER_H_
+#define TRANSFER_H_
+
+#include "../include/raft.h"
+
+/* Initialize the leader state used to track leadership transfers. */
+void transferInit(struct raft *r);
+
+/* Start transferring leadership to the voting server with the given ID, or to
+ * the most up-to-date voting server if @id is 0. If the log of the target
+ * server is already up-to-date, send it a TimeoutNow message right away,
+ * otherwise send it the missing entries first. */
+int transferStart(struct raft *r, struct raft_transfer *req, unsigned id);
+
+/* If leadership is being transferred to the server at index @i in the current
+ * configuration and its log is up-to-date, send it a TimeoutNow message, if
+ * not sent already.
+ *
+ * To be called after receiving AppendEntries results. */
+void transferMaybeSend(struct raft *r, unsigned i);
+
+/* Cancel the leadership transfer in progress, if it did not complete within an
+ * election timeout. To be called at every tick. */
+void transferMaybeExpire(struct raft *r);
+
+/* Fire the callback of the leadership transfer in progress, if any. To be
+ * called when stepping down. */
+void transferClose(struct raft *r);
+
+#endif /* TRANSFER_H_ */
@@ -56,7 +56,8 @@ static int uvInit(struct raft_io *io,
              uv->metadata.version, uv->metadata.term, uv->metadata.voted_for);
 
     /* Detect the I/O capabilities of the underlying file system. */
-    rv = uvProbeIoCapabilities(uv->dir, &direct_io, &uv->async_io, errmsg);
+    rv = uvProbeIoCapabilities(uv->dir, &direct_io, &uv->async_io,
+                               &uv->uring_io, errmsg);
     if (rv != 0) {
         uvErrorf(uv, "probe I/O capabilities: %s", errmsg);
         rv = RAFT_IOERR;
@@ -64,7 +65,8 @@ static int uvInit(struct raft_io *io,
     }
     uv->direct_io = direct_io != 0;
     uv->block_size = direct_io != 0 ? direct_io : 4096;
-    uvDebugf(uv, "I/O: direct %d, block %d", uv->direct_io, uv->block_size);
+    uvDebugf(uv, "I/O: direct %d, block %d, io_uring %d", uv->direct_io,
+             uv->block_size, uv->uring_io);
 
     /* We expect the maximum segment size to be a multiple of the block size */
     assert(UV__MAX_SEGMENT_SIZE % uv->block_size == 0);
@@ -79,6 +81,12 @@ static int uvInit(struct raft_io *io,
     rv = uv_timer_init(uv->loop, &uv->timer);
     assert(rv == 0); /* This should never fail */
     uv->timer.data = uv;
+    rv = uv_check_init(uv->loop, &uv->check);
+    assert(rv == 0); /* This should never fail */
+    uv->check.data = uv;
+    rv = uv_idle_init(uv->loop, &uv->idle);
+    assert(rv == 0); /* This should never fail */
+    uv->idle.data = uv;
     uv->state = UV__ACTIVE;
     uv->log_level = RAFT_INFO;
 
@@ -120,6 +128,50 @@ static int uvStart(struct raft_io *io,
     return 0;
 }
 
+/* Check callback, invoked once per loop iteration after I/O events have been
+ * processed. */
+static void checkCb(uv_check_t *check)
+{
+    struct uv *uv = check->data;
+    raft_io_flush_cb cb = uv->flush_cb;
+    int rv;
+    rv = uv_check_stop(&uv->check);
+    assert(rv == 0);
+    rv = uv_idle_stop(&uv->idle);
+    assert(rv == 0);
+    uv->flush_cb = NULL;
+    if (cb != NULL) {
+        cb(uv->io);
+    }
+}
+
+/* Idle callback. It does nothing, an active idle handle just makes the loop
+ * poll for I/O without blocking, so checkCb() fires in the current iteration
+ * instead of after the next I/O event or timer. */
+static void idleCb(uv_idle_t *idle)
+{
+    (void)idle;
+}
+
+/* Implementation of raft_io->flush. */
+static int uvFlush(struct raft_io *io, raft_io_flush_cb cb)
+{
+    struct uv *uv;
+    int rv;
+    uv = io->impl;
+    if (uv->closing) {
+        return RAFT_CANCELED;
+    }
+    if (uv->flush_cb == NULL) {
+        rv = uv_check_start(&uv->check, checkCb);
+        assert(rv == 0);
+        rv = uv_idle_start(&uv->idle, idleCb);
+        assert(rv == 0);
+    }
+    uv->flush_cb = cb;
+    return 0;
+}
+
 static bool hasPendingDiskIO(struct uv *uv)
 {
     return !QUEUE_IS_EMPTY(&uv->append_segments) ||
@@ -127,6 +179,7 @@ static bool hasPendingDiskIO(struct uv *uv)
            uv->finalize_work.data != NULL ||
            !QUEUE_IS_EMPTY(&uv->truncate_reqs) ||
            uv->truncate_work.data != NULL ||
+           !QUEUE_IS_EMPTY(&uv->read_reqs) ||
            !QUEUE_IS_EMPTY(&uv->snapshot_put_reqs) ||
            !QUEUE_IS_EMPTY(&uv->snapshot_get_reqs);
 }
@@ -142,7 +195,7 @@ void uvMaybeClose(struct uv *uv)
         return;
     }
 
-    if (hasPendingDiskIO(uv)) {
+    if (hasPendingDiskIO(uv) || uv->worker != NULL) {
         return;
     }
 
@@ -158,10 +211,22 @@ static void timerCloseCb(uv_handle_t *handle)
     uvMaybeClose(uv);
 }
 
+static void idleCloseCb(uv_handle_t *handle)
+{
+    struct uv *uv = handle->data;
+    uv_close((uv_handle_t *)&uv->timer, timerCloseCb);
+}
+
+static void checkCloseCb(uv_handle_t *handle)
+{
+    struct uv *uv = handle->data;
+    uv_close((uv_handle_t *)&uv->idle, idleCloseCb);
+}
+
 static void transportCloseCb(struct raft_uv_transport *t)
 {
     struct uv *uv = t->data;
-    uv_close((uv_handle_t *)&uv->timer, timerCloseCb);
+    uv_close((uv_handle_t *)&uv->check, checkCloseCb);
 }
 
 /* Implementation of raft_io->close. */
@@ -175,11 +240,19 @@ static int uvClose(struct raft_io *io, void (*cb)(struct raft_io *io))
     uv->closing = true;
     rv = uv_timer_stop(&uv->timer);
     assert(rv == 0);
+    rv = uv_check_stop(&uv->check);
+    assert(rv == 0);
+    rv = uv_idle_stop(&uv->idle);
+    assert(rv == 0);
+    uv->flush_cb = NULL;
     uvSendClose(uv);
     uvRecvClose(uv);
     uvPrepareClose(uv);
     uvAppendClose(uv);
     uvTruncateClose(uv);
+    uvReadClose(uv);
+    uvSnapshotClose(uv);
+    uvWorkClose(uv);
     uv->transport->close(uv->transport, transportCloseCb);
     return 0;
 }
@@ -497,6 +570,13 @@ int uvAppend(struct raft_io *io,
 /* Implementation of raft_io->truncate (defined in uv_truncate.c). */
 int uvTruncate(struct raft_io *io, raft_index index);
 
+/* Implementation of raft_io->read_entries (defined in uv_read.c). */
+int uvReadEntries(struct raft_io *io,
+                  struct raft_io_read_entries *req,
+                  raft_index index,
+                  size_t max_bytes,
+                  raft_io_read_entries_cb cb);
+
 /* Implementation of raft_io->send (defined in uv_send.c). */
 int uvSend(struct raft_io *io,
            struct raft_io_send *req,
@@ -515,6 +595,14 @@ int uvSnapshotGet(struct raft_io *io,
                   struct raft_io_snapshot_get *req,
                   raft_io_snapshot_get_cb cb);
 
+/* Implementation of raft_io->snapshot_release (defined in uv_snapshot.c). */
+void uvSnapshotRelease(struct raft_io *io, struct raft_snapshot *snapshot);
+
+/* Implementation of raft_io->async_work (defined in uv_work.c). */
+int uvAsyncWork(struct raft_io *io,
+                struct raft_io_async_work *req,
+                raft_io_async_work_cb cb);
+
 /* Implementation of raft_io->time. */
 static raft_time uvTime(struct raft_io *io)
 {
@@ -580,14 +668,24 @@ int raft_uv_init(struct raft_io *io,
     uv->finalize_work.data = NULL;
     QUEUE_INIT(&uv->truncate_reqs);
     uv->truncate_work.data = NULL;
+    QUEUE_INIT(&uv->read_reqs);
     QUEUE_INIT(&uv->snapshot_put_reqs);
     QUEUE_INIT(&uv->snapshot_get_reqs);
     uv->snapshot_put_work.data = NULL;
+    uv->snapshot_cache = NULL;
+    uv->snapshot_n_puts = 0;
+    uv->snapshot_dedup = false;
+    uv->snapshot_compression = false;
+    uv->append_offload = false;
+    uv->busy_poll = 0;
     uv->tick_cb = NULL;
+    uv->flush_cb = NULL;
+    uv->worker = NULL;
     uv->closing = false;
     uv->close_cb = NULL;
 
     /* Set the raft_io implementation. */
+    io->version = 2;
     io->impl = uv;
     io->init = uvInit;
     io->start = uvStart;
@@ -603,10 +701,42 @@ int raft_uv_init(struct raft_io *io,
     io->snapshot_get = uvSnapshotGet;
     io->time = uvTime;
     io->random = uvRandom;
+    io->flush = uvFlush;
+    io->async_work = uvAsyncWork;
+    io->snapshot_release = uvSnapshotRelease;
+    io->read_entries = uvReadEntries;
 
     return 0;
 }
 
+void raft_uv_set_snapshot_dedup(struct raft_io *io, bool enabled)
+{
+    struct uv *uv;
+    uv = io->impl;
+    uv->snapshot_dedup = enabled;
+}
+
+void raft_uv_set_snapshot_compression(struct raft_io *io, bool enabled)
+{
+    struct uv *uv;
+    uv = io->impl;
+    uv->snapshot_compression = enabled;
+}
+
+void raft_uv_set_append_offload(struct raft_io *io, bool enabled)
+{
+    struct uv *uv;
+    uv = io->impl;
+    uv->append_offload = enabled;
+}
+
+void raft_uv_set_busy_poll(struct raft_io *io, unsigned usecs)
+{
+    struct uv *uv;
+    uv = io->impl;
+    uv->busy_poll = usecs;
+}
+
 void raft_uv_close(struct raft_io *io)
 {
     struct uv *uv;
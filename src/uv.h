@@ -11,6 +11,10 @@
 /* 8 Megabytes */
 #define UV__MAX_SEGMENT_SIZE (8 * 1024 * 1024)
 
+/* Maximum number of writes against an open segment that can be in flight at
+ * the same time. Each of them might be split in two file write requests. */
+#define UV__MAX_CONCURRENT_WRITES 4
+
 /* Template string for closed segment filenames: start index (inclusive), end
  * index (inclusive). */
 #define UV__CLOSED_TEMPLATE "%llu-%llu"
@@ -26,6 +30,22 @@
  * index, creation timestamp (milliseconds since epoch). */
 #define UV__SNAPSHOT_META_TEMPLATE UV__SNAPSHOT_TEMPLATE ".meta"
 
+/* Template string for snapshot chunk filenames: CRC32 checksum of the chunk
+ * data, chunk length, counter disambiguating chunks with the same checksum
+ * and length but different content. */
+#define UV__SNAPSHOT_CHUNK_TEMPLATE "chunk-%08x-%zu-%u"
+
+/* Maximum size of a snapshot chunk file. */
+#define UV__SNAPSHOT_CHUNK_SIZE (256 * 1024)
+
+/* Flags stored in the upper 32 bits of the format version field of snapshot
+ * metadata files. Older versions of the library reject such files as having
+ * an unsupported format, instead of misreading them. */
+enum {
+    UV__SNAPSHOT_CHUNKED = 1,   /* The data file is a manifest of chunk files */
+    UV__SNAPSHOT_COMPRESSED = 2 /* Data is compressed with UV__CODEC_LZ */
+};
+
 /* State codes. */
 enum { UV__ACTIVE = 1, UV__CLOSED };
 
@@ -46,6 +66,12 @@ struct uvClient;
 /* Hold state associated with an inbound connection. */
 struct uvServer;
 
+/* Hold state of the thread executing raft_io->async_work requests. */
+struct uvWorker;
+
+/* Reference-counted in-memory copy of a snapshot stored on disk. */
+struct uvSnapshot;
+
 /* Hold state of a libuv-based raft_io implementation. */
 struct uv
 {
@@ -59,6 +85,7 @@ struct uv
     bool errored;                        /* If a disk I/O error was hit */
     bool direct_io;                      /* Whether direct I/O is supported */
     bool async_io;                       /* Whether async I/O is supported */
+    bool uring_io;                       /* Whether io_uring is supported */
     size_t block_size;                   /* Block size of the data dir */
     unsigned n_blocks;                   /* N. of blocks in a segment */
     struct uvClient **clients;           /* Outbound connections */
@@ -79,12 +106,23 @@ struct uv
     struct uv_work_s finalize_work;      /* Resize and rename segments */
     queue truncate_reqs;                 /* Pending truncate requests */
     struct uv_work_s truncate_work;      /* Execute truncate log requests */
+    queue read_reqs;                     /* Pending read entries requests */
     queue snapshot_put_reqs;             /* Inflight put snapshot requests */
     queue snapshot_get_reqs;             /* Inflight get snapshot requests */
     struct uv_work_s snapshot_put_work;  /* Execute snapshot put requests */
+    struct uvSnapshot *snapshot_cache;   /* Last snapshot loaded */
+    unsigned long long snapshot_n_puts;  /* Completed snapshot put requests */
+    bool snapshot_dedup;                 /* Store snapshot data in chunks */
+    bool snapshot_compression;           /* Compress snapshot data */
+    bool append_offload;                 /* Encode entries in threadpool */
+    unsigned busy_poll;                  /* Busy-poll budget in usecs */
     struct uvMetadata metadata;          /* Cache of metadata on disk */
     struct uv_timer_s timer;             /* Timer for periodic ticks */
     raft_io_tick_cb tick_cb;             /* Invoked when the timer expires */
+    struct uv_check_s check;             /* Fire flush_cb after loop I/O */
+    struct uv_idle_s idle;               /* Don't block while flushing */
+    raft_io_flush_cb flush_cb;           /* Pending raft_io->flush() callback */
+    struct uvWorker *worker;             /* Thread running async work */
     raft_io_recv_cb recv_cb;             /* Invoked when upon RPC messages */
     bool closing;                        /* True if we are closing */
     raft_io_close_cb close_cb;           /* Invoked when finishing closing */
@@ -156,6 +194,16 @@ int uvSegmentLoadClosed(struct uv *uv,
                         struct raft_entry *entries[],
                         size_t *n);
 
+/* Load the entries of the given closed segment starting at @index and whose
+ * payloads fit in @max_bytes, always including the first one. Only the batches
+ * containing them are read. The entries are returned in a single batch. */
+int uvSegmentLoadRange(struct uv *uv,
+                       struct uvSegmentInfo *segment,
+                       raft_index index,
+                       size_t max_bytes,
+                       struct raft_entry *entries[],
+                       unsigned *n);
+
 /* Load raft entries from the given segments. The @start_index is the expected
  * index of the first entry of the first segment. */
 int uvSegmentLoadAll(struct uv *uv,
@@ -186,6 +234,11 @@ void uvSegmentBufferClose(struct uvSegmentBuffer *b);
  * must be called when the buffer is empty. */
 int uvSegmentBufferFormat(struct uvSegmentBuffer *b);
 
+/* Make sure that the buffer can hold @size more bytes, so that subsequent calls
+ * to uvSegmentBufferFormat() and uvSegmentBufferAppend() for at most that many
+ * bytes won't allocate memory and can't fail. */
+int uvSegmentBufferReserve(struct uvSegmentBuffer *b, size_t size);
+
 /* Extend the segment's buffer by encoding the given entries.
  *
  * Previous data in the buffer will be retained, and data for these new entries
@@ -199,12 +252,12 @@ int uvSegmentBufferAppend(struct uvSegmentBuffer *b,
  * memory to write. */
 void uvSegmentBufferFinalize(struct uvSegmentBuffer *b, uv_buf_t *out);
 
-/* Reset the buffer preparing it for the next segment write.
- *
- * If the retain parameter is greater than zero, then the data of the retain'th
- * block will be copied at the beginning of the buffer and the write offset will
- * be set accordingly. */
-void uvSegmentBufferReset(struct uvSegmentBuffer *b, unsigned retain);
+/* Copy at the beginning of the given empty buffer the last block of @src, if
+ * that block was only partially filled, so that the next write can append data
+ * to it. Memory for at least one block must have been reserved with
+ * uvSegmentBufferReserve(). */
+void uvSegmentBufferRetain(struct uvSegmentBuffer *b,
+                           const struct uvSegmentBuffer *src);
 
 /* Write the first closed segment, containing just one entry for the given
  * configuration. */
@@ -238,7 +291,10 @@ int uvSnapshotInfoAppendIfMatch(struct uv *uv,
  * snapshots will come first. */
 void uvSnapshotSort(struct uvSnapshotInfo *infos, size_t n_infos);
 
-/* Load the snapshot associated with the given metadata. */
+/* Load the snapshot associated with the given metadata.
+ *
+ * In case of error the configuration of the given snapshot is left empty, and
+ * anything else that was loaded is released. */
 int uvSnapshotLoad(struct uv *uv,
                    struct uvSnapshotInfo *meta,
                    struct raft_snapshot *snapshot);
@@ -320,6 +376,13 @@ void uvTruncateClose(struct uv *uv);
  * segment is left. */
 void uvTruncateMaybeProcessRequests(struct uv *uv);
 
+/* Callback invoked after a segment has been finalized or truncated. It will
+ * start executing the read entries requests that were waiting for it. */
+void uvReadMaybeProcessRequests(struct uv *uv);
+
+/* Cancel all read entries requests that were not started yet. */
+void uvReadClose(struct uv *uv);
+
 /* Stop all clients by closing the outbound stream handles and canceling all
  * pending send requests.  */
 void uvSendClose(struct uv *uv);
@@ -335,6 +398,24 @@ void uvRecvClose(struct uv *uv);
  * snapshot put requests. */
 void uvSnapshotMaybeProcessRequests(struct uv *uv);
 
+/* If the given chunk of snapshot data belongs to the cached snapshot, whose
+ * data was compressed when it was loaded, and it starts and ends at
+ * compression block boundaries, set @blocks to the compressed blocks covering
+ * it and return true. They remain valid as long as the snapshot does. */
+bool uvSnapshotCompressedBlocks(struct uv *uv,
+                                const struct raft_buffer *chunk,
+                                uv_buf_t *blocks);
+
+/* Drop the reference held on the cached snapshot, if any. Snapshots still in
+ * use by raft_io->snapshot_get() callers are released when they're done. */
+void uvSnapshotClose(struct uv *uv);
+
+/* Stop the worker thread executing async work requests, if it was started,
+ * waiting for the request currently being executed to finish. The callbacks of
+ * all outstanding requests are fired, with #RAFT_CANCELED for the ones that
+ * were not executed. */
+void uvWorkClose(struct uv *uv);
+
 void uvMaybeClose(struct uv *uv);
 
 #endif /* UV_H_ */
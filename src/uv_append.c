@@ -19,15 +19,17 @@
  *   the entries in the request, then request a new open segment to be prepared,
  *   queue the request and link it to the newly requested segment.
  *
- * - Wait for any pending write against the current segment to complete, and
- *   also for the prepare request if we asked for a new segment.
+ * - Wait for the prepare request if we asked for a new segment, and for enough
+ *   pending writes against the current segment to complete, if there are too
+ *   many of them or if the new entries would only rewrite the block partially
+ *   filled by the last one.
  *
  * - Submit a write request for the entries in this append request. The write
  *   request might contain other entries that might have accumulated in the
  *   meantime.
  *
- * - Wait for the write request to finish and fire the append request's
- *   callback.
+ * - Wait for the write request and all the ones submitted before it to finish
+ *   and fire the append request's callback.
  *
  * Possible failure modes are:
  *
@@ -44,15 +46,15 @@ struct segment
     struct uv *uv;                  /* Our writer */
     struct uvPrepare prepare;       /* Prepare segment file request */
     struct uvFile *file;            /* File to write to */
-    struct uvFileWrite write;       /* Write request */
     unsigned long long counter;     /* Open segment counter */
     raft_index first_index;         /* Index of the first entry written */
     raft_index last_index;          /* Index of the last entry written */
     size_t size;                    /* Total number of bytes used */
     unsigned next_block;            /* Next segment block to write */
     struct uvSegmentBuffer pending; /* Buffer for data yet to be written */
-    uv_buf_t buf;                   /* Write buffer for current write */
     size_t written;                 /* Number of bytes actually written */
+    queue writes;                   /* Writes in flight, oldest first */
+    unsigned n_writes;              /* Number of writes in flight */
     queue queue;                    /* Segment queue */
     bool finalize;                  /* Finalize the segment after writing */
 };
@@ -68,6 +70,34 @@ struct append
     queue queue;
 };
 
+/* A write of the batches of one or more append requests.
+ *
+ * Several writes against the same segment can be in flight at the same time,
+ * as long as they don't overlap. Since writes are block-aligned, the last block
+ * of a write is often only partially filled, and the next write starts by
+ * rewriting it with more data. In that case the first block of the next write
+ * is held back until the previous write completes, while the other blocks are
+ * submitted right away. */
+struct write
+{
+    struct segment *segment;     /* Segment being written */
+    struct append **reqs;        /* Append requests fulfilled by this write */
+    unsigned n_reqs;             /* Number of append requests */
+    struct uvSegmentBuffer data; /* Encoded batches, owned by this write */
+    unsigned first_block;        /* Segment block where the data starts */
+    size_t end;                  /* Segment size once the data is written */
+    uv_buf_t buf;                /* Blocks to write */
+    uv_buf_t first;              /* First block, if held back */
+    uv_buf_t rest;               /* Other blocks, if the first is held back */
+    struct uvFileWrite req;      /* Write request for the blocks not held */
+    struct uvFileWrite held_req; /* Write request for the held block */
+    bool held;                   /* Whether the first block is held back */
+    bool offloaded;              /* Whether batches are encoded in a thread */
+    unsigned n_left;             /* Number of file writes yet to complete */
+    int status;                  /* Result of the write */
+    queue queue;                 /* Link in the segment's writes queue */
+};
+
 /* Initialize an append request object. In particular, calculate the number of
  * bytes needed to store this batch in on disk. */
 static void initRequest(struct append *r,
@@ -104,40 +134,60 @@ static void reserveSegmentCapacity(struct segment *s, size_t size)
     s->size += size;
 }
 
-/* Extend the segment's write buffer by encoding the entries in the given
- * request into it. IOW, previous data in the write buffer will be retained, and
- * data for these new entries will be appended. */
-static int encodeEntriesToSegmentWriteBuf(struct segment *s, struct append *req)
+/* Extend the given write buffer by encoding the batches of the requests of the
+ * given write, preceded by the format version if the write is the very first
+ * one of its segment. IOW, previous data in the write buffer will be retained,
+ * and data for these new entries will be appended. */
+static int encodeWrite(struct write *w, struct uvSegmentBuffer *b)
 {
+    unsigned i;
     int rv;
-    assert(req->segment == s);
-    assert(s->written + req->size <= s->uv->block_size * s->uv->n_blocks);
 
-    /* If this is the very first write to the segment, we need to include the
-     * format version */
-    if (s->pending.n == 0 && s->next_block == 0) {
-        rv = uvSegmentBufferFormat(&s->pending);
+    if (b->n == 0 && w->first_block == 0) {
+        rv = uvSegmentBufferFormat(b);
         if (rv != 0) {
             return rv;
         }
     }
 
-    rv = uvSegmentBufferAppend(&s->pending, req->entries, req->n);
-    if (rv != 0) {
-        return rv;
+    for (i = 0; i < w->n_reqs; i++) {
+        struct append *r = w->reqs[i];
+        assert(r->segment == w->segment);
+        rv = uvSegmentBufferAppend(b, r->entries, r->n);
+        if (rv != 0) {
+            return rv;
+        }
     }
 
-    s->last_index += req->n;
-
     return 0;
 }
 
+/* Encode the batches of the given write and point its buffer at the result.
+ *
+ * This is invoked in the threadpool right before the write is submitted, when
+ * entries encoding is offloaded. The loop thread doesn't touch the write until
+ * it completes, and the needed memory was already reserved, so encoding can't
+ * fail. */
+static void encodeWriteInThreadpool(struct uvFileWrite *req)
+{
+    struct write *w = req->data;
+    int rv;
+
+    rv = encodeWrite(w, &w->data);
+    assert(rv == 0);
+    (void)rv;
+
+    uvSegmentBufferFinalize(&w->data, &w->buf);
+}
+
 /* Submit a request to close the current open segment. */
 static void finalizeSegment(struct segment *s)
 {
     struct uv *uv = s->uv;
     int rv;
 
+    assert(QUEUE_IS_EMPTY(&s->writes));
+
     rv = uvFinalize(uv, s->counter, s->written, s->first_index, s->last_index);
     if (rv != 0) {
         uv->errored = true;
@@ -176,101 +226,313 @@ static void flushRequests(queue *q, int status)
     }
 }
 
+/* Release the memory used by the given write. */
+static void destroyWrite(struct write *w)
+{
+    uvSegmentBufferClose(&w->data);
+    raft_free(w->reqs);
+    raft_free(w);
+}
+
+/* Remove the completed writes at the head of the segment's queue and fire the
+ * callbacks of their requests.
+ *
+ * Writes are removed strictly in order, so append requests are always
+ * completed in the same order they were submitted, even if a later write
+ * finishes first. */
+static void flushWrites(struct segment *s)
+{
+    struct uv *uv = s->uv;
+    queue q;
+
+    QUEUE_INIT(&q);
+
+    while (!QUEUE_IS_EMPTY(&s->writes)) {
+        struct write *w;
+        unsigned i;
+
+        w = QUEUE_DATA(QUEUE_HEAD(&s->writes), struct write, queue);
+        if (w->n_left > 0) {
+            break;
+        }
+
+        s->written = w->end;
+        for (i = 0; i < w->n_reqs; i++) {
+            struct append *r = w->reqs[i];
+            assert(QUEUE_HEAD(&uv->append_writing_reqs) == &r->queue);
+            r->status = w->status;
+            QUEUE_REMOVE(&r->queue);
+            QUEUE_PUSH(&q, &r->queue);
+        }
+
+        QUEUE_REMOVE(&w->queue);
+        s->n_writes--;
+        destroyWrite(w);
+    }
+
+    /* Don't touch the segment from here on, since callbacks might close it. */
+    while (!QUEUE_IS_EMPTY(&q)) {
+        struct append *r;
+        queue *head;
+        head = QUEUE_HEAD(&q);
+        QUEUE_REMOVE(head);
+        r = QUEUE_DATA(head, struct append, queue);
+        r->req->cb(r->req, r->status);
+        raft_free(r);
+    }
+}
+
 static void processRequests(struct uv *uv);
-static void writeSegmentCb(struct uvFileWrite *write,
-                           const int status,
-                           const char *errmsg)
+static void writeCb(struct uvFileWrite *req,
+                    const int status,
+                    const char *errmsg);
+
+/* Submit the write of the first block of the given write, which was held back
+ * until the previous write completed. */
+static void submitHeldBlock(struct write *w)
 {
-    struct segment *s = write->data;
+    struct segment *s = w->segment;
     struct uv *uv = s->uv;
-    unsigned n_blocks;
-    int result = 0;
+    char errmsg[2048];
+    int rv;
 
-    assert(uv->state != UV__CLOSED);
+    assert(w->held);
+    w->held = false;
 
-    assert(s->buf.len % uv->block_size == 0);
-    assert(s->buf.len >= uv->block_size);
+    rv = uvFileWrite(s->file, &w->held_req, &w->first, 1,
+                     w->first_block * uv->block_size, writeCb, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "write: %s", errmsg);
+        uv->errored = true;
+        w->status = RAFT_IOERR;
+        w->n_left--;
+    }
+}
 
-    /* Check if the write was successful. */
+static void writeCb(struct uvFileWrite *req,
+                    const int status,
+                    const char *errmsg)
+{
+    struct write *w = req->data;
+    struct segment *s = w->segment;
+    struct uv *uv = s->uv;
+    queue *head;
+
+    assert(uv->state != UV__CLOSED);
+    assert(w->n_left > 0);
+
+    /* Check if the write was successful. If not, none of the writes that
+     * follow can be reported as successful either. */
     if (status != 0) {
         assert(status != UV__CANCELED); /* We never cancel write requests */
         uvErrorf(uv, "write: %s", errmsg);
-        result = RAFT_IOERR;
         uv->errored = true;
+        for (head = &w->queue; head != &s->writes; head = QUEUE_NEXT(head)) {
+            QUEUE_DATA(head, struct write, queue)->status = RAFT_IOERR;
+        }
+    }
+
+    w->n_left--;
+    if (w->n_left > 0) {
+        return;
     }
 
-    s->written = s->next_block * uv->block_size + s->pending.n;
+    /* If the batches were encoded in the threadpool, the next write can only
+     * now start from the last block of this one. */
+    if (w->offloaded) {
+        uvSegmentBufferRetain(&s->pending, &w->data);
+    }
 
-    /* Update our write markers.
-     *
-     * We have four cases:
-     *
-     * - The data fit completely in the leftover space of the first block that
-     *   we wrote and there is more space left. In this case we just keep the
-     *   scheduled marker unchanged.
-     *
-     * - The data fit completely in the leftover space of the first block that
-     *   we wrote and there is no space left. In this case we advance the
-     *   current block counter, reset the first write block and set the
-     *   scheduled marker to 0.
-     *
-     * - The data did not fit completely in the leftover space of the first
-     *   block that we wrote, so we wrote more than one block. The last block
-     *   that we wrote was not filled completely and has leftover space. In this
-     *   case we advance the current block counter and copy the memory used for
-     *   the last block to the head of the write arena list, updating the
-     *   scheduled marker accordingly.
-     *
-     * - The data did not fit completely in the leftover space of the first
-     *   block that we wrote, so we wrote more than one block. The last block
-     *   that we wrote was filled exactly and has no leftover space. In this
-     *   case we advance the current block counter, reset the first buffer and
-     *   set the scheduled marker to 0.
-     */
-    n_blocks = s->buf.len / uv->block_size; /* Number of blocks written. */
-    if (s->pending.n < uv->block_size) {
-        /* Nothing to do */
-        assert(n_blocks == 1);
-    } else if (s->pending.n == uv->block_size) {
-        assert(n_blocks == 1);
-        s->next_block++;
-        uvSegmentBufferReset(&s->pending, 0);
-    } else {
-        assert(s->pending.n > uv->block_size);
-        assert(s->buf.len > uv->block_size);
-
-        if (s->pending.n % uv->block_size > 0) {
-            s->next_block += n_blocks - 1;
-            uvSegmentBufferReset(&s->pending, n_blocks - 1);
-        } else {
-            s->next_block += n_blocks;
-            uvSegmentBufferReset(&s->pending, 0);
+    /* The next write might be waiting for this one to complete before
+     * rewriting the block they share. If submitting that block fails, the next
+     * write is complete as well, and so on. */
+    head = QUEUE_NEXT(&w->queue);
+    while (head != &s->writes) {
+        struct write *next = QUEUE_DATA(head, struct write, queue);
+        if (!next->held) {
+            break;
         }
+        submitHeldBlock(next);
+        if (next->n_left > 0) {
+            break;
+        }
+        head = QUEUE_NEXT(head);
     }
 
-    /* Fire the callbacks of all requests that were fulfilled with this
-     * write. */
-    flushRequests(&uv->append_writing_reqs, result);
+    flushWrites(s);
 
     /* Possibly process waiting requests. */
     processRequests(uv);
 }
 
-/* Submit a file write request to append the entries encoded in the write buffer
- * of the given segment. */
-static int writeSegment(struct segment *s)
+/* Return true if a new write against the given segment, holding @size more
+ * bytes, can be submitted without waiting for the writes in flight. */
+static bool canWrite(struct segment *s, size_t size)
+{
+    struct uv *uv = s->uv;
+    struct write *last;
+
+    if (QUEUE_IS_EMPTY(&s->writes)) {
+        return true;
+    }
+
+    if (s->n_writes == UV__MAX_CONCURRENT_WRITES) {
+        return false;
+    }
+
+    /* When batches are encoded in the threadpool, the last block of the
+     * previous write is not available until it completes. */
+    last = QUEUE_DATA(QUEUE_TAIL(&s->writes), struct write, queue);
+    if (last->offloaded || uv->append_offload) {
+        return false;
+    }
+
+    /* If the new data would only go into the block partially filled by the
+     * last write, it could only be written after that write completes, so keep
+     * accumulating requests in the meantime. */
+    return last->n_left == 0 || s->pending.n == 0 ||
+           s->pending.n + size > uv->block_size;
+}
+
+/* Return true if the first block of a new write against the given segment must
+ * be held back, because the last write is still writing it. */
+static bool mustHoldFirstBlock(struct segment *s)
+{
+    struct write *last;
+
+    if (QUEUE_IS_EMPTY(&s->writes) || s->pending.n == 0) {
+        return false;
+    }
+
+    last = QUEUE_DATA(QUEUE_TAIL(&s->writes), struct write, queue);
+    return last->n_left > 0;
+}
+
+/* Submit a file write request for the first @n_reqs pending append requests,
+ * which are targeted to the given segment and take @size bytes on disk. */
+static int startWrite(struct segment *s, unsigned n_reqs, size_t size)
 {
+    struct uv *uv = s->uv;
+    struct uvSegmentBuffer next;
+    struct write *w;
+    size_t n;
     char errmsg[2048];
+    queue *head;
+    unsigned i;
     int rv;
-    assert(s->file != NULL);
-    assert(s->pending.n > 0);
-    uvSegmentBufferFinalize(&s->pending, &s->buf);
-    rv = uvFileWrite(s->file, &s->write, &s->buf, 1,
-                     s->next_block * s->uv->block_size, writeSegmentCb, errmsg);
+
+    assert(canWrite(s, size));
+
+    w = raft_malloc(sizeof *w);
+    if (w == NULL) {
+        rv = RAFT_NOMEM;
+        goto err;
+    }
+    w->reqs = raft_malloc(n_reqs * sizeof *w->reqs);
+    if (w->reqs == NULL) {
+        rv = RAFT_NOMEM;
+        goto err_after_write_alloc;
+    }
+    head = QUEUE_HEAD(&uv->append_pending_reqs);
+    for (i = 0; i < n_reqs; i++) {
+        w->reqs[i] = QUEUE_DATA(head, struct append, queue);
+        assert(w->reqs[i]->segment == s);
+        head = QUEUE_NEXT(head);
+    }
+    w->segment = s;
+    w->n_reqs = n_reqs;
+    w->first_block = s->next_block;
+    w->req.data = w;
+    w->held_req.data = w;
+    w->held = mustHoldFirstBlock(s);
+    w->offloaded = uv->append_offload;
+    w->n_left = w->held ? 2 : 1;
+    w->status = 0;
+
+    /* Total number of bytes in the buffer once the batches are encoded. */
+    n = s->pending.n + size;
+    if (s->pending.n == 0 && s->next_block == 0) {
+        n += sizeof(uint64_t); /* Format version */
+    }
+    w->end = w->first_block * uv->block_size + n;
+
+    /* Allocate all the memory we need here, even when encoding in the
+     * threadpool, since raft_malloc() is not required to be thread-safe. The
+     * buffer for the next write needs at least the block that this write
+     * might leave partially filled. */
+    uvSegmentBufferInit(&next, uv->block_size);
+    rv = uvSegmentBufferReserve(&next, uv->block_size);
     if (rv != 0) {
-        return rv;
+        goto err_after_reqs_alloc;
+    }
+
+    w->data = s->pending;
+    if (w->offloaded) {
+        rv = uvSegmentBufferReserve(&w->data, n - w->data.n);
+        if (rv != 0) {
+            goto err_after_next_reserve;
+        }
+    } else {
+        rv = encodeWrite(w, &w->data);
+        if (rv != 0) {
+            goto err_after_next_reserve;
+        }
+        assert(w->data.n == n);
+        uvSegmentBufferFinalize(&w->data, &w->buf);
+        uvSegmentBufferRetain(&next, &w->data);
+    }
+
+    if (w->offloaded) {
+        w->buf.base = NULL;
+        w->buf.len = 0;
+        rv = uvFileWriteDeferred(s->file, &w->req, &w->buf, 1,
+                                 w->first_block * uv->block_size,
+                                 encodeWriteInThreadpool, writeCb, errmsg);
+    } else if (w->held) {
+        w->first.base = w->buf.base;
+        w->first.len = uv->block_size;
+        w->rest.base = w->buf.base + uv->block_size;
+        w->rest.len = w->buf.len - uv->block_size;
+        assert(w->rest.len > 0);
+        rv = uvFileWrite(s->file, &w->req, &w->rest, 1,
+                         (w->first_block + 1) * uv->block_size, writeCb,
+                         errmsg);
+    } else {
+        rv = uvFileWrite(s->file, &w->req, &w->buf, 1,
+                         w->first_block * uv->block_size, writeCb, errmsg);
+    }
+    if (rv != 0) {
+        uvErrorf(uv, "write: %s", errmsg);
+        rv = RAFT_IOERR;
+        goto err_after_next_reserve;
+    }
+
+    /* The write was submitted, so hand the buffer over to it and move its
+     * requests to the writing queue. */
+    s->pending = next;
+    s->next_block = (unsigned)(w->end / uv->block_size);
+    for (i = 0; i < n_reqs; i++) {
+        s->last_index += w->reqs[i]->n;
+        QUEUE_REMOVE(&w->reqs[i]->queue);
+        QUEUE_PUSH(&uv->append_writing_reqs, &w->reqs[i]->queue);
     }
+    QUEUE_PUSH(&s->writes, &w->queue);
+    s->n_writes++;
+
     return 0;
+
+err_after_next_reserve:
+    /* Drop anything that was encoded, and keep the buffer. */
+    w->data.n = s->pending.n;
+    s->pending = w->data;
+    uvSegmentBufferClose(&next);
+err_after_reqs_alloc:
+    raft_free(w->reqs);
+err_after_write_alloc:
+    raft_free(w);
+err:
+    assert(rv != 0);
+    return rv;
 }
 
 /* Return the segment currently being written, or NULL when no segment has been
@@ -291,27 +553,20 @@ static struct segment *currentSegment(struct uv *uv)
 static void processRequests(struct uv *uv)
 {
     struct segment *segment;
-    struct append *req;
     queue *head;
-    queue q;
     unsigned n_reqs;
+    size_t size;
     int rv;
 
-    /* During the closing sequence we should only get called by the
-     * segmentWriteCb callback after an in-flight write has been completed. */
+    /* During the closing sequence we should only get called by the writeCb
+     * callback after an in-flight write has been completed. */
     if (uv->closing) {
         assert(QUEUE_IS_EMPTY(&uv->append_pending_reqs));
-        assert(QUEUE_IS_EMPTY(&uv->append_writing_reqs));
         segment = currentSegment(uv);
         assert(segment != NULL);
         assert(segment->finalize);
     }
 
-    /* If we are already writing, let's wait. */
-    if (!QUEUE_IS_EMPTY(&uv->append_writing_reqs)) {
-        return;
-    }
-
     /* If we're truncating, let's wait. */
     if (uv->truncate_work.data != NULL) {
         return;
@@ -326,33 +581,30 @@ prepare:
         return;
     }
 
-    /* Let's add to the segment's write buffer all pending requests targeted to
-     * this segment. */
-    QUEUE_INIT(&q);
-
+    /* Let's gather all pending requests targeted to this segment. */
     n_reqs = 0;
-    while (!QUEUE_IS_EMPTY(&uv->append_pending_reqs)) {
-        head = QUEUE_HEAD(&uv->append_pending_reqs);
-        req = QUEUE_DATA(head, struct append, queue);
+    size = 0;
+    QUEUE_FOREACH(head, &uv->append_pending_reqs)
+    {
+        struct append *req = QUEUE_DATA(head, struct append, queue);
         assert(req->segment != NULL);
         if (req->segment != segment) {
             break; /* Not targeted to this segment */
         }
-        QUEUE_REMOVE(head);
-        QUEUE_PUSH(&q, head);
         n_reqs++;
-        rv = encodeEntriesToSegmentWriteBuf(segment, req);
-        if (rv != 0) {
-            goto err;
-        }
+        size += req->size;
     }
 
-    /* If we have no more requests for this segment, let's check if it has been
-     * marked for closing, and in that case finalize it and possibly trigger a
-     * write against the next segment (unless there is a truncate request, in
-     * that case we need to wait for it). Otherwise it must mean we have
-     * exhausted the queue of pending append requests. */
+    /* If we have no more requests for this segment, let's wait for the writes
+     * in flight, then check if it has been marked for closing, and in that
+     * case finalize it and possibly trigger a write against the next segment
+     * (unless there is a truncate request, in that case we need to wait for
+     * it). Otherwise it must mean we have exhausted the queue of pending append
+     * requests. */
     if (n_reqs == 0) {
+        if (!QUEUE_IS_EMPTY(&segment->writes)) {
+            return;
+        }
         assert(QUEUE_IS_EMPTY(&uv->append_writing_reqs));
         if (segment->finalize) {
             finalizeSegment(segment);
@@ -367,13 +619,13 @@ prepare:
         return;
     }
 
-    while (!QUEUE_IS_EMPTY(&q)) {
-        head = QUEUE_HEAD(&q);
-        QUEUE_REMOVE(head);
-        QUEUE_PUSH(&uv->append_writing_reqs, head);
+    /* If the new write can't be submitted yet, it will be once one of the
+     * writes in flight completes. */
+    if (!canWrite(segment, size)) {
+        return;
     }
 
-    rv = writeSegment(segment);
+    rv = startWrite(segment, n_reqs, size);
     if (rv != 0) {
         goto err;
     }
@@ -405,11 +657,25 @@ static void prepareSegmentCb(struct uvPrepare *req,
         return;
     }
 
+    /* Fail the requests targeted to this segment. */
     if (status != 0) {
+        queue q;
+        queue *head;
+        QUEUE_INIT(&q);
+        head = QUEUE_HEAD(&uv->append_pending_reqs);
+        while (head != &uv->append_pending_reqs) {
+            struct append *r = QUEUE_DATA(head, struct append, queue);
+            head = QUEUE_NEXT(head);
+            if (r->segment == segment) {
+                QUEUE_REMOVE(&r->queue);
+                QUEUE_PUSH(&q, &r->queue);
+            }
+        }
         QUEUE_REMOVE(&segment->queue);
+        uvSegmentBufferClose(&segment->pending);
         raft_free(segment);
         uv->errored = true;
-        flushRequests(&uv->append_writing_reqs, RAFT_IOERR);
+        flushRequests(&q, RAFT_IOERR);
         return;
     }
 
@@ -425,7 +691,6 @@ static void initSegment(struct segment *s, struct uv *uv)
 {
     s->uv = uv;
     s->prepare.data = s;
-    s->write.data = s;
     s->counter = 0;
     s->file = NULL;
     s->first_index = uv->append_next_index;
@@ -434,6 +699,8 @@ static void initSegment(struct segment *s, struct uv *uv)
     s->next_block = 0;
     uvSegmentBufferInit(&s->pending, uv->block_size);
     s->written = 0;
+    QUEUE_INIT(&s->writes);
+    s->n_writes = 0;
     s->finalize = false;
 }
 
@@ -5,8 +5,38 @@
 #include "assert.h"
 #include "byte.h"
 #include "configuration.h"
+#include "lz.h"
 #include "uv_encoding.h"
 
+/**
+ * Layout versions of RAFT_IO_INSTALL_SNAPSHOT messages. Version 0 carries the
+ * whole snapshot, version 1 adds the offset of the carried chunk and whether
+ * it's the last one, version 2 adds the codec the chunk is compressed with.
+ */
+#define INSTALL_SNAPSHOT_V0 0
+#define INSTALL_SNAPSHOT_V1 1
+#define INSTALL_SNAPSHOT_V2 2
+
+/**
+ * Layout versions of RAFT_IO_REQUEST_VOTE messages. Version 1 adds flags, which
+ * tell whether the candidate is the target of a leadership transfer.
+ */
+#define REQUEST_VOTE_V0 0
+#define REQUEST_VOTE_V1 1
+
+/**
+ * Flags of version 1 RAFT_IO_REQUEST_VOTE messages.
+ */
+#define REQUEST_VOTE_DISRUPT_LEADER 1
+
+/**
+ * The type field of the preamble holds the message type in its lowest byte and
+ * the layout version in the next one. Servers that don't know a version reject
+ * the message as having an unknown type.
+ */
+#define TYPE_MASK 0xff
+#define VERSION_SHIFT 8
+
 /**
  * Size of the request preable.
  */
@@ -22,6 +52,13 @@ size_t sizeofRequestVote()
            sizeof(uint64_t) /* Last log term. */;
 }
 
+static size_t sizeofTimeoutNow()
+{
+    return sizeof(uint64_t) + /* Term. */
+           sizeof(uint64_t) + /* Last log index. */
+           sizeof(uint64_t) /* Last log term. */;
+}
+
 static size_t sizeofRequestVoteResult()
 {
     return sizeof(uint64_t) + /* Term. */
@@ -46,17 +83,26 @@ static size_t sizeofAppendEntriesResult()
            sizeof(uint64_t) /* Last log index. */;
 }
 
-static size_t sizeofInstallSnapshot(const struct raft_install_snapshot *p)
+static size_t sizeofInstallSnapshot(const struct raft_install_snapshot *p,
+                                    unsigned version)
 {
     size_t conf_size = configurationEncodedSize(&p->conf);
-    return sizeof(uint64_t) + /* Leader's term. */
-           sizeof(uint64_t) + /* Leader ID */
-           sizeof(uint64_t) + /* Snapshot's last index */
-           sizeof(uint64_t) + /* Term of last index */
-           sizeof(uint64_t) + /* Configuration's index */
-           sizeof(uint64_t) + /* Length of configuration */
-           conf_size +        /* Configuration data */
-           sizeof(uint64_t);  /* Length of snapshot data */
+    size_t size = sizeof(uint64_t) + /* Leader's term. */
+                  sizeof(uint64_t) + /* Leader ID */
+                  sizeof(uint64_t) + /* Snapshot's last index */
+                  sizeof(uint64_t) + /* Term of last index */
+                  sizeof(uint64_t) + /* Configuration's index */
+                  sizeof(uint64_t) + /* Length of configuration */
+                  conf_size +        /* Configuration data */
+                  sizeof(uint64_t);  /* Length of snapshot data */
+    if (version >= INSTALL_SNAPSHOT_V1) {
+        size += sizeof(uint64_t) + /* Offset of snapshot data */
+                sizeof(uint64_t);  /* Whether this is the last chunk */
+    }
+    if (version >= INSTALL_SNAPSHOT_V2) {
+        size += sizeof(uint64_t); /* Codec of snapshot data */
+    }
+    return size;
 }
 
 size_t uvSizeofBatchHeader(size_t n)
@@ -65,7 +111,9 @@ size_t uvSizeofBatchHeader(size_t n)
            16 * n /* One header per entry */;
 }
 
-static void encodeRequestVote(const struct raft_request_vote *p, void *buf)
+static void encodeRequestVote(const struct raft_request_vote *p,
+                              unsigned version,
+                              void *buf)
 {
     void *cursor = buf;
 
@@ -73,6 +121,18 @@ static void encodeRequestVote(const struct raft_request_vote *p, void *buf)
     bytePut64(&cursor, p->candidate_id);
     bytePut64(&cursor, p->last_log_index);
     bytePut64(&cursor, p->last_log_term);
+    if (version >= REQUEST_VOTE_V1) {
+        bytePut64(&cursor, p->disrupt_leader ? REQUEST_VOTE_DISRUPT_LEADER : 0);
+    }
+}
+
+static void encodeTimeoutNow(const struct raft_timeout_now *p, void *buf)
+{
+    void *cursor = buf;
+
+    bytePut64(&cursor, p->term);
+    bytePut64(&cursor, p->last_log_index);
+    bytePut64(&cursor, p->last_log_term);
 }
 
 static void encodeRequestVoteResult(const struct raft_request_vote_result *p,
@@ -110,6 +170,9 @@ static void encodeAppendEntriesResult(
 }
 
 static void encodeInstallSnapshot(const struct raft_install_snapshot *p,
+                                  unsigned version,
+                                  unsigned codec,
+                                  size_t data_len,
                                   void *buf)
 {
     void *cursor;
@@ -124,14 +187,28 @@ static void encodeInstallSnapshot(const struct raft_install_snapshot *p,
     bytePut64(&cursor, conf_size);     /* Configuration length. */
     configurationEncodeToBuf(&p->conf, cursor);
     cursor += conf_size;
-    bytePut64(&cursor, p->data.len); /* Snapshot data size. */
+    bytePut64(&cursor, data_len); /* Snapshot data size. */
+    if (version >= INSTALL_SNAPSHOT_V1) {
+        bytePut64(&cursor, p->offset); /* Snapshot data offset. */
+        bytePut64(&cursor, p->done);   /* Whether this is the last chunk. */
+    }
+    if (version >= INSTALL_SNAPSHOT_V2) {
+        bytePut64(&cursor, codec); /* Snapshot data codec. */
+    }
 }
 
 int uvEncodeMessage(const struct raft_message *message,
+                    const uv_buf_t *compressed,
                     uv_buf_t **bufs,
                     unsigned *n_bufs)
 {
     uv_buf_t header;
+    uv_buf_t payload = {NULL, 0};
+    uint64_t type = message->type;
+    unsigned version = 0;
+    unsigned codec = UV__CODEC_NONE;
+    size_t prefix_len = 0;
+    size_t data_len = 0;
     void *cursor;
 
     /* Figure out the length of the header for this request and allocate a
@@ -140,6 +217,13 @@ int uvEncodeMessage(const struct raft_message *message,
     switch (message->type) {
         case RAFT_IO_REQUEST_VOTE:
             header.len += sizeofRequestVote();
+            /* Servers not supporting leadership transfer reject version 1
+             * messages, so only use it when needed. */
+            if (message->request_vote.disrupt_leader) {
+                version = REQUEST_VOTE_V1;
+                header.len += sizeof(uint64_t); /* Flags */
+            }
+            type |= version << VERSION_SHIFT;
             break;
         case RAFT_IO_REQUEST_VOTE_RESULT:
             header.len += sizeofRequestVoteResult();
@@ -151,13 +235,38 @@ int uvEncodeMessage(const struct raft_message *message,
             header.len += sizeofAppendEntriesResult();
             break;
         case RAFT_IO_INSTALL_SNAPSHOT:
-            header.len += sizeofInstallSnapshot(&message->install_snapshot);
+            /* Servers not supporting chunks or compression reject version 1
+             * and 2 messages, so only use them when needed. */
+            if (compressed != NULL) {
+                version = INSTALL_SNAPSHOT_V2;
+            } else if (message->install_snapshot.offset != 0 ||
+                       !message->install_snapshot.done) {
+                version = INSTALL_SNAPSHOT_V1;
+            }
+            header.len += sizeofInstallSnapshot(&message->install_snapshot,
+                                                version);
+            type |= version << VERSION_SHIFT;
+            payload.base = message->install_snapshot.data.base;
+            payload.len = message->install_snapshot.data.len;
+            /* The compressed blocks are sent in place of the data, prefixed by
+             * its total size, which is stored in the header buffer. Send the
+             * data as it is if compressing didn't make it smaller. */
+            if (compressed != NULL &&
+                sizeof(uint64_t) + compressed->len < payload.len) {
+                codec = UV__CODEC_LZ;
+                prefix_len = sizeof(uint64_t);
+                payload = *compressed;
+            }
+            data_len = prefix_len + payload.len;
+            break;
+        case RAFT_IO_TIMEOUT_NOW:
+            header.len += sizeofTimeoutNow();
             break;
         default:
             return RAFT_MALFORMED;
     };
 
-    header.base = raft_malloc(header.len);
+    header.base = raft_malloc(header.len + prefix_len);
     if (header.base == NULL) {
         goto oom;
     }
@@ -165,13 +274,13 @@ int uvEncodeMessage(const struct raft_message *message,
     cursor = header.base;
 
     /* Encode the request preamble, with message type and message size. */
-    bytePut64(&cursor, message->type);
+    bytePut64(&cursor, type);
     bytePut64(&cursor, header.len - RAFT_IO_UV__PREAMBLE_SIZE);
 
     /* Encode the request header. */
     switch (message->type) {
         case RAFT_IO_REQUEST_VOTE:
-            encodeRequestVote(&message->request_vote, cursor);
+            encodeRequestVote(&message->request_vote, version, cursor);
             break;
         case RAFT_IO_REQUEST_VOTE_RESULT:
             encodeRequestVoteResult(&message->request_vote_result, cursor);
@@ -183,7 +292,11 @@ int uvEncodeMessage(const struct raft_message *message,
             encodeAppendEntriesResult(&message->append_entries_result, cursor);
             break;
         case RAFT_IO_INSTALL_SNAPSHOT:
-            encodeInstallSnapshot(&message->install_snapshot, cursor);
+            encodeInstallSnapshot(&message->install_snapshot, version, codec,
+                                  data_len, cursor);
+            break;
+        case RAFT_IO_TIMEOUT_NOW:
+            encodeTimeoutNow(&message->timeout_now, cursor);
             break;
     };
 
@@ -205,6 +318,11 @@ int uvEncodeMessage(const struct raft_message *message,
     }
 
     (*bufs)[0] = header;
+    if (codec != UV__CODEC_NONE) {
+        cursor = (uint8_t *)header.base + header.len;
+        bytePut64(&cursor, message->install_snapshot.data.len);
+        (*bufs)[0].len += prefix_len;
+    }
 
     if (message->type == RAFT_IO_APPEND_ENTRIES) {
         unsigned i;
@@ -217,8 +335,7 @@ int uvEncodeMessage(const struct raft_message *message,
     }
 
     if (message->type == RAFT_IO_INSTALL_SNAPSHOT) {
-        (*bufs)[1].base = message->install_snapshot.data.base;
-        (*bufs)[1].len = message->install_snapshot.data.len;
+        (*bufs)[1] = payload;
     }
 
     return 0;
@@ -256,7 +373,9 @@ void uvEncodeBatchHeader(const struct raft_entry *entries,
     }
 }
 
-static void decodeRequestVote(const uv_buf_t *buf, struct raft_request_vote *p)
+static void decodeRequestVote(const uv_buf_t *buf,
+                              unsigned version,
+                              struct raft_request_vote *p)
 {
     const void *cursor;
 
@@ -266,6 +385,23 @@ static void decodeRequestVote(const uv_buf_t *buf, struct raft_request_vote *p)
     p->candidate_id = byteGet64(&cursor);
     p->last_log_index = byteGet64(&cursor);
     p->last_log_term = byteGet64(&cursor);
+    p->disrupt_leader = false;
+
+    if (version >= REQUEST_VOTE_V1) {
+        uint64_t flags = byteGet64(&cursor);
+        p->disrupt_leader = (flags & REQUEST_VOTE_DISRUPT_LEADER) != 0;
+    }
+}
+
+static void decodeTimeoutNow(const uv_buf_t *buf, struct raft_timeout_now *p)
+{
+    const void *cursor;
+
+    cursor = buf->base;
+
+    p->term = byteGet64(&cursor);
+    p->last_log_index = byteGet64(&cursor);
+    p->last_log_term = byteGet64(&cursor);
 }
 
 static void decodeRequestVoteResult(const uv_buf_t *buf,
@@ -284,7 +420,6 @@ int uvDecodeBatchHeader(const void *batch,
                         unsigned *n)
 {
     const void *cursor = batch;
-    size_t i;
     int rv;
 
     *n = byteGet64(&cursor);
@@ -301,16 +436,39 @@ int uvDecodeBatchHeader(const void *batch,
         goto err;
     }
 
-    for (i = 0; i < *n; i++) {
-        struct raft_entry *entry = &(*entries)[i];
+    rv = uvDecodeBatchHeaderInto(batch, *entries);
+    if (rv != 0) {
+        goto err_after_alloc;
+    }
+
+    return 0;
+
+err_after_alloc:
+    raft_free(*entries);
+
+err:
+    assert(rv != 0);
+
+    return rv;
+}
+
+int uvDecodeBatchHeaderInto(const void *batch, struct raft_entry *entries)
+{
+    const void *cursor = batch;
+    size_t n;
+    size_t i;
+
+    n = byteGet64(&cursor);
+
+    for (i = 0; i < n; i++) {
+        struct raft_entry *entry = &entries[i];
 
         entry->term = byteGet64(&cursor);
         entry->type = byteGet8(&cursor);
 
         if (entry->type != RAFT_COMMAND && entry->type != RAFT_BARRIER &&
             entry->type != RAFT_CHANGE) {
-            rv = RAFT_MALFORMED;
-            goto err_after_alloc;
+            return RAFT_MALFORMED;
         }
 
         cursor += 3; /* Unused */
@@ -320,14 +478,6 @@ int uvDecodeBatchHeader(const void *batch,
     }
 
     return 0;
-
-err_after_alloc:
-    raft_free(entries);
-
-err:
-    assert(rv != 0);
-
-    return rv;
 }
 
 static int decodeAppendEntries(const uv_buf_t *buf,
@@ -367,7 +517,9 @@ static void decodeAppendEntriesResult(const uv_buf_t *buf,
 }
 
 static int decodeInstallSnapshot(const uv_buf_t *buf,
-                                 struct raft_install_snapshot *args)
+                                 unsigned version,
+                                 struct raft_install_snapshot *args,
+                                 unsigned *codec)
 {
     const void *cursor;
     struct raft_buffer conf;
@@ -391,6 +543,29 @@ static int decodeInstallSnapshot(const uv_buf_t *buf,
     }
     cursor += conf.len;
     args->data.len = byteGet64(&cursor);
+    args->data.base = NULL;
+
+    *codec = UV__CODEC_NONE;
+
+    /* Version 0 messages carry the whole snapshot. */
+    if (version == INSTALL_SNAPSHOT_V0) {
+        args->offset = 0;
+        args->done = true;
+        return 0;
+    }
+
+    args->offset = byteGet64(&cursor);
+    args->done = byteGet64(&cursor);
+
+    if (version == INSTALL_SNAPSHOT_V1) {
+        return 0;
+    }
+
+    *codec = byteGet64(&cursor);
+    if (*codec != UV__CODEC_NONE && *codec != UV__CODEC_LZ) {
+        raft_configuration_close(&args->conf);
+        return RAFT_MALFORMED;
+    }
 
     return 0;
 }
@@ -398,11 +573,35 @@ static int decodeInstallSnapshot(const uv_buf_t *buf,
 int uvDecodeMessage(unsigned type,
                     const uv_buf_t *header,
                     struct raft_message *message,
-                    size_t *payload_len)
+                    size_t *payload_len,
+                    unsigned *codec)
 {
+    unsigned version = type >> VERSION_SHIFT;
     unsigned i;
     int rv = 0;
 
+    type &= TYPE_MASK;
+
+    /* Only InstallSnapshot and RequestVote messages have more than one layout
+     * version. */
+    switch (type) {
+        case RAFT_IO_INSTALL_SNAPSHOT:
+            if (version > INSTALL_SNAPSHOT_V2) {
+                return RAFT_IOERR;
+            }
+            break;
+        case RAFT_IO_REQUEST_VOTE:
+            if (version > REQUEST_VOTE_V1) {
+                return RAFT_IOERR;
+            }
+            break;
+        default:
+            if (version != 0) {
+                return RAFT_IOERR;
+            }
+            break;
+    }
+
     message->type = type;
 
     *payload_len = 0;
@@ -410,7 +609,7 @@ int uvDecodeMessage(unsigned type,
     /* Decode the header. */
     switch (type) {
         case RAFT_IO_REQUEST_VOTE:
-            decodeRequestVote(header, &message->request_vote);
+            decodeRequestVote(header, version, &message->request_vote);
             break;
         case RAFT_IO_REQUEST_VOTE_RESULT:
             decodeRequestVoteResult(header, &message->request_vote_result);
@@ -425,9 +624,13 @@ int uvDecodeMessage(unsigned type,
             decodeAppendEntriesResult(header, &message->append_entries_result);
             break;
         case RAFT_IO_INSTALL_SNAPSHOT:
-            rv = decodeInstallSnapshot(header, &message->install_snapshot);
+            rv = decodeInstallSnapshot(header, version,
+                                       &message->install_snapshot, codec);
             *payload_len += message->install_snapshot.data.len;
             break;
+        case RAFT_IO_TIMEOUT_NOW:
+            decodeTimeoutNow(header, &message->timeout_now);
+            break;
         default:
             rv = RAFT_IOERR;
             break;
@@ -466,6 +669,152 @@ void uvDecodeEntriesBatch(const struct raft_buffer *buf,
     }
 }
 
+/* Size of the header of a compressed block. */
+#define BLOCK_HEADER_SIZE (sizeof(uint32_t) * 2)
+
+/* Round up to the next 8-byte boundary. */
+static size_t pad8(size_t len)
+{
+    return len % 8 == 0 ? len : len + 8 - len % 8;
+}
+
+size_t uvCompressBound(const struct raft_buffer bufs[], unsigned n_bufs)
+{
+    size_t size = sizeof(uint64_t); /* Total size */
+    unsigned i;
+
+    /* A block is stored as it is if it doesn't shrink. */
+    for (i = 0; i < n_bufs; i++) {
+        size_t n_blocks = bufs[i].len / UV__COMPRESSION_BLOCK_SIZE;
+        size_t last = bufs[i].len % UV__COMPRESSION_BLOCK_SIZE;
+        size += n_blocks * (BLOCK_HEADER_SIZE + UV__COMPRESSION_BLOCK_SIZE);
+        if (last > 0) {
+            size += BLOCK_HEADER_SIZE + pad8(last);
+        }
+    }
+
+    return size;
+}
+
+size_t uvCompress(const struct raft_buffer bufs[], unsigned n_bufs, void *dst)
+{
+    void *cursor = dst;
+    size_t total = 0;
+    unsigned i;
+
+    for (i = 0; i < n_bufs; i++) {
+        total += bufs[i].len;
+    }
+    bytePut64(&cursor, total);
+
+    for (i = 0; i < n_bufs; i++) {
+        const uint8_t *base = bufs[i].base;
+        size_t offset;
+        for (offset = 0; offset < bufs[i].len;
+             offset += UV__COMPRESSION_BLOCK_SIZE) {
+            size_t len = bufs[i].len - offset;
+            uint8_t *data = (uint8_t *)cursor + BLOCK_HEADER_SIZE;
+            size_t stored;
+
+            if (len > UV__COMPRESSION_BLOCK_SIZE) {
+                len = UV__COMPRESSION_BLOCK_SIZE;
+            }
+
+            stored = lzCompress(base + offset, len, data, len - 1);
+            if (stored == 0) {
+                memcpy(data, base + offset, len);
+                stored = len;
+            }
+            /* Zero the padding, so the same data always produces the same
+             * output. */
+            memset(data + stored, 0, pad8(stored) - stored);
+
+            bytePut32(&cursor, (uint32_t)len);
+            bytePut32(&cursor, (uint32_t)stored);
+            cursor = data + pad8(stored);
+        }
+    }
+
+    return (size_t)((uint8_t *)cursor - (uint8_t *)dst);
+}
+
+void uvCompressedBlockOffsets(const void *src, size_t len, size_t offsets[])
+{
+    size_t n_blocks = (len + UV__COMPRESSION_BLOCK_SIZE - 1) /
+                      UV__COMPRESSION_BLOCK_SIZE;
+    size_t offset = sizeof(uint64_t); /* Total size */
+    size_t i;
+
+    for (i = 0; i < n_blocks; i++) {
+        const void *cursor = (const uint8_t *)src + offset;
+        size_t stored;
+        offsets[i] = offset;
+        byteGet32(&cursor); /* Decompressed size */
+        stored = byteGet32(&cursor);
+        offset += BLOCK_HEADER_SIZE + pad8(stored);
+    }
+    offsets[n_blocks] = offset;
+}
+
+int uvDecompressedSize(const void *src, size_t len, size_t *size)
+{
+    const void *cursor = src;
+    if (len < sizeof(uint64_t)) {
+        return RAFT_MALFORMED;
+    }
+    *size = byteGet64(&cursor);
+    return 0;
+}
+
+int uvDecompress(const void *src, size_t len, void *dst)
+{
+    const void *cursor = src;
+    const uint8_t *end = (const uint8_t *)src + len;
+    uint8_t *out = dst;
+    size_t total;
+    size_t n = 0;
+    int rv;
+
+    rv = uvDecompressedSize(src, len, &total);
+    if (rv != 0) {
+        return rv;
+    }
+    cursor = (const uint8_t *)src + sizeof(uint64_t);
+
+    while ((const uint8_t *)cursor < end) {
+        size_t block_len;
+        size_t stored;
+
+        if ((size_t)(end - (const uint8_t *)cursor) < BLOCK_HEADER_SIZE) {
+            return RAFT_MALFORMED;
+        }
+        block_len = byteGet32(&cursor);
+        stored = byteGet32(&cursor);
+        if (stored > block_len || block_len > total - n ||
+            pad8(stored) > (size_t)(end - (const uint8_t *)cursor)) {
+            return RAFT_MALFORMED;
+        }
+
+        if (stored == block_len) {
+            memcpy(out + n, cursor, stored);
+        } else {
+            rv = lzDecompress(cursor, stored, out + n, block_len);
+            if (rv != 0) {
+                return RAFT_MALFORMED;
+            }
+        }
+
+        n += block_len;
+        cursor = (const uint8_t *)cursor + pad8(stored);
+    }
+
+    if (n != total) {
+        return RAFT_MALFORMED;
+    }
+
+    return 0;
+}
+
 int uvEncodeSnapshotMeta(const struct raft_configuration *conf,
                          raft_index conf_index,
                          struct raft_buffer *buf)
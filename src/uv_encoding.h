@@ -10,19 +10,46 @@
 /* Current disk format version. */
 #define UV__DISK_FORMAT 1
 
+/* Format version of segments whose batches are checksummed with CRC32C, which
+ * is cheaper to compute than the CRC32 used by UV__DISK_FORMAT segments. New
+ * segments are written in this format, older ones can still be loaded. */
+#define UV__DISK_FORMAT_CRC32C 2
+
+/* Codecs used to compress snapshot data. */
+enum {
+    UV__CODEC_NONE = 0, /* Data is not compressed */
+    UV__CODEC_LZ        /* Data is compressed with the codec in lz.h */
+};
+
+/* Size of the blocks that snapshot data is compressed in. */
+#define UV__COMPRESSION_BLOCK_SIZE (64 * 1024)
+
+/* Encode the given message. If the message is an InstallSnapshot request and
+ * @compressed is not NULL, it holds the compressed blocks covering the snapshot
+ * data, as produced by uvCompress() but without the leading total size, which
+ * are sent in place of the data if they are smaller. Like the data, they are
+ * referenced by the returned buffers and are not copied. */
 int uvEncodeMessage(const struct raft_message *message,
+                    const uv_buf_t *compressed,
                     uv_buf_t **bufs,
                     unsigned *n_bufs);
 
+/* Decode the header of a message. For InstallSnapshot requests @codec is set
+ * to the codec that the payload is compressed with. */
 int uvDecodeMessage(unsigned type,
                     const uv_buf_t *header,
                     struct raft_message *message,
-                    size_t *payload_len);
+                    size_t *payload_len,
+                    unsigned *codec);
 
 int uvDecodeBatchHeader(const void *batch,
                         struct raft_entry **entries,
                         unsigned *n);
 
+/* Same as uvDecodeBatchHeader(), but decode the entries into the given array,
+ * which must have room for all the entries in the batch. */
+int uvDecodeBatchHeaderInto(const void *batch, struct raft_entry *entries);
+
 void uvDecodeEntriesBatch(const struct raft_buffer *buf,
                           struct raft_entry *entries,
                           unsigned n);
@@ -55,6 +82,39 @@ void uvEncodeBatchHeader(const struct raft_entry *entries,
                          unsigned n,
                          void *buf);
 
+/**
+ * Compressed snapshot data has the following layout:
+ *
+ * [8 bytes] Total size of the decompressed data, little endian.
+ * [4 bytes] Decompressed size of the first block, little endian.
+ * [4 bytes] Stored size of the first block, little endian.
+ * [  ...  ] Stored data of the first block, padded to 8-byte boundary.
+ * [  ...  ] More blocks.
+ *
+ * Each buffer of the original data is split in blocks of at most
+ * #UV__COMPRESSION_BLOCK_SIZE bytes, compressed independently. A block whose
+ * stored size equals its decompressed size didn't compress and is stored as
+ * it is.
+ */
+size_t uvCompressBound(const struct raft_buffer bufs[], unsigned n_bufs);
+
+/* Compress the given buffers into @dst, which must be at least
+ * uvCompressBound() bytes long, and return the size of the compressed data. */
+size_t uvCompress(const struct raft_buffer bufs[], unsigned n_bufs, void *dst);
+
+/* Fill @offsets with the offsets of the blocks of the data at @src, produced
+ * by uvCompress() from a single buffer of @len bytes, followed by the size of
+ * the compressed data. The array must have room for one offset per block plus
+ * one. */
+void uvCompressedBlockOffsets(const void *src, size_t len, size_t offsets[]);
+
+/* Return the size of the data obtained decompressing the @len bytes at @src. */
+int uvDecompressedSize(const void *src, size_t len, size_t *size);
+
+/* Decompress the @len bytes at @src into @dst, which must be as big as
+ * returned by uvDecompressedSize(). */
+int uvDecompress(const void *src, size_t len, void *dst);
+
 /* Encode the content of a snapshot metadata file. */
 int uvEncodeSnapshotMeta(const struct raft_configuration *conf,
                          raft_index conf_index,
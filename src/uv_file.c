@@ -1,4 +1,6 @@
+#include <fcntl.h>
 #include <libgen.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/eventfd.h>
@@ -7,12 +9,33 @@
 
 #include <uv.h>
 
+#if defined(RAFT_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#endif
+
 #include "assert.h"
 #include "uv_file.h"
 
 /* State codes */
 enum { CREATING = 1, READY, ERRORED, CLOSED };
 
+#if defined(RAFT_HAVE_IO_URING)
+/* Kinds of io_uring submission entries. The kind is stored in the low bits of
+ * the entry's user data, next to the pointer to the associated request.
+ *
+ * Each request is a chain of linked entries, all of them except the last one
+ * flagged with IOSQE_CQE_SKIP_SUCCESS, so exactly one completion is posted per
+ * request: either for the first entry that failed or for the last one. */
+enum {
+    URING_WRITE = 0,  /* Write the data of a write request */
+    URING_WRITE_SYNC, /* Sync the data of a write request */
+    URING_ALLOCATE,   /* Allocate the space of a new file */
+    URING_FILE_SYNC,  /* Sync a new file */
+    URING_DIR_SYNC    /* Sync the directory of a new file */
+};
+#define URING_KIND_MASK 7
+#endif
+
 /* Run blocking syscalls involved in file creation (e.g. posix_fallocate()). */
 static void createWorkCb(uv_work_t *work)
 {
@@ -65,6 +88,17 @@ err:
     req->status = UV__ERROR;
 }
 
+/* Return the total lengths of the given buffers. */
+static size_t lenOfBufs(const uv_buf_t bufs[], unsigned n)
+{
+    size_t len = 0;
+    unsigned i;
+    for (i = 0; i < n; i++) {
+        len += bufs[i].len;
+    }
+    return len;
+}
+
 /* Set the write status according the given result code. */
 static void setWriteStatus(struct uvFileWrite *req, int result)
 {
@@ -99,6 +133,20 @@ static void writeWorkCb(uv_work_t *work)
 
     iocbs = &req->iocb;
 
+    /* If the data to write is produced in the threadpool, do it now that we
+     * are about to submit it. */
+    if (req->fill != NULL) {
+        const uv_buf_t *bufs = (const uv_buf_t *)(uintptr_t)req->iocb.aio_buf;
+        req->fill(req);
+        req->len = lenOfBufs(bufs, (unsigned)req->iocb.aio_nbytes);
+    }
+
+    /* With io_uring the write itself is submitted by writeAfterWorkCb(). */
+    if (f->uring) {
+        req->status = 0;
+        return;
+    }
+
     /* If more than one write in parallel is allowed, submit the AIO request
      * using a dedicated context, to avoid synchronization issues between
      * threads when multiple writes are submitted in parallel. This is
@@ -147,7 +195,19 @@ out:
  * callback if set. */
 static void writeFinish(struct uvFileWrite *req)
 {
+    struct uvFile *f = req->file;
+    int rv;
+
     QUEUE_REMOVE(&req->queue);
+
+    /* Stop busy-polling once there's no more inflight write, regardless of
+     * whether this one was reaped by the busy poller or by the event fd
+     * poller. */
+    if (f->busy_poll > 0 && QUEUE_IS_EMPTY(&f->write_queue)) {
+        rv = uv_idle_stop(&f->busy_poller);
+        assert(rv == 0); /* This should never fail */
+    }
+
     req->cb(req, req->status, req->errmsg);
 }
 
@@ -168,6 +228,11 @@ static void pollCloseCb(struct uv_handle_s *handle)
         rv = uvIoDestroy(f->ctx, errmsg);
         assert(rv == 0);
     }
+#if defined(RAFT_HAVE_IO_URING)
+    if (f->ring.fd != -1) {
+        uvUringClose(&f->ring);
+    }
+#endif
     free(f->events);
 
     f->state = CLOSED;
@@ -177,6 +242,14 @@ static void pollCloseCb(struct uv_handle_s *handle)
     }
 }
 
+/* Invoked when the busy-poll idle handle has been closed. It closes the event
+ * fd poller. */
+static void busyPollCloseCb(struct uv_handle_s *handle)
+{
+    struct uvFile *f = handle->data;
+    uv_close((struct uv_handle_s *)&f->event_poller, pollCloseCb);
+}
+
 /* Close the poller if the closing flag is on and there's no infiglht create or
    write request. */
 static void maybeClosed(struct uvFile *f)
@@ -197,17 +270,83 @@ static void maybeClosed(struct uvFile *f)
         return;
     }
 
+    /* When busy-polling, close the idle handle first, the poller will be
+     * closed by its close callback. */
+    if (f->busy_poll > 0) {
+        if (!uv_is_closing((struct uv_handle_s *)&f->busy_poller)) {
+            uv_close((struct uv_handle_s *)&f->busy_poller, busyPollCloseCb);
+        }
+        return;
+    }
+
     if (!uv_is_closing((struct uv_handle_s *)&f->event_poller)) {
         uv_close((struct uv_handle_s *)&f->event_poller, pollCloseCb);
     }
 }
 
+static void busyPollCb(uv_idle_t *idler);
+
+/* Start busy-polling for the completion of a write that was just submitted
+ * asynchronously, if enabled. */
+static void startBusyPoll(struct uvFile *f)
+{
+    int rv;
+
+    if (f->busy_poll == 0) {
+        return;
+    }
+
+    f->busy_poll_start = uv_hrtime();
+
+    if (!uv_is_active((struct uv_handle_s *)&f->busy_poller)) {
+        rv = uv_idle_start(&f->busy_poller, busyPollCb);
+        assert(rv == 0); /* This should never fail */
+    }
+}
+
+#if defined(RAFT_HAVE_IO_URING)
+/* Submit the given write request through io_uring, linking it to a fdatasync()
+ * of the file, so the request completes only once its data is durable. */
+static int uringSubmitWrite(struct uvFileWrite *req, char *errmsg)
+{
+    struct uvFile *f = req->file;
+    struct io_uring_sqe *sqe;
+
+    if (uvUringSpace(&f->ring) < 2) {
+        /* UNTESTED: the ring is sized after the maximum number of concurrent
+         * writes. */
+        uvErrMsgPrintf(errmsg, "io_uring: submission queue is full");
+        return UV__ERROR;
+    }
+
+    sqe = uvUringGetSqe(&f->ring);
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    sqe->fd = f->fd;
+    sqe->addr = req->iocb.aio_buf;
+    sqe->len = (unsigned)req->iocb.aio_nbytes;
+    sqe->off = (uint64_t)req->iocb.aio_offset;
+    sqe->user_data = (uintptr_t)req | URING_WRITE;
+
+    sqe = uvUringGetSqe(&f->ring);
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = f->fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = (uintptr_t)req | URING_WRITE_SYNC;
+
+    return uvUringSubmit(&f->ring, errmsg);
+}
+#endif /* RAFT_HAVE_IO_URING */
+
 /* Callback run after writeWorkCb has returned. It normally invokes the write
  * request callback. */
 static void writeAfterWorkCb(uv_work_t *work, int status)
 {
     struct uvFileWrite *req; /* Write file request object */
     struct uvFile *f;
+#if defined(RAFT_HAVE_IO_URING)
+    int rv;
+#endif
 
     assert(status == 0); /* We don't cancel worker requests */
 
@@ -223,49 +362,36 @@ static void writeAfterWorkCb(uv_work_t *work, int status)
         req->status = UV__CANCELED;
     }
 
+#if defined(RAFT_HAVE_IO_URING)
+    /* With io_uring only the buffers were filled in the threadpool, so submit
+     * the write now. */
+    if (f->uring && !f->closing) {
+        rv = uringSubmitWrite(req, req->errmsg);
+        if (rv == 0) {
+            startBusyPoll(f);
+            return;
+        }
+        req->status = rv;
+    }
+#endif
+
     writeFinish(req);
     maybeClosed(f);
 }
 
-/* Callback fired when the event fd associated with AIO write requests should be
- * ready for reading (i.e. when a write has completed). */
-static void writePollCb(uv_poll_t *poller, int status, int events)
+/* Fetch the responses of completed KAIO write requests, without blocking, and
+ * fire their callbacks. Return the number of responses fetched. */
+static unsigned kaioReap(struct uvFile *f)
 {
-    struct uvFile *f = poller->data; /* File handle */
-    uint64_t completed;              /* True if the write is complete */
+    struct timespec timeout = {0, 0};
     uvErrMsg errmsg;
     unsigned i;
     int n_events;
     int rv;
 
-    assert(f != NULL);
-    assert(f->event_fd >= 0);
-    assert(f->state == READY);
-
-    /* TODO: it's not clear when polling could fail. In this case we should
-     * probably mark all pending requests as failed. */
-    assert(status == 0);
-
-    assert(events & UV_READABLE);
-
-    /* Read the event file descriptor */
-    rv = read(f->event_fd, &completed, sizeof completed);
-    if (rv != sizeof completed) {
-        /* UNTESTED: According to eventfd(2) this is the only possible failure
-         * mode, meaning that epoll has indicated that the event FD is not yet
-         * ready. */
-        assert(errno == EAGAIN);
-        return;
-    }
-
-    /* TODO: this assertion fails in unit tests */
-    /* assert(completed == 1); */
-
-    /* Try to fetch the write responses.
-     *
-     * If we got here at least one write should have completed and io_events
-     * should return immediately without blocking. */
-    rv = uvIoGetevents(f->ctx, 1, f->n_events, f->events, NULL, &n_events,
+    /* Don't wait for any event: when busy-polling, the responses signaled by
+     * the event fd might have been fetched already. */
+    rv = uvIoGetevents(f->ctx, 0, f->n_events, f->events, &timeout, &n_events,
                        errmsg);
     assert(rv == 0);
 
@@ -299,7 +425,7 @@ static void writePollCb(uv_poll_t *poller, int status, int events)
                 req->status = UV__ERROR;
                 goto finish;
             }
-            return;
+            continue;
         }
 #endif /* RWF_NOWAIT */
 
@@ -309,26 +435,56 @@ static void writePollCb(uv_poll_t *poller, int status, int events)
         writeFinish(req);
     }
 
+    return (unsigned)n_events;
+}
+
+/* Callback fired when the event fd associated with AIO write requests should be
+ * ready for reading (i.e. when a write has completed). */
+static void writePollCb(uv_poll_t *poller, int status, int events)
+{
+    struct uvFile *f = poller->data; /* File handle */
+    uint64_t completed;              /* True if the write is complete */
+    int rv;
+
+    assert(f != NULL);
+    assert(f->event_fd >= 0);
+    assert(f->state == READY);
+
+    /* TODO: it's not clear when polling could fail. In this case we should
+     * probably mark all pending requests as failed. */
+    assert(status == 0);
+
+    assert(events & UV_READABLE);
+
+    /* Read the event file descriptor */
+    rv = read(f->event_fd, &completed, sizeof completed);
+    if (rv != sizeof completed) {
+        /* UNTESTED: According to eventfd(2) this is the only possible failure
+         * mode, meaning that epoll has indicated that the event FD is not yet
+         * ready. */
+        assert(errno == EAGAIN);
+        return;
+    }
+
+    /* TODO: this assertion fails in unit tests */
+    /* assert(completed == 1); */
+
+    kaioReap(f);
+
     /* If we've been closed, let's see if we can stop the poller and fire the
      * close callback. */
     maybeClosed(f);
 }
 
-/* Main loop callback run after @createWorkCb has returned. It normally starts
- * the eventfd poller to receive notifications about completed writes and invoke
- * the create request callback. */
-static void createAfterWorkCb(uv_work_t *work, int status)
+/* Complete a create request. It normally starts the eventfd poller to receive
+ * notifications about completed writes and invoke the create request
+ * callback. */
+static void createFinish(struct uvFileCreate *req)
 {
-    struct uvFileCreate *req;
-    struct uvFile *f;
+    struct uvFile *f = req->file;
     uvErrMsg errmsg;
     int rv;
 
-    assert(status == 0); /* We don't cancel worker requests */
-    req = work->data;
-    assert(req != NULL);
-    f = req->file;
-
     /* If we were closed, abort here. */
     if (f->closing) {
         uvTryUnlinkFile(req->dir, req->filename);
@@ -337,8 +493,9 @@ static void createAfterWorkCb(uv_work_t *work, int status)
         goto out;
     }
 
-    /* If no error occurred, start polling the event file descriptor. */
-    if (req->status == 0) {
+    /* If no error occurred, start polling the event file descriptor. With
+     * io_uring we're already polling it. */
+    if (req->status == 0 && !f->uring) {
         rv = uv_poll_start(&f->event_poller, UV_READABLE, writePollCb);
         if (rv != 0) {
             /* UNTESTED: the underlying libuv calls should never fail. */
@@ -365,18 +522,258 @@ out:
     maybeClosed(f);
 }
 
+/* Main loop callback run after @createWorkCb has returned. */
+static void createAfterWorkCb(uv_work_t *work, int status)
+{
+    assert(status == 0); /* We don't cancel worker requests */
+    assert(work->data != NULL);
+    createFinish(work->data);
+}
+
+#if defined(RAFT_HAVE_IO_URING)
+/* Handle the completion of a write request submitted through io_uring. */
+static void uringWriteCompleted(struct uvFileWrite *req, unsigned kind, int res)
+{
+    struct uvFile *f = req->file;
+
+    if (kind == URING_WRITE) {
+        /* The write failed or was short, and its sync got canceled. */
+        setWriteStatus(req, res);
+    } else if (res < 0) {
+        uvErrMsgSys(req->errmsg, fdatasync, -res);
+        req->status = UV__ERROR;
+    } else {
+        req->status = 0;
+    }
+
+    /* If we are closing, we mark the write as canceled, although technically
+     * it might have worked. */
+    if (f->closing) {
+        uvErrMsgPrintf(req->errmsg, "canceled");
+        req->status = UV__CANCELED;
+    }
+
+    writeFinish(req);
+}
+
+/* Handle the completion of a create request submitted through io_uring. */
+static void uringCreateCompleted(struct uvFileCreate *req,
+                                 unsigned kind,
+                                 int res)
+{
+    struct uvFile *f = req->file;
+    int rv;
+
+    close(req->dir_fd);
+
+    if (res < 0) {
+        switch (kind) {
+            case URING_ALLOCATE:
+                uvErrMsgSys(req->errmsg, fallocate, -res);
+                break;
+            case URING_FILE_SYNC:
+                /* UNTESTED: should fail only in case of disk errors */
+                uvErrMsgSys(req->errmsg, fsync, -res);
+                break;
+            default:
+                /* UNTESTED: should fail only in case of disk errors */
+                uvErrMsgPrintf(req->errmsg, "fsync dir: %s", strerror(-res));
+                break;
+        }
+        req->status = UV__ERROR;
+    }
+
+    /* Set direct I/O if available. */
+    if (req->status == 0 && f->direct) {
+        rv = uvSetDirectIo(f->fd, req->errmsg);
+        if (rv != 0) {
+            req->status = rv;
+        }
+    }
+
+    createFinish(req);
+}
+
+/* Pop all available io_uring completion entries and handle them. Return the
+ * number of entries popped. */
+static unsigned uringReap(struct uvFile *f)
+{
+    struct io_uring_cqe cqe; /* io_uring completion entry */
+    unsigned n = 0;
+
+    while (uvUringPop(&f->ring, &cqe)) {
+        unsigned kind = (unsigned)(cqe.user_data & URING_KIND_MASK);
+        void *req = (void *)(uintptr_t)(cqe.user_data - kind);
+        if (kind <= URING_WRITE_SYNC) {
+            uringWriteCompleted(req, kind, cqe.res);
+        } else {
+            uringCreateCompleted(req, kind, cqe.res);
+        }
+        n++;
+    }
+
+    return n;
+}
+
+/* Callback fired when the event fd registered with io_uring is ready for
+ * reading (i.e. when a create or write request has made progress). */
+static void uringPollCb(uv_poll_t *poller, int status, int events)
+{
+    struct uvFile *f = poller->data; /* File handle */
+    uint64_t completed;              /* Number of completed entries */
+    int rv;
+
+    assert(f != NULL);
+    assert(f->event_fd >= 0);
+
+    /* TODO: it's not clear when polling could fail. In this case we should
+     * probably mark all pending requests as failed. */
+    assert(status == 0);
+
+    assert(events & UV_READABLE);
+
+    /* Read the event file descriptor */
+    rv = read(f->event_fd, &completed, sizeof completed);
+    if (rv != sizeof completed) {
+        /* UNTESTED: According to eventfd(2) this is the only possible failure
+         * mode, meaning that epoll has indicated that the event FD is not yet
+         * ready. */
+        assert(errno == EAGAIN);
+        return;
+    }
+
+    uringReap(f);
+
+    /* If we've been closed, let's see if we can stop the poller and fire the
+     * close callback. */
+    maybeClosed(f);
+}
+
+/* Allocate the space of a newly opened file, then sync it and its directory,
+ * all through io_uring. */
+static int uringCreate(struct uvFile *f,
+                       struct uvFileCreate *req,
+                       char *errmsg)
+{
+    struct io_uring_sqe *sqe;
+    int rv;
+
+    /* Each write takes two entries, and creating the file three. */
+    rv = uvUringInit(&f->ring, 2 * f->n_events + 1, errmsg);
+    if (rv != 0) {
+        goto err;
+    }
+
+    rv = uvUringRegisterEventFd(&f->ring, f->event_fd, errmsg);
+    if (rv != 0) {
+        goto err_after_ring_init;
+    }
+
+    rv = uv_poll_start(&f->event_poller, UV_READABLE, uringPollCb);
+    if (rv != 0) {
+        /* UNTESTED: the underlying libuv calls should never fail. */
+        uvErrMsgPrintf(errmsg, "uv_poll_start: %s", uv_strerror(rv));
+        rv = UV__ERROR;
+        goto err_after_ring_init;
+    }
+
+    req->dir_fd = open(req->dir, O_RDONLY | O_DIRECTORY);
+    if (req->dir_fd == -1) {
+        uvErrMsgSys(errmsg, open, errno);
+        rv = UV__ERROR;
+        goto err_after_poll_start;
+    }
+
+    sqe = uvUringGetSqe(&f->ring);
+    sqe->opcode = IORING_OP_FALLOCATE;
+    sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    sqe->fd = f->fd;
+    sqe->off = 0;
+    sqe->addr = req->size; /* Length */
+    sqe->len = 0;          /* Mode */
+    sqe->user_data = (uintptr_t)req | URING_ALLOCATE;
+
+    sqe = uvUringGetSqe(&f->ring);
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    sqe->fd = f->fd;
+    sqe->user_data = (uintptr_t)req | URING_FILE_SYNC;
+
+    sqe = uvUringGetSqe(&f->ring);
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = req->dir_fd;
+    sqe->user_data = (uintptr_t)req | URING_DIR_SYNC;
+
+    rv = uvUringSubmit(&f->ring, errmsg);
+    if (rv != 0) {
+        goto err_after_dir_open;
+    }
+
+    return 0;
+
+err_after_dir_open:
+    close(req->dir_fd);
+err_after_poll_start:
+    uv_poll_stop(&f->event_poller);
+err_after_ring_init:
+    uvUringClose(&f->ring);
+err:
+    assert(rv != 0);
+    return rv;
+}
+#endif /* RAFT_HAVE_IO_URING */
+
+/* Callback run at every loop iteration while busy-polling. It reaps completed
+ * writes without waiting for the event fd to wake up the loop, and stops if
+ * none has completed within the busy-poll budget. */
+static void busyPollCb(uv_idle_t *idler)
+{
+    struct uvFile *f = idler->data;
+    unsigned n;
+    int rv;
+
+    assert(f->state == READY);
+
+#if defined(RAFT_HAVE_IO_URING)
+    if (f->uring) {
+        n = uringReap(f);
+    } else {
+        n = kaioReap(f);
+    }
+#else
+    n = kaioReap(f);
+#endif
+
+    if (n > 0) {
+        f->busy_poll_start = uv_hrtime();
+    }
+
+    if (uv_hrtime() - f->busy_poll_start > f->busy_poll * 1000ULL) {
+        rv = uv_idle_stop(&f->busy_poller);
+        assert(rv == 0); /* This should never fail */
+    }
+
+    maybeClosed(f);
+}
+
 int uvFileInit(struct uvFile *f,
                struct uv_loop_s *loop,
                bool direct,
                bool async,
+               bool uring,
                char *errmsg)
 {
     int rv;
 
+#if !defined(RAFT_HAVE_IO_URING)
+    assert(!uring);
+#endif
+
     f->loop = loop;
     f->fd = -1;
     f->direct = direct;
     f->async = async;
+    f->uring = uring;
     f->event_fd = -1;
 
     /* Create an event file descriptor to get notified when a write has
@@ -402,6 +799,8 @@ int uvFileInit(struct uvFile *f,
     f->ctx = 0;
     f->events = NULL;
     f->n_events = 0;
+    f->ring.fd = -1;
+    f->busy_poll = 0;
     QUEUE_INIT(&f->write_queue);
     f->closing = false;
     f->close_cb = NULL;
@@ -415,6 +814,23 @@ err:
     return rv;
 }
 
+void uvFileSetBusyPoll(struct uvFile *f, unsigned usecs)
+{
+    int rv;
+
+    assert(f->busy_poll == 0);
+    assert(QUEUE_IS_EMPTY(&f->write_queue));
+
+    if (usecs == 0) {
+        return;
+    }
+
+    rv = uv_idle_init(f->loop, &f->busy_poller);
+    assert(rv == 0); /* This should never fail */
+    f->busy_poller.data = f;
+    f->busy_poll = usecs;
+}
+
 int uvFileCreate(struct uvFile *f,
                  struct uvFileCreate *req,
                  uvDir dir,
@@ -456,6 +872,17 @@ int uvFileCreate(struct uvFile *f,
         goto err;
     }
 
+#if defined(RAFT_HAVE_IO_URING)
+    /* With io_uring the file can be created without using the threadpool. */
+    if (f->uring) {
+        rv = uringCreate(f, req, errmsg);
+        if (rv != 0) {
+            goto err_after_open;
+        }
+        return 0;
+    }
+#endif /* RAFT_HAVE_IO_URING */
+
     /* Setup the AIO context. */
     rv = uvIoSetup(f->n_events /* Maximum concurrent requests */, &f->ctx,
                    errmsg);
@@ -495,49 +922,34 @@ err:
     return rv;
 }
 
-/* Return the total lengths of the given buffers. */
-static size_t lenOfBufs(const uv_buf_t bufs[], unsigned n)
-{
-    size_t len = 0;
-    unsigned i;
-    for (i = 0; i < n; i++) {
-        len += bufs[i].len;
-    }
-    return len;
-}
-
-int uvFileWrite(struct uvFile *f,
-                struct uvFileWrite *req,
-                const uv_buf_t bufs[],
-                unsigned n,
-                size_t offset,
-                uvFileWriteCb cb,
-                char *errmsg)
+/* Initialize the KAIO request of the given write request and add it to the
+ * queue of inflight writes. */
+static void initWrite(struct uvFile *f,
+                      struct uvFileWrite *req,
+                      const uv_buf_t bufs[],
+                      unsigned n,
+                      size_t offset,
+                      uvFileWriteCb cb)
 {
-    int rv;
-#if defined(RWF_NOWAIT)
-    struct iocb *iocbs = &req->iocb;
-#endif /* RWF_NOWAIT */
-
     assert(!f->closing);
     assert(f->state == READY);
 
-    /* TODO: at the moment we are not leveraging the support for concurrent
-     *       writes, so ensure that we're getting write requests
-     *       sequentially. */
+    /* If the file was not set up for concurrent writes, ensure that we're
+     * getting write requests sequentially. */
     if (f->n_events == 1) {
         assert(QUEUE_IS_EMPTY(&f->write_queue));
     }
 
     assert(f->fd >= 0);
     assert(f->event_fd >= 0);
-    assert(f->ctx != 0);
+    assert(f->uring || f->ctx != 0);
     assert(req != NULL);
     assert(bufs != NULL);
     assert(n > 0);
 
     req->file = f;
     req->cb = cb;
+    req->fill = NULL;
     req->len = lenOfBufs(bufs, n);
     memset(&req->iocb, 0, sizeof req->iocb);
     req->iocb.aio_fildes = f->fd;
@@ -560,6 +972,33 @@ int uvFileWrite(struct uvFile *f,
      * the file with O_DSYNC. */
     req->iocb.aio_rw_flags |= RWF_DSYNC;
 #endif
+}
+
+int uvFileWrite(struct uvFile *f,
+                struct uvFileWrite *req,
+                const uv_buf_t bufs[],
+                unsigned n,
+                size_t offset,
+                uvFileWriteCb cb,
+                char *errmsg)
+{
+    int rv;
+#if defined(RWF_NOWAIT)
+    struct iocb *iocbs = &req->iocb;
+#endif /* RWF_NOWAIT */
+
+    initWrite(f, req, bufs, n, offset, cb);
+
+#if defined(RAFT_HAVE_IO_URING)
+    if (f->uring) {
+        rv = uringSubmitWrite(req, errmsg);
+        if (rv != 0) {
+            goto err;
+        }
+        startBusyPoll(f);
+        return 0;
+    }
+#endif /* RAFT_HAVE_IO_URING */
 
 #if defined(RWF_NOWAIT)
     /* If io_submit can be run in a 100% non-blocking way, we'll try to write
@@ -583,6 +1022,7 @@ int uvFileWrite(struct uvFile *f,
         /* If no error occurred, we're done, the write request was
          * submitted. */
         if (rv == 0) {
+            startBusyPoll(f);
             goto done;
         }
 
@@ -630,6 +1070,34 @@ err:
     return rv;
 }
 
+int uvFileWriteDeferred(struct uvFile *f,
+                        struct uvFileWrite *req,
+                        uv_buf_t bufs[],
+                        unsigned n,
+                        size_t offset,
+                        uvFileWriteFillCb fill,
+                        uvFileWriteCb cb,
+                        char *errmsg)
+{
+    int rv;
+
+    assert(fill != NULL);
+
+    initWrite(f, req, bufs, n, offset, cb);
+    req->fill = fill;
+    req->work.data = req;
+
+    rv = uv_queue_work(f->loop, &req->work, writeWorkCb, writeAfterWorkCb);
+    if (rv != 0) {
+        /* UNTESTED: with the current libuv implementation this can't fail. */
+        uvErrMsgPrintf(errmsg, "uv_queue_work: %s", uv_strerror(rv));
+        QUEUE_REMOVE(&req->queue);
+        return UV__ERROR;
+    }
+
+    return 0;
+}
+
 void uvFileClose(struct uvFile *f, uvFileCloseCb cb)
 {
     int rv;
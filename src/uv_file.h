@@ -1,17 +1,19 @@
 /* Create and write files asynchronously, using libuv on top of Linux AIO (aka
- * KAIO). */
+ * KAIO) or io_uring. */
 
 #ifndef UV_FILE_H_
 #define UV_FILE_H_
 
 #include <linux/aio_abi.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <uv.h>
 
 #include "queue.h"
 #include "uv_error.h"
 #include "uv_os.h"
+#include "uv_uring.h"
 
 /* Handle to an open file. */
 struct uvFile;
@@ -32,6 +34,11 @@ typedef void (*uvFileWriteCb)(struct uvFileWrite *req,
                               int status,
                               const char *errmsg);
 
+/* Callback called in the threadpool right before a deferred write request is
+ * submitted. It must fill the buffers that were passed to
+ * uvFileWriteDeferred(). */
+typedef void (*uvFileWriteFillCb)(struct uvFileWrite *req);
+
 /* Callback called after the memory associated with a file handle can be
  * released. */
 typedef void (*uvFileCloseCb)(struct uvFile *f);
@@ -41,8 +48,15 @@ int uvFileInit(struct uvFile *f,
                struct uv_loop_s *loop,
                bool direct /* Whether to use direct I/O */,
                bool async /* Whether async I/O is available */,
+               bool uring /* Whether io_uring is available */,
                char *errmsg);
 
+/* Keep the loop busy-polling for completed writes for up to @usecs
+ * microseconds after a write has been submitted asynchronously, instead of
+ * only relying on the event file descriptor. Must be called before submitting
+ * any write. A value of 0 disables busy-polling. */
+void uvFileSetBusyPoll(struct uvFile *f, unsigned usecs);
+
 /* Create the given file in the given directory for subsequent non-blocking
  * writing. The file must not exist yet. */
 int uvFileCreate(struct uvFile *f,
@@ -63,6 +77,20 @@ int uvFileWrite(struct uvFile *f,
                 uvFileWriteCb cb,
                 char *errmsg);
 
+/* Same as uvFileWrite(), but the content of the given buffers is produced by
+ * the @fill callback, which is invoked in the threadpool thread that then
+ * submits the write and waits for it to complete. The loop thread only fires
+ * the @cb callback. When using io_uring, the write is instead submitted by the
+ * loop thread once @fill has returned. */
+int uvFileWriteDeferred(struct uvFile *f,
+                        struct uvFileWrite *req,
+                        uv_buf_t bufs[],
+                        unsigned n_bufs,
+                        size_t offset,
+                        uvFileWriteFillCb fill,
+                        uvFileWriteCb cb,
+                        char *errmsg);
+
 /* Close the given file and release all associated resources. There must be no
  * request in progress. */
 void uvFileClose(struct uvFile *f, uvFileCloseCb cb);
@@ -75,11 +103,16 @@ struct uvFile
     int fd;                        /* Operating system file descriptor */
     bool direct;                   /* Whether direct I/O is supported */
     bool async;                    /* Whether fully async I/O is supported */
+    bool uring;                    /* Whether to use io_uring instead of KAIO */
     int event_fd;                  /* Poll'ed to check if write is finished */
     struct uv_poll_s event_poller; /* To make the loop poll for event_fd */
     aio_context_t ctx;             /* KAIO handle */
     struct io_event *events;       /* Array of KAIO response objects */
     unsigned n_events;             /* Length of the events array */
+    struct uvUring ring;           /* io_uring instance */
+    unsigned busy_poll;            /* Busy-poll budget in microseconds */
+    uint64_t busy_poll_start;      /* Time of last progress, in nanoseconds */
+    struct uv_idle_s busy_poller;  /* To reap completions at each iteration */
     queue write_queue;             /* Queue of inflight write requests */
     bool closing;                  /* True during the close sequence */
     uvFileCloseCb close_cb;        /* Close callback */
@@ -96,19 +129,21 @@ struct uvFileCreate
     uvDir dir;             /* File directory */
     uvFilename filename;   /* File name */
     size_t size;           /* File size */
+    int dir_fd;            /* Directory to sync, when using io_uring */
 };
 
 struct uvFileWrite
 {
-    void *data;            /* User data */
-    struct uvFile *file;   /* File handle */
-    size_t len;            /* Total number of bytes to write */
-    int status;            /* Request result code */
-    uvErrMsg errmsg;       /* Error message (for status != 0) */
-    struct uv_work_s work; /* To execute logic in the threadpool */
-    uvFileWriteCb cb;      /* Callback to invoke upon request completion */
-    struct iocb iocb;      /* KAIO request (for writing) */
-    queue queue;           /* Prev/next links in the inflight queue */
+    void *data;             /* User data */
+    struct uvFile *file;    /* File handle */
+    size_t len;             /* Total number of bytes to write */
+    int status;             /* Request result code */
+    uvErrMsg errmsg;        /* Error message (for status != 0) */
+    struct uv_work_s work;  /* To execute logic in the threadpool */
+    uvFileWriteCb cb;       /* Callback to invoke upon request completion */
+    uvFileWriteFillCb fill; /* Fill the buffers before writing, if not NULL */
+    struct iocb iocb;       /* KAIO request (for writing) */
+    queue queue;            /* Prev/next links in the inflight queue */
 };
 
 #endif /* UV_FILE_H_ */
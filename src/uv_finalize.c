@@ -76,6 +76,7 @@ static void afterWorkCb(uv_work_t *work, int status)
     raft_free(s);
     processRequests(uv);
     uvTruncateMaybeProcessRequests(uv);
+    uvReadMaybeProcessRequests(uv);
     uvMaybeClose(uv);
 }
 
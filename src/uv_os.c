@@ -12,6 +12,11 @@
 #include "assert.h"
 #include "uv_error.h"
 #include "uv_os.h"
+#include "uv_uring.h"
+
+#if defined(RAFT_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#endif
 
 /* Default permissions when creating a directory. */
 #define DEFAULT_DIR_PERM 0700
@@ -505,9 +510,58 @@ static int probeAsyncIO(int fd, size_t size, bool *ok, char *errmsg)
 }
 #endif /* RWF_NOWAIT */
 
+#if defined(RAFT_HAVE_IO_URING)
+/* Check if io_uring is available and supports all the operations we need, by
+ * running a fallocate() against the given file through it. */
+static int probeIoUring(int fd, bool *ok, char *errmsg)
+{
+    struct uvUring ring;      /* Ring to use for the probe */
+    struct io_uring_sqe *sqe; /* Submission entry for fallocate() */
+    struct io_uring_cqe cqe;  /* Completion entry for fallocate() */
+    int rv;
+
+    /* The kernel might not support io_uring or some of its features, or it
+     * might have been disabled by the administrator. */
+    rv = uvUringInit(&ring, 1, errmsg);
+    if (rv != 0) {
+        *ok = false;
+        return 0;
+    }
+
+    sqe = uvUringGetSqe(&ring);
+    sqe->opcode = IORING_OP_FALLOCATE;
+    sqe->fd = fd;
+    sqe->off = 0;
+    sqe->addr = 4096; /* Length */
+    sqe->len = 0;     /* Mode */
+
+    rv = uvUringSubmit(&ring, errmsg);
+    if (rv != 0) {
+        /* UNTESTED: in practice this should fail only with ENOMEM */
+        uvUringClose(&ring);
+        return rv;
+    }
+
+    /* Fetch the response: will block until done. */
+    rv = uvUringWait(&ring, errmsg);
+    assert(rv == 0);
+    rv = uvUringPop(&ring, &cqe);
+    assert(rv);
+
+    uvUringClose(&ring);
+
+    /* The operation fails if the kernel doesn't know about it, or if the file
+     * system doesn't support fallocate(). */
+    *ok = cqe.res == 0;
+
+    return 0;
+}
+#endif /* RAFT_HAVE_IO_URING */
+
 int uvProbeIoCapabilities(const uvDir dir,
                           size_t *direct,
                           bool *async,
+                          bool *uring,
                           char *errmsg)
 {
     uvFilename filename; /* Filename of the probe file */
@@ -556,6 +610,16 @@ int uvProbeIoCapabilities(const uvDir dir,
 #if defined(RWF_NOWAIT)
 out:
 #endif /* RWF_NOWAIT */
+
+#if defined(RAFT_HAVE_IO_URING)
+    rv = probeIoUring(fd, uring, errmsg);
+    if (rv != 0) {
+        goto err_after_file_open;
+    }
+#else
+    *uring = false;
+#endif /* RAFT_HAVE_IO_URING */
+
     close(fd);
     return 0;
 
@@ -112,10 +112,14 @@ bool uvIsAtEof(int fd);
  * to the block size to use for direct I/O otherwise.
  *
  * The @async parameter will be set to true if fully asynchronous I/O is
- * possible using the KAIO API. */
+ * possible using the KAIO API.
+ *
+ * The @uring parameter will be set to true if io_uring is available and
+ * supports all the operations needed to create and write files. */
 int uvProbeIoCapabilities(const uvDir dir,
                           size_t *direct,
                           bool *async,
+                          bool *uring,
                           char *errmsg);
 
 /* Configure the given file descriptor for direct I/O. */
@@ -25,10 +25,6 @@
  * - Cancel any pending internal create segment request.
  */
 
-/* At the moment the uv implementation of raft_io->append does not use
- * concurrent writes. */
-#define MAX_CONCURRENT_WRITES 1
-
 /* Number of open segments that we try to keep ready for writing. */
 #define TARGET_POOL_SIZE 2
 
@@ -194,12 +190,14 @@ static int prepareSegment(struct uv *uv)
         goto err_after_segment_alloc;
     }
 
-    rv = uvFileInit(s->file, uv->loop, uv->direct_io, uv->async_io, errmsg);
+    rv = uvFileInit(s->file, uv->loop, uv->direct_io, uv->async_io,
+                    uv->uring_io, errmsg);
     if (rv != 0) {
         uvErrorf(uv, "init segment file %d: %s", s->counter, uv_strerror(rv));
         rv = RAFT_IOERR;
         goto err_after_file_alloc;
     }
+    uvFileSetBusyPoll(s->file, uv->busy_poll);
 
     s->file->data = s;
     s->create.data = s;
@@ -210,8 +208,9 @@ static int prepareSegment(struct uv *uv)
 
     uvDebugf(uv, "create open segment %s", s->filename);
     rv = uvFileCreate(s->file, &s->create, uv->dir, s->filename,
-                      uv->block_size * uv->n_blocks, MAX_CONCURRENT_WRITES,
-                      prepareSegmentFileCreateCb, errmsg);
+                      uv->block_size * uv->n_blocks,
+                      2 * UV__MAX_CONCURRENT_WRITES, prepareSegmentFileCreateCb,
+                      errmsg);
     if (rv != 0) {
         uvErrorf(uv, "can't create segment %s: %s", s->filename, errmsg);
         rv = RAFT_IOERR;
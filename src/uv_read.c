@@ -0,0 +1,224 @@
+#include "assert.h"
+#include "uv.h"
+
+/* The entries to read are always looked up in closed segments. If the first of
+ * them is still in an open segment, the current open segment is finalized, and
+ * the read request waits for it to be closed. Read requests also wait for
+ * segments being closed or truncated, so they never see a segment file while
+ * it's being renamed or rewritten.
+ *
+ * Reads are executed in the threadpool, and several of them can run at the
+ * same time. */
+
+struct read
+{
+    struct uv *uv;                    /* libuv I/O implementation object */
+    struct raft_io_read_entries *req; /* User request */
+    raft_index index;                 /* Index of the first entry to read */
+    size_t max_bytes;                 /* Maximum size of the payloads */
+    struct raft_entry *entries;       /* Entries that were read */
+    unsigned n;                       /* Number of entries that were read */
+    int status;                       /* Status code of the read */
+    bool submitted;                   /* Whether the work was queued */
+    uv_work_t work;                   /* To execute logic in the threadpool */
+    queue queue;                      /* Link in uv->read_reqs */
+};
+
+/* Run all blocking syscalls involved in reading the entries. */
+static void workCb(uv_work_t *work)
+{
+    struct read *r = work->data;
+    struct uv *uv = r->uv;
+    struct uvSnapshotInfo *snapshots;
+    struct uvSegmentInfo *segments;
+    struct uvSegmentInfo *segment = NULL;
+    size_t n_snapshots;
+    size_t n_segments;
+    size_t i;
+    int rv;
+
+    rv = uvList(uv, &snapshots, &n_snapshots, &segments, &n_segments);
+    if (rv != 0) {
+        goto err;
+    }
+    if (snapshots != NULL) {
+        raft_free(snapshots);
+    }
+
+    /* Look for the closed segment that contains the first entry. */
+    for (i = 0; i < n_segments; i++) {
+        if (segments[i].is_open) {
+            continue;
+        }
+        if (r->index >= segments[i].first_index &&
+            r->index <= segments[i].end_index) {
+            segment = &segments[i];
+            break;
+        }
+    }
+    if (segment == NULL) {
+        uvErrorf(uv, "read entries: no closed segment contains index %lld",
+                 r->index);
+        rv = RAFT_IOERR;
+        goto err_after_list;
+    }
+
+    /* Only decode the batches covering the requested entries, since the
+     * payloads fitting in max_bytes are usually a small part of the segment. */
+    rv = uvSegmentLoadRange(uv, segment, r->index, r->max_bytes, &r->entries,
+                            &r->n);
+    if (rv != 0) {
+        goto err_after_list;
+    }
+
+    raft_free(segments);
+
+    r->status = 0;
+
+    return;
+
+err_after_list:
+    if (segments != NULL) {
+        raft_free(segments);
+    }
+err:
+    assert(rv != 0);
+    r->status = rv;
+}
+
+static void afterWorkCb(uv_work_t *work, int status)
+{
+    struct read *r = work->data;
+    struct uv *uv = r->uv;
+
+    assert(status == 0); /* We don't cancel worker requests */
+
+    QUEUE_REMOVE(&r->queue);
+    r->req->cb(r->req, r->entries, r->n, r->status);
+    raft_free(r);
+
+    uvMaybeClose(uv);
+}
+
+/* Return true if the first entry of the given request can be found in a closed
+ * segment that is not going to be changed in the meantime. */
+static bool isReadable(struct read *r)
+{
+    struct uv *uv = r->uv;
+
+    /* Wait for segments being closed or truncated. */
+    if (!QUEUE_IS_EMPTY(&uv->finalize_reqs) || uv->finalize_work.data != NULL ||
+        !QUEUE_IS_EMPTY(&uv->truncate_reqs) || uv->truncate_work.data != NULL) {
+        return false;
+    }
+
+    return r->index <= uv->finalize_last_index;
+}
+
+/* Submit all pending read requests whose entries can be read. */
+static void processRequests(struct uv *uv)
+{
+    queue *head;
+    int rv;
+
+    head = QUEUE_HEAD(&uv->read_reqs);
+    while (head != &uv->read_reqs) {
+        struct read *r = QUEUE_DATA(head, struct read, queue);
+        head = QUEUE_NEXT(head);
+
+        if (r->submitted || !isReadable(r)) {
+            continue;
+        }
+
+        r->submitted = true;
+        rv = uv_queue_work(uv->loop, &r->work, workCb, afterWorkCb);
+        if (rv != 0) {
+            uvErrorf(uv, "read entries from index %lld: %s", r->index,
+                     uv_strerror(rv));
+            QUEUE_REMOVE(&r->queue);
+            r->req->cb(r->req, NULL, 0, RAFT_IOERR);
+            raft_free(r);
+        }
+    }
+}
+
+int uvReadEntries(struct raft_io *io,
+                  struct raft_io_read_entries *req,
+                  raft_index index,
+                  size_t max_bytes,
+                  raft_io_read_entries_cb cb)
+{
+    struct uv *uv;
+    struct read *r;
+    int rv;
+
+    uv = io->impl;
+
+    assert(!uv->closing);
+    assert(index > 0);
+
+    r = raft_malloc(sizeof *r);
+    if (r == NULL) {
+        rv = RAFT_NOMEM;
+        goto err;
+    }
+    r->uv = uv;
+    r->req = req;
+    r->index = index;
+    r->max_bytes = max_bytes;
+    r->entries = NULL;
+    r->n = 0;
+    r->status = 0;
+    r->submitted = false;
+    r->work.data = r;
+    req->cb = cb;
+
+    /* If the entry was not yet closed in a segment, it's in the one currently
+     * being written, so close it. */
+    if (index > uv->finalize_last_index) {
+        rv = uvAppendForceFinalizingCurrentSegment(uv);
+        if (rv != 0) {
+            goto err_after_req_alloc;
+        }
+    }
+
+    QUEUE_PUSH(&uv->read_reqs, &r->queue);
+    processRequests(uv);
+
+    return 0;
+
+err_after_req_alloc:
+    raft_free(r);
+err:
+    assert(rv != 0);
+    return rv;
+}
+
+void uvReadMaybeProcessRequests(struct uv *uv)
+{
+    if (QUEUE_IS_EMPTY(&uv->read_reqs)) {
+        return;
+    }
+    processRequests(uv);
+}
+
+void uvReadClose(struct uv *uv)
+{
+    queue *head;
+
+    /* Requests already submitted to the threadpool will complete normally,
+     * cancel the ones still waiting for their segment to be closed. */
+    head = QUEUE_HEAD(&uv->read_reqs);
+    while (head != &uv->read_reqs) {
+        struct read *r = QUEUE_DATA(head, struct read, queue);
+        head = QUEUE_NEXT(head);
+
+        if (r->submitted) {
+            continue;
+        }
+
+        QUEUE_REMOVE(&r->queue);
+        r->req->cb(r->req, NULL, 0, RAFT_CANCELED);
+        raft_free(r);
+    }
+}
@@ -21,7 +21,8 @@
  *
  * - The RPC message header is read, whose content depends on the message type.
  *
- * - Optionally, the RPC message payload is read (for AppendEntries requests).
+ * - Optionally, the RPC message payload is read (for AppendEntries requests),
+ *   and decompressed (for compressed InstallSnapshot requests).
  *
  * - The recv callback passed to raft_io->start() gets fired with the received
  *   message.
@@ -46,6 +47,7 @@ struct uvServer
     uint64_t preamble[2];        /* Static buffer with the request preamble */
     uv_buf_t header;             /* Dynamic buffer with the request header */
     uv_buf_t payload;            /* Dynamic buffer with the request payload */
+    unsigned codec;              /* Codec the payload is compressed with */
     struct raft_message message; /* The message being received */
 };
 
@@ -83,6 +85,7 @@ static int initServer(struct uvServer *s,
     s->message.type = 0;
     s->payload.base = NULL;
     s->payload.len = 0;
+    s->codec = UV__CODEC_NONE;
     return 0;
 }
 
@@ -213,6 +216,45 @@ static void recvMessage(struct uvServer *s)
     s->header.len = 0;
     s->payload.base = NULL;
     s->payload.len = 0;
+    s->codec = UV__CODEC_NONE;
+}
+
+/* Replace the compressed snapshot data in the payload buffer with its
+ * decompressed content. */
+static int decompressPayload(struct uvServer *s)
+{
+    struct raft_install_snapshot *p = &s->message.install_snapshot;
+    void *data;
+    size_t len;
+    int rv;
+
+    rv = uvDecompressedSize(s->payload.base, s->payload.len, &len);
+    if (rv != 0) {
+        return rv;
+    }
+
+    /* The codec can't expand data by more than 255 times, don't let a bogus
+     * size make us allocate an arbitrary amount of memory. */
+    if (len / 255 > s->payload.len) {
+        return RAFT_MALFORMED;
+    }
+
+    data = raft_malloc(len > 0 ? len : 1);
+    if (data == NULL) {
+        return RAFT_NOMEM;
+    }
+    rv = uvDecompress(s->payload.base, s->payload.len, data);
+    if (rv != 0) {
+        raft_free(data);
+        return rv;
+    }
+
+    raft_free(s->payload.base);
+    s->payload.base = data;
+    s->payload.len = len;
+    p->data.len = len;
+
+    return 0;
 }
 
 /* Callback invoked when data has been read from the socket. */
@@ -263,8 +305,8 @@ static void readCb(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
             type = byteFlip64(s->preamble[0]);
             assert(type > 0);
 
-            rv =
-                uvDecodeMessage(type, &s->header, &s->message, &s->payload.len);
+            rv = uvDecodeMessage(type, &s->header, &s->message,
+                                 &s->payload.len, &s->codec);
             if (rv != 0) {
                 uvWarnf(s->uv, "decode message: %s", raft_strerror(rv));
                 goto abort;
@@ -293,6 +335,14 @@ static void readCb(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
                                          s->message.append_entries.n_entries);
                     break;
                 case RAFT_IO_INSTALL_SNAPSHOT:
+                    if (s->codec != UV__CODEC_NONE) {
+                        rv = decompressPayload(s);
+                        if (rv != 0) {
+                            uvWarnf(s->uv, "decompress snapshot: %s",
+                                    raft_strerror(rv));
+                            goto abort;
+                        }
+                    }
                     s->message.install_snapshot.data.base = s->payload.base;
                     break;
                 default:
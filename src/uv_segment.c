@@ -1,6 +1,8 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "array.h"
@@ -11,6 +13,9 @@
 #include "uv.h"
 #include "uv_encoding.h"
 
+/* Maximum number of threads used to load closed segments at startup. */
+#define LOAD_MAX_THREADS 4
+
 /* Check if the given filename matches the one of a closed segment (xxx-yyy), or
  * of an open segment (open-xxx), and fill the given info structure if so.
  *
@@ -177,11 +182,29 @@ static int openSegment(struct uv *uv,
     return 0;
 }
 
+/* Function calculating the checksums of segment batches. */
+typedef unsigned (*checksumFn)(const void *buf, size_t size, unsigned init);
+
+/* Return the checksum function used by segments with the given format version,
+ * or NULL if the version is unknown. */
+static checksumFn formatChecksum(uint64_t format)
+{
+    switch (format) {
+        case UV__DISK_FORMAT:
+            return byteCrc32;
+        case UV__DISK_FORMAT_CRC32C:
+            return byteCrc32c;
+        default:
+            return NULL;
+    }
+}
+
 /* Load a single batch of entries from a segment.
  *
  * Set @last to #true if the loaded batch is the last one. */
 static int loadEntriesBatch(struct uv *uv,
                             const int fd,
+                            checksumFn checksum,
                             struct raft_entry **entries,
                             unsigned *n_entries,
                             bool *last)
@@ -249,7 +272,7 @@ static int loadEntriesBatch(struct uv *uv,
 
     /* Check batch header integrity. */
     crc1 = byteFlip32(*(uint32_t *)preamble);
-    crc2 = byteCrc32(header.base, header.len, 0);
+    crc2 = checksum(header.base, header.len, 0);
     if (crc1 != crc2) {
         uvErrorf(uv, "corrupted batch header");
         rv = RAFT_CORRUPT;
@@ -283,7 +306,7 @@ static int loadEntriesBatch(struct uv *uv,
 
     /* Check batch data integrity. */
     crc1 = byteFlip32(*((uint32_t *)preamble + 1));
-    crc2 = byteCrc32(data.base, data.len, 0);
+    crc2 = checksum(data.base, data.len, 0);
     if (crc1 != crc2) {
         uvErrorf(uv, "corrupted batch data");
         rv = RAFT_CORRUPT;
@@ -334,80 +357,510 @@ static int extendEntries(const struct raft_entry *entries1,
     return 0;
 }
 
-int uvSegmentLoadClosed(struct uv *uv,
-                        struct uvSegmentInfo *info,
-                        struct raft_entry *entries[],
-                        size_t *n)
+/* Check that the size of the given closed segment file can accommodate the
+ * entries in the index range encoded in its name, and return their number. */
+static int countClosed(struct uv *uv, struct uvSegmentInfo *info, size_t *n)
 {
-    bool empty;                     /* Whether the file is empty */
-    int fd;                         /* Segment file descriptor */
-    uint64_t format;                /* Format version */
-    bool last;                      /* Whether the last batch was reached */
-    struct raft_entry *tmp_entries; /* Entries in current batch */
-    unsigned tmp_n;                 /* Number of entries in current batch */
-    int i;
+    struct stat sb;
+    raft_index max_n;
     char errmsg[2048];
     int rv;
 
-    /* If the segment is completely empty, just bail out. */
-    rv = uvIsEmptyFile(uv->dir, info->filename, &empty, errmsg);
+    assert(!info->is_open);
+    assert(info->first_index <= info->end_index);
+
+    rv = uvStatFile(uv->dir, info->filename, &sb, errmsg);
     if (rv != 0) {
         uvErrorf(uv, "stat %s: %s", info->filename, errmsg);
-        rv = RAFT_IOERR;
-        goto err;
+        return RAFT_IOERR;
     }
-    if (empty) {
+    if (sb.st_size == 0) {
         uvErrorf(uv, "load %s: file is empty", info->filename);
-        rv = RAFT_CORRUPT;
-        goto err;
+        return RAFT_CORRUPT;
+    }
+
+    /* Each entry takes at least 16 bytes for its header, and each batch 16
+     * bytes for its preamble. This also protects against allocating too much
+     * memory for a segment with a bogus name. Any other inconsistency is
+     * detected when actually loading the segment. */
+    max_n = 1;
+    if ((size_t)sb.st_size > sizeof(uint64_t) * 3) {
+        size_t len = (size_t)sb.st_size - sizeof(uint64_t) * 3;
+        if (len / (sizeof(uint64_t) * 2) > max_n) {
+            max_n = len / (sizeof(uint64_t) * 2);
+        }
+    }
+    if (info->end_index - info->first_index >= max_n) {
+        uvErrorf(uv, "load %s: file is too small for its entries",
+                 info->filename);
+        return RAFT_CORRUPT;
     }
 
-    /* Open the segment file. */
-    rv = openSegment(uv, info->filename, O_RDONLY, &fd, &format);
+    *n = (size_t)(info->end_index - info->first_index + 1);
+
+    return 0;
+}
+
+/* Check the integrity of the header of the batch found at @offset in the
+ * closed segment content mapped at @base, and decode it into @entries, which
+ * has room for @n of them. Advance @offset to the batch data, and return the
+ * number of entries in the batch, the padded size of its data and the checksum
+ * of its data. */
+static int decodeBatchHeaderAt(const uint8_t *base,
+                               size_t len,
+                               size_t *offset,
+                               checksumFn checksum,
+                               struct raft_entry *entries,
+                               size_t n,
+                               size_t *n_batch,
+                               size_t *data_len,
+                               uint32_t *crc,
+                               char *errmsg)
+{
+    uint32_t header_crc;
+    size_t header_len;
+    uint64_t count;
+    size_t j;
+    int rv;
+
+    if (len - *offset < sizeof(uint64_t) * 2) {
+        uvErrMsgPrintf(errmsg, "short batch preamble at offset %zu", *offset);
+        return RAFT_CORRUPT;
+    }
+    header_crc = byteFlip32(*(uint32_t *)(base + *offset));
+    *crc = byteFlip32(*(uint32_t *)(base + *offset + sizeof(uint32_t)));
+    *offset += sizeof(uint64_t);
+
+    count = byteFlip64(*(uint64_t *)(base + *offset));
+    if (count == 0 || count > n) {
+        uvErrMsgPrintf(errmsg, "batch at offset %zu has %llu entries", *offset,
+                       (unsigned long long)count);
+        return RAFT_CORRUPT;
+    }
+
+    header_len = uvSizeofBatchHeader(count);
+    if (len - *offset < header_len) {
+        uvErrMsgPrintf(errmsg, "short batch header at offset %zu", *offset);
+        return RAFT_CORRUPT;
+    }
+    if (checksum(base + *offset, header_len, 0) != header_crc) {
+        uvErrMsgPrintf(errmsg, "corrupted batch header at offset %zu",
+                       *offset);
+        return RAFT_CORRUPT;
+    }
+    rv = uvDecodeBatchHeaderInto(base + *offset, entries);
     if (rv != 0) {
+        uvErrMsgPrintf(errmsg, "malformed batch header at offset %zu",
+                       *offset);
+        return rv;
+    }
+    *offset += header_len;
+
+    *data_len = 0;
+    for (j = 0; j < count; j++) {
+        *data_len += bytePad64(entries[j].buf.len);
+    }
+    if (len - *offset < *data_len) {
+        uvErrMsgPrintf(errmsg, "short batch data at offset %zu", *offset);
+        return RAFT_CORRUPT;
+    }
+
+    *n_batch = (size_t)count;
+
+    return 0;
+}
+
+/* Check the integrity of the closed segment content mapped at @base and decode
+ * its entries into @entries, which has room for exactly @n of them.
+ *
+ * The payloads of all entries are copied into a single batch, so the mapping
+ * can be released afterwards and the segment costs a single allocation. */
+static int decodeClosed(const uint8_t *base,
+                        size_t len,
+                        checksumFn checksum,
+                        struct raft_entry *entries,
+                        size_t n,
+                        char *errmsg)
+{
+    size_t offset; /* Current offset in the segment */
+    size_t size;   /* Total size of the entries data */
+    size_t i;      /* Number of entries decoded so far */
+    uint8_t *batch;
+    uint8_t *cursor;
+    int rv;
+
+    /* First pass: check the integrity of all batches and decode their headers,
+     * calculating the total size of the entries data. */
+    offset = sizeof(uint64_t); /* Format version */
+    size = 0;
+    i = 0;
+    while (offset < len) {
+        size_t n_batch;
+        size_t data_len;
+        uint32_t crc;
+
+        rv = decodeBatchHeaderAt(base, len, &offset, checksum, entries + i,
+                                 n - i, &n_batch, &data_len, &crc, errmsg);
+        if (rv != 0) {
+            return rv;
+        }
+        if (checksum(base + offset, data_len, 0) != crc) {
+            uvErrMsgPrintf(errmsg, "corrupted batch data at offset %zu",
+                           offset);
+            return RAFT_CORRUPT;
+        }
+        offset += data_len;
+
+        size += data_len;
+        i += n_batch;
+    }
+
+    if (i != n) {
+        uvErrMsgPrintf(errmsg, "found %zu entries instead of %zu", i, n);
+        return RAFT_CORRUPT;
+    }
+
+    batch = NULL;
+    if (size > 0) {
+        batch = raft_malloc(size);
+        if (batch == NULL) {
+            return RAFT_NOMEM;
+        }
+    }
+
+    /* Second pass: copy the data of each batch and point the entries to it. */
+    offset = sizeof(uint64_t);
+    cursor = batch;
+    i = 0;
+    while (offset < len) {
+        uint64_t n_batch;
+        size_t data_len;
+        size_t j;
+
+        offset += sizeof(uint64_t); /* Checksums */
+        n_batch = byteFlip64(*(uint64_t *)(base + offset));
+        offset += uvSizeofBatchHeader(n_batch);
+
+        data_len = 0;
+        for (j = 0; j < n_batch; j++) {
+            struct raft_entry *entry = &entries[i + j];
+            entry->batch = batch;
+            entry->buf.base = NULL;
+            if (entry->buf.len > 0) {
+                entry->buf.base = cursor + data_len;
+            }
+            data_len += bytePad64(entry->buf.len);
+        }
+
+        if (data_len > 0) {
+            memcpy(cursor, base + offset, data_len);
+        }
+        cursor += data_len;
+        offset += data_len;
+        i += n_batch;
+    }
+
+    return 0;
+}
+
+/* Map the given closed segment file in memory and return the checksum function
+ * matching its format version.
+ *
+ * This function may run concurrently in several threads, so errors are
+ * reported in @errmsg instead of being logged. */
+static int mapClosed(struct uv *uv,
+                     struct uvSegmentInfo *info,
+                     uint8_t **base,
+                     size_t *len,
+                     checksumFn *checksum,
+                     char *errmsg)
+{
+    struct stat sb;
+    uint64_t format;
+    int fd;
+    int rv;
+
+    rv = uvOpenFile(uv->dir, info->filename, O_RDONLY, &fd, errmsg);
+    if (rv != 0) {
+        rv = RAFT_IOERR;
         goto err;
     }
-    if (format != UV__DISK_FORMAT) {
-        uvErrorf(uv, "load %s: unexpected format version: %lu", info->filename,
-                 format);
+
+    rv = fstat(fd, &sb);
+    if (rv != 0) {
+        uvErrMsgSys(errmsg, fstat, errno);
+        rv = RAFT_IOERR;
+        goto err_after_open;
+    }
+    *len = (size_t)sb.st_size;
+    if (*len < sizeof format) {
+        uvErrMsgPrintf(errmsg, "short format version");
         rv = RAFT_IOERR;
         goto err_after_open;
     }
 
-    /* Load all batches in the segment. */
-    *entries = NULL;
-    *n = 0;
+    *base = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (*base == MAP_FAILED) {
+        uvErrMsgSys(errmsg, mmap, errno);
+        rv = RAFT_IOERR;
+        goto err_after_open;
+    }
 
-    last = false;
-    for (i = 1; !last; i++) {
-        rv = loadEntriesBatch(uv, fd, &tmp_entries, &tmp_n, &last);
+    format = byteFlip64(*(uint64_t *)*base);
+    *checksum = formatChecksum(format);
+    if (*checksum == NULL) {
+        uvErrMsgPrintf(errmsg, "unexpected format version: %llu",
+                       (unsigned long long)format);
+        rv = RAFT_IOERR;
+        goto err_after_mmap;
+    }
+
+    /* The mapping stays valid after the file is closed. */
+    close(fd);
+
+    return 0;
+
+err_after_mmap:
+    munmap(*base, *len);
+err_after_open:
+    close(fd);
+err:
+    assert(rv != 0);
+    return rv;
+}
+
+/* Load the @n entries of the given closed segment into @entries, mapping the
+ * segment file in memory.
+ *
+ * This function may run concurrently in several threads, so errors are
+ * reported in @errmsg instead of being logged. */
+static int loadClosed(struct uv *uv,
+                      struct uvSegmentInfo *info,
+                      struct raft_entry *entries,
+                      size_t n,
+                      char *errmsg)
+{
+    uint8_t *base;
+    size_t len;
+    checksumFn checksum;
+    int rv;
+
+    rv = mapClosed(uv, info, &base, &len, &checksum, errmsg);
+    if (rv != 0) {
+        return rv;
+    }
+
+    /* Segments are read from start to end, ask for aggressive read-ahead.
+     * Ignore errors, since this is just an hint. */
+    madvise(base, len, MADV_SEQUENTIAL);
+
+    rv = decodeClosed(base, len, checksum, entries, n, errmsg);
+    munmap(base, len);
+
+    return rv;
+}
+
+/* Find the entries of the closed segment content mapped at @base that start at
+ * the @start'th one and whose payloads fit in @max_bytes, and copy them into a
+ * single batch. The segment must contain @n entries, whose headers get decoded
+ * into the @scratch array.
+ *
+ * Only the batches containing the wanted entries are checked and copied, the
+ * data of the ones before them is skipped, and the ones after them are not
+ * looked at. */
+static int decodeRange(const uint8_t *base,
+                       size_t len,
+                       checksumFn checksum,
+                       struct raft_entry *scratch,
+                       size_t n,
+                       size_t start,
+                       size_t max_bytes,
+                       struct raft_entry *entries[],
+                       unsigned *n_entries,
+                       char *errmsg)
+{
+    size_t offset;  /* Current offset in the segment */
+    size_t size;    /* Total size of the wanted payloads */
+    size_t i;       /* Number of entries decoded so far */
+    size_t n_range; /* Number of wanted entries found so far */
+    bool full;      /* Whether no more payloads fit in max_bytes */
+    uint8_t *batch;
+    uint8_t *cursor;
+    int rv;
+
+    assert(start < n);
+
+    offset = sizeof(uint64_t); /* Format version */
+    size = 0;
+    i = 0;
+    n_range = 0;
+    full = false;
+    while (offset < len && !full) {
+        size_t n_batch;
+        size_t data_len;
+        size_t data_offset;
+        uint32_t crc;
+        size_t j;
+
+        rv = decodeBatchHeaderAt(base, len, &offset, checksum, scratch + i,
+                                 n - i, &n_batch, &data_len, &crc, errmsg);
         if (rv != 0) {
-            goto err_after_open;
+            return rv;
         }
-        rv = extendEntries(tmp_entries, tmp_n, entries, n);
-        if (rv != 0) {
-            goto err_after_batch_load;
+        if (i + n_batch <= start) {
+            offset += data_len;
+            i += n_batch;
+            continue;
         }
-        raft_free(tmp_entries);
+        if (checksum(base + offset, data_len, 0) != crc) {
+            uvErrMsgPrintf(errmsg, "corrupted batch data at offset %zu",
+                           offset);
+            return RAFT_CORRUPT;
+        }
+
+        /* Point the wanted entries to their payloads in the mapping. Always
+         * include the first entry, even if its payload alone exceeds the bytes
+         * limit, otherwise the caller would never make progress. */
+        data_offset = offset;
+        for (j = 0; j < n_batch; j++) {
+            struct raft_entry *entry = &scratch[i + j];
+            size_t entry_len = entry->buf.len;
+            if (i + j >= start) {
+                if (n_range > 0 &&
+                    (size >= max_bytes || entry_len > max_bytes - size)) {
+                    full = true;
+                    break;
+                }
+                entry->buf.base = (void *)(base + data_offset);
+                size += entry_len;
+                n_range++;
+            }
+            data_offset += bytePad64(entry_len);
+        }
+        offset += data_len;
+        i += n_batch;
     }
 
-    assert(i > 1);  /* At least one batch was loaded. */
-    assert(*n > 0); /* At least one entry was loaded. */
+    if (n_range == 0 || (!full && offset >= len && i != n)) {
+        uvErrMsgPrintf(errmsg, "found %zu entries instead of %zu", i, n);
+        return RAFT_CORRUPT;
+    }
 
-    close(fd);
+    *entries = raft_malloc(n_range * sizeof **entries);
+    if (*entries == NULL) {
+        return RAFT_NOMEM;
+    }
+
+    batch = NULL;
+    if (size > 0) {
+        batch = raft_malloc(size);
+        if (batch == NULL) {
+            raft_free(*entries);
+            return RAFT_NOMEM;
+        }
+    }
+
+    cursor = batch;
+    for (i = 0; i < n_range; i++) {
+        struct raft_entry *entry = &(*entries)[i];
+        *entry = scratch[start + i];
+        entry->batch = batch;
+        if (entry->buf.len > 0) {
+            memcpy(cursor, entry->buf.base, entry->buf.len);
+            entry->buf.base = cursor;
+            cursor += entry->buf.len;
+        } else {
+            entry->buf.base = NULL;
+        }
+    }
+
+    *n_entries = (unsigned)n_range;
 
     return 0;
+}
 
-err_after_batch_load:
-    raft_free(tmp_entries[0].batch);
-    raft_free(tmp_entries);
+int uvSegmentLoadClosed(struct uv *uv,
+                        struct uvSegmentInfo *info,
+                        struct raft_entry *entries[],
+                        size_t *n)
+{
+    char errmsg[2048];
+    int rv;
 
-err_after_open:
-    close(fd);
+    rv = countClosed(uv, info, n);
+    if (rv != 0) {
+        return rv;
+    }
+
+    *entries = raft_malloc(*n * sizeof **entries);
+    if (*entries == NULL) {
+        return RAFT_NOMEM;
+    }
+
+    rv = loadClosed(uv, info, *entries, *n, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "load %s: %s", info->filename, errmsg);
+        raft_free(*entries);
+        return rv;
+    }
+
+    return 0;
+}
 
+int uvSegmentLoadRange(struct uv *uv,
+                       struct uvSegmentInfo *info,
+                       raft_index index,
+                       size_t max_bytes,
+                       struct raft_entry *entries[],
+                       unsigned *n)
+{
+    struct raft_entry *scratch;
+    uint8_t *base;
+    size_t len;
+    checksumFn checksum;
+    size_t n_segment;
+    char errmsg[2048];
+    int rv;
+
+    assert(!info->is_open);
+    assert(index >= info->first_index && index <= info->end_index);
+
+    rv = countClosed(uv, info, &n_segment);
+    if (rv != 0) {
+        goto err;
+    }
+
+    /* Holds the headers of all entries up to the last wanted one. */
+    scratch = raft_malloc(n_segment * sizeof *scratch);
+    if (scratch == NULL) {
+        rv = RAFT_NOMEM;
+        goto err;
+    }
+
+    rv = mapClosed(uv, info, &base, &len, &checksum, errmsg);
+    if (rv != 0) {
+        goto err_after_scratch_alloc;
+    }
+
+    rv = decodeRange(base, len, checksum, scratch, n_segment,
+                     (size_t)(index - info->first_index), max_bytes, entries,
+                     n, errmsg);
+    munmap(base, len);
+    if (rv != 0) {
+        goto err_after_scratch_alloc;
+    }
+
+    raft_free(scratch);
+
+    return 0;
+
+err_after_scratch_alloc:
+    raft_free(scratch);
+    if (rv != RAFT_NOMEM) {
+        uvErrorf(uv, "load %s: %s", info->filename, errmsg);
+    }
 err:
     assert(rv != 0);
-
     return rv;
 }
 
@@ -425,6 +878,7 @@ static int loadOpen(struct uv *uv,
     bool last = false;              /* Whether the last batch was reached */
     int fd;                         /* Segment file descriptor */
     uint64_t format;                /* Format version */
+    checksumFn checksum;            /* Checksum used by the format version */
     size_t n_batches = 0;           /* Number of loaded batches */
     struct raft_entry *tmp_entries; /* Entries in current batch */
     unsigned tmp_n_entries;         /* Number of entries in current batch */
@@ -453,9 +907,10 @@ static int loadOpen(struct uv *uv,
         goto err;
     }
 
-    /* Check that the format is the expected one, or perhaps 0, indicating that
-     * the segment was allocated but never written. */
-    if (format != UV__DISK_FORMAT) {
+    /* Check that the format is a known one, or perhaps 0, indicating that the
+     * segment was allocated but never written. */
+    checksum = formatChecksum(format);
+    if (checksum == NULL) {
         if (format == 0) {
             rv = uvIsFilledWithTrailingZeros(fd, &all_zeros, errmsg);
             if (rv != 0) {
@@ -489,7 +944,8 @@ static int loadOpen(struct uv *uv,
             return RAFT_IOERR;
         }
 
-        rv = loadEntriesBatch(uv, fd, &tmp_entries, &tmp_n_entries, &last);
+        rv = loadEntriesBatch(uv, fd, checksum, &tmp_entries, &tmp_n_entries,
+                              &last);
         if (rv != 0) {
             int rv2;
 
@@ -658,6 +1114,11 @@ void uvSegmentBufferClose(struct uvSegmentBuffer *b)
     }
 }
 
+int uvSegmentBufferReserve(struct uvSegmentBuffer *b, size_t size)
+{
+    return ensureSegmentBufferIsLargeEnough(b, b->n + size);
+}
+
 int uvSegmentBufferFormat(struct uvSegmentBuffer *b)
 {
     int rv;
@@ -671,7 +1132,7 @@ int uvSegmentBufferFormat(struct uvSegmentBuffer *b)
     }
     b->n = n;
     cursor = b->arena.base;
-    bytePut64(&cursor, UV__DISK_FORMAT);
+    bytePut64(&cursor, UV__DISK_FORMAT_CRC32C);
     return 0;
 }
 
@@ -710,7 +1171,7 @@ int uvSegmentBufferAppend(struct uvSegmentBuffer *b,
     /* Batch header */
     header = cursor;
     uvEncodeBatchHeader(entries, n_entries, cursor);
-    crc1 = byteCrc32(header, uvSizeofBatchHeader(n_entries), 0);
+    crc1 = byteCrc32c(header, uvSizeofBatchHeader(n_entries), 0);
     cursor += uvSizeofBatchHeader(n_entries);
 
     /* Batch data */
@@ -720,8 +1181,7 @@ int uvSegmentBufferAppend(struct uvSegmentBuffer *b,
         /* TODO: enforce the requirment of 8-byte aligment also in the
          * higher-level APIs. */
         assert(entry->buf.len % sizeof(uint64_t) == 0);
-        memcpy(cursor, entry->buf.base, entry->buf.len);
-        crc2 = byteCrc32(cursor, entry->buf.len, crc2);
+        crc2 = byteCrc32cCopy(cursor, entry->buf.base, entry->buf.len, crc2);
         cursor += entry->buf.len;
     }
 
@@ -752,20 +1212,177 @@ void uvSegmentBufferFinalize(struct uvSegmentBuffer *b, uv_buf_t *out)
     out->len = n_blocks * b->block_size;
 }
 
-void uvSegmentBufferReset(struct uvSegmentBuffer *b, unsigned retain)
+void uvSegmentBufferRetain(struct uvSegmentBuffer *b,
+                           const struct uvSegmentBuffer *src)
 {
-    assert(b->n > 0);
-    assert(b->arena.base != NULL);
+    size_t tail = src->n % src->block_size;
+
+    assert(b->n == 0);
+    assert(b->block_size == src->block_size);
+    assert(b->arena.len >= b->block_size);
 
-    if (retain == 0) {
-        b->n = 0;
-        memset(b->arena.base, 0, b->block_size);
+    if (tail == 0) {
         return;
     }
 
-    memcpy(b->arena.base, b->arena.base + retain * b->block_size,
-           b->block_size);
-    b->n = b->n % b->block_size;
+    memcpy(b->arena.base, src->arena.base + src->n - tail, tail);
+    memset(b->arena.base + tail, 0, b->block_size - tail);
+    b->n = tail;
+}
+
+/* Job loading a single closed segment. */
+struct loadJob
+{
+    struct uvSegmentInfo *info; /* Segment to load */
+    struct raft_entry *entries; /* Where to decode the segment entries */
+    size_t n;                   /* Number of entries in the segment */
+    int status;                 /* Result of the job */
+};
+
+/* State shared by the threads loading closed segments. */
+struct loader
+{
+    struct uv *uv;        /* I/O implementation object */
+    struct loadJob *jobs; /* Jobs for all closed segments */
+    size_t n_jobs;        /* Number of jobs */
+    size_t next;          /* Next job to pick, accessed atomically */
+    bool failed;          /* Whether a job failed, accessed atomically */
+};
+
+/* Thread loading closed segments. */
+struct loaderThread
+{
+    struct loader *loader; /* Shared state */
+    uv_thread_t thread;    /* Thread handle */
+    size_t failed;         /* First job that failed, or n_jobs */
+    uvErrMsg errmsg;       /* Error message of the failed job */
+};
+
+/* Pick jobs until none is left or one of them fails. Since jobs are picked in
+ * order, all jobs before a failed one get executed anyway. */
+static void loaderRun(void *arg)
+{
+    struct loaderThread *t = arg;
+    struct loader *l = t->loader;
+
+    t->failed = l->n_jobs;
+
+    while (!__atomic_load_n(&l->failed, __ATOMIC_RELAXED)) {
+        struct loadJob *job;
+        size_t i = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+        if (i >= l->n_jobs) {
+            break;
+        }
+        job = &l->jobs[i];
+        job->status =
+            loadClosed(l->uv, job->info, job->entries, job->n, t->errmsg);
+        if (job->status != 0) {
+            t->failed = i;
+            __atomic_store_n(&l->failed, true, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+}
+
+/* Load the given closed segments in parallel, decoding their @n entries into
+ * @entries. */
+static int loadClosedAll(struct uv *uv,
+                         struct uvSegmentInfo *infos,
+                         size_t n_infos,
+                         struct raft_entry *entries,
+                         size_t n)
+{
+    struct loader l;
+    struct loaderThread *threads;
+    struct loaderThread *failed;
+    unsigned n_threads;
+    size_t i;
+    int rv;
+
+    l.uv = uv;
+    l.n_jobs = n_infos;
+    l.next = 0;
+    l.failed = false;
+    l.jobs = raft_malloc(n_infos * sizeof *l.jobs);
+    if (l.jobs == NULL) {
+        rv = RAFT_NOMEM;
+        goto err;
+    }
+
+    for (i = 0; i < n_infos; i++) {
+        struct loadJob *job = &l.jobs[i];
+        job->info = &infos[i];
+        job->entries = entries;
+        job->n = (size_t)(infos[i].end_index - infos[i].first_index + 1);
+        job->status = 0;
+        entries += job->n;
+        n -= job->n;
+    }
+    assert(n == 0);
+
+    n_threads = LOAD_MAX_THREADS;
+    if (n_threads > n_infos) {
+        n_threads = (unsigned)n_infos;
+    }
+    threads = raft_malloc(n_threads * sizeof *threads);
+    if (threads == NULL) {
+        rv = RAFT_NOMEM;
+        goto err_after_jobs_alloc;
+    }
+
+    /* The calling thread runs the first loader. If a thread can't be started,
+     * just go ahead with the ones we have. */
+    for (i = 0; i < n_threads; i++) {
+        threads[i].loader = &l;
+        threads[i].failed = n_infos;
+    }
+    for (i = 1; i < n_threads; i++) {
+        rv = uv_thread_create(&threads[i].thread, loaderRun, &threads[i]);
+        if (rv != 0) {
+            uvWarnf(uv, "start loader thread: %s", uv_strerror(rv));
+            n_threads = (unsigned)i;
+            break;
+        }
+    }
+    loaderRun(&threads[0]);
+    for (i = 1; i < n_threads; i++) {
+        rv = uv_thread_join(&threads[i].thread);
+        assert(rv == 0);
+    }
+
+    /* Report the first segment that failed to load, if any. */
+    failed = NULL;
+    for (i = 0; i < n_threads; i++) {
+        if (failed == NULL || threads[i].failed < failed->failed) {
+            failed = &threads[i];
+        }
+    }
+    if (failed->failed < n_infos) {
+        struct loadJob *job = &l.jobs[failed->failed];
+        uvErrorf(uv, "load %s: %s", job->info->filename, failed->errmsg);
+        rv = job->status;
+        goto err_after_load;
+    }
+
+    raft_free(threads);
+    raft_free(l.jobs);
+
+    return 0;
+
+err_after_load:
+    /* Release the batches of the segments that were loaded. */
+    for (i = 0; i < n_infos; i++) {
+        struct loadJob *job = &l.jobs[i];
+        if (job->status == 0 && i < l.next) {
+            raft_free(job->entries[0].batch);
+        }
+    }
+    raft_free(threads);
+err_after_jobs_alloc:
+    raft_free(l.jobs);
+err:
+    assert(rv != 0);
+    return rv;
 }
 
 int uvSegmentLoadAll(struct uv *uv,
@@ -775,9 +1392,9 @@ int uvSegmentLoadAll(struct uv *uv,
                      struct raft_entry **entries,
                      size_t *n_entries)
 {
-    raft_index next_index;          /* Next entry to load from disk */
-    struct raft_entry *tmp_entries; /* Entries in current segment */
-    size_t tmp_n;                   /* Number of entries in current segment */
+    raft_index next_index; /* Next entry to load from disk */
+    size_t n_closed;       /* Number of closed segments */
+    size_t n;              /* Number of entries in closed segments */
     size_t i;
     int rv;
 
@@ -789,41 +1406,54 @@ int uvSegmentLoadAll(struct uv *uv,
 
     next_index = start_index;
 
-    for (i = 0; i < n_infos; i++) {
+    /* Closed segments are sorted before open ones. Check that their names
+     * match what we expect and count their entries, so the entries array can
+     * be allocated upfront. */
+    n = 0;
+    for (i = 0; i < n_infos && !infos[i].is_open; i++) {
         struct uvSegmentInfo *info = &infos[i];
+        size_t n_segment;
 
-        if (info->is_open) {
-            rv = loadOpen(uv, info, entries, n_entries, &next_index);
-            if (rv != 0) {
-                goto err;
-            }
-        } else {
-            assert(info->first_index >= start_index);
-            assert(info->first_index <= info->end_index);
-
-            /* Check that the start index encoded in the name of the segment
-             * matches what we expect and there are no gaps in the sequence. */
-            if (info->first_index != next_index) {
-                uvErrorf(uv, "load %s: expected first index to be %lld",
-                         info->filename, next_index);
-                rv = RAFT_CORRUPT;
-                goto err;
-            }
+        assert(info->first_index >= start_index);
+        assert(info->first_index <= info->end_index);
 
-            rv = uvSegmentLoadClosed(uv, info, &tmp_entries, &tmp_n);
-            if (rv != 0) {
-                goto err;
-            }
+        /* Check that the start index encoded in the name of the segment
+         * matches what we expect and there are no gaps in the sequence. */
+        if (info->first_index != next_index) {
+            uvErrorf(uv, "load %s: expected first index to be %lld",
+                     info->filename, next_index);
+            return RAFT_CORRUPT;
+        }
 
-            assert(tmp_n > 0);
-            rv = extendEntries(tmp_entries, tmp_n, entries, n_entries);
-            if (rv != 0) {
-                /* TODO: release memory of entries in tmp_entries */
-                goto err;
-            }
+        rv = countClosed(uv, info, &n_segment);
+        if (rv != 0) {
+            return rv;
+        }
 
-            raft_free(tmp_entries);
-            next_index += tmp_n;
+        n += n_segment;
+        next_index += n_segment;
+    }
+    n_closed = i;
+
+    if (n_closed > 0) {
+        *entries = raft_malloc(n * sizeof **entries);
+        if (*entries == NULL) {
+            return RAFT_NOMEM;
+        }
+        rv = loadClosedAll(uv, infos, n_closed, *entries, n);
+        if (rv != 0) {
+            raft_free(*entries);
+            *entries = NULL;
+            return rv;
+        }
+        *n_entries = n;
+    }
+
+    for (i = n_closed; i < n_infos; i++) {
+        assert(infos[i].is_open);
+        rv = loadOpen(uv, &infos[i], entries, n_entries, &next_index);
+        if (rv != 0) {
+            goto err;
         }
     }
 
@@ -396,6 +396,8 @@ int uvSend(struct raft_io *io,
     struct uv *uv = io->impl;
     struct send *r;
     struct uvClient *c;
+    uv_buf_t blocks;
+    const uv_buf_t *compressed = NULL;
     int rv;
 
     assert(uv->state == UV__ACTIVE);
@@ -410,7 +412,16 @@ int uvSend(struct raft_io *io,
     r->req = req;
     req->cb = cb;
 
-    rv = uvEncodeMessage(message, &r->bufs, &r->n_bufs);
+    /* Snapshot data is compressed in the threadpool when the snapshot is
+     * loaded, see uvSnapshotGet(), and its compressed blocks are shared by all
+     * messages carrying its chunks. */
+    if (uv->snapshot_compression &&
+        message->type == RAFT_IO_INSTALL_SNAPSHOT &&
+        uvSnapshotCompressedBlocks(uv, &message->install_snapshot.data,
+                                   &blocks)) {
+        compressed = &blocks;
+    }
+    rv = uvEncodeMessage(message, compressed, &r->bufs, &r->n_bufs);
     if (rv != 0) {
         goto err_after_request_alloc;
     }
@@ -1,4 +1,6 @@
+#include <errno.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/uio.h>
 
 #include "array.h"
@@ -119,10 +121,11 @@ void uvSnapshotSort(struct uvSnapshotInfo *infos, size_t n_infos)
 }
 
 /* Parse the metadata file of a snapshot and populate the given snapshot object
- * accordingly. */
+ * accordingly, returning also the flags stored alongside the format version. */
 static int loadMeta(struct uv *uv,
                     struct uvSnapshotInfo *info,
-                    struct raft_snapshot *snapshot)
+                    struct raft_snapshot *snapshot,
+                    unsigned *flags)
 {
     uint64_t header[1 + /* Format version */
                     1 + /* CRC checksum */
@@ -152,13 +155,20 @@ static int loadMeta(struct uv *uv,
         goto err_after_open;
     }
 
-    format = byteFlip64(header[0]);
+    format = byteFlip64(header[0]) & 0xffffffff;
     if (format != UV__DISK_FORMAT) {
         uvErrorf(uv, "load %s: unsupported format %lu", info->filename, format);
         rv = RAFT_MALFORMED;
         goto err_after_open;
     }
 
+    *flags = byteFlip64(header[0]) >> 32;
+    if ((*flags & ~(UV__SNAPSHOT_CHUNKED | UV__SNAPSHOT_COMPRESSED)) != 0) {
+        uvErrorf(uv, "load %s: unsupported flags %u", info->filename, *flags);
+        rv = RAFT_MALFORMED;
+        goto err_after_open;
+    }
+
     crc1 = byteFlip64(header[1]);
 
     snapshot->configuration_index = byteFlip64(header[2]);
@@ -218,6 +228,327 @@ err:
     return rv;
 }
 
+/* A chunk of the data of a snapshot stored with deduplication enabled. */
+struct chunk
+{
+    unsigned crc; /* CRC32 checksum of the chunk data */
+    size_t len;   /* Length of the chunk data */
+    unsigned n;   /* Disambiguate chunks with the same checksum and length */
+};
+
+/* Size of the header of a chunk manifest: number of chunks and checksum. */
+#define MANIFEST_HEADER_SIZE (sizeof(uint64_t) * 2)
+
+/* Size of a single chunk item in a chunk manifest. */
+#define MANIFEST_ITEM_SIZE (sizeof(uint64_t) * 3)
+
+/* Render the filename of a chunk file. */
+static void chunkFilename(const struct chunk *chunk, uvFilename filename)
+{
+    sprintf(filename, UV__SNAPSHOT_CHUNK_TEMPLATE, chunk->crc, chunk->len,
+            chunk->n);
+}
+
+/* Read the list of chunks stored in the data file of a chunked snapshot. */
+static int loadManifest(struct uv *uv,
+                        struct uvSnapshotInfo *info,
+                        struct chunk *chunks[],
+                        unsigned *n_chunks)
+{
+    uvFilename filename;
+    struct stat sb;
+    struct raft_buffer buf;
+    const void *cursor;
+    uint64_t n;
+    unsigned crc;
+    unsigned i;
+    char errmsg[2048];
+    int fd;
+    int rv;
+
+    filenameOf(info, filename);
+
+    rv = uvOpenFile(uv->dir, filename, O_RDONLY, &fd, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "open %s: %s", filename, errmsg);
+        rv = RAFT_IOERR;
+        goto err;
+    }
+
+    rv = fstat(fd, &sb);
+    if (rv != 0) {
+        uvErrorf(uv, "stat %s: %s", filename, strerror(errno));
+        rv = RAFT_IOERR;
+        goto err_after_open;
+    }
+
+    buf.len = sb.st_size;
+    if (buf.len < MANIFEST_HEADER_SIZE) {
+        uvErrorf(uv, "load %s: chunk list too short", filename);
+        rv = RAFT_CORRUPT;
+        goto err_after_open;
+    }
+    buf.base = raft_malloc(buf.len);
+    if (buf.base == NULL) {
+        rv = RAFT_NOMEM;
+        goto err_after_open;
+    }
+
+    rv = uvReadFully(fd, buf.base, buf.len, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "read %s: %s", filename, errmsg);
+        rv = RAFT_IOERR;
+        goto err_after_buf_alloc;
+    }
+
+    cursor = buf.base;
+    n = byteGet64(&cursor);
+    crc = byteGet64(&cursor);
+    if (n > (buf.len - MANIFEST_HEADER_SIZE) / MANIFEST_ITEM_SIZE ||
+        buf.len != MANIFEST_HEADER_SIZE + n * MANIFEST_ITEM_SIZE) {
+        uvErrorf(uv, "load %s: chunk list has wrong size", filename);
+        rv = RAFT_CORRUPT;
+        goto err_after_buf_alloc;
+    }
+    if (byteCrc32(cursor, n * MANIFEST_ITEM_SIZE, 0) != crc) {
+        uvErrorf(uv, "load %s: checksum mismatch", filename);
+        rv = RAFT_CORRUPT;
+        goto err_after_buf_alloc;
+    }
+
+    *n_chunks = (unsigned)n;
+    *chunks = NULL;
+    if (n > 0) {
+        *chunks = raft_malloc(n * sizeof **chunks);
+        if (*chunks == NULL) {
+            rv = RAFT_NOMEM;
+            goto err_after_buf_alloc;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        struct chunk *chunk = &(*chunks)[i];
+        chunk->crc = byteGet64(&cursor);
+        chunk->len = byteGet64(&cursor);
+        chunk->n = byteGet64(&cursor);
+    }
+
+    raft_free(buf.base);
+    close(fd);
+
+    return 0;
+
+err_after_buf_alloc:
+    raft_free(buf.base);
+err_after_open:
+    close(fd);
+err:
+    assert(rv != 0);
+    return rv;
+}
+
+/* Read the content of the given chunks into the given memory area, which must
+ * be large enough to hold all of them. */
+static int readChunks(struct uv *uv,
+                      const struct chunk *chunks,
+                      unsigned n_chunks,
+                      uint8_t *base)
+{
+    unsigned i;
+    char errmsg[2048];
+    int rv;
+
+    for (i = 0; i < n_chunks; i++) {
+        const struct chunk *chunk = &chunks[i];
+        uvFilename filename;
+        int fd;
+
+        chunkFilename(chunk, filename);
+
+        rv = uvOpenFile(uv->dir, filename, O_RDONLY, &fd, errmsg);
+        if (rv != 0) {
+            uvErrorf(uv, "open %s: %s", filename, errmsg);
+            return RAFT_IOERR;
+        }
+        rv = uvReadFully(fd, base, chunk->len, errmsg);
+        close(fd);
+        if (rv != 0) {
+            uvErrorf(uv, "read %s: %s", filename, errmsg);
+            return RAFT_IOERR;
+        }
+        if (byteCrc32(base, chunk->len, 0) != chunk->crc) {
+            uvErrorf(uv, "read %s: checksum mismatch", filename);
+            return RAFT_CORRUPT;
+        }
+
+        base += chunk->len;
+    }
+
+    return 0;
+}
+
+/* Allocate memory for @buf->len bytes of snapshot data. If @mapped is true, use
+ * an anonymous memory mapping instead of a heap buffer, consistently with
+ * mapData(). */
+static int allocData(bool mapped, struct raft_buffer *buf)
+{
+    buf->base = NULL;
+    if (mapped && buf->len > 0) {
+        buf->base = mmap(NULL, buf->len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf->base == MAP_FAILED) {
+            buf->base = NULL;
+            return RAFT_NOMEM;
+        }
+    } else if (!mapped) {
+        buf->base = raft_malloc(buf->len);
+        if (buf->base == NULL) {
+            return RAFT_NOMEM;
+        }
+    }
+    return 0;
+}
+
+/* Release memory allocated with allocData() or mapData(). */
+static void freeData(bool mapped, struct raft_buffer *buf)
+{
+    if (!mapped) {
+        raft_free(buf->base);
+    } else if (buf->base != NULL) {
+        munmap(buf->base, buf->len);
+    }
+}
+
+/* Decompress the given snapshot data, which is the concatenation of the given
+ * compressed pieces, into a new buffer allocated with allocData(). */
+static int inflateData(struct uv *uv,
+                       const char *filename,
+                       const struct chunk *pieces,
+                       unsigned n_pieces,
+                       const struct raft_buffer *src,
+                       bool mapped,
+                       struct raft_buffer *dst)
+{
+    const uint8_t *cursor;
+    uint8_t *out;
+    size_t len;
+    unsigned i;
+    int rv;
+
+    /* Figure out the total size first, checking that it's plausible since the
+     * codec can't expand data by more than 255 times. */
+    dst->len = 0;
+    cursor = src->base;
+    for (i = 0; i < n_pieces; i++) {
+        rv = uvDecompressedSize(cursor, pieces[i].len, &len);
+        if (rv != 0 || len / 255 > pieces[i].len) {
+            goto err_corrupt;
+        }
+        dst->len += len;
+        cursor += pieces[i].len;
+    }
+
+    rv = allocData(mapped, dst);
+    if (rv != 0) {
+        return rv;
+    }
+
+    cursor = src->base;
+    out = dst->base;
+    for (i = 0; i < n_pieces; i++) {
+        uvDecompressedSize(cursor, pieces[i].len, &len);
+        rv = uvDecompress(cursor, pieces[i].len, out);
+        if (rv != 0) {
+            freeData(mapped, dst);
+            goto err_corrupt;
+        }
+        cursor += pieces[i].len;
+        out += len;
+    }
+
+    return 0;
+
+err_corrupt:
+    uvErrorf(uv, "load %s: malformed compressed data", filename);
+    return RAFT_CORRUPT;
+}
+
+/* Load the data of a chunked snapshot into a single buffer. If @mapped is
+ * true, the buffer is an anonymous memory mapping instead of a heap buffer,
+ * consistently with mapData(). */
+static int loadChunkedData(struct uv *uv,
+                           struct uvSnapshotInfo *info,
+                           unsigned flags,
+                           bool mapped,
+                           struct raft_snapshot *snapshot)
+{
+    struct chunk *chunks;
+    unsigned n_chunks;
+    struct raft_buffer stored;
+    struct raft_buffer buf;
+    bool compressed = flags & UV__SNAPSHOT_COMPRESSED;
+    unsigned i;
+    int rv;
+
+    rv = loadManifest(uv, info, &chunks, &n_chunks);
+    if (rv != 0) {
+        goto err;
+    }
+
+    stored.len = 0;
+    for (i = 0; i < n_chunks; i++) {
+        stored.len += chunks[i].len;
+    }
+
+    /* Compressed chunks are read in a temporary buffer and then inflated. */
+    rv = allocData(mapped && !compressed, &stored);
+    if (rv != 0) {
+        goto err_after_manifest_load;
+    }
+
+    rv = readChunks(uv, chunks, n_chunks, stored.base);
+    if (rv != 0) {
+        goto err_after_stored_alloc;
+    }
+
+    if (compressed) {
+        uvFilename filename;
+        filenameOf(info, filename);
+        rv = inflateData(uv, filename, chunks, n_chunks, &stored, mapped,
+                         &buf);
+        if (rv != 0) {
+            goto err_after_stored_alloc;
+        }
+        raft_free(stored.base);
+    } else {
+        buf = stored;
+    }
+
+    snapshot->bufs = raft_malloc(sizeof *snapshot->bufs);
+    if (snapshot->bufs == NULL) {
+        rv = RAFT_NOMEM;
+        freeData(mapped, &buf);
+        goto err_after_manifest_load;
+    }
+    snapshot->n_bufs = 1;
+    snapshot->bufs[0] = buf;
+
+    if (chunks != NULL) {
+        raft_free(chunks);
+    }
+
+    return 0;
+
+err_after_stored_alloc:
+    freeData(mapped && !compressed, &stored);
+err_after_manifest_load:
+    if (chunks != NULL) {
+        raft_free(chunks);
+    }
+err:
+    assert(rv != 0);
+    return rv;
+}
+
 /* Load the snapshot data file. */
 static int loadData(struct uv *uv,
                     struct uvSnapshotInfo *info,
@@ -283,17 +614,134 @@ err:
     return rv;
 }
 
+/* Map the snapshot data file in memory instead of reading it into a heap
+ * buffer. The content is paged in from the page cache as it gets sent, and
+ * since the mapping is backed by the file it doesn't count towards anonymous
+ * memory and can be reclaimed by the kernel under pressure. */
+static int mapData(struct uv *uv,
+                   struct uvSnapshotInfo *info,
+                   struct raft_snapshot *snapshot)
+{
+    struct stat sb;
+    uvFilename filename;
+    struct raft_buffer buf;
+    char errmsg[2048];
+    int fd;
+    int rv;
+
+    filenameOf(info, filename);
+
+    rv = uvOpenFile(uv->dir, filename, O_RDONLY, &fd, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "open %s: %s", filename, errmsg);
+        rv = RAFT_IOERR;
+        goto err;
+    }
+
+    rv = fstat(fd, &sb);
+    if (rv != 0) {
+        uvErrorf(uv, "stat %s: %s", filename, strerror(errno));
+        rv = RAFT_IOERR;
+        goto err_after_open;
+    }
+
+    buf.len = sb.st_size;
+    buf.base = NULL;
+    if (buf.len > 0) {
+        buf.base = mmap(NULL, buf.len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (buf.base == MAP_FAILED) {
+            uvErrorf(uv, "mmap %s: %s", filename, strerror(errno));
+            rv = RAFT_IOERR;
+            goto err_after_open;
+        }
+        /* Snapshots are sent from start to end, ask for aggressive
+         * read-ahead. Ignore errors, since this is just an hint. */
+        madvise(buf.base, buf.len, MADV_SEQUENTIAL);
+    }
+
+    snapshot->bufs = raft_malloc(sizeof *snapshot->bufs);
+    if (snapshot->bufs == NULL) {
+        rv = RAFT_NOMEM;
+        goto err_after_mmap;
+    }
+    snapshot->n_bufs = 1;
+    snapshot->bufs[0] = buf;
+
+    /* The mapping stays valid after closing the file descriptor. */
+    close(fd);
+
+    return 0;
+
+err_after_mmap:
+    if (buf.base != NULL) {
+        munmap(buf.base, buf.len);
+    }
+err_after_open:
+    close(fd);
+err:
+    assert(rv != 0);
+    return rv;
+}
+
+/* Load the data of a snapshot stored with the given layout flags, either in a
+ * heap buffer or, if @mapped is true, in a memory mapping. */
+static int loadSnapshotData(struct uv *uv,
+                            struct uvSnapshotInfo *info,
+                            unsigned flags,
+                            bool mapped,
+                            struct raft_snapshot *snapshot)
+{
+    struct raft_buffer buf;
+    struct chunk piece;
+    uvFilename filename;
+    int rv;
+
+    if (flags & UV__SNAPSHOT_CHUNKED) {
+        return loadChunkedData(uv, info, flags, mapped, snapshot);
+    }
+
+    if (mapped) {
+        rv = mapData(uv, info, snapshot);
+    } else {
+        rv = loadData(uv, info, snapshot);
+    }
+    if (rv != 0) {
+        return rv;
+    }
+
+    if (!(flags & UV__SNAPSHOT_COMPRESSED)) {
+        return 0;
+    }
+
+    /* The data file holds a single compressed piece, replace it with its
+     * decompressed content. */
+    filenameOf(info, filename);
+    piece.len = snapshot->bufs[0].len;
+    rv = inflateData(uv, filename, &piece, 1, &snapshot->bufs[0], mapped, &buf);
+    freeData(mapped, &snapshot->bufs[0]);
+    if (rv != 0) {
+        raft_free(snapshot->bufs);
+        return rv;
+    }
+    snapshot->bufs[0] = buf;
+
+    return 0;
+}
+
 int uvSnapshotLoad(struct uv *uv,
                    struct uvSnapshotInfo *meta,
                    struct raft_snapshot *snapshot)
 {
+    unsigned flags;
     int rv;
-    rv = loadMeta(uv, meta, snapshot);
+    rv = loadMeta(uv, meta, snapshot, &flags);
     if (rv != 0) {
         return rv;
     }
-    rv = loadData(uv, meta, snapshot);
+    rv = loadSnapshotData(uv, meta, flags, false, snapshot);
     if (rv != 0) {
+        raft_configuration_close(&snapshot->configuration);
+        raft_configuration_init(&snapshot->configuration);
         return rv;
     }
     return 0;
@@ -305,6 +753,8 @@ struct put
     size_t trailing;
     struct raft_io_snapshot_put *req;
     const struct raft_snapshot *snapshot;
+    bool chunked;    /* Whether to store the snapshot data in chunks */
+    bool compressed; /* Whether to compress the snapshot data */
     struct
     {
         unsigned long long timestamp;
@@ -315,16 +765,378 @@ struct put
     queue queue;
 };
 
+/* The last snapshot loaded by a get request is kept in memory and handed to
+ * subsequent get requests, until a new snapshot is put. Since snapshots are
+ * immutable, all requests can share the same copy, which gets released when
+ * the last of them is done with it. The snapshot data is memory-mapped, see
+ * mapData().
+ *
+ * If compression is enabled, the data is also compressed when it's loaded, so
+ * the InstallSnapshot messages sent to any server just reference the
+ * compressed blocks covering their chunk, see uvSnapshotCompressedBlocks(). */
+struct uvSnapshot
+{
+    struct raft_snapshot snapshot; /* Must be the first field */
+    unsigned refs;                 /* Number of references to the snapshot */
+    struct raft_buffer compressed; /* Data compressed with uvCompress() */
+    size_t *blocks;                /* Offsets of the compressed blocks */
+};
+
 struct get
 {
     struct uv *uv;
     struct raft_io_snapshot_get *req;
-    struct raft_snapshot *snapshot;
+    struct uvSnapshot *snapshot;
+    bool cached;               /* Whether the snapshot was already loaded */
+    bool compress;             /* Whether to compress the loaded data */
+    unsigned long long n_puts; /* Snapshots put before this request */
     struct uv_work_s work;
     int status;
     queue queue;
 };
 
+static void snapshotRef(struct uvSnapshot *s)
+{
+    s->refs++;
+}
+
+static void snapshotUnref(struct uvSnapshot *s)
+{
+    assert(s->refs > 0);
+    s->refs--;
+    if (s->refs == 0) {
+        struct raft_buffer *buf = &s->snapshot.bufs[0];
+        if (buf->base != NULL) {
+            munmap(buf->base, buf->len);
+        }
+        raft_free(s->snapshot.bufs);
+        raft_configuration_close(&s->snapshot.configuration);
+        if (s->compressed.base != NULL) {
+            raft_free(s->compressed.base);
+            raft_free(s->blocks);
+        }
+        raft_free(s);
+    }
+}
+
+/* Drop the cached snapshot, if any. */
+static void invalidateCache(struct uv *uv)
+{
+    if (uv->snapshot_cache != NULL) {
+        snapshotUnref(uv->snapshot_cache);
+        uv->snapshot_cache = NULL;
+    }
+}
+
+/* Check whether the content of the given chunk file matches the given data,
+ * whose length must match the one of the file. */
+static int compareChunk(struct uv *uv,
+                        const uvFilename filename,
+                        const void *data,
+                        size_t len,
+                        bool *equal)
+{
+    void *base;
+    char errmsg[2048];
+    int fd;
+    int rv;
+
+    rv = uvOpenFile(uv->dir, filename, O_RDONLY, &fd, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "open %s: %s", filename, errmsg);
+        return RAFT_IOERR;
+    }
+    base = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        uvErrorf(uv, "mmap %s: %s", filename, strerror(errno));
+        return RAFT_IOERR;
+    }
+    *equal = memcmp(base, data, len) == 0;
+    munmap(base, len);
+
+    return 0;
+}
+
+/* Store the given piece of snapshot data in a chunk file, unless a chunk file
+ * with the same content already exists. Set @created to true if a new file was
+ * created. */
+static int storeChunk(struct uv *uv,
+                      const void *data,
+                      size_t len,
+                      struct chunk *chunk,
+                      bool *created)
+{
+    uvFilename filename;
+    struct raft_buffer buf;
+    struct stat sb;
+    char errmsg[2048];
+    bool equal;
+    int rv;
+
+    assert(len > 0);
+
+    chunk->crc = byteCrc32(data, len, 0);
+    chunk->len = len;
+
+    /* Files with the same checksum and length but a different content are
+     * either checksum collisions or leftovers of a crash, skip them. */
+    for (chunk->n = 0;; chunk->n++) {
+        chunkFilename(chunk, filename);
+        rv = uvStatFile(uv->dir, filename, &sb, errmsg);
+        if (rv == UV__NOENT) {
+            break;
+        }
+        if (rv != 0) {
+            uvErrorf(uv, "stat %s: %s", filename, errmsg);
+            return RAFT_IOERR;
+        }
+        if ((size_t)sb.st_size != len) {
+            continue;
+        }
+        rv = compareChunk(uv, filename, data, len, &equal);
+        if (rv != 0) {
+            return rv;
+        }
+        if (equal) {
+            return 0;
+        }
+    }
+
+    buf.base = (void *)data;
+    buf.len = len;
+    rv = uvMakeFile(uv->dir, filename, &buf, 1, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "write %s: %s", filename, errmsg);
+        return RAFT_IOERR;
+    }
+    *created = true;
+
+    return 0;
+}
+
+/* Store the data of the given snapshot in chunk files, and then write the list
+ * of chunks in the snapshot data file with the given name. If @compressed is
+ * true, each chunk is compressed before being stored. */
+static int putChunks(struct uv *uv,
+                     const struct raft_snapshot *snapshot,
+                     const uvFilename filename,
+                     bool compressed)
+{
+    struct chunk *chunks = NULL;
+    unsigned n_chunks = 0;
+    struct raft_buffer manifest;
+    struct raft_buffer piece;
+    void *scratch = NULL;
+    void *items;
+    void *cursor;
+    bool created = false;
+    size_t offset;
+    unsigned i;
+    unsigned j;
+    char errmsg[2048];
+    int rv;
+
+    for (i = 0; i < snapshot->n_bufs; i++) {
+        size_t len = snapshot->bufs[i].len;
+        n_chunks += len / UV__SNAPSHOT_CHUNK_SIZE;
+        if (len % UV__SNAPSHOT_CHUNK_SIZE != 0) {
+            n_chunks++;
+        }
+    }
+
+    manifest.len = MANIFEST_HEADER_SIZE + n_chunks * MANIFEST_ITEM_SIZE;
+    manifest.base = raft_malloc(manifest.len);
+    if (manifest.base == NULL) {
+        rv = RAFT_NOMEM;
+        goto err;
+    }
+
+    if (n_chunks > 0) {
+        chunks = raft_malloc(n_chunks * sizeof *chunks);
+        if (chunks == NULL) {
+            rv = RAFT_NOMEM;
+            goto err_after_manifest_alloc;
+        }
+    }
+
+    if (compressed && n_chunks > 0) {
+        piece.base = NULL;
+        piece.len = UV__SNAPSHOT_CHUNK_SIZE;
+        scratch = raft_malloc(uvCompressBound(&piece, 1));
+        if (scratch == NULL) {
+            rv = RAFT_NOMEM;
+            goto err_after_chunks_alloc;
+        }
+    }
+
+    j = 0;
+    for (i = 0; i < snapshot->n_bufs; i++) {
+        const struct raft_buffer *buf = &snapshot->bufs[i];
+        for (offset = 0; offset < buf->len; offset += UV__SNAPSHOT_CHUNK_SIZE) {
+            size_t len = buf->len - offset;
+            if (len > UV__SNAPSHOT_CHUNK_SIZE) {
+                len = UV__SNAPSHOT_CHUNK_SIZE;
+            }
+            piece.base = (uint8_t *)buf->base + offset;
+            piece.len = len;
+            /* Compression is deterministic, so chunks with the same content
+             * are still deduplicated. */
+            if (compressed) {
+                piece.len = uvCompress(&piece, 1, scratch);
+                piece.base = scratch;
+            }
+            rv = storeChunk(uv, piece.base, piece.len, &chunks[j], &created);
+            if (rv != 0) {
+                goto err_after_scratch_alloc;
+            }
+            j++;
+        }
+    }
+    assert(j == n_chunks);
+
+    /* Make sure that new chunk files are there before referencing them. */
+    if (created) {
+        rv = uvSyncDir(uv->dir, errmsg);
+        if (rv != 0) {
+            uvErrorf(uv, "sync %s: %s", uv->dir, errmsg);
+            rv = RAFT_IOERR;
+            goto err_after_scratch_alloc;
+        }
+    }
+
+    items = (uint8_t *)manifest.base + MANIFEST_HEADER_SIZE;
+    cursor = items;
+    for (i = 0; i < n_chunks; i++) {
+        bytePut64(&cursor, chunks[i].crc);
+        bytePut64(&cursor, chunks[i].len);
+        bytePut64(&cursor, chunks[i].n);
+    }
+    cursor = manifest.base;
+    bytePut64(&cursor, n_chunks);
+    bytePut64(&cursor, byteCrc32(items, n_chunks * MANIFEST_ITEM_SIZE, 0));
+
+    rv = uvMakeFile(uv->dir, filename, &manifest, 1, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "write %s: %s", filename, errmsg);
+        rv = RAFT_IOERR;
+        goto err_after_scratch_alloc;
+    }
+
+    if (scratch != NULL) {
+        raft_free(scratch);
+    }
+    if (chunks != NULL) {
+        raft_free(chunks);
+    }
+    raft_free(manifest.base);
+
+    return 0;
+
+err_after_scratch_alloc:
+    if (scratch != NULL) {
+        raft_free(scratch);
+    }
+err_after_chunks_alloc:
+    if (chunks != NULL) {
+        raft_free(chunks);
+    }
+err_after_manifest_alloc:
+    raft_free(manifest.base);
+err:
+    assert(rv != 0);
+    return rv;
+}
+
+static int compareFilenames(const void *p1, const void *p2)
+{
+    return strcmp(p1, p2);
+}
+
+/* Remove all chunk files which are not used by any of the given snapshots. */
+static int removeUnusedChunks(struct uv *uv,
+                              struct uvSnapshotInfo *snapshots,
+                              size_t n_snapshots)
+{
+    uvFilename *used = NULL;
+    size_t n_used = 0;
+    struct dirent **dirents;
+    int n_dirents;
+    size_t i;
+    int j;
+    char errmsg[2048];
+    int rv;
+
+    /* Collect the names of the chunk files used by the snapshots. */
+    for (i = 0; i < n_snapshots; i++) {
+        struct raft_snapshot snapshot;
+        struct chunk *chunks;
+        unsigned n_chunks;
+        unsigned flags;
+        uvFilename *tmp;
+        unsigned k;
+
+        rv = loadMeta(uv, &snapshots[i], &snapshot, &flags);
+        if (rv != 0) {
+            goto out;
+        }
+        raft_configuration_close(&snapshot.configuration);
+        if (!(flags & UV__SNAPSHOT_CHUNKED)) {
+            continue;
+        }
+
+        rv = loadManifest(uv, &snapshots[i], &chunks, &n_chunks);
+        if (rv != 0) {
+            goto out;
+        }
+        if (n_chunks == 0) {
+            continue;
+        }
+        tmp = raft_realloc(used, (n_used + n_chunks) * sizeof *used);
+        if (tmp == NULL) {
+            raft_free(chunks);
+            rv = RAFT_NOMEM;
+            goto out;
+        }
+        used = tmp;
+        for (k = 0; k < n_chunks; k++) {
+            chunkFilename(&chunks[k], used[n_used]);
+            n_used++;
+        }
+        raft_free(chunks);
+    }
+    if (used != NULL) {
+        qsort(used, n_used, sizeof *used, compareFilenames);
+    }
+
+    rv = uvScanDir(uv->dir, &dirents, &n_dirents, errmsg);
+    if (rv != 0) {
+        uvErrorf(uv, "scan %s: %s", uv->dir, errmsg);
+        rv = RAFT_IOERR;
+        goto out;
+    }
+    for (j = 0; j < n_dirents; j++) {
+        const char *filename = dirents[j]->d_name;
+        if (rv == 0 && strncmp(filename, "chunk-", strlen("chunk-")) == 0 &&
+            (used == NULL || bsearch(filename, used, n_used, sizeof *used,
+                                     compareFilenames) == NULL)) {
+            rv = uvUnlinkFile(uv->dir, filename, errmsg);
+            if (rv != 0) {
+                uvErrorf(uv, "unlink %s: %s", filename, errmsg);
+                rv = RAFT_IOERR;
+            }
+        }
+        free(dirents[j]);
+    }
+    free(dirents);
+
+out:
+    if (used != NULL) {
+        raft_free(used);
+    }
+    return rv;
+}
+
 /* Remove all segmens and snapshots that are not needed anymore. */
 static int removeOldSegmentsAndSnapshots(struct uv *uv,
                                          raft_index last_index,
@@ -347,6 +1159,16 @@ static int removeOldSegmentsAndSnapshots(struct uv *uv,
         goto out;
     }
 
+    /* The snapshots removed above are the oldest ones. */
+    if (n_snapshots > 2) {
+        rv = removeUnusedChunks(uv, &snapshots[n_snapshots - 2], 2);
+    } else {
+        rv = removeUnusedChunks(uv, snapshots, n_snapshots);
+    }
+    if (rv != 0) {
+        goto out;
+    }
+
     if (segments != NULL) {
         size_t deleted;
         rv = uvSegmentKeepTrailing(uv, segments, n_segments, last_index,
@@ -404,6 +1226,32 @@ int uvSnapshotKeepLastTwo(struct uv *uv,
     return 0;
 }
 
+/* Compress the data of the given snapshot and write it in the snapshot data
+ * file with the given name. */
+static int putCompressedData(struct uv *uv,
+                             const struct raft_snapshot *snapshot,
+                             const uvFilename filename)
+{
+    struct raft_buffer buf;
+    char errmsg[2048];
+    int rv;
+
+    buf.base = raft_malloc(uvCompressBound(snapshot->bufs, snapshot->n_bufs));
+    if (buf.base == NULL) {
+        return RAFT_NOMEM;
+    }
+    buf.len = uvCompress(snapshot->bufs, snapshot->n_bufs, buf.base);
+
+    rv = uvMakeFile(uv->dir, filename, &buf, 1, errmsg);
+    raft_free(buf.base);
+    if (rv != 0) {
+        uvErrorf(uv, "write %s: %s", filename, errmsg);
+        return RAFT_IOERR;
+    }
+
+    return 0;
+}
+
 static void putWorkCb(uv_work_t *work)
 {
     struct put *r = work->data;
@@ -425,12 +1273,26 @@ static void putWorkCb(uv_work_t *work)
     sprintf(filename, UV__SNAPSHOT_TEMPLATE, r->snapshot->term,
             r->snapshot->index, r->meta.timestamp);
 
-    rv = uvMakeFile(uv->dir, filename, r->snapshot->bufs, r->snapshot->n_bufs,
-                    errmsg);
-    if (rv != 0) {
-        uvErrorf(uv, "write %s: %s", filename, errmsg);
-        r->status = RAFT_IOERR;
-        return;
+    if (r->chunked) {
+        rv = putChunks(uv, r->snapshot, filename, r->compressed);
+        if (rv != 0) {
+            r->status = rv;
+            return;
+        }
+    } else if (r->compressed) {
+        rv = putCompressedData(uv, r->snapshot, filename);
+        if (rv != 0) {
+            r->status = rv;
+            return;
+        }
+    } else {
+        rv = uvMakeFile(uv->dir, filename, r->snapshot->bufs,
+                        r->snapshot->n_bufs, errmsg);
+        if (rv != 0) {
+            uvErrorf(uv, "write %s: %s", filename, errmsg);
+            r->status = RAFT_IOERR;
+            return;
+        }
     }
 
     rv = uvSyncDir(uv->dir, errmsg);
@@ -459,6 +1321,7 @@ static void putAfterWorkCb(uv_work_t *work, int status)
     assert(status == 0);
     QUEUE_REMOVE(&r->queue);
     uv->snapshot_put_work.data = NULL;
+    uv->snapshot_n_puts++;
 
     r->req->cb(r->req, r->status);
 
@@ -519,6 +1382,7 @@ int uvSnapshotPut(struct raft_io *io,
     struct uv *uv;
     struct put *r;
     void *cursor;
+    unsigned flags;
     unsigned crc;
     int rv;
 
@@ -528,6 +1392,9 @@ int uvSnapshotPut(struct raft_io *io,
 
     uvDebugf(uv, "put snapshot at %lld, keeping %d", snapshot->index, trailing);
 
+    /* The cached snapshot is about to become stale. */
+    invalidateCache(uv);
+
     r = raft_malloc(sizeof *r);
     if (r == NULL) {
         rv = RAFT_NOMEM;
@@ -538,6 +1405,8 @@ int uvSnapshotPut(struct raft_io *io,
     r->snapshot = snapshot;
     r->meta.timestamp = uv_now(uv->loop);
     r->trailing = trailing;
+    r->chunked = uv->snapshot_dedup;
+    r->compressed = uv->snapshot_compression;
 
     req->cb = cb;
 
@@ -562,8 +1431,15 @@ int uvSnapshotPut(struct raft_io *io,
         uvAppendFixPreparedSegmentFirstIndex(uv);
     }
 
+    /* Store the flags describing the layout of the data file next to the
+     * format version. */
+    flags = r->chunked ? UV__SNAPSHOT_CHUNKED : 0;
+    if (r->compressed) {
+        flags |= UV__SNAPSHOT_COMPRESSED;
+    }
+
     cursor = r->meta.header;
-    bytePut64(&cursor, UV__DISK_FORMAT);
+    bytePut64(&cursor, UV__DISK_FORMAT | (uint64_t)flags << 32);
     bytePut64(&cursor, 0);
     bytePut64(&cursor, snapshot->configuration_index);
     bytePut64(&cursor, r->meta.bufs[1].len);
@@ -595,6 +1471,45 @@ void uvSnapshotMaybeProcessRequests(struct uv *uv)
     processPutRequests(uv);
 }
 
+void uvSnapshotClose(struct uv *uv)
+{
+    invalidateCache(uv);
+}
+
+/* Compress the data of the given snapshot and index its compressed blocks. If
+ * memory is short, leave it uncompressed: it will be sent as it is. */
+static void compressSnapshot(struct uvSnapshot *s)
+{
+    const struct raft_buffer *data = &s->snapshot.bufs[0];
+    size_t n_blocks;
+    void *base;
+
+    if (data->len == 0) {
+        return;
+    }
+    n_blocks = (data->len + UV__COMPRESSION_BLOCK_SIZE - 1) /
+               UV__COMPRESSION_BLOCK_SIZE;
+
+    s->blocks = raft_malloc((n_blocks + 1) * sizeof *s->blocks);
+    if (s->blocks == NULL) {
+        return;
+    }
+    s->compressed.base = raft_malloc(uvCompressBound(data, 1));
+    if (s->compressed.base == NULL) {
+        raft_free(s->blocks);
+        s->blocks = NULL;
+        return;
+    }
+    s->compressed.len = uvCompress(data, 1, s->compressed.base);
+    uvCompressedBlockOffsets(s->compressed.base, data->len, s->blocks);
+
+    /* Give back the room reserved for blocks that didn't shrink. */
+    base = raft_realloc(s->compressed.base, s->compressed.len);
+    if (base != NULL) {
+        s->compressed.base = base;
+    }
+}
+
 static void getWorkCb(uv_work_t *work)
 {
     struct get *r = work->data;
@@ -607,17 +1522,36 @@ static void getWorkCb(uv_work_t *work)
 
     r->status = 0;
 
+    if (r->cached) {
+        return;
+    }
+
     rv = uvList(uv, &snapshots, &n_snapshots, &segments, &n_segments);
     if (rv != 0) {
         r->status = rv;
         goto out;
     }
     if (snapshots != NULL) {
-        rv = uvSnapshotLoad(uv, &snapshots[n_snapshots - 1], r->snapshot);
+        struct uvSnapshotInfo *info = &snapshots[n_snapshots - 1];
+        struct raft_snapshot *snapshot = &r->snapshot->snapshot;
+        unsigned flags;
+        rv = loadMeta(uv, info, snapshot, &flags);
+        if (rv == 0) {
+            rv = loadSnapshotData(uv, info, flags, true, snapshot);
+            if (rv != 0) {
+                raft_configuration_close(&snapshot->configuration);
+            }
+        }
+        if (rv == 0 && r->compress) {
+            compressSnapshot(r->snapshot);
+        }
         if (rv != 0) {
             r->status = rv;
         }
         raft_free(snapshots);
+    } else {
+        uvErrorf(uv, "get last snapshot: no snapshot found");
+        r->status = RAFT_IOERR;
     }
     if (segments != NULL) {
         raft_free(segments);
@@ -630,9 +1564,30 @@ static void getAfterWorkCb(uv_work_t *work, int status)
 {
     struct get *r = work->data;
     struct uv *uv = r->uv;
+    struct uvSnapshot *snapshot = r->snapshot;
     assert(status == 0);
     QUEUE_REMOVE(&r->queue);
-    r->req->cb(r->req, r->snapshot, r->status);
+
+    if (r->status != 0) {
+        assert(!r->cached);
+        raft_free(snapshot);
+        r->req->cb(r->req, NULL, r->status);
+        goto out;
+    }
+
+    /* Cache the snapshot we loaded, unless a new snapshot was put (or is
+     * being put) since the request was submitted, in which case what we
+     * loaded might be already stale. */
+    if (!r->cached && !uv->closing && r->n_puts == uv->snapshot_n_puts &&
+        QUEUE_IS_EMPTY(&uv->snapshot_put_reqs)) {
+        invalidateCache(uv);
+        snapshotRef(snapshot);
+        uv->snapshot_cache = snapshot;
+    }
+
+    r->req->cb(r->req, &snapshot->snapshot, 0);
+
+out:
     raft_free(r);
     uvMaybeClose(uv);
 }
@@ -654,30 +1609,97 @@ int uvSnapshotGet(struct raft_io *io,
     }
     r->uv = uv;
     r->req = req;
+    r->n_puts = uv->snapshot_n_puts;
     req->cb = cb;
 
-    r->snapshot = raft_malloc(sizeof *r->snapshot);
-    if (r->snapshot == NULL) {
-        rv = RAFT_NOMEM;
-        goto err_after_req_alloc;
+    /* If the last snapshot is already in memory, share it and skip reading
+     * it from disk. The callback still fires asynchronously. */
+    if (uv->snapshot_cache != NULL) {
+        r->snapshot = uv->snapshot_cache;
+        r->cached = true;
+    } else {
+        r->snapshot = raft_malloc(sizeof *r->snapshot);
+        if (r->snapshot == NULL) {
+            rv = RAFT_NOMEM;
+            goto err_after_req_alloc;
+        }
+        r->snapshot->refs = 0;
+        r->snapshot->compressed.base = NULL;
+        r->snapshot->compressed.len = 0;
+        r->snapshot->blocks = NULL;
+        r->cached = false;
     }
+    r->compress = uv->snapshot_compression;
     r->work.data = r;
 
     QUEUE_PUSH(&uv->snapshot_get_reqs, &r->queue);
     rv = uv_queue_work(uv->loop, &r->work, getWorkCb, getAfterWorkCb);
     if (rv != 0) {
+        QUEUE_REMOVE(&r->queue);
         uvErrorf(uv, "get last snapshot: %s", uv_strerror(rv));
         rv = RAFT_IOERR;
         goto err_after_snapshot_alloc;
     }
 
+    /* Reference owned by the caller, dropped by raft_io->snapshot_release. */
+    snapshotRef(r->snapshot);
+
     return 0;
 
 err_after_snapshot_alloc:
-    raft_free(r->snapshot);
+    if (!r->cached) {
+        raft_free(r->snapshot);
+    }
 err_after_req_alloc:
     raft_free(r);
 err:
     assert(rv != 0);
     return rv;
 }
+
+void uvSnapshotRelease(struct raft_io *io, struct raft_snapshot *snapshot)
+{
+    (void)io;
+    snapshotUnref((struct uvSnapshot *)snapshot);
+}
+
+bool uvSnapshotCompressedBlocks(struct uv *uv,
+                                const struct raft_buffer *chunk,
+                                uv_buf_t *blocks)
+{
+    struct uvSnapshot *s = uv->snapshot_cache;
+    const struct raft_buffer *data;
+    uintptr_t base;
+    uintptr_t start;
+    size_t offset;
+    size_t end;
+
+    if (s == NULL || s->compressed.base == NULL) {
+        return false;
+    }
+    data = &s->snapshot.bufs[0];
+
+    base = (uintptr_t)data->base;
+    start = (uintptr_t)chunk->base;
+    if (start < base || start - base > data->len ||
+        chunk->len > data->len - (start - base)) {
+        return false;
+    }
+    offset = start - base;
+    end = offset + chunk->len;
+
+    /* Blocks are compressed independently, so they can be reused as they are
+     * only if the chunk starts and ends at block boundaries. */
+    if (offset % UV__COMPRESSION_BLOCK_SIZE != 0 ||
+        (end % UV__COMPRESSION_BLOCK_SIZE != 0 && end != data->len)) {
+        return false;
+    }
+
+    offset = s->blocks[offset / UV__COMPRESSION_BLOCK_SIZE];
+    end = s->blocks[(end + UV__COMPRESSION_BLOCK_SIZE - 1) /
+                    UV__COMPRESSION_BLOCK_SIZE];
+    blocks->base = (char *)s->compressed.base + offset;
+    blocks->len = end - offset;
+
+    return true;
+}
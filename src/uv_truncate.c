@@ -126,6 +126,7 @@ static void afterWorkCb(uv_work_t *work, int status)
 
     uvAppendMaybeProcessRequests(uv);
     uvSnapshotMaybeProcessRequests(uv);
+    uvReadMaybeProcessRequests(uv);
     uvMaybeClose(uv);
 }
 
@@ -0,0 +1,222 @@
+#include "uv_uring.h"
+
+#if defined(RAFT_HAVE_IO_URING)
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "uv_error.h"
+
+/* Return a pointer to the field at the given offset of a ring mapping. */
+#define RING_FIELD(RING, OFFSET) (void *)((char *)(RING) + (OFFSET))
+
+int uvUringInit(struct uvUring *r, unsigned n, char *errmsg)
+{
+    struct io_uring_params p;
+    void *ptr;
+    int rv;
+
+    /* Keep submitting entries even if one of them fails to be prepared, the
+     * error will be reported in its completion entry. */
+    memset(&p, 0, sizeof p);
+    p.flags = IORING_SETUP_SUBMIT_ALL;
+    rv = (int)syscall(__NR_io_uring_setup, n, &p);
+    if (rv == -1) {
+        uvErrMsgSys(errmsg, io_uring_setup, errno);
+        return UV__ERROR;
+    }
+    r->fd = rv;
+
+    if (!(p.features & IORING_FEAT_CQE_SKIP)) {
+        uvErrMsgPrintf(errmsg, "io_uring: CQE skip not supported");
+        goto err_after_setup;
+    }
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    /* With IORING_FEAT_SINGLE_MMAP both rings live in the same mapping. */
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) {
+            r->sq_ring_size = r->cq_ring_size;
+        }
+        r->cq_ring_size = r->sq_ring_size;
+    }
+
+    ptr = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED) {
+        uvErrMsgSys(errmsg, mmap, errno);
+        goto err_after_setup;
+    }
+    r->sq_ring = ptr;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        ptr = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (ptr == MAP_FAILED) {
+            uvErrMsgSys(errmsg, mmap, errno);
+            goto err_after_sq_ring_map;
+        }
+        r->cq_ring = ptr;
+    }
+
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ptr = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED) {
+        uvErrMsgSys(errmsg, mmap, errno);
+        goto err_after_cq_ring_map;
+    }
+    r->sqes = ptr;
+
+    r->sq_head = RING_FIELD(r->sq_ring, p.sq_off.head);
+    r->sq_tail = RING_FIELD(r->sq_ring, p.sq_off.tail);
+    r->sq_array = RING_FIELD(r->sq_ring, p.sq_off.array);
+    r->sq_mask = *(unsigned *)RING_FIELD(r->sq_ring, p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = RING_FIELD(r->cq_ring, p.cq_off.head);
+    r->cq_tail = RING_FIELD(r->cq_ring, p.cq_off.tail);
+    r->cqes = RING_FIELD(r->cq_ring, p.cq_off.cqes);
+    r->cq_mask = *(unsigned *)RING_FIELD(r->cq_ring, p.cq_off.ring_mask);
+    r->n_prepared = 0;
+
+    return 0;
+
+err_after_cq_ring_map:
+    if (r->cq_ring != r->sq_ring) {
+        munmap(r->cq_ring, r->cq_ring_size);
+    }
+err_after_sq_ring_map:
+    munmap(r->sq_ring, r->sq_ring_size);
+err_after_setup:
+    close(r->fd);
+    r->fd = -1;
+    return UV__ERROR;
+}
+
+void uvUringClose(struct uvUring *r)
+{
+    assert(r->fd != -1);
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring != r->sq_ring) {
+        munmap(r->cq_ring, r->cq_ring_size);
+    }
+    munmap(r->sq_ring, r->sq_ring_size);
+    close(r->fd);
+    r->fd = -1;
+}
+
+int uvUringRegisterEventFd(struct uvUring *r, int fd, char *errmsg)
+{
+    int rv;
+    rv = (int)syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_EVENTFD,
+                      &fd, 1);
+    if (rv == -1) {
+        uvErrMsgSys(errmsg, io_uring_register, errno);
+        return UV__ERROR;
+    }
+    return 0;
+}
+
+unsigned uvUringSpace(struct uvUring *r)
+{
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *r->sq_tail + r->n_prepared;
+    return r->sq_entries - (tail - head);
+}
+
+struct io_uring_sqe *uvUringGetSqe(struct uvUring *r)
+{
+    struct io_uring_sqe *sqe;
+    unsigned index;
+
+    assert(uvUringSpace(r) > 0);
+
+    index = (*r->sq_tail + r->n_prepared) & r->sq_mask;
+    sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof *sqe);
+    r->sq_array[index] = index;
+    r->n_prepared++;
+
+    return sqe;
+}
+
+int uvUringSubmit(struct uvUring *r, char *errmsg)
+{
+    unsigned tail = *r->sq_tail;
+    unsigned n = r->n_prepared;
+    unsigned submitted = 0;
+    int rv;
+
+    /* Publish the prepared entries. Without SQPOLL the kernel only consumes
+     * them from within io_uring_enter(), so we can safely take them back if
+     * it fails. */
+    __atomic_store_n(r->sq_tail, tail + n, __ATOMIC_RELEASE);
+    r->n_prepared = 0;
+
+    /* The kernel consumes the entries in order, and fails only if it couldn't
+     * consume any of them. If it runs out of resources it might stop early:
+     * the entries it consumed can't be taken back, and since they are linked
+     * to the remaining ones, re-enter until those are consumed too. */
+    while (submitted < n) {
+        rv = (int)syscall(__NR_io_uring_enter, r->fd, n - submitted, 0, 0,
+                          NULL, 0);
+        if (rv == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (submitted == 0) {
+                uvErrMsgSys(errmsg, io_uring_enter, errno);
+                __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+                return UV__ERROR;
+            }
+            /* UNTESTED: the kernel is temporarily out of memory. */
+            continue;
+        }
+        submitted += (unsigned)rv;
+    }
+
+    return 0;
+}
+
+int uvUringWait(struct uvUring *r, char *errmsg)
+{
+    int rv;
+    do {
+        rv = (int)syscall(__NR_io_uring_enter, r->fd, 0, 1,
+                          IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (rv == -1 && errno == EINTR);
+
+    if (rv == -1) {
+        uvErrMsgSys(errmsg, io_uring_enter, errno);
+        return UV__ERROR;
+    }
+    return 0;
+}
+
+bool uvUringPop(struct uvUring *r, struct io_uring_cqe *cqe)
+{
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return false;
+    }
+
+    *cqe = r->cqes[head & r->cq_mask];
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+#endif /* RAFT_HAVE_IO_URING */
@@ -0,0 +1,67 @@
+/* Minimal wrapper around the Linux io_uring API, using raw system calls. */
+
+#ifndef UV_URING_H_
+#define UV_URING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/* Submission and completion queues shared with the kernel. */
+struct uvUring
+{
+    int fd;                    /* Ring file descriptor, or -1 */
+    void *sq_ring;             /* Mapping of the submission queue ring */
+    size_t sq_ring_size;       /* Size of the submission queue mapping */
+    void *cq_ring;             /* Mapping of the completion queue ring */
+    size_t cq_ring_size;       /* Size of the completion queue mapping */
+    struct io_uring_sqe *sqes; /* Mapping of the submission queue entries */
+    size_t sqes_size;          /* Size of the submission entries mapping */
+    unsigned *sq_head;         /* Submission queue head, moved by the kernel */
+    unsigned *sq_tail;         /* Submission queue tail, moved by us */
+    unsigned *sq_array;        /* Indexes of the entries to submit */
+    unsigned sq_mask;          /* Mask to apply to submission queue indexes */
+    unsigned sq_entries;       /* Number of submission queue entries */
+    unsigned *cq_head;         /* Completion queue head, moved by us */
+    unsigned *cq_tail;         /* Completion queue tail, moved by the kernel */
+    struct io_uring_cqe *cqes; /* Completion queue entries */
+    unsigned cq_mask;          /* Mask to apply to completion queue indexes */
+    unsigned n_prepared;       /* Entries prepared but not yet submitted */
+};
+
+/* Create a ring able to hold at least @n submission entries.
+ *
+ * Fail if the kernel does not support all the features we rely on, in
+ * particular IOSQE_CQE_SKIP_SUCCESS: it lets a chain of linked entries post a
+ * single completion, either for the first entry that failed or for the last
+ * entry of the chain. */
+int uvUringInit(struct uvUring *r, unsigned n, char *errmsg);
+
+/* Release all resources associated with the ring. */
+void uvUringClose(struct uvUring *r);
+
+/* Make the kernel signal the given eventfd each time a request completes. */
+int uvUringRegisterEventFd(struct uvUring *r, int fd, char *errmsg);
+
+/* Return the number of submission entries that can still be prepared. */
+unsigned uvUringSpace(struct uvUring *r);
+
+/* Return a zeroed submission entry to fill. It will be sent to the kernel by
+ * the next call to uvUringSubmit(). There must be space for it. */
+struct io_uring_sqe *uvUringGetSqe(struct uvUring *r);
+
+/* Submit all prepared entries, which must form a single chain of linked
+ * entries. In case of error none of them was consumed by the kernel, and they
+ * are all discarded. */
+int uvUringSubmit(struct uvUring *r, char *errmsg);
+
+/* Block until at least one completion entry is available. */
+int uvUringWait(struct uvUring *r, char *errmsg);
+
+/* Copy the oldest completion entry to @cqe and remove it from the queue.
+ * Return false if there's no completion entry. */
+bool uvUringPop(struct uvUring *r, struct io_uring_cqe *cqe);
+
+#endif /* UV_URING_H_ */
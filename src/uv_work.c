@@ -0,0 +1,223 @@
+#include "assert.h"
+#include "uv.h"
+
+/* Maximum number of async work requests that can be outstanding at the same
+ * time. */
+#define RING_SIZE 64
+
+/* The happy path for a raft_io->async_work request is:
+ *
+ * - Start the worker thread, if it's not running yet.
+ * - Store the request in the next free slot of the ring and signal the worker
+ *   thread.
+ * - The worker thread runs the request's work function, stores its return
+ *   value in the slot and signals the loop thread with uv_async_send().
+ * - The loop thread fires the request callback.
+ *
+ * The ring is a single-producer single-consumer queue which needs no locking:
+ * only the loop thread advances the submitted and completed counters, and only
+ * the worker thread advances the executed counter. */
+
+/* A slot of the ring. */
+struct uvWorkSlot
+{
+    struct raft_io_async_work *req; /* Request occupying the slot */
+    int status;                     /* Return value of the work function */
+};
+
+/* State of the worker thread executing async work requests. */
+struct uvWorker
+{
+    struct uv *uv;                      /* I/O object using the worker */
+    uv_thread_t thread;                 /* Worker thread */
+    uv_sem_t sem;                       /* Signal new requests and stop */
+    struct uv_async_s async;            /* Signal executed requests */
+    struct uvWorkSlot slots[RING_SIZE]; /* Outstanding requests */
+    unsigned long long submitted;       /* Requests submitted so far */
+    unsigned long long executed;        /* Requests executed so far */
+    unsigned long long completed;       /* Requests completed so far */
+    bool stop;                          /* Whether the worker must exit */
+};
+
+/* Body of the worker thread. */
+static void workerThread(void *arg)
+{
+    struct uvWorker *w = arg;
+    unsigned long long executed = w->executed;
+
+    for (;;) {
+        unsigned long long submitted;
+
+        uv_sem_wait(&w->sem);
+
+        submitted = __atomic_load_n(&w->submitted, __ATOMIC_ACQUIRE);
+        while (executed < submitted) {
+            struct uvWorkSlot *slot;
+            if (__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+            slot = &w->slots[executed % RING_SIZE];
+            slot->status = slot->req->work(slot->req);
+            executed++;
+            __atomic_store_n(&w->executed, executed, __ATOMIC_RELEASE);
+            uv_async_send(&w->async);
+        }
+
+        if (__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+    }
+}
+
+/* Fire the callbacks of all requests executed by the worker thread. */
+static void workerComplete(struct uvWorker *w)
+{
+    unsigned long long executed;
+
+    executed = __atomic_load_n(&w->executed, __ATOMIC_ACQUIRE);
+    while (w->completed < executed) {
+        struct uvWorkSlot *slot = &w->slots[w->completed % RING_SIZE];
+        struct raft_io_async_work *req = slot->req;
+        int status = slot->status;
+        /* Free the slot before invoking the callback, which might submit a
+         * new request. */
+        w->completed++;
+        req->cb(req, status);
+    }
+}
+
+static void asyncCb(uv_async_t *async)
+{
+    struct uvWorker *w = async->data;
+    workerComplete(w);
+}
+
+/* Start the worker thread. */
+static int workerStart(struct uv *uv)
+{
+    struct uvWorker *w;
+    int rv;
+
+    w = raft_malloc(sizeof *w);
+    if (w == NULL) {
+        rv = RAFT_NOMEM;
+        goto err;
+    }
+    w->uv = uv;
+    w->submitted = 0;
+    w->executed = 0;
+    w->completed = 0;
+    w->stop = false;
+
+    rv = uv_sem_init(&w->sem, 0);
+    if (rv != 0) {
+        uvErrorf(uv, "init worker semaphore: %s", uv_strerror(rv));
+        rv = RAFT_IOERR;
+        goto err_after_worker_alloc;
+    }
+
+    /* The worker thread doesn't touch the async handle until a request is
+     * submitted, so it's safe to initialize it afterwards. */
+    rv = uv_thread_create(&w->thread, workerThread, w);
+    if (rv != 0) {
+        uvErrorf(uv, "start worker thread: %s", uv_strerror(rv));
+        rv = RAFT_IOERR;
+        goto err_after_sem_init;
+    }
+
+    rv = uv_async_init(uv->loop, &w->async, asyncCb);
+    assert(rv == 0); /* This should never fail */
+    w->async.data = w;
+
+    uv->worker = w;
+
+    return 0;
+
+err_after_sem_init:
+    uv_sem_destroy(&w->sem);
+err_after_worker_alloc:
+    raft_free(w);
+err:
+    assert(rv != 0);
+    return rv;
+}
+
+/* Implementation of raft_io->async_work. */
+int uvAsyncWork(struct raft_io *io,
+                struct raft_io_async_work *req,
+                raft_io_async_work_cb cb)
+{
+    struct uv *uv;
+    struct uvWorker *w;
+    struct uvWorkSlot *slot;
+    int rv;
+
+    uv = io->impl;
+    assert(req->work != NULL);
+
+    if (uv->closing) {
+        return RAFT_CANCELED;
+    }
+
+    if (uv->worker == NULL) {
+        rv = workerStart(uv);
+        if (rv != 0) {
+            return rv;
+        }
+    }
+    w = uv->worker;
+
+    /* If the ring is full, let the caller retry later. */
+    if (w->submitted - w->completed == RING_SIZE) {
+        return RAFT_BUSY;
+    }
+
+    req->cb = cb;
+
+    slot = &w->slots[w->submitted % RING_SIZE];
+    slot->req = req;
+    slot->status = 0;
+
+    __atomic_store_n(&w->submitted, w->submitted + 1, __ATOMIC_RELEASE);
+    uv_sem_post(&w->sem);
+
+    return 0;
+}
+
+static void asyncCloseCb(uv_handle_t *handle)
+{
+    struct uvWorker *w = handle->data;
+    struct uv *uv = w->uv;
+    raft_free(w);
+    uv->worker = NULL;
+    uvMaybeClose(uv);
+}
+
+void uvWorkClose(struct uv *uv)
+{
+    struct uvWorker *w = uv->worker;
+    int rv;
+
+    if (w == NULL) {
+        return;
+    }
+
+    /* Wait for the worker thread to finish executing the current request, if
+     * any. */
+    __atomic_store_n(&w->stop, true, __ATOMIC_RELEASE);
+    uv_sem_post(&w->sem);
+    rv = uv_thread_join(&w->thread);
+    assert(rv == 0);
+    uv_sem_destroy(&w->sem);
+
+    /* Fire the callbacks of executed requests, and cancel the others. */
+    workerComplete(w);
+    while (w->completed < w->submitted) {
+        struct raft_io_async_work *req;
+        req = w->slots[w->completed % RING_SIZE].req;
+        w->completed++;
+        req->cb(req, RAFT_CANCELED);
+    }
+
+    uv_close((uv_handle_t *)&w->async, asyncCloseCb);
+}
@@ -87,6 +87,104 @@ TEST_CASE(success, first, NULL)
     return MUNIT_OK;
 }
 
+/* Multiple commands submitted during the same loop iteration are written to
+ * disk and sent to followers in one go. */
+TEST_CASE(success, coalesce, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    struct raft_apply reqs[3];
+    unsigned n_send = CLUSTER_N_SEND(0, RAFT_IO_APPEND_ENTRIES);
+    unsigned i;
+    (void)params;
+    CLUSTER_SET_FLUSH(0, true);
+    for (i = 0; i < 3; i++) {
+        struct raft_buffer buf;
+        int rv;
+        test_fsm_encode_add_x(1, &buf);
+        rv = raft_apply(raft, &reqs[i], &buf, 1, NULL);
+        munit_assert_int(rv, ==, 0);
+    }
+
+    /* Nothing was written or sent yet. */
+    munit_assert_int(raft->leader_state.flush_index, ==, 2);
+
+    /* The entries get flushed at the end of the next loop iteration. */
+    CLUSTER_STEP;
+    munit_assert_int(raft->leader_state.flush_index, ==, 0);
+
+    CLUSTER_STEP_UNTIL_APPLIED(0, 4, 1000);
+    munit_assert_int(CLUSTER_N_SEND(0, RAFT_IO_APPEND_ENTRIES), ==, n_send + 1);
+    munit_assert_int(test_fsm_get_x(CLUSTER_FSM(0)), ==, 3);
+
+    return MUNIT_OK;
+}
+
+/* If the FSM supports batches, consecutive committed commands are applied with
+ * a single apply_batch() call. */
+TEST_CASE(success, batch, NULL)
+{
+    struct fixture *f = data;
+    struct raft_buffer bufs[3];
+    unsigned i;
+    int rv;
+    (void)params;
+    test_fsm_enable_batch(CLUSTER_FSM(0));
+    for (i = 0; i < 3; i++) {
+        test_fsm_encode_add_x(1, &bufs[i]);
+    }
+    f->req.data = f;
+    rv = raft_apply(CLUSTER_RAFT(0), &f->req, bufs, 3, apply_cb);
+    munit_assert_int(rv, ==, 0);
+    CLUSTER_STEP_UNTIL_APPLIED(0, 4, 1000);
+    munit_assert_true(f->invoked);
+    munit_assert_int(f->status, ==, 0);
+    munit_assert_int(test_fsm_get_x(CLUSTER_FSM(0)), ==, 3);
+    munit_assert_int(test_fsm_n_batches(CLUSTER_FSM(0)), ==, 1);
+    return MUNIT_OK;
+}
+
+/* When asynchronous apply is enabled, committed commands are applied by an
+ * async work request, and last_applied is updated only once it completes. */
+TEST_CASE(success, async, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    (void)params;
+    CLUSTER_SET_ASYNC_APPLY(0, true);
+    APPLY(0, 0);
+    while (raft->commit_index < 2) {
+        CLUSTER_STEP;
+    }
+    munit_assert_ptr_not_null(raft->apply.work);
+    munit_assert_int(raft->last_applied, ==, 1);
+    munit_assert_false(f->invoked);
+    CLUSTER_STEP_UNTIL_APPLIED(0, 2, 1000);
+    munit_assert_ptr_null(raft->apply.work);
+    munit_assert_true(f->invoked);
+    munit_assert_int(f->status, ==, 0);
+    munit_assert_int(test_fsm_get_x(CLUSTER_FSM(0)), ==, 123);
+    return MUNIT_OK;
+}
+
+/* If the I/O implementation doesn't support async work, commands are applied
+ * on the event loop thread even if asynchronous apply is enabled. */
+TEST_CASE(success, async_not_supported, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    (void)params;
+    raft_set_async_apply(raft, true);
+    APPLY(0, 0);
+    while (raft->commit_index < 2) {
+        CLUSTER_STEP;
+    }
+    munit_assert_ptr_null(raft->apply.work);
+    munit_assert_int(raft->last_applied, ==, 2);
+    munit_assert_true(f->invoked);
+    return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * Failure scenarios
@@ -119,3 +217,18 @@ TEST_CASE(error, leadership_lost, NULL)
     munit_assert_int(f->status, ==, RAFT_LEADERSHIPLOST);
     return MUNIT_OK;
 }
+
+/* If the raft instance steps down from leader state before deferred entries
+ * are flushed, the apply callback still fires with an error. */
+TEST_CASE(error, leadership_lost_before_flush, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    CLUSTER_SET_FLUSH(0, true);
+    APPLY(0, 0);
+    munit_assert_int(CLUSTER_RAFT(0)->leader_state.flush_index, ==, 2);
+    CLUSTER_DEPOSE;
+    munit_assert_true(f->invoked);
+    munit_assert_int(f->status, ==, RAFT_LEADERSHIPLOST);
+    return MUNIT_OK;
+}
@@ -0,0 +1,251 @@
+#include "../lib/cluster.h"
+#include "../lib/runner.h"
+
+TEST_MODULE(read_index);
+
+/******************************************************************************
+ *
+ * Fixture
+ *
+ *****************************************************************************/
+
+struct fixture
+{
+    FIXTURE_CLUSTER;
+    struct raft_read_index req;
+    bool invoked;
+    int status;
+};
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+    struct fixture *f = munit_malloc(sizeof *f);
+    (void)user_data;
+    SETUP_CLUSTER(3);
+    f->invoked = false;
+    f->status = -1;
+    CLUSTER_BOOTSTRAP;
+    CLUSTER_START;
+    CLUSTER_ELECT(0);
+    return f;
+}
+
+static void tear_down(void *data)
+{
+    struct fixture *f = data;
+    TEAR_DOWN_CLUSTER;
+    free(f);
+}
+
+/******************************************************************************
+ *
+ * Helper macros
+ *
+ *****************************************************************************/
+
+static void read_index_cb(struct raft_read_index *req, int status)
+{
+    struct fixture *f = req->data;
+    f->invoked = true;
+    f->status = status;
+}
+
+/* Submit a read index request and assert that it returns the given value. */
+#define READ_INDEX(I, RV)                                               \
+    {                                                                   \
+        int rv_;                                                        \
+        f->invoked = false;                                             \
+        f->req.data = f;                                                \
+        rv_ = raft_read_index(CLUSTER_RAFT(I), &f->req, read_index_cb); \
+        munit_assert_int(rv_, ==, RV);                                  \
+    }
+
+/* Step the cluster until the read index request completes. */
+#define STEP_UNTIL_READ(MAX_MSECS)                      \
+    {                                                   \
+        raft_time start_ = CLUSTER_TIME;                \
+        while (!f->invoked) {                           \
+            CLUSTER_STEP;                               \
+            munit_assert_int(CLUSTER_TIME - start_, <=, \
+                             MAX_MSECS);                \
+        }                                               \
+    }
+
+/******************************************************************************
+ *
+ * Success scenarios
+ *
+ *****************************************************************************/
+
+TEST_SUITE(success);
+TEST_SETUP(success, setup);
+TEST_TEAR_DOWN(success, tear_down);
+
+/* If the leader hasn't committed any entry in its term yet, a barrier entry is
+ * appended and the read completes once it's applied. */
+TEST_CASE(success, barrier, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    (void)params;
+    READ_INDEX(0, 0);
+    munit_assert_int(raft_last_index(raft), ==, 2);
+    munit_assert_int(f->req.index, ==, 2);
+    STEP_UNTIL_READ(1000);
+    munit_assert_int(f->status, ==, 0);
+    munit_assert_int(raft->last_applied, >=, 2);
+    return MUNIT_OK;
+}
+
+/* Once the leader has committed an entry in its term, reads don't append any
+ * entry and complete after a round of heartbeats. */
+TEST_CASE(success, no_entries, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    raft_index last_index;
+    (void)params;
+    READ_INDEX(0, 0);
+    STEP_UNTIL_READ(1000);
+    last_index = raft_last_index(raft);
+    READ_INDEX(0, 0);
+    munit_assert_int(f->req.index, ==, raft->commit_index);
+    munit_assert_false(f->invoked);
+    STEP_UNTIL_READ(1000);
+    munit_assert_int(f->status, ==, 0);
+    munit_assert_int(raft_last_index(raft), ==, last_index);
+    return MUNIT_OK;
+}
+
+/* A read can't complete if the leader can't reach a majority of the cluster. */
+TEST_CASE(success, no_quorum, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    READ_INDEX(0, 0);
+    STEP_UNTIL_READ(1000);
+    CLUSTER_SATURATE_BOTHWAYS(0, 1);
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+    READ_INDEX(0, 0);
+    CLUSTER_STEP_UNTIL_ELAPSED(100);
+    munit_assert_false(f->invoked);
+    CLUSTER_DESATURATE_BOTHWAYS(0, 1);
+    STEP_UNTIL_READ(1000);
+    munit_assert_int(f->status, ==, 0);
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * Failure scenarios
+ *
+ *****************************************************************************/
+
+TEST_SUITE(error);
+TEST_SETUP(error, setup);
+TEST_TEAR_DOWN(error, tear_down);
+
+/* If the raft instance is not in leader state, an error is returned. */
+TEST_CASE(error, not_leader, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    READ_INDEX(1, RAFT_NOTLEADER);
+    munit_assert_false(f->invoked);
+    return MUNIT_OK;
+}
+
+/* If the raft instance steps down from leader state, the read callback fires
+ * with an error. */
+TEST_CASE(error, leadership_lost, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    READ_INDEX(0, 0);
+    CLUSTER_DEPOSE;
+    munit_assert_true(f->invoked);
+    munit_assert_int(f->status, ==, RAFT_LEADERSHIPLOST);
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * Leader leases
+ *
+ *****************************************************************************/
+
+TEST_SUITE(lease);
+TEST_SETUP(lease, setup);
+TEST_TEAR_DOWN(lease, tear_down);
+
+/* Leases are disabled by default. */
+TEST_CASE(lease, disabled, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    (void)params;
+    READ_INDEX(0, 0);
+    STEP_UNTIL_READ(1000);
+    CLUSTER_STEP_UNTIL_ELAPSED(200);
+    munit_assert_false(raft_lease_valid(raft));
+    munit_assert_int(raft_read_local(raft), ==, RAFT_BUSY);
+    return MUNIT_OK;
+}
+
+/* Once a round of heartbeats is acknowledged and an entry of the current term
+ * is applied, reads can be served locally. */
+TEST_CASE(lease, read_local, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    (void)params;
+    raft_set_lease(raft, true);
+    munit_assert_false(raft_lease_valid(raft));
+    CLUSTER_STEP_UNTIL_ELAPSED(200);
+    munit_assert_true(raft_lease_valid(raft));
+
+    /* No entry of the current term was committed yet. */
+    munit_assert_int(raft_read_local(raft), ==, RAFT_BUSY);
+
+    READ_INDEX(0, 0);
+    STEP_UNTIL_READ(1000);
+    munit_assert_int(raft_read_local(raft), ==, 0);
+
+    /* The lease keeps being renewed by heartbeats. */
+    CLUSTER_STEP_UNTIL_ELAPSED(2000);
+    munit_assert_int(raft_read_local(raft), ==, 0);
+
+    return MUNIT_OK;
+}
+
+/* If the leader can't reach a majority of the cluster, its lease expires
+ * before it steps down. */
+TEST_CASE(lease, expire, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    (void)params;
+    raft_set_lease(raft, true);
+    raft_set_max_clock_drift(raft, 20);
+    CLUSTER_STEP_UNTIL_ELAPSED(200);
+    munit_assert_true(raft_lease_valid(raft));
+    CLUSTER_SATURATE_BOTHWAYS(0, 1);
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+    CLUSTER_STEP_UNTIL_ELAPSED(800);
+    munit_assert_int(CLUSTER_STATE(0), ==, RAFT_LEADER);
+    munit_assert_false(raft_lease_valid(raft));
+    munit_assert_int(raft_read_local(raft), ==, RAFT_BUSY);
+    return MUNIT_OK;
+}
+
+/* Only the leader can serve local reads. */
+TEST_CASE(lease, not_leader, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(1);
+    (void)params;
+    raft_set_lease(raft, true);
+    munit_assert_false(raft_lease_valid(raft));
+    munit_assert_int(raft_read_local(raft), ==, RAFT_NOTLEADER);
+    return MUNIT_OK;
+}
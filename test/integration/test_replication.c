@@ -1,6 +1,8 @@
 #include "../lib/cluster.h"
 #include "../lib/runner.h"
 
+#include "../../src/progress.h"
+
 TEST_MODULE(replication);
 
 /******************************************************************************
@@ -42,6 +44,13 @@ static MunitParameterEnum cluster_3_params[] = {
     {NULL, NULL},
 };
 
+static char *cluster_5[] = {"5", NULL};
+
+static MunitParameterEnum cluster_5_params[] = {
+    {"cluster-n", cluster_5},
+    {NULL, NULL},
+};
+
 /******************************************************************************
  *
  * Helper macros
@@ -298,6 +307,139 @@ TEST_CASE(send, mode, pipeline, NULL)
     return MUNIT_OK;
 }
 
+/* In pipeline mode, entries exceeding the per-message limits are streamed to
+ * the follower in successive AppendEntries windows. */
+TEST_CASE(send, mode, windows, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft;
+    struct raft_apply req;
+    struct raft_buffer bufs[5];
+    unsigned i;
+    int rv;
+    (void)params;
+    CLUSTER_BOOTSTRAP;
+    CLUSTER_START;
+
+    raft = CLUSTER_RAFT(0);
+    raft_set_max_append_entries(raft, 2);
+
+    /* Server 0 becomes leader and transitions server 1 to pipeline mode. */
+    CLUSTER_STEP_UNTIL_ELAPSED(1060);
+    ASSERT_LEADER(0);
+    munit_assert_int(CLUSTER_N_SEND(0, RAFT_IO_APPEND_ENTRIES), ==, 1);
+
+    /* Server 0 receives 5 new entries at once, and sends them immediately
+     * using 3 messages. */
+    for (i = 0; i < 5; i++) {
+        test_fsm_encode_add_x(1, &bufs[i]);
+    }
+    rv = raft_apply(raft, &req, bufs, 5, NULL);
+    munit_assert_int(rv, ==, 0);
+    munit_assert_int(raft->leader_state.progress[1].next_index, ==, 7);
+
+    CLUSTER_STEP_UNTIL_APPLIED(0, 6, 50);
+    munit_assert_int(CLUSTER_N_SEND(0, RAFT_IO_APPEND_ENTRIES), ==, 4);
+    munit_assert_int(CLUSTER_N_RECV(1, RAFT_IO_APPEND_ENTRIES), ==, 4);
+
+    CLUSTER_STEP_UNTIL_APPLIED(1, 6, 1000);
+
+    return MUNIT_OK;
+}
+
+/* In pipeline mode, no new entries are sent once the follower's in-flight
+ * window is full, and sending resumes when messages are acknowledged. */
+TEST_CASE(send, mode, inflight, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft;
+    struct raft_apply req;
+    struct raft_buffer bufs[3];
+    unsigned i;
+    int rv;
+    (void)params;
+    CLUSTER_BOOTSTRAP;
+    CLUSTER_START;
+
+    raft = CLUSTER_RAFT(0);
+    raft_set_max_append_entries(raft, 1);
+    raft_set_max_inflight(raft, 2);
+
+    /* Server 0 becomes leader and transitions server 1 to pipeline mode. */
+    CLUSTER_STEP_UNTIL_ELAPSED(1060);
+    ASSERT_LEADER(0);
+
+    /* Server 0 receives 3 new entries at once, but sends only 2 of them since
+     * the in-flight window is full. */
+    for (i = 0; i < 3; i++) {
+        test_fsm_encode_add_x(1, &bufs[i]);
+    }
+    rv = raft_apply(raft, &req, bufs, 3, NULL);
+    munit_assert_int(rv, ==, 0);
+    munit_assert_int(raft->leader_state.progress[1].next_index, ==, 4);
+    munit_assert_int(raft->leader_state.progress[1].inflight.n, ==, 2);
+
+    /* Once the follower acknowledges the first message, the last entry gets
+     * sent too. */
+    CLUSTER_STEP_UNTIL_APPLIED(0, 2, 1000);
+    munit_assert_int(raft->leader_state.progress[1].next_index, ==, 5);
+    munit_assert_int(raft->leader_state.progress[1].inflight.n, ==, 2);
+
+    CLUSTER_STEP_UNTIL_APPLIED(0, 4, 1000);
+    munit_assert_int(raft->leader_state.progress[1].inflight.n, ==, 0);
+
+    return MUNIT_OK;
+}
+
+/* In pipeline mode, if the follower is slow to acknowledge a full in-flight
+ * window, only heartbeats are sent to it and the window is not resent. */
+TEST_CASE(send, mode, inflight_heartbeat, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft;
+    struct raft_apply req;
+    struct raft_buffer bufs[3];
+    unsigned n_send;
+    unsigned i;
+    int rv;
+    (void)params;
+    CLUSTER_BOOTSTRAP;
+    CLUSTER_START;
+
+    raft = CLUSTER_RAFT(0);
+    raft_set_max_append_entries(raft, 1);
+    raft_set_max_inflight(raft, 2);
+
+    /* Server 0 becomes leader and transitions server 1 to pipeline mode. */
+    CLUSTER_STEP_UNTIL_ELAPSED(1060);
+    ASSERT_LEADER(0);
+
+    /* Server 1 takes a long time to persist entries. */
+    CLUSTER_SET_DISK_LATENCY(1, 300);
+
+    for (i = 0; i < 3; i++) {
+        test_fsm_encode_add_x(1, &bufs[i]);
+    }
+    rv = raft_apply(raft, &req, bufs, 3, NULL);
+    munit_assert_int(rv, ==, 0);
+    munit_assert_int(raft->leader_state.progress[1].inflight.n, ==, 2);
+    CLUSTER_STEP;
+    n_send = CLUSTER_N_SEND(0, RAFT_IO_APPEND_ENTRIES);
+
+    /* After a heartbeat interval without acknowledgements a heartbeat is sent,
+     * but the in-flight entries are not resent. */
+    CLUSTER_STEP_UNTIL_ELAPSED(110);
+    munit_assert_int(CLUSTER_N_SEND(0, RAFT_IO_APPEND_ENTRIES), ==, n_send + 1);
+    munit_assert_int(raft->leader_state.progress[1].state, ==,
+                     PROGRESS__PIPELINE);
+    munit_assert_int(raft->leader_state.progress[1].next_index, ==, 4);
+    munit_assert_int(raft->leader_state.progress[1].inflight.n, ==, 2);
+
+    CLUSTER_STEP_UNTIL_APPLIED(0, 4, 2000);
+
+    return MUNIT_OK;
+}
+
 TEST_GROUP(send, error);
 
 /* A follower disconnects while in probe mode. */
@@ -832,6 +974,58 @@ TEST_CASE(result, higher_term, cluster_3_params)
     return MUNIT_OK;
 }
 
+/* If the response acknowledges an index which is not yet stored on a majority,
+ * lower indexes which are get committed anyway. */
+TEST_CASE(result, commit_lower_index, cluster_5_params)
+{
+    struct fixture *f = data;
+    struct raft_apply *req1 = munit_malloc(sizeof *req1);
+    struct raft_apply *req2 = munit_malloc(sizeof *req2);
+    struct raft_apply *req3 = munit_malloc(sizeof *req3);
+    (void)params;
+    BOOTSTRAP_START_AND_ELECT;
+
+    /* Servers 3 and 4 never receive any entry. */
+    CLUSTER_SATURATE_BOTHWAYS(0, 3);
+    CLUSTER_SATURATE_BOTHWAYS(0, 4);
+
+    /* The first entry gets replicated to server 1, but not to server 2. */
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+    CLUSTER_APPLY_ADD_X(0, req1, 1, NULL);
+    CLUSTER_STEP_UNTIL_ELAPSED(150);
+    munit_assert_int(CLUSTER_RAFT(0)->leader_state.progress[1].match_index, ==,
+                     req1->index);
+
+    /* The second entry gets persisted only by the leader. */
+    CLUSTER_SATURATE_BOTHWAYS(0, 1);
+    CLUSTER_APPLY_ADD_X(0, req2, 1, NULL);
+    CLUSTER_STEP_UNTIL_ELAPSED(20);
+    munit_assert_int(CLUSTER_RAFT(0)->last_stored, ==, req2->index);
+
+    /* Set a high disk latency on the leader, so it will take a while to
+     * persist the third entry. */
+    CLUSTER_SET_DISK_LATENCY(0, 1000);
+    CLUSTER_APPLY_ADD_X(0, req3, 1, NULL);
+
+    /* Server 2 receives and acknowledges all entries at once. Neither its last
+     * index nor the leader's one are stored on a majority, but the first
+     * entry is, so it gets committed. */
+    CLUSTER_DESATURATE_BOTHWAYS(0, 2);
+    CLUSTER_STEP_UNTIL_APPLIED(0, req1->index, 500);
+    munit_assert_int(CLUSTER_RAFT(0)->commit_index, ==, req1->index);
+    munit_assert_int(CLUSTER_RAFT(0)->last_stored, ==, req2->index);
+
+    /* Eventually the other entries get committed too. */
+    CLUSTER_DESATURATE_BOTHWAYS(0, 1);
+    CLUSTER_STEP_UNTIL_APPLIED(0, req3->index, 2000);
+
+    free(req1);
+    free(req2);
+    free(req3);
+
+    return MUNIT_OK;
+}
+
 /* If the response fails because a log mismatch, the nextIndex for the server is
  * updated and the relevant older entries are resent. */
 TEST_CASE(result, retry, NULL)
@@ -858,3 +1052,76 @@ TEST_CASE(result, retry, NULL)
 
     return MUNIT_OK;
 }
+
+/******************************************************************************
+ *
+ * Bounded in-memory log
+ *
+ *****************************************************************************/
+
+TEST_SUITE(evict);
+TEST_SETUP(evict, setup);
+TEST_TEAR_DOWN(evict, tear_down);
+
+/* If the payloads of the entries that a follower is missing were evicted from
+ * memory, the leader reads them back from disk before sending them. */
+TEST_CASE(evict, read_entries, cluster_3_params)
+{
+    struct fixture *f = data;
+    struct raft_apply reqs[5];
+    unsigned i;
+    (void)params;
+    BOOTSTRAP_START_AND_ELECT;
+    raft_set_max_log_bytes(CLUSTER_RAFT(0), 16);
+
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+    for (i = 0; i < 5; i++) {
+        CLUSTER_APPLY_ADD_X(0, &reqs[i], 1, NULL);
+    }
+    CLUSTER_STEP_UNTIL_APPLIED(0, 6, 2000);
+    munit_assert_int(CLUSTER_RAFT(0)->log.evicted, >=, 4);
+
+    /* The follower catches up with the evicted entries. */
+    CLUSTER_DESATURATE_BOTHWAYS(0, 2);
+    CLUSTER_STEP_UNTIL_APPLIED(2, 6, 2000);
+    munit_assert_int(test_fsm_get_x(CLUSTER_FSM(2)), ==, 5);
+
+    return MUNIT_OK;
+}
+
+/* While the entries that a follower is missing are read back from disk, the
+ * leader keeps sending it heartbeats, so it doesn't start an election. */
+TEST_CASE(evict, read_entries_heartbeat, cluster_3_params)
+{
+    struct fixture *f = data;
+    struct raft_apply reqs[5];
+    unsigned n_recv;
+    unsigned i;
+    (void)params;
+    BOOTSTRAP_START_AND_ELECT;
+    raft_set_max_log_bytes(CLUSTER_RAFT(0), 16);
+
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+    for (i = 0; i < 5; i++) {
+        CLUSTER_APPLY_ADD_X(0, &reqs[i], 1, NULL);
+    }
+    CLUSTER_STEP_UNTIL_APPLIED(0, 6, 2000);
+    munit_assert_int(CLUSTER_RAFT(0)->log.evicted, >=, 4);
+
+    /* Reading the entries takes longer than the election timeout. */
+    CLUSTER_SET_DISK_LATENCY(0, 1500);
+    CLUSTER_DESATURATE_BOTHWAYS(0, 2);
+    CLUSTER_STEP_UNTIL_ELAPSED(150);
+    munit_assert_true(CLUSTER_RAFT(0)->leader_state.progress[2].fetching);
+    n_recv = CLUSTER_N_RECV(2, RAFT_IO_APPEND_ENTRIES);
+
+    CLUSTER_STEP_UNTIL_ELAPSED(1000);
+    munit_assert_true(CLUSTER_RAFT(0)->leader_state.progress[2].fetching);
+    munit_assert_int(CLUSTER_N_RECV(2, RAFT_IO_APPEND_ENTRIES), >, n_recv);
+    munit_assert_int(CLUSTER_STATE(2), ==, RAFT_FOLLOWER);
+
+    CLUSTER_STEP_UNTIL_APPLIED(2, 6, 3000);
+    munit_assert_int(test_fsm_get_x(CLUSTER_FSM(2)), ==, 5);
+
+    return MUNIT_OK;
+}
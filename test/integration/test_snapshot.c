@@ -89,3 +89,121 @@ TEST_CASE(install, one, NULL)
 
     return MUNIT_OK;
 }
+
+/* Install a snapshot sent in several chunks. */
+TEST_CASE(install, chunks, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+
+    SET_SNAPSHOT_THRESHOLD(3);
+    SET_SNAPSHOT_TRAILING(1);
+    raft_set_snapshot_chunk_size(CLUSTER_RAFT(0), 4);
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+
+    CLUSTER_MAKE_PROGRESS;
+    CLUSTER_MAKE_PROGRESS;
+    CLUSTER_MAKE_PROGRESS;
+
+    /* The test FSM snapshot is 16 bytes long. */
+    CLUSTER_DESATURATE_BOTHWAYS(0, 2);
+    CLUSTER_STEP_UNTIL_APPLIED(2, 4, 5000);
+    munit_assert_int(CLUSTER_N_RECV(2, RAFT_IO_INSTALL_SNAPSHOT), ==, 4);
+    munit_assert_int(test_fsm_get_x(CLUSTER_FSM(2)), ==, 3);
+
+    return MUNIT_OK;
+}
+
+/* If sending a chunk fails, the transfer later resumes from that chunk. */
+TEST_CASE(install, resume, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+
+    SET_SNAPSHOT_THRESHOLD(3);
+    SET_SNAPSHOT_TRAILING(1);
+    raft_set_snapshot_chunk_size(CLUSTER_RAFT(0), 4);
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+
+    CLUSTER_MAKE_PROGRESS;
+    CLUSTER_MAKE_PROGRESS;
+    CLUSTER_MAKE_PROGRESS;
+
+    /* Fail the submission of the third chunk. */
+    CLUSTER_DESATURATE_BOTHWAYS(0, 2);
+    while (CLUSTER_N_SEND(0, RAFT_IO_INSTALL_SNAPSHOT) < 1) {
+        CLUSTER_STEP;
+    }
+    CLUSTER_IO_FAULT(0, 0, 1);
+
+    CLUSTER_STEP_UNTIL_APPLIED(2, 4, 5000);
+    munit_assert_int(CLUSTER_N_SEND(0, RAFT_IO_INSTALL_SNAPSHOT), ==, 4);
+    munit_assert_int(CLUSTER_N_RECV(2, RAFT_IO_INSTALL_SNAPSHOT), ==, 4);
+    munit_assert_int(test_fsm_get_x(CLUSTER_FSM(2)), ==, 3);
+
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * Take a snapshot asynchronously
+ *
+ *****************************************************************************/
+
+TEST_SUITE(async);
+
+TEST_SETUP(async, setup);
+TEST_TEAR_DOWN(async, tear_down);
+
+/* Entries keep being applied while the FSM takes a snapshot, and the log is
+ * truncated at the snapshot index once it's stored. */
+TEST_CASE(async, apply_while_taking, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    (void)params;
+
+    test_fsm_enable_async_snapshot(CLUSTER_FSM(0));
+    SET_SNAPSHOT_THRESHOLD(3);
+    SET_SNAPSHOT_TRAILING(1);
+
+    CLUSTER_MAKE_PROGRESS;
+    CLUSTER_MAKE_PROGRESS;
+    munit_assert_true(test_fsm_snapshot_pending(CLUSTER_FSM(0)));
+    munit_assert_int(raft->snapshot.pending.index, ==, 3);
+
+    CLUSTER_MAKE_PROGRESS;
+    CLUSTER_MAKE_PROGRESS;
+    munit_assert_int(raft->last_applied, ==, 5);
+    munit_assert_int(raft->log.snapshot.last_index, ==, 0);
+
+    test_fsm_complete_snapshot(CLUSTER_FSM(0));
+    CLUSTER_STEP_UNTIL_ELAPSED(100);
+    munit_assert_int(raft->log.snapshot.last_index, ==, 3);
+    munit_assert_int(raft->snapshot.pending.term, ==, 0);
+
+    return MUNIT_OK;
+}
+
+/* A follower that has fallen behind can install a snapshot taken
+ * asynchronously. */
+TEST_CASE(async, install, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+
+    test_fsm_enable_async_snapshot(CLUSTER_FSM(0));
+    SET_SNAPSHOT_THRESHOLD(3);
+    SET_SNAPSHOT_TRAILING(1);
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+
+    CLUSTER_MAKE_PROGRESS;
+    CLUSTER_MAKE_PROGRESS;
+    CLUSTER_MAKE_PROGRESS;
+    test_fsm_complete_snapshot(CLUSTER_FSM(0));
+
+    CLUSTER_DESATURATE_BOTHWAYS(0, 2);
+    CLUSTER_STEP_UNTIL_APPLIED(2, 4, 5000);
+
+    return MUNIT_OK;
+}
@@ -0,0 +1,227 @@
+#include "../lib/cluster.h"
+#include "../lib/runner.h"
+
+TEST_MODULE(transfer);
+
+/******************************************************************************
+ *
+ * Fixture
+ *
+ *****************************************************************************/
+
+struct fixture
+{
+    FIXTURE_CLUSTER;
+    struct raft_transfer req;
+    bool invoked;
+    int status;
+};
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+    struct fixture *f = munit_malloc(sizeof *f);
+    (void)user_data;
+    SETUP_CLUSTER(3);
+    f->invoked = false;
+    f->status = -1;
+    CLUSTER_BOOTSTRAP;
+    CLUSTER_START;
+    CLUSTER_ELECT(0);
+    return f;
+}
+
+static void tear_down(void *data)
+{
+    struct fixture *f = data;
+    TEAR_DOWN_CLUSTER;
+    free(f);
+}
+
+/******************************************************************************
+ *
+ * Helper macros
+ *
+ *****************************************************************************/
+
+static void transfer_cb(struct raft_transfer *req, int status)
+{
+    struct fixture *f = req->data;
+    f->invoked = true;
+    f->status = status;
+}
+
+/* Submit a transfer request to the given server and assert that it returns the
+ * given value. */
+#define TRANSFER(I, ID, RV)                                             \
+    {                                                                   \
+        int rv_;                                                        \
+        f->invoked = false;                                             \
+        f->req.data = f;                                                \
+        rv_ = raft_transfer(CLUSTER_RAFT(I), &f->req, ID, transfer_cb); \
+        munit_assert_int(rv_, ==, RV);                                  \
+    }
+
+/* Step the cluster until the transfer request completes. */
+#define STEP_UNTIL_TRANSFERRED(MAX_MSECS)               \
+    {                                                   \
+        raft_time start_ = CLUSTER_TIME;                \
+        while (!f->invoked) {                           \
+            CLUSTER_STEP;                               \
+            munit_assert_int(CLUSTER_TIME - start_, <=, \
+                             MAX_MSECS);                \
+        }                                               \
+    }
+
+/******************************************************************************
+ *
+ * Success scenarios
+ *
+ *****************************************************************************/
+
+TEST_SUITE(success);
+TEST_SETUP(success, setup);
+TEST_TEAR_DOWN(success, tear_down);
+
+/* Transfer leadership to an up-to-date follower, which gets elected without
+ * waiting for its election timeout. */
+TEST_CASE(success, up_to_date, NULL)
+{
+    struct fixture *f = data;
+    raft_time start = CLUSTER_TIME;
+    (void)params;
+    CLUSTER_MAKE_PROGRESS;
+    TRANSFER(0, 2, 0);
+    munit_assert_true(f->req.sent);
+    STEP_UNTIL_TRANSFERRED(1000);
+    munit_assert_int(f->status, ==, 0);
+    CLUSTER_STEP_UNTIL_STATE_IS(1, RAFT_LEADER, 1000);
+    munit_assert_int(CLUSTER_TIME - start, <,
+                     CLUSTER_RAFT(1)->election_timeout);
+    munit_assert_int(CLUSTER_N_SEND(0, RAFT_IO_TIMEOUT_NOW), ==, 1);
+    return MUNIT_OK;
+}
+
+/* If the target server is missing entries, they are sent before TimeoutNow. */
+TEST_CASE(success, catch_up, NULL)
+{
+    struct fixture *f = data;
+    struct raft_apply req;
+    (void)params;
+    CLUSTER_SATURATE_BOTHWAYS(0, 2);
+    CLUSTER_APPLY_ADD_X(0, &req, 1, NULL);
+    CLUSTER_STEP_UNTIL_APPLIED(0, 2, 1000);
+    CLUSTER_DESATURATE_BOTHWAYS(0, 2);
+    TRANSFER(0, 3, 0);
+    munit_assert_false(f->req.sent);
+    CLUSTER_STEP_UNTIL_STATE_IS(2, RAFT_LEADER, 1000);
+    munit_assert_true(f->invoked);
+    munit_assert_int(f->status, ==, 0);
+    munit_assert_int(raft_last_index(CLUSTER_RAFT(2)), >=, 2);
+    return MUNIT_OK;
+}
+
+/* If no ID is given, the most up-to-date voting server is picked. */
+TEST_CASE(success, pick_target, NULL)
+{
+    struct fixture *f = data;
+    struct raft_apply req;
+    (void)params;
+    CLUSTER_SATURATE_BOTHWAYS(0, 1);
+    CLUSTER_APPLY_ADD_X(0, &req, 1, NULL);
+    CLUSTER_STEP_UNTIL_APPLIED(0, 2, 1000);
+    TRANSFER(0, 0, 0);
+    munit_assert_int(f->req.id, ==, 3);
+    CLUSTER_STEP_UNTIL_STATE_IS(2, RAFT_LEADER, 1000);
+    munit_assert_int(f->status, ==, 0);
+    return MUNIT_OK;
+}
+
+/* New entries are refused while the transfer is in progress. */
+TEST_CASE(success, no_new_entries, NULL)
+{
+    struct fixture *f = data;
+    struct raft_barrier barrier;
+    (void)params;
+    CLUSTER_SATURATE_BOTHWAYS(0, 1);
+    TRANSFER(0, 2, 0);
+    munit_assert_int(raft_barrier(CLUSTER_RAFT(0), &barrier, NULL), ==,
+                     RAFT_NOTLEADER);
+    return MUNIT_OK;
+}
+
+/* Once TimeoutNow is sent, the leader lease can't be used anymore. */
+TEST_CASE(success, revoke_lease, NULL)
+{
+    struct fixture *f = data;
+    struct raft *raft = CLUSTER_RAFT(0);
+    (void)params;
+    raft_set_lease(raft, true);
+    CLUSTER_STEP_UNTIL_ELAPSED(200);
+    munit_assert_true(raft_lease_valid(raft));
+    TRANSFER(0, 2, 0);
+    munit_assert_false(raft_lease_valid(raft));
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * Failure scenarios
+ *
+ *****************************************************************************/
+
+TEST_SUITE(error);
+TEST_SETUP(error, setup);
+TEST_TEAR_DOWN(error, tear_down);
+
+/* If the raft instance is not in leader state, an error is returned. */
+TEST_CASE(error, not_leader, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    TRANSFER(1, 3, RAFT_NOTLEADER);
+    munit_assert_false(f->invoked);
+    return MUNIT_OK;
+}
+
+/* The target must be a voting server other than the leader itself. */
+TEST_CASE(error, bad_id, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    TRANSFER(0, 1, RAFT_BADID);
+    TRANSFER(0, 4, RAFT_BADID);
+    munit_assert_ptr_null(CLUSTER_RAFT(0)->leader_state.transfer);
+    return MUNIT_OK;
+}
+
+/* Only one transfer can be in progress at a time. */
+TEST_CASE(error, busy, NULL)
+{
+    struct fixture *f = data;
+    struct raft_transfer req;
+    int rv;
+    (void)params;
+    CLUSTER_SATURATE_BOTHWAYS(0, 1);
+    TRANSFER(0, 2, 0);
+    rv = raft_transfer(CLUSTER_RAFT(0), &req, 3, NULL);
+    munit_assert_int(rv, ==, RAFT_BUSY);
+    return MUNIT_OK;
+}
+
+/* If the target server can't be reached, the transfer is canceled after an
+ * election timeout and new entries are accepted again. */
+TEST_CASE(error, timeout, NULL)
+{
+    struct fixture *f = data;
+    struct raft_apply req;
+    (void)params;
+    CLUSTER_SATURATE_BOTHWAYS(0, 1);
+    CLUSTER_APPLY_ADD_X(0, &req, 1, NULL);
+    CLUSTER_STEP_UNTIL_APPLIED(0, 2, 1000);
+    TRANSFER(0, 2, 0);
+    STEP_UNTIL_TRANSFERRED(2000);
+    munit_assert_int(f->status, ==, RAFT_CANCELED);
+    munit_assert_int(CLUSTER_STATE(0), ==, RAFT_LEADER);
+    CLUSTER_APPLY_ADD_X(0, &req, 1, NULL);
+    return MUNIT_OK;
+}
@@ -342,6 +342,18 @@
 #define CLUSTER_SET_DISK_LATENCY(I, MSECS) \
     raft_fixture_set_disk_latency(&f->cluster, I, MSECS)
 
+/* Enable or disable deferred flushing of new entries on server I. */
+#define CLUSTER_SET_FLUSH(I, ENABLED) \
+    raft_fixture_set_flush(&f->cluster, I, ENABLED)
+
+/* Enable or disable applying committed entries off the event loop thread on
+ * server I. */
+#define CLUSTER_SET_ASYNC_APPLY(I, ENABLED)                   \
+    {                                                         \
+        raft_fixture_set_async_work(&f->cluster, I, ENABLED); \
+        raft_set_async_apply(CLUSTER_RAFT(I), ENABLED);       \
+    }
+
 /* Set the term persisted on the I'th server. This must be called before
  * starting the cluster. */
 #define CLUSTER_SET_TERM(I, TERM) raft_fixture_set_term(&f->cluster, I, TERM)
@@ -8,6 +8,14 @@ struct test_fsm
 {
     int x;
     int y;
+    unsigned n_batches; /* Number of apply_batch() invocations */
+    struct              /* Pending snapshot_async() invocation */
+    {
+        struct raft_fsm_snapshot *req;
+        raft_fsm_snapshot_cb cb;
+        int x;
+        int y;
+    } snapshot;
 };
 
 /* Command codes */
@@ -50,6 +58,27 @@ static int test_fsm__apply(struct raft_fsm *fsm,
     return 0;
 }
 
+static int test_fsm__apply_batch(struct raft_fsm *fsm,
+                                 const struct raft_buffer bufs[],
+                                 unsigned n,
+                                 void *results[])
+{
+    struct test_fsm *t = fsm->data;
+    unsigned i;
+    int rv;
+
+    for (i = 0; i < n; i++) {
+        rv = test_fsm__apply(fsm, &bufs[i], &results[i]);
+        if (rv != 0) {
+            return rv;
+        }
+    }
+
+    t->n_batches++;
+
+    return 0;
+}
+
 static int test_fsm__restore(struct raft_fsm *fsm, struct raft_buffer *buf)
 {
     struct test_fsm *t = fsm->data;
@@ -103,6 +132,19 @@ static int test_fsm__snapshot(struct raft_fsm *fsm,
     return encode_snapshot(t->x, t->y, bufs, n_bufs);
 }
 
+static int test_fsm__snapshot_async(struct raft_fsm *fsm,
+                                    struct raft_fsm_snapshot *req,
+                                    raft_fsm_snapshot_cb cb)
+{
+    struct test_fsm *t = fsm->data;
+    munit_assert_ptr_null(t->snapshot.req);
+    t->snapshot.req = req;
+    t->snapshot.cb = cb;
+    t->snapshot.x = t->x;
+    t->snapshot.y = t->y;
+    return 0;
+}
+
 void test_fsm_setup(const MunitParameter params[], struct raft_fsm *fsm)
 {
     struct test_fsm *t = munit_malloc(sizeof *fsm);
@@ -111,12 +153,46 @@ void test_fsm_setup(const MunitParameter params[], struct raft_fsm *fsm)
 
     t->x = 0;
     t->y = 0;
+    t->n_batches = 0;
+    t->snapshot.req = NULL;
 
-    fsm->version = 1;
+    fsm->version = 2;
     fsm->data = t;
     fsm->apply = test_fsm__apply;
     fsm->snapshot = test_fsm__snapshot;
     fsm->restore = test_fsm__restore;
+    fsm->apply_batch = NULL;
+    fsm->snapshot_async = NULL;
+}
+
+void test_fsm_enable_batch(struct raft_fsm *fsm)
+{
+    fsm->apply_batch = test_fsm__apply_batch;
+}
+
+void test_fsm_enable_async_snapshot(struct raft_fsm *fsm)
+{
+    fsm->snapshot_async = test_fsm__snapshot_async;
+}
+
+bool test_fsm_snapshot_pending(struct raft_fsm *fsm)
+{
+    struct test_fsm *t = fsm->data;
+    return t->snapshot.req != NULL;
+}
+
+void test_fsm_complete_snapshot(struct raft_fsm *fsm)
+{
+    struct test_fsm *t = fsm->data;
+    struct raft_fsm_snapshot *req = t->snapshot.req;
+    int rv;
+
+    munit_assert_ptr_not_null(req);
+    t->snapshot.req = NULL;
+    rv = encode_snapshot(t->snapshot.x, t->snapshot.y, &req->bufs,
+                         &req->n_bufs);
+    munit_assert_int(rv, ==, 0);
+    t->snapshot.cb(req, 0);
 }
 
 void test_fsm_tear_down(struct raft_fsm *fsm)
@@ -202,3 +278,9 @@ void test_fsm_set_y(struct raft_fsm *fsm, int value)
     struct test_fsm *t = fsm->data;
     t->y = value;
 }
+
+unsigned test_fsm_n_batches(struct raft_fsm *fsm)
+{
+    struct test_fsm *t = fsm->data;
+    return t->n_batches;
+}
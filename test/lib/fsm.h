@@ -15,6 +15,28 @@ void test_fsm_setup(const MunitParameter params[], struct raft_fsm *fsm);
 
 void test_fsm_tear_down(struct raft_fsm *fsm);
 
+/**
+ * Make the FSM implement apply_batch(), which is disabled by default.
+ */
+void test_fsm_enable_batch(struct raft_fsm *fsm);
+
+/**
+ * Make the FSM implement snapshot_async(), which is disabled by default. The
+ * state is captured when snapshot_async() is invoked, and the snapshot
+ * completes only when test_fsm_complete_snapshot() is called.
+ */
+void test_fsm_enable_async_snapshot(struct raft_fsm *fsm);
+
+/**
+ * Return true if a snapshot_async() call is waiting to be completed.
+ */
+bool test_fsm_snapshot_pending(struct raft_fsm *fsm);
+
+/**
+ * Complete the pending snapshot_async() call.
+ */
+void test_fsm_complete_snapshot(struct raft_fsm *fsm);
+
 /**
  * Encode a command to set x to the given value.
  */
@@ -49,4 +71,9 @@ int test_fsm_get_y(struct raft_fsm *fsm);
 void test_fsm_set_x(struct raft_fsm *fsm, int value);
 void test_fsm_set_y(struct raft_fsm *fsm, int value);
 
+/**
+ * Return the number of times apply_batch() has been invoked.
+ */
+unsigned test_fsm_n_batches(struct raft_fsm *fsm);
+
 #endif /* TEST_FSM_H */
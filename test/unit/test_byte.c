@@ -31,6 +31,17 @@ TEST_CASE(crc32, valid, NULL)
     return MUNIT_OK;
 }
 
+/* The checksum of the standard check input matches the one computed one byte
+ * at a time by earlier versions, so existing data stays readable. */
+TEST_CASE(crc32, check, NULL)
+{
+    const char *input = "123456789";
+    (void)data;
+    (void)params;
+    munit_assert_int(byteCrc32(input, strlen(input), 0), ==, 0x89a1897f);
+    return MUNIT_OK;
+}
+
 /* Different data produces a different sum. */
 TEST_CASE(crc32, invalid, NULL)
 {
@@ -42,6 +53,66 @@ TEST_CASE(crc32, invalid, NULL)
     return MUNIT_OK;
 }
 
+/******************************************************************************
+ *
+ * byteCrc32c
+ *
+ *****************************************************************************/
+
+TEST_SUITE(crc32c);
+
+/* The checksum of the standard check input has the expected value. */
+TEST_CASE(crc32c, check, NULL)
+{
+    const char *input = "123456789";
+    (void)data;
+    (void)params;
+    munit_assert_int(byteCrc32c(input, strlen(input), 0), ==, 0xe3069283);
+    return MUNIT_OK;
+}
+
+/* The checksum of several buffers can be calculated incrementally. */
+TEST_CASE(crc32c, incremental, NULL)
+{
+    uint8_t buf[100];
+    unsigned crc;
+    size_t i;
+    (void)data;
+    (void)params;
+    for (i = 0; i < sizeof buf; i++) {
+        buf[i] = (uint8_t)(i * 7);
+    }
+    for (i = 0; i < sizeof buf; i++) {
+        crc = byteCrc32c(buf, i, 0);
+        crc = byteCrc32c(buf + i, sizeof buf - i, crc);
+        munit_assert_int(crc, ==, byteCrc32c(buf, sizeof buf, 0));
+    }
+    return MUNIT_OK;
+}
+
+/* Copying and checksumming at the same time is the same as doing it in two
+ * steps, regardless of the alignment of the buffers. */
+TEST_CASE(crc32c, copy, NULL)
+{
+    uint8_t src[100];
+    uint8_t dst[100];
+    size_t i;
+    (void)data;
+    (void)params;
+    for (i = 0; i < sizeof src; i++) {
+        src[i] = (uint8_t)(i * 13);
+    }
+    for (i = 0; i < 8; i++) {
+        size_t n = sizeof src - 8;
+        unsigned crc;
+        memset(dst, 0, sizeof dst);
+        crc = byteCrc32cCopy(dst + i, src + 8 - i, n, 0);
+        munit_assert_int(crc, ==, byteCrc32c(src + 8 - i, n, 0));
+        munit_assert_int(memcmp(dst + i, src + 8 - i, n), ==, 0);
+    }
+    return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * Convert to little endian representation (least significant byte first).
@@ -107,6 +107,14 @@ static void tear_down(void *data)
         munit_assert_int(rv2, ==, 0);                   \
     }
 
+#define ACQUIRE_AT_MOST(INDEX, MAX_N, MAX_BYTES)                           \
+    {                                                                      \
+        int rv2;                                                           \
+        rv2 = logAcquireAtMost(&f->log, INDEX, MAX_N, MAX_BYTES, &entries, \
+                               &n);                                        \
+        munit_assert_int(rv2, ==, 0);                                      \
+    }
+
 #define RELEASE(INDEX) logRelease(&f->log, INDEX, entries, n);
 
 #define TRUNCATE(N) logTruncate(&f->log, N)
@@ -143,21 +151,19 @@ static void tear_down(void *data)
     }
 
 /* Assert that the number of outstanding references for the entry at INDEX
- * equals COUNT. */
-#define ASSERT_REFCOUNT(INDEX, COUNT)                                 \
-    {                                                                 \
-        size_t i;                                                     \
-        munit_assert_ptr_not_null(f->log.refs);                       \
-        for (i = 0; i < f->log.refs_size; i++) {                      \
-            if (f->log.refs[i].index == INDEX) {                      \
-                munit_assert_int(f->log.refs[i].count, ==, COUNT);    \
-                break;                                                \
-            }                                                         \
-        }                                                             \
-        if (i == f->log.refs_size) {                                  \
-            munit_errorf("no refcount found for entry with index %d", \
-                         (int)INDEX);                                 \
-        }                                                             \
+ * equals COUNT, counting the log itself and each acquired range containing the
+ * entry. */
+#define ASSERT_REFCOUNT(INDEX, COUNT)                                    \
+    {                                                                    \
+        unsigned count_ = logGet(&f->log, INDEX) != NULL ? 1 : 0;        \
+        size_t i_;                                                       \
+        for (i_ = 0; i_ < f->log.refs_size; i_++) {                      \
+            const struct raft_entry_ref *ref_ = &f->log.refs[i_];        \
+            if (INDEX >= ref_->index && INDEX < ref_->index + ref_->n) { \
+                count_++;                                                \
+            }                                                            \
+        }                                                                \
+        munit_assert_int(count_, ==, COUNT);                             \
     }
 
 /******************************************************************************
@@ -556,8 +562,8 @@ TEST_CASE(append, three, NULL)
     return MUNIT_OK;
 }
 
-/* Append enough entries to force the reference count hash table to be
- * resized. */
+/* Append many entries, forcing the log to be grown several times. Appending
+ * doesn't register any reference. */
 TEST_CASE(append, many, NULL)
 {
     struct fixture *f = data;
@@ -566,7 +572,8 @@ TEST_CASE(append, many, NULL)
     for (i = 0; i < 3000; i++) {
         APPEND(1 /* term */);
     }
-    munit_assert_int(f->log.refs_size, ==, 4096);
+    munit_assert_int(NUM_ENTRIES, ==, 3000);
+    munit_assert_int(f->log.refs_size, ==, 0);
     return MUNIT_OK;
 }
 
@@ -634,7 +641,7 @@ TEST_CASE(append, batch, NULL)
 
 TEST_GROUP(append, error);
 
-static char *append_oom_heap_fault_delay[] = {"0", "1", NULL};
+static char *append_oom_heap_fault_delay[] = {"0", NULL};
 static char *append_oom_heap_fault_repeat[] = {"1", NULL};
 
 static MunitParameterEnum append_oom_params[] = {
@@ -658,15 +665,48 @@ TEST_CASE(append, error, oom, append_oom_params)
     return MUNIT_OK;
 }
 
-/* Out of memory when trying to grow the refs count table. */
-TEST_CASE(append, error, oom_refs, NULL)
+/* Out of memory when allocating the batch reference count table. */
+TEST_CASE(append, error, oom_batch, NULL)
 {
     struct fixture *f = data;
+    struct raft_buffer buf;
+    void *batch;
+    int rv;
     (void)params;
-    APPEND_MANY(1, LOG__REFS_INITIAL_SIZE);
+    batch = raft_malloc(8);
+    buf.base = batch;
+    buf.len = 8;
     test_heap_fault_config(&f->heap, 1, 1);
     test_heap_fault_enable(&f->heap);
-    APPEND_ERROR(1, RAFT_NOMEM);
+    rv = logAppend(&f->log, 1, RAFT_COMMAND, &buf, batch);
+    munit_assert_int(rv, ==, RAFT_NOMEM);
+    munit_assert_int(NUM_ENTRIES, ==, 0);
+    raft_free(batch);
+    return MUNIT_OK;
+}
+
+/* Append entries from many batches, forcing the batch reference count table to
+ * be grown several times. */
+TEST_CASE(append, many_batches, NULL)
+{
+    struct fixture *f = data;
+    int i;
+    (void)params;
+    for (i = 0; i < 100; i++) {
+        APPEND_BATCH(2 /* n entries */);
+    }
+    munit_assert_int(f->log.n_batches, ==, 100);
+    munit_assert_int(f->log.batches_size, ==, 256);
+
+    /* Delete the batches in a different order than the insertion one. */
+    SNAPSHOT(100 /* last index */, 0 /* trailing */);
+    munit_assert_int(f->log.n_batches, ==, 50);
+    TRUNCATE(151 /* index */);
+    munit_assert_int(f->log.n_batches, ==, 25);
+    for (i = 101; i <= 150; i += 2) {
+        munit_assert_int(*(uint64_t *)GET(i)->buf.base, ==, 0);
+        munit_assert_int(*(uint64_t *)GET(i + 1)->buf.base, ==, 1000);
+    }
     return MUNIT_OK;
 }
 
@@ -880,6 +920,251 @@ TEST_CASE(acquire, error, oom, NULL)
     return MUNIT_OK;
 }
 
+/* Out of memory when registering the acquired range. */
+TEST_CASE(acquire, error, oom_refs, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entries;
+    unsigned n;
+    int rv;
+    (void)params;
+
+    APPEND(1 /* term */);
+
+    test_heap_fault_config(&f->heap, 1, 1);
+    test_heap_fault_enable(&f->heap);
+
+    rv = logAcquire(&f->log, 1, &entries, &n);
+    munit_assert_int(rv, ==, RAFT_NOMEM);
+    ASSERT_REFCOUNT(1 /* index */, 1 /* count */);
+
+    return MUNIT_OK;
+}
+
+/* Acquire the same entries several times, growing the array of acquired
+ * ranges, and release them in a different order. */
+TEST_CASE(acquire, many, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *acquired[5];
+    unsigned n;
+    int i;
+    int rv;
+    (void)params;
+
+    APPEND_MANY(1 /* term */, 3 /* n */);
+
+    for (i = 0; i < 5; i++) {
+        rv = logAcquire(&f->log, 1, &acquired[i], &n);
+        munit_assert_int(rv, ==, 0);
+        munit_assert_int(n, ==, 3);
+    }
+    ASSERT_REFCOUNT(2 /* index */, 6 /* count */);
+
+    /* Truncate the log, so the entries are released along with the last
+     * acquired range. */
+    TRUNCATE(1 /* index */);
+    ASSERT_REFCOUNT(2 /* index */, 5 /* count */);
+
+    for (i = 0; i < 5; i++) {
+        logRelease(&f->log, 1, acquired[(i + 2) % 5], 3);
+    }
+    ASSERT_REFCOUNT(2 /* index */, 0 /* count */);
+    munit_assert_ptr_null(f->log.refs);
+
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * logAcquireAtMost
+ *
+ *****************************************************************************/
+
+TEST_SUITE(acquire_at_most);
+
+TEST_SETUP(acquire_at_most, setup);
+TEST_TEAR_DOWN(acquire_at_most, tear_down);
+
+/* The number of acquired entries is capped. */
+TEST_CASE(acquire_at_most, max_n, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entries;
+    unsigned n;
+    (void)params;
+    APPEND_MANY(1 /* term */, 5 /* n */);
+    ACQUIRE_AT_MOST(2 /* index */, 3 /* max n */, 1024 /* max bytes */);
+    munit_assert_int(n, ==, 3);
+    ASSERT_REFCOUNT(4 /* index */, 2 /* count */);
+    ASSERT_REFCOUNT(5 /* index */, 1 /* count */);
+    RELEASE(2 /* index */);
+    return MUNIT_OK;
+}
+
+/* Acquisition stops before the total payload size exceeds the limit. */
+TEST_CASE(acquire_at_most, max_bytes, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entries;
+    unsigned n;
+    (void)params;
+    APPEND_MANY(1 /* term */, 5 /* n */);
+    ACQUIRE_AT_MOST(1 /* index */, 10 /* max n */, 20 /* max bytes */);
+    munit_assert_int(n, ==, 2);
+    RELEASE(1 /* index */);
+    return MUNIT_OK;
+}
+
+/* The first entry is acquired even if it alone exceeds the bytes limit. */
+TEST_CASE(acquire_at_most, too_big, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entries;
+    unsigned n;
+    (void)params;
+    APPEND_MANY(1 /* term */, 2 /* n */);
+    ACQUIRE_AT_MOST(1 /* index */, 10 /* max n */, 4 /* max bytes */);
+    munit_assert_int(n, ==, 1);
+    RELEASE(1 /* index */);
+    return MUNIT_OK;
+}
+
+/* Acquire a capped number of entries in a wrapped log. */
+TEST_CASE(acquire_at_most, wrap, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entries;
+    unsigned n;
+    (void)params;
+    APPEND_MANY(1 /* term */, 5 /* n */);
+    SNAPSHOT(4 /* last index */, 0 /* trailing */);
+    APPEND_MANY(1 /* term */, 3 /* n */);
+    /* Now the log is [e7, e8, NULL, NULL, e5, e6] */
+    ACQUIRE_AT_MOST(5 /* index */, 3 /* max n */, 1024 /* max bytes */);
+    munit_assert_int(n, ==, 3);
+    ASSERT_REFCOUNT(7 /* index */, 2 /* count */);
+    ASSERT_REFCOUNT(8 /* index */, 1 /* count */);
+    RELEASE(5 /* index */);
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * logEvict
+ *
+ *****************************************************************************/
+
+TEST_SUITE(evict);
+
+TEST_SETUP(evict, setup);
+TEST_TEAR_DOWN(evict, tear_down);
+
+/* The payloads of the oldest entries are released until the size limit is
+ * met, while their terms are retained. */
+TEST_CASE(evict, prefix, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    APPEND(1 /* term */);
+    APPEND(2 /* term */);
+    APPEND(2 /* term */);
+    munit_assert_int(f->log.bytes, ==, 24);
+    logEvict(&f->log, 3 /* index */, 10 /* max bytes */);
+    munit_assert_int(logEvictedIndex(&f->log), ==, 2);
+    munit_assert_int(f->log.bytes, ==, 8);
+    munit_assert_ptr_null(GET(1)->buf.base);
+    munit_assert_ptr_null(GET(2)->buf.base);
+    munit_assert_ptr_not_null(GET(3)->buf.base);
+    ASSERT_TERM_OF(1 /* index */, 1 /* term */);
+    ASSERT_TERM_OF(2 /* index */, 2 /* term */);
+    return MUNIT_OK;
+}
+
+/* Entries past the given index are never evicted. */
+TEST_CASE(evict, up_to_index, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    APPEND_MANY(1 /* term */, 3 /* n entries */);
+    logEvict(&f->log, 1 /* index */, 0 /* max bytes */);
+    munit_assert_int(logEvictedIndex(&f->log), ==, 1);
+    munit_assert_int(f->log.bytes, ==, 16);
+    return MUNIT_OK;
+}
+
+/* The payloads of configuration entries are kept. */
+TEST_CASE(evict, keep_configuration, NULL)
+{
+    struct fixture *f = data;
+    struct raft_configuration configuration;
+    int rv;
+    (void)params;
+    raft_configuration_init(&configuration);
+    rv = raft_configuration_add(&configuration, 1, "1", true);
+    munit_assert_int(rv, ==, 0);
+    rv = logAppendConfiguration(&f->log, 1, &configuration);
+    munit_assert_int(rv, ==, 0);
+    raft_configuration_close(&configuration);
+    APPEND(1 /* term */);
+    logEvict(&f->log, 2 /* index */, 0 /* max bytes */);
+    munit_assert_int(logEvictedIndex(&f->log), ==, 2);
+    munit_assert_ptr_not_null(GET(1)->buf.base);
+    munit_assert_ptr_null(GET(2)->buf.base);
+    munit_assert_int(f->log.bytes, ==, GET(1)->buf.len);
+    return MUNIT_OK;
+}
+
+/* Eviction stops at the first acquired entry. */
+TEST_CASE(evict, acquired, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entries;
+    unsigned n;
+    (void)params;
+    APPEND_MANY(1 /* term */, 3 /* n entries */);
+    ACQUIRE(2 /* index */);
+    logEvict(&f->log, 3 /* index */, 0 /* max bytes */);
+    munit_assert_int(logEvictedIndex(&f->log), ==, 1);
+    RELEASE(2 /* index */);
+    logEvict(&f->log, 3 /* index */, 0 /* max bytes */);
+    munit_assert_int(logEvictedIndex(&f->log), ==, 3);
+    munit_assert_int(f->log.bytes, ==, 0);
+    return MUNIT_OK;
+}
+
+/* A batch is released once the payloads of all its entries are evicted. */
+TEST_CASE(evict, batch, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    APPEND_BATCH(3 /* n entries */);
+    logEvict(&f->log, 2 /* index */, 0 /* max bytes */);
+    munit_assert_int(f->log.n_batches, ==, 1);
+    munit_assert_int(*(uint64_t *)GET(3)->buf.base, ==, 2000);
+    logEvict(&f->log, 3 /* index */, 0 /* max bytes */);
+    munit_assert_int(f->log.n_batches, ==, 0);
+    return MUNIT_OK;
+}
+
+/* Entries that were already evicted are deleted normally when taking a
+ * snapshot, and restoring a snapshot resets the evicted index. */
+TEST_CASE(evict, snapshot, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    APPEND_MANY(1 /* term */, 4 /* n entries */);
+    logEvict(&f->log, 2 /* index */, 0 /* max bytes */);
+    SNAPSHOT(3 /* last index */, 0 /* trailing */);
+    munit_assert_int(f->log.bytes, ==, 8);
+    logEvict(&f->log, 4 /* index */, 0 /* max bytes */);
+    munit_assert_int(logEvictedIndex(&f->log), ==, 4);
+    RESTORE(5 /* last index */, 1 /* last term */);
+    munit_assert_int(logEvictedIndex(&f->log), ==, 0);
+    munit_assert_int(f->log.bytes, ==, 0);
+    return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * logTruncate
@@ -1022,6 +1307,26 @@ TEST_CASE(truncate, batch, NULL)
     return MUNIT_OK;
 }
 
+/* Truncate all entries belonging to a batch, while one of them is still
+ * acquired. The batch memory is released only when the entry is released. */
+TEST_CASE(truncate, batch_acquired, NULL)
+{
+    struct fixture *f = data;
+    struct raft_entry *entries;
+    unsigned n;
+    (void)params;
+
+    APPEND_BATCH(3 /* n entries */);
+    ACQUIRE(3 /* index */);
+    TRUNCATE(1 /* index */);
+    munit_assert_int(f->log.n_batches, ==, 1);
+    munit_assert_int(*(uint64_t *)entries[0].buf.base, ==, 2000);
+    RELEASE(3 /* index */);
+    munit_assert_int(f->log.n_batches, ==, 0);
+
+    return MUNIT_OK;
+}
+
 /* Acquire entries at a certain index. Truncate the log at that index. The
  * truncated entries are still referenced. Then append a new entry, which will
  * have the same index but different term. */
@@ -1047,7 +1352,7 @@ TEST_CASE(truncate, acquired, NULL)
 }
 
 /* Acquire some entries, truncate the log and then append new ones forcing the
-   log to be grown and the reference count hash table to be re-built. */
+   log to be grown. */
 TEST_CASE(truncate, acquire_append, NULL)
 {
     struct fixture *f = data;
@@ -1065,7 +1370,7 @@ TEST_CASE(truncate, acquire_append, NULL)
 
     TRUNCATE(2);
 
-    for (i = 0; i < LOG__REFS_INITIAL_SIZE; i++) {
+    for (i = 0; i < 256; i++) {
         APPEND(2 /* term */);
     }
 
@@ -1085,9 +1390,9 @@ static MunitParameterEnum truncate_acquired_oom_params[] = {
     {NULL, NULL},
 };
 
-/* Acquire entries at a certain index. Truncate the log at that index. The
- * truncated entries are still referenced. Then append a new entry, which fails
- * to be appended due to OOM. */
+/* Acquire entries at a certain index. Truncate the whole log. The truncated
+ * entries are still referenced. Then append a new entry, which fails to be
+ * appended due to OOM. */
 TEST_CASE(truncate, error, acquired_oom, truncate_acquired_oom_params)
 {
     struct fixture *f = data;
@@ -1103,7 +1408,7 @@ TEST_CASE(truncate, error, acquired_oom, truncate_acquired_oom_params)
     ACQUIRE(2);
     munit_assert_int(n, ==, 1);
 
-    TRUNCATE(2);
+    TRUNCATE(1);
 
     buf.base = NULL;
     buf.len = 0;
@@ -1292,6 +1597,26 @@ TEST_CASE(snapshot, wrap, NULL)
     return MUNIT_OK;
 }
 
+/* Take a snapshot deleting only some of the entries of a batch, which is
+ * released once all of them are deleted. */
+TEST_CASE(snapshot, batch, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+
+    APPEND_BATCH(3 /* n entries */);
+    APPEND(1 /* term */);
+
+    SNAPSHOT(2 /* last index */, 0 /* trailing */);
+    munit_assert_int(f->log.n_batches, ==, 1);
+    munit_assert_int(*(uint64_t *)GET(3)->buf.base, ==, 2000);
+
+    SNAPSHOT(4 /* last index */, 0 /* trailing */);
+    munit_assert_int(f->log.n_batches, ==, 0);
+
+    return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * logRestore
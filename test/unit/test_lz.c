@@ -0,0 +1,175 @@
+#include <string.h>
+
+#include "../../src/lz.h"
+
+#include "../lib/runner.h"
+
+TEST_MODULE(lz);
+
+/******************************************************************************
+ *
+ * Helper macros
+ *
+ *****************************************************************************/
+
+/* Compress the given data, decompress it back and check that it matches the
+ * original. Set COMPRESSED to the size of the compressed data. */
+#define ROUNDTRIP(DATA, LEN, COMPRESSED)                                 \
+    {                                                                    \
+        size_t cap_ = lzCompressBound(LEN);                              \
+        uint8_t *compressed_ = munit_malloc(cap_);                       \
+        uint8_t *decompressed_ = munit_malloc(LEN + 1);                  \
+        int rv_;                                                         \
+        COMPRESSED = lzCompress(DATA, LEN, compressed_, cap_);           \
+        munit_assert_int(COMPRESSED, >, 0);                              \
+        munit_assert_int(COMPRESSED, <=, cap_);                          \
+        rv_ = lzDecompress(compressed_, COMPRESSED, decompressed_, LEN); \
+        munit_assert_int(rv_, ==, 0);                                    \
+        munit_assert_memory_equal(LEN, decompressed_, DATA);             \
+        free(compressed_);                                               \
+        free(decompressed_);                                             \
+    }
+
+/* Fill a buffer with pseudo-random bytes. */
+static void fillRandom(uint8_t *buf, size_t len)
+{
+    uint32_t state = 42;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        state = state * 1103515245 + 12345;
+        buf[i] = (uint8_t)(state >> 16);
+    }
+}
+
+/******************************************************************************
+ *
+ * lzCompress
+ *
+ *****************************************************************************/
+
+TEST_SUITE(compress);
+
+/* Repetitive data gets much smaller. */
+TEST_CASE(compress, repetitive, NULL)
+{
+    uint8_t buf[64 * 1024];
+    size_t compressed;
+    size_t i;
+    (void)data;
+    (void)params;
+    for (i = 0; i < sizeof buf; i++) {
+        buf[i] = "raft log entry "[i % 15];
+    }
+    ROUNDTRIP(buf, sizeof buf, compressed);
+    munit_assert_int(compressed, <, sizeof buf / 10);
+    return MUNIT_OK;
+}
+
+/* Incompressible data still roundtrips, within the bound. */
+TEST_CASE(compress, random, NULL)
+{
+    uint8_t buf[4096];
+    size_t compressed;
+    (void)data;
+    (void)params;
+    fillRandom(buf, sizeof buf);
+    ROUNDTRIP(buf, sizeof buf, compressed);
+    return MUNIT_OK;
+}
+
+/* Data shorter than the minimum match length is stored as literals. */
+TEST_CASE(compress, short, NULL)
+{
+    uint8_t buf[3] = {1, 2, 3};
+    size_t compressed;
+    (void)data;
+    (void)params;
+    ROUNDTRIP(buf, sizeof buf, compressed);
+    munit_assert_int(compressed, ==, 4);
+    return MUNIT_OK;
+}
+
+/* Empty data compresses to a single token. */
+TEST_CASE(compress, empty, NULL)
+{
+    uint8_t buf[1] = {0};
+    uint8_t out[16];
+    size_t compressed;
+    int rv;
+    (void)data;
+    (void)params;
+    compressed = lzCompress(buf, 0, out, sizeof out);
+    munit_assert_int(compressed, ==, 1);
+    rv = lzDecompress(out, compressed, buf, 0);
+    munit_assert_int(rv, ==, 0);
+    return MUNIT_OK;
+}
+
+/* If the compressed data doesn't fit in the destination, 0 is returned. */
+TEST_CASE(compress, no_room, NULL)
+{
+    uint8_t buf[256];
+    uint8_t out[128];
+    (void)data;
+    (void)params;
+    fillRandom(buf, sizeof buf);
+    munit_assert_int(lzCompress(buf, sizeof buf, out, sizeof out), ==, 0);
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * lzDecompress
+ *
+ *****************************************************************************/
+
+TEST_SUITE(decompress);
+
+/* Truncated compressed data is detected. */
+TEST_CASE(decompress, truncated, NULL)
+{
+    uint8_t buf[1024];
+    uint8_t out[2048];
+    uint8_t decompressed[1024];
+    size_t compressed;
+    int rv;
+    (void)data;
+    (void)params;
+    memset(buf, 'x', sizeof buf);
+    compressed = lzCompress(buf, sizeof buf, out, sizeof out);
+    munit_assert_int(compressed, >, 2);
+    rv = lzDecompress(out, compressed - 1, decompressed, sizeof decompressed);
+    munit_assert_int(rv, ==, RAFT_CORRUPT);
+    return MUNIT_OK;
+}
+
+/* Data decompressing to a different size than the expected one is detected. */
+TEST_CASE(decompress, wrong_size, NULL)
+{
+    uint8_t buf[1024];
+    uint8_t out[2048];
+    uint8_t decompressed[1024];
+    size_t compressed;
+    int rv;
+    (void)data;
+    (void)params;
+    memset(buf, 'x', sizeof buf);
+    compressed = lzCompress(buf, sizeof buf, out, sizeof out);
+    rv = lzDecompress(out, compressed, decompressed, sizeof decompressed - 1);
+    munit_assert_int(rv, ==, RAFT_CORRUPT);
+    return MUNIT_OK;
+}
+
+/* A match referring to data before the start of the output is detected. */
+TEST_CASE(decompress, bad_offset, NULL)
+{
+    /* One literal, then a match of 4 bytes at offset 2. */
+    uint8_t in[] = {0x10, 'a', 2, 0, 0x00};
+    uint8_t decompressed[5];
+    int rv;
+    (void)data;
+    (void)params;
+    rv = lzDecompress(in, sizeof in, decompressed, sizeof decompressed);
+    munit_assert_int(rv, ==, RAFT_CORRUPT);
+    return MUNIT_OK;
+}
@@ -0,0 +1,203 @@
+#include "../../src/request.h"
+
+#include "../lib/heap.h"
+#include "../lib/runner.h"
+
+TEST_MODULE(request);
+
+/******************************************************************************
+ *
+ * Fixture
+ *
+ *****************************************************************************/
+
+struct fixture
+{
+    FIXTURE_HEAP;
+    struct raft_request_registry reg;
+};
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+    struct fixture *f = munit_malloc(sizeof *f);
+    (void)user_data;
+    SETUP_HEAP;
+    requestRegInit(&f->reg);
+    return f;
+}
+
+static void tear_down(void *data)
+{
+    struct fixture *f = data;
+    requestRegClose(&f->reg);
+    TEAR_DOWN_HEAP;
+    free(f);
+}
+
+/******************************************************************************
+ *
+ * Helper macros
+ *
+ *****************************************************************************/
+
+/* Initialize the given requests, setting their indexes starting at the given
+ * one, and enqueue them. */
+#define ENQUEUE(REQS, INDEX)                        \
+    {                                               \
+        int n_ = sizeof REQS / sizeof REQS[0];      \
+        int i_;                                     \
+        for (i_ = 0; i_ < n_; i_++) {               \
+            struct request *req_ = &REQS[i_];       \
+            int rv_;                                \
+            req_->type = RAFT_COMMAND;              \
+            req_->index = INDEX + i_;               \
+            rv_ = requestRegEnqueue(&f->reg, req_); \
+            munit_assert_int(rv_, ==, 0);           \
+        }                                           \
+    }
+
+/* Dequeue the request associated with the given index. */
+#define DEQUEUE(INDEX) requestRegDequeue(&f->reg, INDEX, RAFT_COMMAND)
+
+/******************************************************************************
+ *
+ * Assertions
+ *
+ *****************************************************************************/
+
+/* Assert the number of outstanding requests. */
+#define ASSERT_N(N) munit_assert_int(requestRegNumRequests(&f->reg), ==, N)
+
+/******************************************************************************
+ *
+ * requestRegEnqueue
+ *
+ *****************************************************************************/
+
+TEST_SUITE(enqueue);
+
+TEST_SETUP(enqueue, setup);
+TEST_TEAR_DOWN(enqueue, tear_down);
+
+/* Enqueue many requests, growing the buffer several times. */
+TEST_CASE(enqueue, many, NULL)
+{
+    struct fixture *f = data;
+    struct request reqs[33];
+    int i;
+    (void)params;
+    ENQUEUE(reqs, 1);
+    ASSERT_N(33);
+    for (i = 0; i < 33; i++) {
+        munit_assert_ptr_equal(DEQUEUE(i + 1), &reqs[i]);
+    }
+    ASSERT_N(0);
+    return MUNIT_OK;
+}
+
+/* Enqueue and dequeue requests so the circular buffer wraps around. */
+TEST_CASE(enqueue, wrap, NULL)
+{
+    struct fixture *f = data;
+    struct request reqs1[1];
+    struct request reqs2[2];
+    (void)params;
+    ENQUEUE(reqs1, 1);
+    munit_assert_ptr_equal(DEQUEUE(1), &reqs1[0]);
+    ENQUEUE(reqs2, 2);
+    ASSERT_N(2);
+    munit_assert_ptr_equal(DEQUEUE(2), &reqs2[0]);
+    munit_assert_ptr_equal(DEQUEUE(3), &reqs2[1]);
+    ASSERT_N(0);
+    return MUNIT_OK;
+}
+
+/* Out of memory when growing the buffer. */
+TEST_CASE(enqueue, oom, NULL)
+{
+    struct fixture *f = data;
+    struct request req;
+    int rv;
+    (void)params;
+    req.type = RAFT_COMMAND;
+    req.index = 1;
+    test_heap_fault_config(&f->heap, 0, 1);
+    test_heap_fault_enable(&f->heap);
+    rv = requestRegEnqueue(&f->reg, &req);
+    munit_assert_int(rv, ==, RAFT_NOMEM);
+    ASSERT_N(0);
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * requestRegDequeue
+ *
+ *****************************************************************************/
+
+TEST_SUITE(dequeue);
+
+TEST_SETUP(dequeue, setup);
+TEST_TEAR_DOWN(dequeue, tear_down);
+
+/* No request is associated with an entry whose index is lower than the one of
+ * the oldest request. */
+TEST_CASE(dequeue, gap, NULL)
+{
+    struct fixture *f = data;
+    struct request reqs[1];
+    (void)params;
+    ENQUEUE(reqs, 3);
+    munit_assert_ptr_null(DEQUEUE(1));
+    munit_assert_ptr_null(DEQUEUE(2));
+    munit_assert_ptr_equal(DEQUEUE(3), &reqs[0]);
+    return MUNIT_OK;
+}
+
+/* Dequeueing from an empty registry returns NULL. */
+TEST_CASE(dequeue, empty, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    munit_assert_ptr_null(DEQUEUE(1));
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * requestRegPopFront and requestRegPopBack
+ *
+ *****************************************************************************/
+
+TEST_SUITE(pop);
+
+TEST_SETUP(pop, setup);
+TEST_TEAR_DOWN(pop, tear_down);
+
+/* Requests are popped from the front in FIFO order. */
+TEST_CASE(pop, front, NULL)
+{
+    struct fixture *f = data;
+    struct request reqs[3];
+    int i;
+    (void)params;
+    ENQUEUE(reqs, 1);
+    for (i = 0; i < 3; i++) {
+        munit_assert_ptr_equal(requestRegPopFront(&f->reg), &reqs[i]);
+    }
+    munit_assert_ptr_null(requestRegPopFront(&f->reg));
+    return MUNIT_OK;
+}
+
+/* Popping from the back removes the most recent request. */
+TEST_CASE(pop, back, NULL)
+{
+    struct fixture *f = data;
+    struct request reqs[2];
+    (void)params;
+    ENQUEUE(reqs, 1);
+    requestRegPopBack(&f->reg, &reqs[1]);
+    ASSERT_N(1);
+    munit_assert_ptr_equal(requestRegPopFront(&f->reg), &reqs[0]);
+    return MUNIT_OK;
+}
@@ -36,6 +36,10 @@ struct fixture
         bool invoked;
         struct raft_message *message;
     } recv_cb;
+    struct
+    {
+        bool invoked;
+    } flush_cb;
 };
 
 static void __tick_cb(struct raft_io *io)
@@ -69,6 +73,13 @@ static void __recv_cb(struct raft_io *io, struct raft_message *message)
     f->recv_cb.message = message;
 }
 
+static void __flush_cb(struct raft_io *io)
+{
+    struct fixture *f = io->data;
+
+    f->flush_cb.invoked = true;
+}
+
 static void *setup(const MunitParameter params[], void *user_data)
 {
     struct fixture *f = munit_malloc(sizeof *f);
@@ -91,6 +102,8 @@ static void *setup(const MunitParameter params[], void *user_data)
     f->send_cb.invoked = false;
     f->send_cb.status = -1;
 
+    f->flush_cb.invoked = false;
+
     return f;
 }
 
@@ -199,7 +212,7 @@ TEST_CASE(start, recv, NULL)
     message.server_id = 1;
     message.server_address = "127.0.0.1:9000";
 
-    rv = uvEncodeMessage(&message, &bufs, &n_bufs);
+    rv = uvEncodeMessage(&message, NULL, &bufs, &n_bufs);
     munit_assert_int(rv, ==, 0);
     munit_assert_int(n_bufs, ==, 1);
 
@@ -409,3 +422,31 @@ TEST_CASE(send, first, NULL)
 
     return MUNIT_OK;
 }
+
+/**
+ * raft_io->flush()
+ */
+
+TEST_SUITE(flush);
+TEST_SETUP(flush, setup);
+TEST_TEAR_DOWN(flush, tear_down);
+
+/* The flush callback fires in the current loop iteration, without waiting for
+ * I/O events or for the tick timer to expire. */
+TEST_CASE(flush, no_wait, NULL)
+{
+    struct fixture *f = data;
+    int rv;
+
+    (void)params;
+
+    rv = f->io.flush(&f->io, __flush_cb);
+    munit_assert_int(rv, ==, 0);
+
+    LOOP_RUN(1);
+
+    munit_assert_true(f->flush_cb.invoked);
+    munit_assert_false(f->tick_cb.invoked);
+
+    return MUNIT_OK;
+}
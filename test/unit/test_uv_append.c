@@ -122,7 +122,7 @@ static void appendCb(struct raft_io_append *req, int status)
 #define WAIT_CB(N, STATUS)                       \
     {                                            \
         int i2;                                  \
-        for (i2 = 0; i2 < 5; i2++) {             \
+        for (i2 = 0; i2 < LOOP_MAX_RUN; i2++) {  \
             LOOP_RUN(1);                         \
             if (f->invoked == N) {               \
                 break;                           \
@@ -139,7 +139,7 @@ static void appendCb(struct raft_io_append *req, int status)
  *
  *****************************************************************************/
 
-/* Assert that the open segment with the given counter has format version 1 and
+/* Assert that the open segment with the given counter has format version 2 and
  * N entries with a total data size of S bytes. */
 #define ASSERT_SEGMENT(COUNTER, N, SIZE)                                     \
     {                                                                        \
@@ -157,7 +157,7 @@ static void appendCb(struct raft_io_append *req, int status)
         test_dir_read_file(f->dir, filename, buf.base, buf.len);             \
                                                                              \
         cursor = buf.base;                                                   \
-        munit_assert_int(byteGet64(&cursor), ==, 1);                       \
+        munit_assert_int(byteGet64(&cursor), ==, 2);                       \
                                                                              \
         while (i_ < N) {                                                     \
             unsigned crc1 = byteGet32(&cursor);                            \
@@ -186,7 +186,7 @@ static void appendCb(struct raft_io_append *req, int status)
                 data_size += entry->buf.len;                                 \
             }                                                                \
                                                                              \
-            crc = byteCrc32(header, uvSizeofBatchHeader(n_), 0);           \
+            crc = byteCrc32c(header, uvSizeofBatchHeader(n_), 0);          \
             munit_assert_int(crc, ==, crc1);                                 \
                                                                              \
             content = cursor;                                                \
@@ -200,7 +200,7 @@ static void appendCb(struct raft_io_append *req, int status)
                 i_++;                                                        \
             }                                                                \
                                                                              \
-            crc = byteCrc32(content, data_size, 0);                        \
+            crc = byteCrc32c(content, data_size, 0);                       \
             munit_assert_int(crc, ==, crc2);                                 \
                                                                              \
             free(entries);                                                   \
@@ -398,6 +398,64 @@ TEST_CASE(success, resize_arena, NULL)
     return MUNIT_OK;
 }
 
+/* Append requests submitted while a write is in flight are written right away,
+ * if their entries don't fit in the block partially filled by that write. */
+TEST_CASE(success, pipeline, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+
+    CREATE_ENTRIES(1, 64);
+    APPEND(0);
+    WAIT_CB(1, 0);
+
+    CREATE_ENTRIES(1, f->uv->block_size);
+    APPEND(0);
+
+    CREATE_ENTRIES(1, f->uv->block_size);
+    APPEND(0);
+
+    WAIT_CB(2, 0);
+
+    CREATE_ENTRIES(1, 64);
+    APPEND(0);
+    WAIT_CB(1, 0);
+
+    ASSERT_SEGMENT(1, 4, 64 * 2 + f->uv->block_size * 2);
+
+    return MUNIT_OK;
+}
+
+/* When entries encoding is offloaded to the threadpool, the resulting segment is
+ * the same. */
+TEST_CASE(success, offload, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+
+    raft_uv_set_append_offload(&f->io, true);
+
+    CREATE_ENTRIES(2, 64);
+    APPEND(0);
+    WAIT_CB(1, 0);
+
+    CREATE_ENTRIES(1, f->uv->block_size);
+    APPEND(0);
+
+    CREATE_ENTRIES(2, 64);
+    APPEND(0);
+
+    WAIT_CB(2, 0);
+
+    CREATE_ENTRIES(1, f->uv->block_size);
+    APPEND(0);
+    WAIT_CB(1, 0);
+
+    ASSERT_SEGMENT(1, 6, 64 * 4 + f->uv->block_size * 2);
+
+    return MUNIT_OK;
+}
+
 /* A few append requests get queued, then a truncate request comes in and other
  * append requests right after, before truncation is fully completed. */
 TEST_CASE(success, truncate, NULL)
@@ -7,6 +7,34 @@
 
 TEST_MODULE(uv_file);
 
+/******************************************************************************
+ *
+ * Parameters
+ *
+ *****************************************************************************/
+
+/* Munit parameter forcing the use of KAIO even if io_uring is available. */
+#define KAIO "kaio"
+
+static char *kaio[] = {"1", NULL};
+
+static MunitParameterEnum kaio_params[] = {
+    {KAIO, kaio},
+    {NULL, NULL},
+};
+
+static MunitParameterEnum kaio_all_params[] = {
+    {TEST_DIR_FS, test_dir_all},
+    {KAIO, kaio},
+    {NULL, NULL},
+};
+
+static MunitParameterEnum kaio_no_aio_params[] = {
+    {TEST_DIR_FS, test_dir_no_aio},
+    {KAIO, kaio},
+    {NULL, NULL},
+};
+
 /******************************************************************************
  *
  * Fixture
@@ -20,6 +48,7 @@ struct fixture
     size_t block_size;
     size_t direct_io;
     bool async_io;
+    bool uring_io;
     struct uvFile file;
     struct uvFileCreate create_req;
     struct uvFileWrite write_req;
@@ -37,11 +66,15 @@ static void *setup(const MunitParameter params[], void *user_data)
     (void)user_data;
     SETUP_DIR;
     SETUP_LOOP;
-    rv = uvProbeIoCapabilities(f->dir, &f->direct_io, &f->async_io, f->errmsg);
+    rv = uvProbeIoCapabilities(f->dir, &f->direct_io, &f->async_io,
+                               &f->uring_io, f->errmsg);
     munit_assert_int(rv, ==, 0);
+    if (munit_parameters_get(params, KAIO) != NULL) {
+        f->uring_io = false;
+    }
     f->block_size = f->direct_io != 0 ? f->direct_io : 4096;
     rv = uvFileInit(&f->file, &f->loop, f->direct_io != 0, f->async_io,
-                    f->errmsg);
+                    f->uring_io, f->errmsg);
     munit_assert_int(rv, ==, 0);
     f->file.data = f;
     f->create_req.data = f;
@@ -97,12 +130,13 @@ static void writeCb(struct uvFileWrite *req, int status, const char *errmsg)
 #define CREATE_WAIT_STATUS(STATUS)               \
     {                                            \
         int i_;                                  \
-        for (i_ = 0; i_ < 2; i_++) {             \
+        for (i_ = 0; i_ < LOOP_MAX_RUN; i_++) {  \
             LOOP_RUN(1);                         \
             if (f->completed == 1) {             \
                 break;                           \
             }                                    \
         }                                        \
+        munit_assert_int(f->completed, ==, 1);   \
         munit_assert_int(f->status, ==, STATUS); \
         f->completed = 0;                        \
     }
@@ -122,7 +156,7 @@ static void writeCb(struct uvFileWrite *req, int status, const char *errmsg)
 #define WRITE_WAIT_STATUS_N(N, STATUS)           \
     {                                            \
         int i_;                                  \
-        for (i_ = 0; i_ < 5; i_++) {             \
+        for (i_ = 0; i_ < LOOP_MAX_RUN; i_++) {  \
             LOOP_RUN(1);                         \
             if (f->completed == N) {             \
                 break;                           \
@@ -141,6 +175,21 @@ static void writeCb(struct uvFileWrite *req, int status, const char *errmsg)
     WRITE(N_BUFS, OFFSET);             \
     WRITE_WAIT
 
+/* Wait for a write callback to fire while busy-polling. Loop iterations are
+ * very short in that case, so don't bound their number: once the busy-poll
+ * budget is exhausted the loop blocks until the write completes. */
+#define BUSY_POLL_WAIT                         \
+    {                                          \
+        while (f->completed == 0) {            \
+            LOOP_RUN(1);                       \
+        }                                      \
+        munit_assert_int(f->completed, ==, 1); \
+        munit_assert_int(f->status, ==, 0);    \
+                                               \
+        f->completed = 0;                      \
+        f->status = -1;                        \
+    }
+
 /* CLose the fixture's file object. */
 #define CLOSE                        \
     {                                \
@@ -224,7 +273,7 @@ TEST_CASE(create, error, already_exists, NULL)
 }
 
 /* The file system has run out of space. */
-TEST_CASE(create, error, no_space, NULL)
+TEST_CASE(create, error, no_space, kaio_params)
 {
     struct fixture *f = data;
     (void)params;
@@ -235,7 +284,7 @@ TEST_CASE(create, error, no_space, NULL)
 }
 
 /* The kernel has ran out of available AIO events. */
-TEST_CASE(create, error, no_resources, NULL)
+TEST_CASE(create, error, no_resources, kaio_params)
 {
     struct fixture *f = data;
     aio_context_t ctx = 0;
@@ -349,6 +398,38 @@ TEST_CASE(write, vec_twice, dir_all_params)
     return MUNIT_OK;
 }
 
+/* Write two buffers using KAIO, even if io_uring is available. */
+TEST_CASE(write, kaio, kaio_all_params)
+{
+    struct fixture *f = data;
+    (void)params;
+    munit_assert_false(f->file.uring);
+    WRITE_AND_WAIT(1 /* n_bufs */, 0 /* offset */);
+    FILL_BUF(0, 2);
+    WRITE_AND_WAIT(1 /* n_bufs */, f->block_size /* offset */);
+    ASSERT_CONTENT(2);
+    return MUNIT_OK;
+}
+
+/* Reap completed writes by busy-polling the loop. */
+TEST_CASE(write, busy_poll, dir_all_params)
+{
+    struct fixture *f = data;
+    bool async = f->file.async || f->file.uring;
+    (void)params;
+    uvFileSetBusyPoll(&f->file, 1000000 /* 1 second */);
+    WRITE(1 /* n_bufs */, 0 /* offset */);
+    munit_assert_int(uv_is_active((uv_handle_t *)&f->file.busy_poller), ==,
+                     async);
+    BUSY_POLL_WAIT;
+    munit_assert_false(uv_is_active((uv_handle_t *)&f->file.busy_poller));
+    FILL_BUF(0, 2);
+    WRITE(1 /* n_bufs */, f->block_size /* offset */);
+    BUSY_POLL_WAIT;
+    ASSERT_CONTENT(2);
+    return MUNIT_OK;
+}
+
 /* Write two different blocks concurrently. */
 TEST_CASE(write, concurrent, dir_all_params)
 {
@@ -402,7 +483,7 @@ TEST_GROUP(write, error)
 
 /* There are not enough resources to create an AIO context to perform the
  * write. */
-TEST_CASE(write, error, no_resources, dir_no_aio_params)
+TEST_CASE(write, error, no_resources, kaio_no_aio_params)
 {
     struct fixture *f = data;
     aio_context_t ctx = 0;
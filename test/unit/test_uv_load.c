@@ -129,6 +129,72 @@ TEST_CASE(segments, closed, NULL)
     return MUNIT_OK;
 }
 
+/* The data directory has many closed segments, which are loaded in parallel
+ * into a single array of entries. */
+TEST_CASE(segments, many_closed, NULL)
+{
+    struct fixture *f = data;
+    unsigned i;
+
+    (void)params;
+
+    for (i = 0; i < 10; i++) {
+        UV_WRITE_CLOSED_SEGMENT(i * 3 + 1, 3, i * 3 + 1);
+    }
+
+    LOAD;
+
+    munit_assert_int(f->n, ==, 30);
+    for (i = 0; i < f->n; i++) {
+        const void *cursor = f->entries[i].buf.base;
+        munit_assert_int(byteGet64(&cursor), ==, i + 1);
+    }
+
+    return MUNIT_OK;
+}
+
+/* Segments written with the legacy format version, whose batches are
+ * checksummed with CRC32 instead of CRC32C, can still be loaded. */
+TEST_CASE(segments, legacy_checksum, NULL)
+{
+    struct fixture *f = data;
+    uint8_t buf[WORD_SIZE * 6];
+    uint8_t *header = buf + WORD_SIZE * 2;
+    uint8_t *content = buf + WORD_SIZE * 5;
+    void *cursor = buf;
+    const void *value;
+
+    (void)params;
+
+    bytePut64(&cursor, UV__DISK_FORMAT); /* Format version */
+    bytePut64(&cursor, 0);               /* Checksums placeholder */
+    bytePut64(&cursor, 1);               /* Number of entries */
+    bytePut64(&cursor, 1);               /* Entry term */
+    bytePut8(&cursor, RAFT_COMMAND);     /* Entry type */
+    bytePut8(&cursor, 0);                /* Unused */
+    bytePut8(&cursor, 0);                /* Unused */
+    bytePut8(&cursor, 0);                /* Unused */
+    bytePut32(&cursor, WORD_SIZE);       /* Entry data size */
+    bytePut64(&cursor, 123);             /* Entry data */
+
+    cursor = buf + WORD_SIZE;
+    bytePut32(&cursor, byteCrc32(header, uvSizeofBatchHeader(1), 0));
+    bytePut32(&cursor, byteCrc32(content, WORD_SIZE, 0));
+
+    test_dir_write_file(f->dir, "1-1", buf, sizeof buf);
+    test_dir_write_file(f->dir, "open-1", buf, sizeof buf);
+
+    LOAD;
+
+    munit_assert_int(f->n, ==, 2);
+    value = f->entries[0].buf.base;
+    munit_assert_int(byteGet64(&value), ==, 123);
+    value = f->entries[1].buf.base;
+    munit_assert_int(byteGet64(&value), ==, 123);
+
+    return MUNIT_OK;
+}
+
 /* The data directory has an empty open segment. */
 TEST_CASE(segments, open_empty, NULL)
 {
@@ -600,13 +666,24 @@ TEST_CASE(error, closed_empty, NULL)
 TEST_CASE(error, closed_bad_format, NULL)
 {
     struct fixture *f = data;
-    uint8_t buf[8] = {2, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t buf[8] = {3, 0, 0, 0, 0, 0, 0, 0};
     (void)params;
     test_dir_write_file(f->dir, "1-1", buf, sizeof buf);
     LOAD_ERROR(RAFT_IOERR);
     return MUNIT_OK;
 }
 
+/* The data directory has a closed segment with less entries than the ones in
+ * the index range encoded in its name. */
+TEST_CASE(error, closed_missing_entries, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    UV__WRITE_SEGMENT("1-3", 2, 1, true);
+    LOAD_ERROR(RAFT_CORRUPT);
+    return MUNIT_OK;
+}
+
 /* The data directory has an open segment which is not readable. */
 TEST_CASE(error, open_no_access, NULL)
 {
@@ -640,7 +717,7 @@ TEST_CASE(error, open_bad_format, NULL)
     uint8_t buf[WORD_SIZE /* Format version */];
     void *cursor = buf;
     (void)params;
-    bytePut64(&cursor, 2); /* Format version */
+    bytePut64(&cursor, 3); /* Format version */
     UV_WRITE_OPEN_SEGMENT(1, 1, 1);
     test_dir_overwrite_file(f->dir, "open-1", buf, sizeof buf, 0);
     LOAD_ERROR(RAFT_MALFORMED);
@@ -63,14 +63,16 @@ static void tear_down(void *data)
 /* Invoke uvProbeIoCapabilities against the fixture's tmpdir. */
 #define PROBE_IO_CAPABILITIES_RV(...) \
     uvProbeIoCapabilities(f->dir, __VA_ARGS__, f->errmsg)
-#define PROBE_IO_CAPABILITIES(DIRECT_IO, ASYNC_IO) \
-    munit_assert_int(PROBE_IO_CAPABILITIES_RV(DIRECT_IO, ASYNC_IO), ==, 0)
-#define PROBE_IO_CAPABILITIES_ERROR(RV)                            \
-    {                                                              \
-        size_t direct_io;                                          \
-        bool async_io;                                             \
-        int rv_ = PROBE_IO_CAPABILITIES_RV(&direct_io, &async_io); \
-        munit_assert_int(rv_, ==, RV);                             \
+#define PROBE_IO_CAPABILITIES(DIRECT_IO, ASYNC_IO, URING_IO)                  \
+    munit_assert_int(PROBE_IO_CAPABILITIES_RV(DIRECT_IO, ASYNC_IO, URING_IO), \
+                     ==, 0)
+#define PROBE_IO_CAPABILITIES_ERROR(RV)                                       \
+    {                                                                         \
+        size_t direct_io;                                                     \
+        bool async_io;                                                        \
+        bool uring_io;                                                        \
+        int rv_ = PROBE_IO_CAPABILITIES_RV(&direct_io, &async_io, &uring_io); \
+        munit_assert_int(rv_, ==, RV);                                        \
     }
 
 /******************************************************************************
@@ -227,8 +229,9 @@ TEST_CASE(probe, tmpfs, dir_tmpfs_params)
     struct fixture *f = data;
     size_t direct_io;
     bool async_io;
+    bool uring_io;
     (void)params;
-    PROBE_IO_CAPABILITIES(&direct_io, &async_io);
+    PROBE_IO_CAPABILITIES(&direct_io, &async_io, &uring_io);
     munit_assert_false(direct_io);
     munit_assert_false(async_io);
     return MUNIT_OK;
@@ -243,8 +246,9 @@ TEST_CASE(probe, zfs_direct_io, dir_zfs_params)
     struct fixture *f = data;
     size_t direct_io;
     bool async_io;
+    bool uring_io;
     (void)params;
-    PROBE_IO_CAPABILITIES(&direct_io, &async_io);
+    PROBE_IO_CAPABILITIES(&direct_io, &async_io, &uring_io);
     munit_assert_true(direct_io);
     munit_assert_false(async_io);
     return MUNIT_OK;
@@ -257,8 +261,9 @@ TEST_CASE(probe, zfs, dir_zfs_params)
     struct fixture *f = data;
     size_t direct_io;
     bool async_io;
+    bool uring_io;
     (void)params;
-    PROBE_IO_CAPABILITIES(&direct_io, &async_io);
+    PROBE_IO_CAPABILITIES(&direct_io, &async_io, &uring_io);
     munit_assert_false(direct_io);
     munit_assert_false(async_io);
     return MUNIT_OK;
@@ -0,0 +1,231 @@
+#include "../lib/runner.h"
+#include "../lib/uv.h"
+
+#include "../../src/byte.h"
+#include "../../src/entry.h"
+
+#define WORD_SIZE sizeof(uint64_t)
+
+/* Size of a batch holding a single entry with a WORD_SIZE payload: checksums,
+ * header and data. */
+#define BATCH_SIZE (WORD_SIZE * 5)
+
+TEST_MODULE(uv_read_entries);
+
+/******************************************************************************
+ *
+ * Fixture
+ *
+ *****************************************************************************/
+
+struct fixture
+{
+    FIXTURE_UV;
+    struct raft_entry *entries;
+    unsigned n;
+    int status;
+    bool invoked;
+};
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+    struct fixture *f = munit_malloc(sizeof *f);
+    (void)user_data;
+    SETUP_UV_NO_INIT;
+    f->entries = NULL;
+    f->n = 0;
+    f->status = -1;
+    f->invoked = false;
+    return f;
+}
+
+static void tear_down(void *data)
+{
+    struct fixture *f = data;
+    if (f->entries != NULL) {
+        entryBatchesDestroy(f->entries, f->n);
+    }
+    TEAR_DOWN_UV;
+    free(f);
+}
+
+/******************************************************************************
+ *
+ * Helper macros
+ *
+ *****************************************************************************/
+
+/* Write a closed segment file containing N batches with a single entry each,
+ * whose data is DATA, DATA + 1, etc. */
+static void writeClosedSegment(struct fixture *f,
+                               raft_index first_index,
+                               unsigned n,
+                               uint64_t data)
+{
+    struct uvSegmentBuffer buf;
+    struct raft_entry entry;
+    uint64_t payload;
+    uvFilename filename;
+    unsigned i;
+    int rv;
+
+    uvSegmentBufferInit(&buf, 4096);
+    rv = uvSegmentBufferFormat(&buf);
+    munit_assert_int(rv, ==, 0);
+
+    entry.term = 1;
+    entry.type = RAFT_COMMAND;
+    entry.buf.base = &payload;
+    entry.buf.len = sizeof payload;
+    for (i = 0; i < n; i++) {
+        void *cursor = &payload;
+        bytePut64(&cursor, data + i);
+        rv = uvSegmentBufferAppend(&buf, &entry, 1);
+        munit_assert_int(rv, ==, 0);
+    }
+
+    sprintf(filename, "%llu-%llu", first_index, first_index + n - 1);
+    test_dir_write_file(f->dir, filename, buf.arena.base, buf.n);
+    uvSegmentBufferClose(&buf);
+}
+
+#define WRITE_CLOSED_SEGMENT(FIRST_INDEX, N, DATA) \
+    writeClosedSegment(f, FIRST_INDEX, N, DATA)
+
+/* Initialize the instance and load the segments written so far, so they can be
+ * read back. */
+#define INIT_AND_LOAD                                                        \
+    {                                                                        \
+        raft_term term_;                                                     \
+        unsigned voted_for_;                                                 \
+        struct raft_snapshot *snapshot_;                                     \
+        raft_index start_index_;                                             \
+        struct raft_entry *entries_;                                         \
+        size_t n_;                                                           \
+        int rv_;                                                             \
+        UV_INIT;                                                             \
+        rv_ = f->io.load(&f->io, 10, &term_, &voted_for_, &snapshot_,        \
+                         &start_index_, &entries_, &n_);                     \
+        munit_assert_int(rv_, ==, 0);                                        \
+        munit_assert_ptr_null(snapshot_);                                    \
+        entryBatchesDestroy(entries_, (unsigned)n_);                         \
+    }
+
+static void readEntriesCb(struct raft_io_read_entries *req,
+                          struct raft_entry entries[],
+                          unsigned n,
+                          int status)
+{
+    struct fixture *f = req->data;
+    f->entries = entries;
+    f->n = n;
+    f->status = status;
+    f->invoked = true;
+}
+
+static bool readEntriesCbWasInvoked(void *data)
+{
+    struct fixture *f = data;
+    return f->invoked;
+}
+
+/* Read the entries starting at INDEX and wait for the request to complete. */
+#define READ_ENTRIES(INDEX, MAX_BYTES, STATUS)                                \
+    {                                                                         \
+        struct raft_io_read_entries req_;                                     \
+        int rv_;                                                              \
+        req_.data = f;                                                        \
+        rv_ = f->io.read_entries(&f->io, &req_, INDEX, MAX_BYTES,             \
+                                 readEntriesCb);                              \
+        munit_assert_int(rv_, ==, 0);                                         \
+        LOOP_RUN_UNTIL(readEntriesCbWasInvoked, f);                           \
+        munit_assert_int(f->status, ==, STATUS);                              \
+    }
+
+/* Assert that the I'th entry that was read has the given data. */
+#define ASSERT_ENTRY_DATA(I, DATA)                        \
+    {                                                     \
+        const void *cursor_ = f->entries[I].buf.base;     \
+        munit_assert_int(f->entries[I].buf.len, ==, 8);   \
+        munit_assert_int(byteGet64(&cursor_), ==, DATA); \
+    }
+
+/******************************************************************************
+ *
+ * Success scenarios.
+ *
+ *****************************************************************************/
+
+TEST_SUITE(success);
+TEST_SETUP(success, setup);
+TEST_TEAR_DOWN(success, tear_down);
+
+/* Only the entries whose payloads fit in the bytes limit are returned, in a
+ * single batch. */
+TEST_CASE(success, max_bytes, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    WRITE_CLOSED_SEGMENT(1, 5, 1);
+    INIT_AND_LOAD;
+    READ_ENTRIES(3, 16, 0);
+    munit_assert_int(f->n, ==, 2);
+    ASSERT_ENTRY_DATA(0, 3);
+    ASSERT_ENTRY_DATA(1, 4);
+    munit_assert_ptr_equal(f->entries[0].batch, f->entries[1].batch);
+    return MUNIT_OK;
+}
+
+/* The first entry is always returned, even if its payload exceeds the bytes
+ * limit. */
+TEST_CASE(success, first_too_big, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    WRITE_CLOSED_SEGMENT(1, 5, 1);
+    INIT_AND_LOAD;
+    READ_ENTRIES(2, 1, 0);
+    munit_assert_int(f->n, ==, 1);
+    ASSERT_ENTRY_DATA(0, 2);
+    return MUNIT_OK;
+}
+
+/* No entry past the end of the segment containing the first one is returned. */
+TEST_CASE(success, segment_end, NULL)
+{
+    struct fixture *f = data;
+    (void)params;
+    WRITE_CLOSED_SEGMENT(1, 3, 1);
+    WRITE_CLOSED_SEGMENT(4, 3, 4);
+    INIT_AND_LOAD;
+    READ_ENTRIES(2, 1024, 0);
+    munit_assert_int(f->n, ==, 2);
+    ASSERT_ENTRY_DATA(0, 2);
+    ASSERT_ENTRY_DATA(1, 3);
+    return MUNIT_OK;
+}
+
+/******************************************************************************
+ *
+ * Failure scenarios.
+ *
+ *****************************************************************************/
+
+TEST_SUITE(error);
+TEST_SETUP(error, setup);
+TEST_TEAR_DOWN(error, tear_down);
+
+/* The data of an entry to return is corrupted. */
+TEST_CASE(error, corrupted_data, NULL)
+{
+    struct fixture *f = data;
+    uint64_t garbage = 666;
+    (void)params;
+    WRITE_CLOSED_SEGMENT(1, 5, 1);
+    INIT_AND_LOAD;
+    test_dir_overwrite_file(f->dir, "1-5", &garbage, sizeof garbage,
+                            WORD_SIZE + BATCH_SIZE * 3 + WORD_SIZE * 4);
+    READ_ENTRIES(3, 16, RAFT_CORRUPT);
+    munit_assert_int(f->n, ==, 0);
+    return MUNIT_OK;
+}
@@ -17,9 +17,11 @@ struct fixture
     {
         char handshake[sizeof(uint64_t) * 3 /* Preamble */ + 16 /* Address */];
         struct raft_message message;
+        uv_buf_t *compressed;
     } peer;
     int invoked;
     struct raft_message *message;
+    struct raft_message received; /* Copy of the last message received */
 };
 
 static void recv_cb(struct raft_io *io, struct raft_message *message)
@@ -27,6 +29,7 @@ static void recv_cb(struct raft_io *io, struct raft_message *message)
     struct fixture *f = io->data;
     f->invoked++;
     f->message = message;
+    f->received = *message;
 }
 
 static void *setup(const MunitParameter params[], void *user_data)
@@ -40,6 +43,7 @@ static void *setup(const MunitParameter params[], void *user_data)
     f->peer.message.type = RAFT_IO_REQUEST_VOTE;
     f->peer.message.server_id = 1;
     f->peer.message.server_address = f->tcp.server.address;
+    f->peer.compressed = NULL;
     f->invoked = 0;
     f->message = NULL;
     return f;
@@ -67,27 +71,28 @@ static void tear_down(void *data)
 
 /* Send the first N buffers of f->peer.message. If N is 0, send the whole
  * message */
-#define recv__peer_send_bufs(N)                                        \
-    {                                                                  \
-        uv_buf_t *bufs;                                                \
-        unsigned n;                                                    \
-        unsigned n_bufs;                                               \
-        unsigned i;                                                    \
-        int rv2;                                                       \
-        rv2 = uvEncodeMessage(&f->peer.message, &bufs, &n_bufs); \
-        munit_assert_int(rv2, ==, 0);                                  \
-        if (N == 0) {                                                  \
-            n = n_bufs;                                                \
-        } else {                                                       \
-            n = N;                                                     \
-        }                                                              \
-        for (i = 0; i < n_bufs; i++) {                                 \
-            if (i < n) {                                               \
-                test_tcp_send(&f->tcp, bufs[i].base, bufs[i].len);     \
-            }                                                          \
-            raft_free(bufs[i].base);                                   \
-        }                                                              \
-        raft_free(bufs);                                               \
+#define recv__peer_send_bufs(N)                                       \
+    {                                                                 \
+        uv_buf_t *bufs;                                               \
+        unsigned n;                                                   \
+        unsigned n_bufs;                                              \
+        unsigned i;                                                   \
+        int rv2;                                                      \
+        rv2 = uvEncodeMessage(&f->peer.message, f->peer.compressed,   \
+                              &bufs, &n_bufs);                        \
+        munit_assert_int(rv2, ==, 0);                                 \
+        if (N == 0) {                                                 \
+            n = n_bufs;                                               \
+        } else {                                                      \
+            n = N;                                                    \
+        }                                                             \
+        for (i = 0; i < n_bufs; i++) {                                \
+            if (i < n) {                                              \
+                test_tcp_send(&f->tcp, bufs[i].base, bufs[i].len);    \
+            }                                                         \
+            raft_free(bufs[i].base);                                  \
+        }                                                             \
+        raft_free(bufs);                                              \
     }
 #define recv__peer_send recv__peer_send_bufs(0)
 
@@ -169,6 +174,58 @@ TEST_CASE(success, request_vote_result, NULL)
     return MUNIT_OK;
 }
 
+/* Receive a RequestVote message from the target of a leadership transfer. */
+TEST_CASE(success, request_vote_disrupt_leader, NULL)
+{
+    struct fixture *f = data;
+
+    (void)params;
+
+    f->peer.message.request_vote.term = 3;
+    f->peer.message.request_vote.candidate_id = 2;
+    f->peer.message.request_vote.last_log_index = 123;
+    f->peer.message.request_vote.last_log_term = 2;
+    f->peer.message.request_vote.disrupt_leader = true;
+
+    recv__peer_connect;
+    recv__peer_handshake;
+    recv__peer_send;
+
+    LOOP_RUN(2);
+
+    munit_assert_int(f->message->request_vote.term, ==, 3);
+    munit_assert_int(f->message->request_vote.last_log_term, ==, 2);
+    munit_assert_true(f->message->request_vote.disrupt_leader);
+
+    return MUNIT_OK;
+}
+
+/* Receive a TimeoutNow message. */
+TEST_CASE(success, timeout_now, NULL)
+{
+    struct fixture *f = data;
+
+    (void)params;
+
+    f->peer.message.type = RAFT_IO_TIMEOUT_NOW;
+    f->peer.message.timeout_now.term = 3;
+    f->peer.message.timeout_now.last_log_index = 123;
+    f->peer.message.timeout_now.last_log_term = 2;
+
+    recv__peer_connect;
+    recv__peer_handshake;
+    recv__peer_send;
+
+    LOOP_RUN(2);
+
+    munit_assert_int(f->received.type, ==, RAFT_IO_TIMEOUT_NOW);
+    munit_assert_int(f->received.timeout_now.term, ==, 3);
+    munit_assert_int(f->received.timeout_now.last_log_index, ==, 123);
+    munit_assert_int(f->received.timeout_now.last_log_term, ==, 2);
+
+    return MUNIT_OK;
+}
+
 /* Receive an AppendEntries message with two entries. */
 TEST_CASE(success, append_entries, NULL)
 {
@@ -300,6 +357,149 @@ TEST_CASE(success, install_snapshot, NULL)
     return MUNIT_OK;
 }
 
+/* An InstallSnapshot message carrying the whole uncompressed snapshot is sent
+ * with the version 0 layout, which servers not supporting chunks understand
+ * too. */
+TEST_CASE(success, install_snapshot_whole, NULL)
+{
+    struct fixture *f = data;
+    struct raft_install_snapshot *p = &f->peer.message.install_snapshot;
+    const void *cursor;
+    uv_buf_t *bufs;
+    unsigned n_bufs;
+    int rv;
+
+    (void)params;
+
+    f->peer.message.type = RAFT_IO_INSTALL_SNAPSHOT;
+    raft_configuration_init(&p->conf);
+    rv = raft_configuration_add(&p->conf, 1, "1", true);
+    munit_assert_int(rv, ==, 0);
+    p->offset = 0;
+    p->done = true;
+    p->data.len = 8;
+    p->data.base = raft_malloc(p->data.len);
+    *(uint64_t *)p->data.base = byteFlip64(666);
+
+    rv = uvEncodeMessage(&f->peer.message, NULL, &bufs, &n_bufs);
+    munit_assert_int(rv, ==, 0);
+    cursor = bufs[0].base;
+    munit_assert_int(byteGet64(&cursor), ==, RAFT_IO_INSTALL_SNAPSHOT);
+    raft_free(bufs[0].base); /* The data buffer is still ours */
+    raft_free(bufs);
+
+    recv__peer_connect;
+    recv__peer_handshake;
+    recv__peer_send;
+    raft_configuration_close(&p->conf);
+
+    LOOP_RUN(2);
+
+    munit_assert_int(f->invoked, ==, 1);
+    munit_assert_int(f->received.type, ==, RAFT_IO_INSTALL_SNAPSHOT);
+    munit_assert_int(f->received.install_snapshot.offset, ==, 0);
+    munit_assert_true(f->received.install_snapshot.done);
+    munit_assert_int(
+        byteFlip64(*(uint64_t *)f->received.install_snapshot.data.base), ==,
+        666);
+
+    raft_configuration_close(&f->received.install_snapshot.conf);
+    raft_free(f->received.install_snapshot.data.base);
+
+    return MUNIT_OK;
+}
+
+/* Receive an InstallSnapshot message carrying a chunk of the snapshot. */
+TEST_CASE(success, install_snapshot_chunk, NULL)
+{
+    struct fixture *f = data;
+    struct raft_install_snapshot *p = &f->peer.message.install_snapshot;
+    int rv;
+
+    (void)params;
+
+    f->peer.message.type = RAFT_IO_INSTALL_SNAPSHOT;
+    raft_configuration_init(&p->conf);
+    rv = raft_configuration_add(&p->conf, 1, "1", true);
+    munit_assert_int(rv, ==, 0);
+    p->offset = 16;
+    p->done = true;
+    p->data.len = 8;
+    p->data.base = raft_malloc(p->data.len);
+    *(uint64_t *)p->data.base = byteFlip64(666);
+
+    recv__peer_connect;
+    recv__peer_handshake;
+    recv__peer_send;
+    raft_configuration_close(&p->conf);
+
+    LOOP_RUN(2);
+
+    munit_assert_int(f->invoked, ==, 1);
+    munit_assert_int(f->received.type, ==, RAFT_IO_INSTALL_SNAPSHOT);
+    munit_assert_int(f->received.install_snapshot.offset, ==, 16);
+    munit_assert_true(f->received.install_snapshot.done);
+    munit_assert_int(f->received.install_snapshot.data.len, ==, 8);
+
+    raft_configuration_close(&f->received.install_snapshot.conf);
+    raft_free(f->received.install_snapshot.data.base);
+
+    return MUNIT_OK;
+}
+
+/* Receive an InstallSnapshot message whose data is compressed. */
+TEST_CASE(success, install_snapshot_compressed, NULL)
+{
+    struct fixture *f = data;
+    struct raft_install_snapshot *p = &f->peer.message.install_snapshot;
+    uv_buf_t blocks;
+    uint8_t *compressed;
+    size_t i;
+    int rv;
+
+    (void)params;
+
+    f->peer.message.type = RAFT_IO_INSTALL_SNAPSHOT;
+    raft_configuration_init(&p->conf);
+    rv = raft_configuration_add(&p->conf, 1, "1", true);
+    munit_assert_int(rv, ==, 0);
+    p->offset = 0;
+    p->done = true;
+    p->data.len = 4096;
+    p->data.base = raft_malloc(p->data.len);
+    for (i = 0; i < p->data.len; i++) {
+        ((uint8_t *)p->data.base)[i] = i % 16;
+    }
+
+    /* The compressed blocks are sent in place of the data, so the original
+     * data buffer is still ours. */
+    compressed = munit_malloc(uvCompressBound(&p->data, 1));
+    blocks.len = uvCompress(&p->data, 1, compressed) - sizeof(uint64_t);
+    blocks.base = raft_malloc(blocks.len);
+    memcpy(blocks.base, compressed + sizeof(uint64_t), blocks.len);
+    free(compressed);
+    f->peer.compressed = &blocks;
+
+    recv__peer_connect;
+    recv__peer_handshake;
+    recv__peer_send;
+    raft_configuration_close(&p->conf);
+
+    LOOP_RUN(2);
+
+    munit_assert_int(f->invoked, ==, 1);
+    munit_assert_int(f->received.type, ==, RAFT_IO_INSTALL_SNAPSHOT);
+    munit_assert_int(f->received.install_snapshot.data.len, ==, 4096);
+    munit_assert_memory_equal(4096, f->received.install_snapshot.data.base,
+                              p->data.base);
+
+    raft_configuration_close(&f->received.install_snapshot.conf);
+    raft_free(f->received.install_snapshot.data.base);
+    raft_free(p->data.base);
+
+    return MUNIT_OK;
+}
+
 /**
  * Failure scenarios.
  */
@@ -1,3 +1,5 @@
+#include <unistd.h>
+
 #include "../lib/runner.h"
 #include "../lib/uv.h"
 
@@ -5,6 +7,7 @@
 #include "../../src/queue.h"
 #include "../../src/snapshot.h"
 #include "../../src/uv.h"
+#include "../../src/uv_encoding.h"
 
 TEST_MODULE(uv_snapshot);
 
@@ -189,6 +192,7 @@ TEST_CASE(load, error, no_data, NULL)
 
     WRITE_META;
     LOAD(RAFT_IOERR);
+    munit_assert_int(f->snapshot.configuration.n, ==, 0);
 
     return MUNIT_OK;
 }
@@ -449,6 +453,131 @@ TEST_CASE(put, after_truncate, NULL)
     return MUNIT_OK;
 }
 
+/* Assert whether the chunk file holding 8 bytes all set to the given value
+ * exists. */
+#define put__assert_chunk(VALUE, EXISTS)                                    \
+    {                                                                       \
+        uint8_t data_[8];                                                   \
+        char filename_[64];                                                 \
+        memset(data_, VALUE, sizeof data_);                                 \
+        sprintf(filename_, UV__SNAPSHOT_CHUNK_TEMPLATE,                     \
+                byteCrc32(data_, sizeof data_, 0), sizeof data_, 0);        \
+        munit_assert_int(test_dir_has_file(f->dir, filename_), ==, EXISTS); \
+    }
+
+/* With deduplication enabled, unchanged chunks are not written again, and
+ * chunks no longer used by any snapshot are removed. */
+TEST_CASE(put, dedup, NULL)
+{
+    struct put_fixture *f = data;
+    struct uvSnapshotInfo *snapshots;
+    size_t n_snapshots;
+    struct uvSegmentInfo *segments;
+    size_t n_segments;
+    struct raft_snapshot snapshot;
+    uint8_t *content;
+    int rv;
+
+    (void)params;
+
+    raft_uv_set_snapshot_dedup(&f->io, true);
+
+    memset(f->bufs[0].base, 'a', 8);
+    memset(f->bufs[1].base, 'b', 8);
+    put__invoke(0);
+    put__wait_cb(0);
+    put__assert_chunk('a', true);
+    put__assert_chunk('b', true);
+
+    memset(f->bufs[1].base, 'c', 8);
+    f->snapshot.index = 9;
+    f->invoked = false;
+    put__invoke(0);
+    put__wait_cb(0);
+    put__assert_chunk('b', true);
+    put__assert_chunk('c', true);
+
+    /* The first snapshot gets removed, along with the chunk only it used. */
+    f->snapshot.index = 10;
+    f->invoked = false;
+    put__invoke(0);
+    put__wait_cb(0);
+    put__assert_chunk('a', true);
+    put__assert_chunk('b', false);
+    put__assert_chunk('c', true);
+
+    rv = uvList(f->uv, &snapshots, &n_snapshots, &segments, &n_segments);
+    munit_assert_int(rv, ==, 0);
+    munit_assert_int(n_snapshots, ==, 2);
+    munit_assert_int(snapshots[1].index, ==, 10);
+
+    rv = uvSnapshotLoad(f->uv, &snapshots[1], &snapshot);
+    munit_assert_int(rv, ==, 0);
+    munit_assert_int(snapshot.n_bufs, ==, 1);
+    munit_assert_int(snapshot.bufs[0].len, ==, 16);
+    content = snapshot.bufs[0].base;
+    munit_assert_int(content[0], ==, 'a');
+    munit_assert_int(content[15], ==, 'c');
+
+    snapshotClose(&snapshot);
+    raft_free(snapshots);
+
+    return MUNIT_OK;
+}
+
+/* With compression enabled, snapshot data is stored compressed, with or
+ * without deduplication, and decompressed when loaded. */
+TEST_CASE(put, compressed, NULL)
+{
+    struct put_fixture *f = data;
+    struct uvSnapshotInfo *snapshots;
+    size_t n_snapshots;
+    struct uvSegmentInfo *segments;
+    size_t n_segments;
+    struct raft_snapshot snapshot;
+    uint8_t *content;
+    size_t i;
+    int rv;
+
+    (void)params;
+
+    raft_uv_set_snapshot_compression(&f->io, true);
+
+    memset(f->bufs[0].base, 'a', 8);
+    memset(f->bufs[1].base, 'b', 8);
+    put__invoke(0);
+    put__wait_cb(0);
+
+    raft_uv_set_snapshot_dedup(&f->io, true);
+    f->snapshot.index = 9;
+    f->invoked = false;
+    put__invoke(0);
+    put__wait_cb(0);
+
+    /* Chunk files hold compressed data. */
+    put__assert_chunk('a', false);
+    put__assert_chunk('b', false);
+
+    rv = uvList(f->uv, &snapshots, &n_snapshots, &segments, &n_segments);
+    munit_assert_int(rv, ==, 0);
+    munit_assert_int(n_snapshots, ==, 2);
+
+    for (i = 0; i < n_snapshots; i++) {
+        rv = uvSnapshotLoad(f->uv, &snapshots[i], &snapshot);
+        munit_assert_int(rv, ==, 0);
+        munit_assert_int(snapshot.n_bufs, ==, 1);
+        munit_assert_int(snapshot.bufs[0].len, ==, 16);
+        content = snapshot.bufs[0].base;
+        munit_assert_int(content[0], ==, 'a');
+        munit_assert_int(content[15], ==, 'b');
+        snapshotClose(&snapshot);
+    }
+
+    raft_free(snapshots);
+
+    return MUNIT_OK;
+}
+
 /******************************************************************************
  *
  * raft_io->snapshot_get
@@ -498,8 +627,7 @@ TEST_TEAR_DOWN(get)
 {
     struct get_fixture *f = data;
     if (f->snapshot != NULL) {
-        snapshotClose(f->snapshot);
-        raft_free(f->snapshot);
+        f->io.snapshot_release(&f->io, f->snapshot);
     }
     TEAR_DOWN_UV;
     free(f);
@@ -521,7 +649,49 @@ TEST_TEAR_DOWN(get)
         munit_assert_int(rv, ==, RV);                     \
     }
 
-#define get__wait_cb(STATUS) LOOP_RUN_UNTIL(get_cb_was_invoked, f);
+#define get__wait_cb(STATUS)                 \
+    LOOP_RUN_UNTIL(get_cb_was_invoked, f);   \
+    munit_assert_int(f->status, ==, STATUS); \
+    f->invoked = false
+
+static void get__put_cb(struct raft_io_snapshot_put *req, int status)
+{
+    bool *invoked = req->data;
+    munit_assert_int(status, ==, 0);
+    *invoked = true;
+}
+
+static bool get__put_cb_was_invoked(void *data)
+{
+    return *(bool *)data;
+}
+
+/* Put a new snapshot with the given term and index, using the raft_io
+ * interface. */
+#define get__put(TERM, INDEX)                                                  \
+    {                                                                          \
+        struct raft_snapshot snapshot_;                                        \
+        struct raft_io_snapshot_put req_;                                      \
+        struct raft_buffer buf_;                                               \
+        bool invoked_ = false;                                                 \
+        int rv_;                                                               \
+        buf_.base = raft_malloc(8);                                            \
+        buf_.len = 8;                                                          \
+        snapshot_.term = TERM;                                                 \
+        snapshot_.index = INDEX;                                               \
+        snapshot_.configuration_index = 1;                                     \
+        snapshot_.bufs = &buf_;                                                \
+        snapshot_.n_bufs = 1;                                                  \
+        raft_configuration_init(&snapshot_.configuration);                     \
+        rv_ = raft_configuration_add(&snapshot_.configuration, 1, "1", true);  \
+        munit_assert_int(rv_, ==, 0);                                          \
+        req_.data = &invoked_;                                                 \
+        rv_ = f->io.snapshot_put(&f->io, 128, &req_, &snapshot_, get__put_cb); \
+        munit_assert_int(rv_, ==, 0);                                          \
+        LOOP_RUN_UNTIL(get__put_cb_was_invoked, &invoked_);                    \
+        raft_configuration_close(&snapshot_.configuration);                    \
+        raft_free(buf_.base);                                                  \
+    }
 
 TEST_CASE(get, first, NULL)
 {
@@ -544,3 +714,169 @@ TEST_CASE(get, first, NULL)
 
     return MUNIT_OK;
 }
+
+/* Concurrent and subsequent requests share the same in-memory snapshot. */
+TEST_CASE(get, cached, NULL)
+{
+    struct get_fixture *f = data;
+    struct raft_snapshot *snapshot;
+
+    (void)params;
+
+    get__write_snapshot;
+    get__invoke(0);
+    get__wait_cb(0);
+
+    snapshot = f->snapshot;
+    munit_assert_ptr_equal(f->uv->snapshot_cache, snapshot);
+
+    get__invoke(0);
+    get__wait_cb(0);
+
+    munit_assert_ptr_equal(f->snapshot, snapshot);
+    f->io.snapshot_release(&f->io, snapshot);
+
+    munit_assert_int(f->snapshot->index, ==, 8);
+    munit_assert_int(byteFlip64(*(uint64_t *)f->snapshot->bufs[0].base), ==,
+                     666);
+
+    return MUNIT_OK;
+}
+
+/* Putting a new snapshot invalidates the cached one. Snapshots still in use
+ * stay valid until they are released. */
+TEST_CASE(get, after_put, NULL)
+{
+    struct get_fixture *f = data;
+    struct raft_snapshot *snapshot;
+
+    (void)params;
+
+    get__write_snapshot;
+    get__invoke(0);
+    get__wait_cb(0);
+
+    snapshot = f->snapshot;
+    get__put(4, 10);
+    munit_assert_ptr_null(f->uv->snapshot_cache);
+    munit_assert_int(snapshot->index, ==, 8);
+
+    get__invoke(0);
+    get__wait_cb(0);
+
+    f->io.snapshot_release(&f->io, snapshot);
+    munit_assert_ptr_not_equal(f->snapshot, snapshot);
+    munit_assert_int(f->snapshot->term, ==, 4);
+    munit_assert_int(f->snapshot->index, ==, 10);
+
+    return MUNIT_OK;
+}
+
+/* The snapshot data is mapped in memory, and stays readable even if the
+ * snapshot files get removed while the snapshot is in use. */
+TEST_CASE(get, file_removed, NULL)
+{
+    struct get_fixture *f = data;
+    char path[1024];
+
+    (void)params;
+
+    get__write_snapshot;
+    get__invoke(0);
+    get__wait_cb(0);
+
+    sprintf(path, "%s/snapshot-3-8-123", f->dir);
+    munit_assert_int(unlink(path), ==, 0);
+
+    munit_assert_int(f->snapshot->bufs[0].len, ==, 8);
+    munit_assert_int(byteFlip64(*(uint64_t *)f->snapshot->bufs[0].base), ==,
+                     666);
+
+    return MUNIT_OK;
+}
+
+/* Compressed snapshot data is decompressed when loaded. */
+TEST_CASE(get, compressed, NULL)
+{
+    struct get_fixture *f = data;
+
+    (void)params;
+
+    raft_uv_set_snapshot_compression(&f->io, true);
+
+    get__write_snapshot;
+    get__put(4, 10);
+    get__invoke(0);
+    get__wait_cb(0);
+
+    munit_assert_int(f->snapshot->term, ==, 4);
+    munit_assert_int(f->snapshot->index, ==, 10);
+    munit_assert_int(f->snapshot->n_bufs, ==, 1);
+    munit_assert_int(f->snapshot->bufs[0].len, ==, 8);
+
+    return MUNIT_OK;
+}
+
+/* When compression is enabled, the loaded snapshot data is compressed too, and
+ * chunks aligned to the compression blocks can be sent as the compressed
+ * blocks covering them. */
+TEST_CASE(get, compressed_blocks, NULL)
+{
+    struct get_fixture *f = data;
+    size_t len = UV__COMPRESSION_BLOCK_SIZE * 2 + 100;
+    struct raft_buffer chunk;
+    uv_buf_t blocks;
+    uint8_t *buf = munit_malloc(len);
+    uint8_t *compressed;
+    uint8_t *decompressed;
+    void *cursor;
+    size_t i;
+
+    (void)params;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = i % 16;
+    }
+    UV_WRITE_SNAPSHOT_META(f->dir, 3, 8, 123, 1, 1);
+    UV_WRITE_SNAPSHOT_DATA(f->dir, 3, 8, 123, buf, len);
+
+    raft_uv_set_snapshot_compression(&f->io, true);
+    get__invoke(0);
+    get__wait_cb(0);
+
+    /* The last chunk ends with a partial block. */
+    chunk.base = (uint8_t *)f->snapshot->bufs[0].base +
+                 UV__COMPRESSION_BLOCK_SIZE;
+    chunk.len = UV__COMPRESSION_BLOCK_SIZE + 100;
+    munit_assert_true(uvSnapshotCompressedBlocks(f->uv, &chunk, &blocks));
+    munit_assert_int(blocks.len, <, chunk.len);
+
+    compressed = munit_malloc(sizeof(uint64_t) + blocks.len);
+    cursor = compressed;
+    bytePut64(&cursor, chunk.len);
+    memcpy(cursor, blocks.base, blocks.len);
+    decompressed = munit_malloc(chunk.len);
+    munit_assert_int(uvDecompress(compressed, sizeof(uint64_t) + blocks.len,
+                                  decompressed),
+                     ==, 0);
+    munit_assert_memory_equal(chunk.len, decompressed, chunk.base);
+    free(decompressed);
+    free(compressed);
+
+    /* Chunks not aligned to the blocks must be compressed on their own. */
+    chunk.base = f->snapshot->bufs[0].base;
+    chunk.len = 1000;
+    munit_assert_false(uvSnapshotCompressedBlocks(f->uv, &chunk, &blocks));
+    chunk.base = (uint8_t *)f->snapshot->bufs[0].base + 1000;
+    chunk.len = UV__COMPRESSION_BLOCK_SIZE;
+    munit_assert_false(uvSnapshotCompressedBlocks(f->uv, &chunk, &blocks));
+
+    /* Data not belonging to the snapshot has no compressed blocks. */
+    chunk.base = buf;
+    chunk.len = UV__COMPRESSION_BLOCK_SIZE;
+    munit_assert_false(uvSnapshotCompressedBlocks(f->uv, &chunk, &blocks));
+
+    free(buf);
+
+    return MUNIT_OK;
+}